@@ -17,6 +17,7 @@
 #define LOG_TAG "MklDnnDriver"
 
 #include "MklDnnDriver.h"
+#include "LatencyStats.h"
 #include "MklDnnPreparedModel.h"
 #include <android/hidl/allocator/1.0/IAllocator.h>
 #include <android-base/logging.h>
@@ -59,6 +60,12 @@ Return<DeviceStatus> MklDnnDriver::getStatus() {
     return DeviceStatus::AVAILABLE;
 }
 
+Return<void> MklDnnDriver::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) return Void();
+    LatencyStats::dumpAll(fd->data[0]);
+    return Void();
+}
+
 Return<void> MklDnnDriver::getCapabilities(getCapabilities_cb cb) {
     Capabilities capabilities = {.float32Performance = {.execTime = 0.9f, .powerUsage = 1.1f},
                                  .quantized8Performance = {.execTime = 0.9f, .powerUsage = 1.1f}};
@@ -18,8 +18,10 @@
 
 #include <android-base/logging.h>
 #include <cutils/log.h>
+#include <algorithm>
 #include <thread>
 
+#include "ExecutionQueue.h"
 #include "MklDnnPreparedModel.h"
 
 #define DISABLE_ALL_QUANT
@@ -73,6 +75,8 @@ namespace neuralnetworks {
 namespace V1_0 {
 namespace mkldnn_driver {
 
+using ::nnhal::ExecutionQueue;
+
 enum PaddingScheme {
     kPaddingUnknown = 0,
     kPaddingSame = 1,
@@ -294,6 +298,29 @@ bool RunTimePoolInfo::update() {
     return true;
 }
 
+// The copies to and from the request take the bytes of the memory as they are,
+// so the memory can as well use the request buffer: when it holds floats in a
+// plain format, nothing more than the bytes of the operand, and the buffer is
+// aligned for them. Blocked and quantized memories get the copy.
+static bool canUseRequestBuffer(const RunTimeOperandInfo& operand, const memory& pmem,
+                                const uint8_t* data)
+{
+    auto desc = pmem.get_primitive_desc().desc();
+    if (static_cast<memory::data_type>(desc.data.data_type) != memory::data_type::f32)
+        return false;
+    switch (static_cast<memory::format>(desc.data.format)) {
+        case memory::format::nhwc:
+        case memory::format::nchw:
+        case memory::format::nc:
+        case memory::format::x:
+            break;
+        default:
+            return false;
+    }
+    return pmem.get_primitive_desc().get_size() == operand.length &&
+           reinterpret_cast<uintptr_t>(data) % sizeof(float) == 0;
+}
+
 bool setRunTimePoolInfosFromHidlMemories(std::vector<RunTimePoolInfo>* poolInfos,
                                          const hidl_vec<hidl_memory>& pools) {
     poolInfos->resize(pools.size());
@@ -334,7 +361,7 @@ void MklDnnPreparedModel::initializeInput(RunTimeOperandInfo* input, memory::for
                                             input->format}, *cpu_engine);
     if (input->buffer == nullptr) {
         VLOG(L2, "input buffer is null");
-        input->pmem = new memory(primitive_desc_mem);
+        input->pmem = newActivation(primitive_desc_mem);
         input->buffer = input->pmem->get_data_handle();
     } else {
         VLOG(L2, "input buffer is %p", input->buffer);
@@ -434,32 +461,258 @@ void MklDnnPreparedModel::addStubPmem(RunTimeOperandInfo* operand, memory* pmem)
     operand->stub_pmems.push_back(pmem);
 }
 
-memory* MklDnnPreparedModel::insertActivation(memory* pmem, FusedActivationFunc activation)
+//memories are all those the primitive reads or writes, for their live ranges
+void MklDnnPreparedModel::addStep(const std::vector<memory*>& memories, Step step)
 {
-    VLOG(L2, "insert activation of %d to pmem %p", activation, pmem);
-    mkldnn::algorithm alg;
-    float alpha = 0;
+    mSteps.push_back(std::move(step));
+    mStepMemories.push_back(memories);
+}
+
+//a memory the executions write, each context gets its own, in its arena
+memory* MklDnnPreparedModel::newActivation(const memory::primitive_desc& desc)
+{
+    auto pmem = new memory(desc, nullptr);
+    mActivations.push_back(pmem);
+    return pmem;
+}
+
+//a memory on the buffer of base, with another shape or format
+memory* MklDnnPreparedModel::newView(const memory::primitive_desc& desc, memory* base)
+{
+    auto pmem = new memory(desc, base->get_data_handle());
+    if (isActivation(base))
+        mViews.emplace_back(pmem, base);
+    return pmem;
+}
+
+bool MklDnnPreparedModel::isActivation(const memory* pmem) const
+{
+    if (std::find(mActivations.begin(), mActivations.end(), pmem) != mActivations.end())
+        return true;
+    for (const auto& view : mViews)
+        if (view.first == pmem) return true;
+    return false;
+}
+
+//the memory a view is on, through views of views, the memory itself otherwise
+const memory* MklDnnPreparedModel::baseOf(const memory* pmem) const
+{
+    for (auto it = mViews.rbegin(); it != mViews.rend(); ++it)
+        if (it->first == pmem) pmem = it->second;
+    return pmem;
+}
+
+//Places the activations in one arena per context. A memory is live from the
+//first step using it to the last one, a view keeps its base live, and the model
+//inputs and outputs are live throughout. Largest first, each goes to the lowest
+//offset where it overlaps none of the memories placed and live at the same time.
+void MklDnnPreparedModel::planActivations()
+{
+    const size_t alignment = 64;
+    const int count = mActivations.size();
+    std::map<const memory*, int> indexes;
+    for (int i = 0; i < count; i++)
+        indexes[mActivations[i]] = i;
+    auto indexOf = [&](const memory* pmem) {
+        auto it = indexes.find(baseOf(pmem));
+        return it == indexes.end() ? -1 : it->second;
+    };
+
+    const int last = static_cast<int>(mSteps.size()) - 1;
+    std::vector<int> firstUse(count, -1), lastUse(count, -1);
+    for (int step = 0; step <= last; step++) {
+        for (auto pmem : mStepMemories[step]) {
+            int i = indexOf(pmem);
+            if (i < 0) continue;
+            if (firstUse[i] < 0) firstUse[i] = step;
+            lastUse[i] = step;
+        }
+    }
+    auto liveThroughout = [&](int i) {
+        if (i < 0) return;
+        firstUse[i] = 0;
+        lastUse[i] = last;
+    };
+    for (auto index : mModel.inputIndexes)
+        liveThroughout(indexOf(mOperands[index].pmem));
+    for (auto index : mModel.outputIndexes)
+        liveThroughout(indexOf(mOperands[index].pmem));
+
+    std::vector<size_t> sizes(count);
+    std::vector<int> order(count);
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        sizes[i] = (mActivations[i]->get_primitive_desc().get_size() + alignment - 1) /
+                   alignment * alignment;
+        if (firstUse[i] >= 0) total += sizes[i];
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int a, int b) { return sizes[a] > sizes[b]; });
+
+    mActivationOffsets.assign(count, 0);
+    mArenaSize = 0;
+    std::vector<int> placed;
+    for (int i : order) {
+        //no step uses it anymore, a convolution accumulates into another one
+        if (firstUse[i] < 0)
+            continue;
+        std::vector<int> overlapping;
+        for (int j : placed)
+            if (firstUse[j] <= lastUse[i] && firstUse[i] <= lastUse[j])
+                overlapping.push_back(j);
+        std::sort(overlapping.begin(), overlapping.end(), [this](int a, int b) {
+            return mActivationOffsets[a] < mActivationOffsets[b];
+        });
+        size_t offset = 0;
+        for (int j : overlapping) {
+            if (offset + sizes[i] <= mActivationOffsets[j])
+                break;
+            offset = std::max(offset, mActivationOffsets[j] + sizes[j]);
+        }
+        mActivationOffsets[i] = offset;
+        mArenaSize = std::max(mArenaSize, offset + sizes[i]);
+        placed.push_back(i);
+    }
+    VLOG(L1, "%d activations of %zu bytes planned in %zu bytes", count, total, mArenaSize);
+}
+
+//the first context runs on the memories of the plan, the others on copies
+std::unique_ptr<ExecutionContext> MklDnnPreparedModel::createContext(bool first)
+{
+    std::unique_ptr<ExecutionContext> context(new ExecutionContext);
+    void* arena = nullptr;
+    if (mArenaSize > 0 && posix_memalign(&arena, 4096, mArenaSize) != 0) {
+        ALOGE("failed to allocate %zu bytes of activations", mArenaSize);
+        return nullptr;
+    }
+    context->arena.reset(arena);
+    for (size_t i = 0; i < mActivations.size(); i++) {
+        auto pmem = mActivations[i];
+        void* data = static_cast<uint8_t*>(arena) + mActivationOffsets[i];
+        if (first) {
+            pmem->set_data_handle(data);
+        } else {
+            context->owned.emplace_back(new memory(pmem->get_primitive_desc(), data));
+            context->memories[pmem] = context->owned.back().get();
+        }
+    }
+    //in creation order, a view may be based on a view
+    for (const auto& view : mViews) {
+        void* data = context->get(view.second)->get_data_handle();
+        if (first) {
+            view.first->set_data_handle(data);
+        } else {
+            context->owned.emplace_back(new memory(view.first->get_primitive_desc(), data));
+            context->memories[view.first] = context->owned.back().get();
+        }
+    }
+    for (const auto& view : mViews)
+        context->views.emplace_back(context->get(view.first), context->get(view.second));
+    for (auto index : mModel.inputIndexes) {
+        auto pmem = context->get(mOperands[index].pmem);
+        context->buffers[pmem] = pmem->get_data_handle();
+    }
+    for (auto index : mModel.outputIndexes) {
+        auto pmem = context->get(mOperands[index].pmem);
+        context->buffers[pmem] = pmem->get_data_handle();
+    }
+    for (const auto& step : mSteps)
+        context->net.push_back(step(*context));
+    VLOG(L1, "context %zu created", mContexts.size());
+    return context;
+}
+
+ExecutionContext* MklDnnPreparedModel::acquireContext()
+{
+    std::lock_guard<std::mutex> lock(mContextLock);
+    if (mFreeContexts.empty()) {
+        auto context = createContext(mContexts.empty());
+        if (context == nullptr) return nullptr;
+        mContexts.push_back(std::move(context));
+        return mContexts.back().get();
+    }
+    auto context = mFreeContexts.back();
+    mFreeContexts.pop_back();
+    return context;
+}
+
+void MklDnnPreparedModel::releaseContext(ExecutionContext* context)
+{
+    std::lock_guard<std::mutex> lock(mContextLock);
+    mFreeContexts.push_back(context);
+}
+
+//the eltwise of a fused activation, false for NONE and RELU1
+static bool getActivationAlgorithm(FusedActivationFunc activation, mkldnn::algorithm* alg,
+                                   float* alpha)
+{
+    *alpha = 0;
     switch(activation) {
         case FusedActivationFunc::RELU:
-            alg = mkldnn::algorithm::eltwise_relu;
-            break;
+            *alg = mkldnn::algorithm::eltwise_relu;
+            return true;
         case FusedActivationFunc::RELU6:
-            alg = mkldnn::algorithm::eltwise_bounded_relu;
-            alpha = 6;
-            break;
+            *alg = mkldnn::algorithm::eltwise_bounded_relu;
+            *alpha = 6;
+            return true;
         default:
-            nnAssert(false);
-            return nullptr;
+            return false;
     }
+}
 
-    auto pmem_output = new memory(pmem->get_primitive_desc());
+//with the post-ops when the implementations support them, sets *fused then.
+//Otherwise without, the caller adds their primitives.
+template <typename T>
+static typename T::primitive_desc createPrimitiveDesc(const typename T::desc& desc,
+                                                      const mkldnn::post_ops& ops,
+                                                      const engine& engine, bool* fused)
+{
+    *fused = false;
+    if (ops.len() > 0) {
+        try {
+            mkldnn::primitive_attr attr;
+            attr.set_post_ops(ops);
+            auto pd = typename T::primitive_desc(desc, attr, engine);
+            *fused = true;
+            return pd;
+        } catch (const mkldnn::error& e) {
+            VLOG(L1, "post-ops not supported, status %d", e.status);
+        }
+    }
+    return typename T::primitive_desc(desc, engine);
+}
+
+//the post-ops of a fused activation, none if it has no eltwise
+static mkldnn::post_ops activationPostOps(FusedActivationFunc activation)
+{
+    mkldnn::post_ops ops;
+    mkldnn::algorithm alg;
+    float alpha;
+    if (getActivationAlgorithm(activation, &alg, &alpha))
+        ops.append_eltwise(1.0, alg, alpha, 0);
+    return ops;
+}
+
+memory* MklDnnPreparedModel::insertActivation(memory* pmem, FusedActivationFunc activation)
+{
+    VLOG(L2, "insert activation of %d to pmem %p", activation, pmem);
+    mkldnn::algorithm alg;
+    float alpha;
+    if (!getActivationAlgorithm(activation, &alg, &alpha)) {
+        nnAssert(false);
+        return nullptr;
+    }
+
+    auto pmem_output = newActivation(pmem->get_primitive_desc());
     auto desc_relu = mkldnn::eltwise_forward::desc(mkldnn::prop_kind::forward,
                         alg, pmem->get_primitive_desc().desc(), alpha);
     auto primitive_desc_relu = mkldnn::eltwise_forward::primitive_desc(desc_relu,
                         *cpu_engine);
 
-    mNet.push_back(mkldnn::eltwise_forward(primitive_desc_relu, *pmem,
-                        *pmem_output));
+    addStep({pmem, pmem_output}, [=](const ExecutionContext& c) -> primitive {
+        return mkldnn::eltwise_forward(primitive_desc_relu, *c.get(pmem), *c.get(pmem_output));
+    });
 
     return pmem_output;
 }
@@ -483,7 +736,11 @@ memory* MklDnnPreparedModel::insertReorder(memory* src_mem, memory::format forma
     for (int i = 0; i < desc_src.data.ndims; i++) {
         shape[i] = desc_src.data.dims[i];
     }
-    memory* dst_mem = new memory({{shape, type, format}, *cpu_engine});
+    //executed now for the constants, on each execution otherwise
+    memory::primitive_desc pd_dst({shape, type, format}, *cpu_engine);
+    memory* dst_mem = execute ? new memory(pd_dst) : newActivation(pd_dst);
+    if (!execute)
+        mReorderSteps++;
     if (scale != 0) {
         VLOG(L2, "reorder need scale");
         mkldnn::primitive_attr attr;
@@ -496,7 +753,9 @@ memory* MklDnnPreparedModel::insertReorder(memory* src_mem, memory::format forma
             net.push_back(mkldnn::reorder(pd_reorder, *src_mem, *dst_mem));
             mkldnn::stream(mkldnn::stream::kind::eager).submit(net).wait();
         } else {
-            mNet.push_back(mkldnn::reorder(pd_reorder, *src_mem, *dst_mem));
+            addStep({src_mem, dst_mem}, [=](const ExecutionContext& c) -> primitive {
+                return mkldnn::reorder(pd_reorder, *c.get(src_mem), *c.get(dst_mem));
+            });
         }
     } else {
         if (execute) {
@@ -504,7 +763,9 @@ memory* MklDnnPreparedModel::insertReorder(memory* src_mem, memory::format forma
             net.push_back(mkldnn::reorder(*src_mem, *dst_mem));
             mkldnn::stream(mkldnn::stream::kind::eager).submit(net).wait();
         } else {
-            mNet.push_back(mkldnn::reorder(*src_mem, *dst_mem));
+            addStep({src_mem, dst_mem}, [=](const ExecutionContext& c) -> primitive {
+                return mkldnn::reorder(*c.get(src_mem), *c.get(dst_mem));
+            });
         }
     }
 
@@ -576,6 +837,21 @@ memory* MklDnnPreparedModel::insertReorderIfNeed(RunTimeOperandInfo* operand,
     return pmem;
 }
 
+//For the primitives that accept any layout: the memory of the operand in the
+//layout its producer chose, blocked ones included, rather than a reorder to
+//the plain format. Only the type is converted when it has to be.
+memory* MklDnnPreparedModel::keepLayout(RunTimeOperandInfo* operand, memory::format plain,
+                                        memory::data_type type)
+{
+    auto desc = operand->pmem->get_primitive_desc().desc();
+    auto format = static_cast<memory::format>(desc.data.format);
+    if (format != plain && getOperandPmemOfFormatType(*operand, plain, type) == nullptr) {
+        VLOG(L2, "keep format %d of operand %p instead of %d", format, operand, plain);
+        mAvoidedReorders.insert({operand->pmem, plain});
+    }
+    return insertReorderIfNeed(operand, format, type);
+}
+
 bool MklDnnPreparedModel::importOperationConv2D(const Operation& operation)
 {
     const hidl_vec<uint32_t>& ins = operation.inputs;
@@ -703,8 +979,8 @@ bool MklDnnPreparedModel::importOperationConv2D(const Operation& operation)
 
             filter.shape = {channels, depth_multiplier, 1, filter_height, filter_width};
             //add to stub pmem, then can be pick up later
-            addStubPmem(&filter, new memory({{filter.shape, type_conv_filter, format_filter_group},
-                                            *cpu_engine}, pmem->get_data_handle()));
+            addStubPmem(&filter, newView({{filter.shape, type_conv_filter, format_filter_group},
+                                          *cpu_engine}, pmem));
         } else {
             nnAssert(filter.shape.size() == 5);
         }
@@ -726,8 +1002,9 @@ bool MklDnnPreparedModel::importOperationConv2D(const Operation& operation)
     auto desc_conv = mkldnn::convolution_forward::desc(mkldnn::prop_kind::forward,
             mkldnn::convolution_direct, md_conv_input, md_conv_filter, md_conv_bias,
             md_conv_output, strides, paddings_l, paddings_r, mkldnn::padding_kind::zero);
-    auto primitive_desc_conv =
-            mkldnn::convolution_forward::primitive_desc(desc_conv, *cpu_engine);
+    bool fused;
+    auto primitive_desc_conv = createPrimitiveDesc<mkldnn::convolution_forward>(
+            desc_conv, activationPostOps(activation), *cpu_engine, &fused);
 
 
     //reorder for input?
@@ -762,13 +1039,21 @@ bool MklDnnPreparedModel::importOperationConv2D(const Operation& operation)
         pmem_conv_bias = insertReorder(&bias, bias.pmem, conv_bias_desc, bias.scale);*/
     auto pmem_conv_bias = insertReorderIfNeed(&bias, conv_bias_desc);
 
-    output.pmem = new memory(primitive_desc_conv.dst_primitive_desc());
+    auto pmem_conv_output = newActivation(primitive_desc_conv.dst_primitive_desc());
+    output.pmem = pmem_conv_output;
 
-    mNet.push_back(mkldnn::convolution_forward(primitive_desc_conv,
-                       *pmem_conv_input, *pmem_conv_filter, *pmem_conv_bias, *output.pmem));
+    if (activation == FusedActivationFunc::NONE) {
+        mConvSteps.insert({pmem_conv_output, {mSteps.size(), desc_conv, pmem_conv_input,
+                                              pmem_conv_filter, pmem_conv_bias}});
+    }
+    addStep({pmem_conv_input, pmem_conv_filter, pmem_conv_bias, pmem_conv_output},
+            [=](const ExecutionContext& c) -> primitive {
+        return mkldnn::convolution_forward(primitive_desc_conv, *c.get(pmem_conv_input),
+                                           *c.get(pmem_conv_filter), *c.get(pmem_conv_bias),
+                                           *c.get(pmem_conv_output));
+    });
 
-    //TODO: combine relu with conv, conv_relu does not provides src/dst/bias/weights_primitive_get
-    if (activation != FusedActivationFunc::NONE) {
+    if (activation != FusedActivationFunc::NONE && !fused) {
         output.pmem =  insertActivation(output.pmem, activation);
     }
     //pass the format that NN think this opertion output format.
@@ -851,7 +1136,7 @@ bool MklDnnPreparedModel::importOperationPool(const Operation& operation)
     //get output shape, mkldnn define shape as nchw
     output.shape = {batches, channels, output_height, output_width};
 
-    //pooling acccept only nchw
+    //pooling accepts any layout, the output gets the one of the input
     auto type_pool_input = getOperandNeedType(input);
     /*auto pmem_pool_input = getOperandPmemOfFormatType(input, memory::format::nchw,
                                                       type_pool_input);
@@ -859,7 +1144,7 @@ bool MklDnnPreparedModel::importOperationPool(const Operation& operation)
         pmem_pool_input = insertReorder(&input, input.pmem, memory::format::nchw,
                                         type_pool_input, input.scale);
     }*/
-    auto pmem_pool_input = insertReorderIfNeed(&input, memory::format::nchw, type_pool_input);
+    auto pmem_pool_input = keepLayout(&input, memory::format::nchw, type_pool_input);
 
     //output has same type as input
     auto md_pool_output = memory::desc(output.shape, type_pool_input, memory::format::any);
@@ -879,10 +1164,13 @@ bool MklDnnPreparedModel::importOperationPool(const Operation& operation)
     auto primitive_desc_pool =
                 mkldnn::pooling_forward::primitive_desc(desc_pool, *cpu_engine);
 
-    output.pmem = new memory(primitive_desc_pool.dst_primitive_desc());
+    auto pmem_pool_output = newActivation(primitive_desc_pool.dst_primitive_desc());
+    output.pmem = pmem_pool_output;
     /* create pooling primitive an add it to net */
-    mNet.push_back(mkldnn::pooling_forward(primitive_desc_pool, *pmem_pool_input,
-                     *output.pmem));
+    addStep({pmem_pool_input, pmem_pool_output}, [=](const ExecutionContext& c) -> primitive {
+        return mkldnn::pooling_forward(primitive_desc_pool, *c.get(pmem_pool_input),
+                                       *c.get(pmem_pool_output));
+    });
 
     if (activation != FusedActivationFunc::NONE) {
         output.pmem = insertActivation(output.pmem, activation);
@@ -940,8 +1228,9 @@ bool MklDnnPreparedModel::importOperationActivation(const Operation& operation)
 
     //get output shape, mkldnn define shape as nchw
     //output has same type as input
-    output.pmem = new memory({{output.shape, type_activation_input, input.format},
-                                      *cpu_engine});
+    auto pmem_activation_output = newActivation({{output.shape, type_activation_input,
+                                                  input.format}, *cpu_engine});
+    output.pmem = pmem_activation_output;
 
     /* create relu primitive and add it to net */
     auto desc_activation = mkldnn::eltwise_forward::desc(mkldnn::prop_kind::forward,
@@ -949,8 +1238,11 @@ bool MklDnnPreparedModel::importOperationActivation(const Operation& operation)
     auto primitive_desc_activation = mkldnn::eltwise_forward::primitive_desc(desc_activation,
                         *cpu_engine);
 
-    mNet.push_back(mkldnn::eltwise_forward(primitive_desc_activation, *pmem_activation_input,
-                        *output.pmem));
+    addStep({pmem_activation_input, pmem_activation_output},
+            [=](const ExecutionContext& c) -> primitive {
+        return mkldnn::eltwise_forward(primitive_desc_activation, *c.get(pmem_activation_input),
+                                       *c.get(pmem_activation_output));
+    });
 
     //output format same as input, and do not need reorder.
     finalizeOutput(&output, input.format);
@@ -1001,20 +1293,11 @@ bool MklDnnPreparedModel::importOperationConcat(const Operation& operation)
     }
 
     auto type_concat_input = getOperandNeedType(input0);
-    std::vector<memory::primitive_desc> primitive_desc_inputs;
-    std::vector<primitive::at> primitive_inputs;
+    std::vector<RunTimeOperandInfo*> inputs;
     for (uint32_t i = 0; i < in_counts - 1; i++) {
         RunTimeOperandInfo& input = mOperands[ins[i]];
         initializeInput(&input, format_input);
-
-        //based on nchw
-        /*auto pmem_input = getOperandPmemOfFormatType(input, format_concat, type_concat_input);
-        if (pmem_input == nullptr) {
-            pmem_input = insertReorder(&input, input.pmem, format_concat, type_concat_input, input.scale);
-        }*/
-        auto pmem_input = insertReorderIfNeed(&input, format_concat, type_concat_input);
-        primitive_inputs.push_back(*pmem_input);
-        primitive_desc_inputs.push_back(pmem_input->get_primitive_desc());
+        inputs.push_back(&input);
 
         //axis is already nchw, then use input.shape
         for (uint32_t d = 0; d < input.shape.size(); d++) {
@@ -1033,13 +1316,62 @@ bool MklDnnPreparedModel::importOperationConcat(const Operation& operation)
     RunTimeOperandInfo& output = mOperands[outs[0]];
     output.shape = shape_output;
 
-    auto desc_output = memory::desc(output.shape, type_concat_input, format_concat);
-    auto primitive_desc_concat = mkldnn::concat::primitive_desc(desc_output,
-                                          static_cast<int>(axis),
-                                          primitive_desc_inputs);
-    output.pmem = new memory(primitive_desc_concat.dst_primitive_desc());
-
-    mNet.push_back(mkldnn::concat(primitive_desc_concat, primitive_inputs, *output.pmem));
+    //inputs all in the same blocked layout are concatenated in it, if an
+    //implementation supports it with their channels, in nchw otherwise
+    auto format_common = memory::format::format_undef;
+    if (dims_size == 4) {
+        auto formatOf = [](const memory* pmem) {
+            return static_cast<memory::format>(pmem->get_primitive_desc().desc().data.format);
+        };
+        format_common = formatOf(input0.pmem);
+        for (auto input : inputs) {
+            auto type = input->pmem->get_primitive_desc().desc().data.data_type;
+            if (formatOf(input->pmem) != format_common ||
+                static_cast<memory::data_type>(type) != type_concat_input)
+                format_common = memory::format::format_undef;
+        }
+        if (format_common == memory::format::nchw || format_common == memory::format::nhwc)
+            format_common = memory::format::format_undef;
+    }
+
+    std::vector<memory*> pmem_inputs;
+    auto createConcat = [&]() -> mkldnn::concat::primitive_desc {
+        if (format_common != memory::format::format_undef) {
+            try {
+                std::vector<memory::primitive_desc> primitive_desc_inputs;
+                for (auto input : inputs)
+                    primitive_desc_inputs.push_back(input->pmem->get_primitive_desc());
+                auto desc_output = memory::desc(output.shape, type_concat_input, format_common);
+                auto pd = mkldnn::concat::primitive_desc(desc_output, static_cast<int>(axis),
+                                                         primitive_desc_inputs);
+                for (auto input : inputs)
+                    pmem_inputs.push_back(keepLayout(input, format_concat, type_concat_input));
+                return pd;
+            } catch (const mkldnn::error& e) {
+                VLOG(L1, "concat not supported in format %d, status %d", format_common, e.status);
+            }
+        }
+        std::vector<memory::primitive_desc> primitive_desc_inputs;
+        for (auto input : inputs) {
+            pmem_inputs.push_back(insertReorderIfNeed(input, format_concat, type_concat_input));
+            primitive_desc_inputs.push_back(pmem_inputs.back()->get_primitive_desc());
+        }
+        auto desc_output = memory::desc(output.shape, type_concat_input, format_concat);
+        return mkldnn::concat::primitive_desc(desc_output, static_cast<int>(axis),
+                                              primitive_desc_inputs);
+    };
+    auto primitive_desc_concat = createConcat();
+    auto pmem_concat_output = newActivation(primitive_desc_concat.dst_primitive_desc());
+    output.pmem = pmem_concat_output;
+
+    auto pmem_concat_memories = pmem_inputs;
+    pmem_concat_memories.push_back(pmem_concat_output);
+    addStep(pmem_concat_memories, [=](const ExecutionContext& c) -> primitive {
+        std::vector<primitive::at> primitive_inputs;
+        for (auto pmem : pmem_inputs) primitive_inputs.push_back(*c.get(pmem));
+        return mkldnn::concat(primitive_desc_concat, primitive_inputs,
+                              *c.get(pmem_concat_output));
+    });
 
     finalizeOutput(&output, format_output);
     return true;
@@ -1093,13 +1425,17 @@ bool MklDnnPreparedModel::importOperationSoftmax(const Operation& operation)
 
     RunTimeOperandInfo& output = mOperands[outs[0]];
     output.shape = input.shape;
-    output.pmem = new memory({{output.shape, type_softmax_input, format_output}, *cpu_engine});
+    auto pmem_softmax_output = newActivation({{output.shape, type_softmax_input, format_output},
+                                              *cpu_engine});
+    output.pmem = pmem_softmax_output;
 
     auto desc_softmax = mkldnn::softmax_forward::desc(mkldnn::prop_kind::forward_inference,
                                   pmem_softmax_input->get_primitive_desc().desc(), dims_size - 1);
     auto primitive_desc_softmax = mkldnn::softmax_forward::primitive_desc(desc_softmax, *cpu_engine);
-    mNet.push_back(mkldnn::softmax_forward(primitive_desc_softmax,
-                                  *pmem_softmax_input, *output.pmem));
+    addStep({pmem_softmax_input, pmem_softmax_output}, [=](const ExecutionContext& c) -> primitive {
+        return mkldnn::softmax_forward(primitive_desc_softmax, *c.get(pmem_softmax_input),
+                                       *c.get(pmem_softmax_output));
+    });
 
     finalizeOutput(&output, format_output);
     return true;
@@ -1117,15 +1453,13 @@ bool MklDnnPreparedModel::importOperationLRN(const Operation& operation)
 
     RunTimeOperandInfo& input = mOperands[ins[0]];
     initializeInput(&input, memory::format::nhwc);
-    //mkldnn accept nchw;
-    auto format_lrn = memory::format::nchw;
-    auto format_output = memory::format::nchw;
+    //lrn accepts any layout, the output gets the one of the input
     auto type_lrn_input = getOperandNeedType(input);
     /*auto pmem_lrn_input = getOperandPmemOfFormatType(input, softmax_format);
     if (pmem_lrn_input == nullptr) {
         pmem_lrn_input = insertReorder(&input, input.pmem, softmax_format);
     }*/
-    auto pmem_lrn_input = insertReorderIfNeed(&input, format_lrn, type_lrn_input);
+    auto pmem_lrn_input = keepLayout(&input, memory::format::nchw, type_lrn_input);
 
     int32_t radius = getScalarData<int32_t>(mOperands[ins[1]]);
     float bias = getScalarData<float>(mOperands[ins[2]]);
@@ -1134,7 +1468,8 @@ bool MklDnnPreparedModel::importOperationLRN(const Operation& operation)
 
     RunTimeOperandInfo& output = mOperands[outs[0]];
     output.shape = input.shape;
-    output.pmem = new memory({{output.shape, type_lrn_input, format_output}, *cpu_engine});
+    auto pmem_lrn_output = newActivation(pmem_lrn_input->get_primitive_desc());
+    output.pmem = pmem_lrn_output;
 
     //NN pass the depth as (d - depth, d + depth)
     radius = radius * 2 + 1;
@@ -1146,7 +1481,10 @@ bool MklDnnPreparedModel::importOperationLRN(const Operation& operation)
                                               pmem_lrn_input->get_primitive_desc().desc(),
                                               radius, alpha, beta, bias);
     auto primitive_desc_lrn = mkldnn::lrn_forward::primitive_desc(desc_lrn, *cpu_engine);
-    mNet.push_back(mkldnn::lrn_forward(primitive_desc_lrn, *pmem_lrn_input, *output.pmem));
+    addStep({pmem_lrn_input, pmem_lrn_output}, [=](const ExecutionContext& c) -> primitive {
+        return mkldnn::lrn_forward(primitive_desc_lrn, *c.get(pmem_lrn_input),
+                                   *c.get(pmem_lrn_output));
+    });
 
     finalizeOutput(&output, memory::format::nhwc);
     return true;
@@ -1194,9 +1532,19 @@ bool MklDnnPreparedModel::importOperationFC(const Operation& operation)
         memory::dims shape;
         //for nc
         shape.resize(2);
-        if (format_src == format && type_src == type) {
+        if (format_src == format && type_src == type)
             return src_pmem;
-        } else if (format_src != format && type_src == type) {
+        if (desc_src.data.ndims == 4 && format_src != memory::format::nchw &&
+            format_src != memory::format::nhwc) {
+            //a blocked format is padded and can't be reordered to nc, it goes
+            //to the plain format first and the view is made on that
+            src_pmem = insertReorderIfNeed(operand, memory::format::nchw, type);
+            desc_src = src_pmem->get_primitive_desc().desc();
+            format_src = memory::format::nchw;
+            type_src = type;
+        }
+        if (format_src != format && type_src == type &&
+            (format_src == memory::format::nchw || format_src == memory::format::nhwc)) {
             for (int i = 0; i < desc_src.data.ndims; i++) {
                 if (i < shape.size()) {
                     shape[i] = desc_src.data.dims[i];
@@ -1211,8 +1559,7 @@ bool MklDnnPreparedModel::importOperationFC(const Operation& operation)
             can_shrink = false;
         }
         if (can_shrink) {
-            void *buf = src_pmem->get_data_handle();
-            pmem_fc = new memory({{shape, type, format}, *cpu_engine}, buf);
+            pmem_fc = newView({{shape, type, format}, *cpu_engine}, src_pmem);
         } else {
             pmem_fc = insertReorderIfNeed(operand, format, type);
         }
@@ -1226,18 +1573,26 @@ bool MklDnnPreparedModel::importOperationFC(const Operation& operation)
     RunTimeOperandInfo& output = mOperands[outs[0]];
     output.shape = {input.shape[0], weights.shape[0]};
     //output has same type as input
-    output.pmem = new memory({{output.shape, type_fc_input, memory::format::nc}, *cpu_engine});
+    auto pmem_fc_output = newActivation({{output.shape, type_fc_input, memory::format::nc},
+                                         *cpu_engine});
+    output.pmem = pmem_fc_output;
 
     auto desc_fc = mkldnn::inner_product_forward::desc(mkldnn::prop_kind::forward,
                                pmem_fc_input->get_primitive_desc().desc(),
                                pmem_fc_weights->get_primitive_desc().desc(),
                                pmem_fc_bias->get_primitive_desc().desc(),
                                output.pmem->get_primitive_desc().desc());
-    auto primitive_desc_fc = mkldnn::inner_product_forward::primitive_desc(desc_fc, *cpu_engine);
-    mNet.push_back(mkldnn::inner_product_forward(primitive_desc_fc, *pmem_fc_input,
-                                                       *pmem_fc_weights, *pmem_fc_bias, *output.pmem));
-
-    if (activation != FusedActivationFunc::NONE) {
+    bool fused;
+    auto primitive_desc_fc = createPrimitiveDesc<mkldnn::inner_product_forward>(
+            desc_fc, activationPostOps(activation), *cpu_engine, &fused);
+    addStep({pmem_fc_input, pmem_fc_weights, pmem_fc_bias, pmem_fc_output},
+            [=](const ExecutionContext& c) -> primitive {
+        return mkldnn::inner_product_forward(primitive_desc_fc, *c.get(pmem_fc_input),
+                                             *c.get(pmem_fc_weights), *c.get(pmem_fc_bias),
+                                             *c.get(pmem_fc_output));
+    });
+
+    if (activation != FusedActivationFunc::NONE && !fused) {
         output.pmem = insertActivation(output.pmem, activation);
     }
 
@@ -1276,27 +1631,48 @@ bool MklDnnPreparedModel::importOperationAdd(const Operation& operation)
             return false;
     }
 
+    RunTimeOperandInfo& output = mOperands[outs[0]];
+    if (in_counts == 3 && ins[0] != ins[1]) {
+        for (int i = 0; i < 2; i++) {
+            auto pmem = fuseConvSum(mOperands[ins[i]], mOperands[ins[1 - i]], activation);
+            if (pmem != nullptr) {
+                output.pmem = pmem;
+                output.shape = input0.shape;
+                finalizeOutput(&output, format_input);
+                return true;
+            }
+        }
+    }
+
     std::vector<float> scales = {1, 1, 1, 1};
 
+    //the layout of the first input, the others are reordered to it
     std::vector<mkldnn::memory::primitive_desc> md_inputs;
-    std::vector<primitive::at> inputs;
+    std::vector<memory*> pmem_inputs;
     for (uint32_t i = 0; i < in_counts - 1; i++) {
         RunTimeOperandInfo& input = mOperands[ins[i]];
         initializeInput(&input, format_input);
         auto type_input = getOperandNeedType(input);
-        auto pmem_input = insertReorderIfNeed(&input, format_input, type_input);
+        auto pmem_input = i == 0 ? keepLayout(&input, format_input, type_input)
+                                 : insertReorderIfNeed(&input, md_inputs[0].desc());
         md_inputs.push_back(pmem_input->get_primitive_desc());
-        inputs.push_back(*pmem_input);
+        pmem_inputs.push_back(pmem_input);
     }
 
     auto pd_add = mkldnn::sum::primitive_desc(scales, md_inputs);
 
-    RunTimeOperandInfo& output = mOperands[outs[0]];
-    output.pmem = new memory(pd_add.dst_primitive_desc());
+    auto pmem_add_output = newActivation(pd_add.dst_primitive_desc());
+    output.pmem = pmem_add_output;
     //output shape same as input
     output.shape = input0.shape;
 
-    mNet.push_back(mkldnn::sum(pd_add, inputs, *output.pmem));
+    auto pmem_add_memories = pmem_inputs;
+    pmem_add_memories.push_back(pmem_add_output);
+    addStep(pmem_add_memories, [=](const ExecutionContext& c) -> primitive {
+        std::vector<primitive::at> inputs;
+        for (auto pmem : pmem_inputs) inputs.push_back(*c.get(pmem));
+        return mkldnn::sum(pd_add, inputs, *c.get(pmem_add_output));
+    });
 
     if (activation != FusedActivationFunc::NONE) {
         output.pmem = insertActivation(output.pmem, activation);
@@ -1307,6 +1683,63 @@ bool MklDnnPreparedModel::importOperationAdd(const Operation& operation)
     return true;
 }
 
+//Residual ADD of the output of a convolution and another tensor: the
+//convolution adds its result to the other tensor in place, and applies the
+//activation, with post-ops. Only when the ADD is the only reader of the
+//output of the convolution, which is no longer written, when the other tensor
+//is not read after the convolution ran, neither by a step nor by a later
+//operation, and has the output format of the convolution. Returns the output
+//of the ADD, a view on the other tensor, or nullptr when it can't be fused.
+memory* MklDnnPreparedModel::fuseConvSum(const RunTimeOperandInfo& conv,
+                                         const RunTimeOperandInfo& other,
+                                         FusedActivationFunc activation)
+{
+    auto it = mConvSteps.find(conv.pmem);
+    if (it == mConvSteps.end() || !conv.stub_pmems.empty())
+        return nullptr;
+    if (conv.lifetime != OperandLifeTime::TEMPORARY_VARIABLE || conv.numberOfUsesLeft != 1 ||
+        other.lifetime != OperandLifeTime::TEMPORARY_VARIABLE || other.numberOfUsesLeft != 1)
+        return nullptr;
+    const ConvStep& step = it->second;
+    memory* pmem_sum = other.pmem;
+    if (pmem_sum == nullptr ||
+        !(pmem_sum->get_primitive_desc() == conv.pmem->get_primitive_desc()))
+        return nullptr;
+    auto base = baseOf(pmem_sum), base_conv = baseOf(conv.pmem);
+    for (size_t i = step.step; i < mSteps.size(); i++)
+        for (auto pmem : mStepMemories[i])
+            if (baseOf(pmem) == base || (i > step.step && baseOf(pmem) == base_conv))
+                return nullptr;
+
+    mkldnn::post_ops ops;
+    ops.append_sum(1.0);
+    mkldnn::algorithm alg;
+    float alpha;
+    if (getActivationAlgorithm(activation, &alg, &alpha))
+        ops.append_eltwise(1.0, alg, alpha, 0);
+    else if (activation != FusedActivationFunc::NONE)
+        return nullptr;
+    bool fused;
+    auto primitive_desc_conv = createPrimitiveDesc<mkldnn::convolution_forward>(
+            step.desc, ops, *cpu_engine, &fused);
+    if (!fused || !(primitive_desc_conv.src_primitive_desc() == step.src->get_primitive_desc()) ||
+        !(primitive_desc_conv.weights_primitive_desc() == step.weights->get_primitive_desc()) ||
+        !(primitive_desc_conv.bias_primitive_desc() == step.bias->get_primitive_desc()) ||
+        !(primitive_desc_conv.dst_primitive_desc() == pmem_sum->get_primitive_desc()))
+        return nullptr;
+
+    VLOG(L1, "fuse ADD into convolution step %zu", step.step);
+    auto pmem_src = step.src, pmem_weights = step.weights, pmem_bias = step.bias;
+    mSteps[step.step] = [=](const ExecutionContext& c) -> primitive {
+        return mkldnn::convolution_forward(primitive_desc_conv, *c.get(pmem_src),
+                                           *c.get(pmem_weights), *c.get(pmem_bias),
+                                           *c.get(pmem_sum));
+    };
+    mStepMemories[step.step] = {pmem_src, pmem_weights, pmem_bias, pmem_sum};
+    mConvSteps.erase(it);
+    return newView(pmem_sum->get_primitive_desc(), pmem_sum);
+}
+
 // TODO doublecheck
 bool MklDnnPreparedModel::validateRequest(const Request& request, const Model& model)
 {
@@ -1586,15 +2019,36 @@ bool MklDnnPreparedModel::initialize()
                 ALOGE("failed to import operation %d", operation.type);
                 return false;
         }
+        for (auto index : operation.inputs) {
+            auto& operand = mOperands[index];
+            if (operand.numberOfUsesLeft > 0)
+                operand.numberOfUsesLeft--;
+        }
         VLOG(L1, "import %d success", operation.type);
     }
 
+    planActivations();
+    VLOG(L1, "%zu reorders per execution, %zu with the inputs of pooling, LRN, ADD and CONCAT "
+             "in plain formats", mReorderSteps, mReorderSteps + mAvoidedReorders.size());
+    //the first execution does not wait for it
+    auto context = acquireContext();
+    if (context == nullptr)
+        return false;
+    releaseContext(context);
+
+    char name[64];
+    snprintf(name, sizeof(name), "mkldnn model %p", this);
+    mLatency.reset(new LatencyStats(name));
+
     return true;
 }
 
 void MklDnnPreparedModel::deinitialize()
 {
     VLOG(L1,  "deinitialize");
+    //the primitives of the contexts refer to the memories of the operands
+    mFreeContexts.clear();
+    mContexts.clear();
     for (const auto& operand : mOperands) {
         for (const auto& pmem : operand.stub_pmems) {
             VLOG(L1, "free stub pmems %p of operand %p", pmem, &operand);
@@ -1657,65 +2111,106 @@ void printOperandPmem(int level, const memory *pmem, int limit = 0)
 void MklDnnPreparedModel::asyncExecute(const Request& request,
                                        const sp<IExecutionCallback>& callback)
 {
+    LatencyStats::Timer timer(mLatency.get());
     std::vector<RunTimePoolInfo> requestPoolInfos;
     if (!setRunTimePoolInfosFromHidlMemories(&requestPoolInfos, request.pools)) {
         callback->notify(ErrorStatus::GENERAL_FAILURE);
         return;
     }
+    timer.mark(LatencyStats::MAP_POOLS);
+
+    //the requests running at the same time each have their memories
+    ExecutionContext* context = acquireContext();
+    if (context == nullptr) {
+        callback->notify(ErrorStatus::GENERAL_FAILURE);
+        return;
+    }
 
-    auto copyData = [this, &requestPoolInfos](const std::vector<uint32_t>& indexes,
+    //the memories use the request buffers when they can, or their own and copy
+    auto bindData = [this, &requestPoolInfos, context](const std::vector<uint32_t>& indexes,
                        const hidl_vec<RequestArgument>& arguments, bool copyFromRequest) {
-        //do memcpy for input data
         for (size_t i = 0; i < indexes.size(); i++) {
-            RunTimeOperandInfo& operand = mOperands[indexes[i]];
+            const RunTimeOperandInfo& operand = mOperands[indexes[i]];
+            memory* pmem = context->get(operand.pmem);
             const RequestArgument& arg = arguments[i];
             auto poolIndex = arg.location.poolIndex;
             nnAssert(poolIndex < requestPoolInfos.size());
             auto& r = requestPoolInfos[poolIndex];
-            if (copyFromRequest)
-                memcpy(operand.buffer, r.buffer + arg.location.offset, operand.length);
-            else
-                memcpy(r.buffer + arg.location.offset, operand.buffer, operand.length);
+            uint8_t* data = r.buffer + arg.location.offset;
+            if (canUseRequestBuffer(operand, *pmem, data)) {
+                pmem->set_data_handle(data);
+            } else {
+                pmem->set_data_handle(context->buffers[pmem]);
+                if (copyFromRequest)
+                    memcpy(pmem->get_data_handle(), data, operand.length);
+            }
         }
     };
 
-    VLOG(L1, "copy request inputs to model inputs");
+    VLOG(L1, "bind request inputs and outputs to model inputs and outputs");
 
-    copyData(mModel.inputIndexes, request.inputs, true);
+    bindData(mModel.inputIndexes, request.inputs, true);
+    bindData(mModel.outputIndexes, request.outputs, false);
+    for (const auto& view : context->views)
+        view.first->set_data_handle(view.second->get_data_handle());
+    timer.mark(LatencyStats::CONVERT_INPUTS);
 
     VLOG(L1, "Run");
     //run
-    mkldnn::stream(mkldnn::stream::kind::eager).submit(mNet).wait();
+    mkldnn::stream(mkldnn::stream::kind::eager).submit(context->net).wait();
+    timer.mark(LatencyStats::INFER);
 
     VLOG(L1, "copy model output to request output");
 
-    copyData(mModel.outputIndexes, request.outputs, false);
+    for (size_t i = 0; i < mModel.outputIndexes.size(); i++) {
+        const RunTimeOperandInfo& operand = mOperands[mModel.outputIndexes[i]];
+        const memory* pmem = context->get(operand.pmem);
+        const DataLocation& location = request.outputs[i].location;
+        uint8_t* data = requestPoolInfos[location.poolIndex].buffer + location.offset;
+        if (pmem->get_data_handle() != data)
+            memcpy(data, pmem->get_data_handle(), operand.length);
+    }
+    timer.mark(LatencyStats::CONVERT_OUTPUTS);
 
     VLOG(L1, "update shared memories");
     for (auto runtimeInfo : requestPoolInfos) {
         runtimeInfo.update();
     }
+    timer.mark(LatencyStats::SYNC_POOLS);
 
 #ifdef MKLDNN_DEBUG
     {
         VLOG(L2, "Model output0 are:");
         const RunTimeOperandInfo& output = mOperands[mModel.outputIndexes[0]];
-        printOperandPmem(L2, output.pmem);
+        printOperandPmem(L2, context->get(output.pmem));
         VLOG(L4, "Model input0 are:");
         const RunTimeOperandInfo& input = mOperands[mModel.inputIndexes[0]];
-        printOperandPmem(L4, input.pmem, 100);
+        printOperandPmem(L4, context->get(input.pmem), 100);
         for(const auto& op : mModel.operations) {
             const auto& o = mOperands[op.outputs[0]];
             VLOG(L4, "Operation %d has output 0(lifetime %d) are:", op.type, o.lifetime);
-            printOperandPmem(L4, o.pmem, 100);
+            printOperandPmem(L4, context->get(o.pmem), 100);
         }
     }
+    timer.skip();
 #endif
+    releaseContext(context);
 
     Return<void> returned = callback->notify(ErrorStatus::NONE);
     if (!returned.isOk()) {
         ALOGE("hidl callback failed to return properly: %s", returned.description().c_str());
     }
+    timer.mark(LatencyStats::NOTIFY);
+    timer.finish();
+}
+
+// Requests of all the models share the workers. The mkldnn primitives already
+// run multi-threaded, a second request overlaps the copies and the layers that
+// don't scale; each takes an execution context of the model it runs.
+static ExecutionQueue& getExecutionQueue()
+{
+    static ExecutionQueue queue("mkldnn", 2, 32);
+    return queue;
 }
 
 Return<ErrorStatus> MklDnnPreparedModel::execute(const Request& request,
@@ -1723,7 +2218,7 @@ Return<ErrorStatus> MklDnnPreparedModel::execute(const Request& request,
 {
     VLOG(L1, "Begin to execute");
 
-    if (mNet.size() == 0) {
+    if (mSteps.size() == 0) {
         ALOGE("No primitive to execute");
         callback->notify(ErrorStatus::INVALID_ARGUMENT);
         return ErrorStatus::INVALID_ARGUMENT;
@@ -1739,11 +2234,14 @@ Return<ErrorStatus> MklDnnPreparedModel::execute(const Request& request,
         return ErrorStatus::INVALID_ARGUMENT;
     }
 
-    // This thread is intentionally detached because the sample driver service
-    // is expected to live forever.
-    std::thread([this, request, callback]{ asyncExecute(request, callback); }).detach();
+    sp<MklDnnPreparedModel> self(this);
+    if (!getExecutionQueue().submit([self, request, callback]{
+            self->asyncExecute(request, callback); })) {
+        callback->notify(ErrorStatus::DEVICE_UNAVAILABLE);
+        return ErrorStatus::DEVICE_UNAVAILABLE;
+    }
 
-    VLOG(L1, "Start execute thread done");
+    VLOG(L1, "Request queued");
     return ErrorStatus::NONE;
 }
 
@@ -23,11 +23,19 @@
 #include <hidlmemory/mapping.h>
 #include <hardware/hardware.h>
 #include <mkldnn.hpp>
+#include "LatencyStats.h"
 
+#include <stdlib.h>
 #include <sys/mman.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
 
 using ::android::hidl::memory::V1_0::IMemory;
+using ::nnhal::LatencyStats;
 
 using ::mkldnn::memory;
 using ::mkldnn::primitive;
@@ -76,6 +84,30 @@ struct RunTimePoolInfo {
     bool update();
 };
 
+// The memories and primitives of one execution. What initialize() compiled is
+// not modified by the executions: each one runs on a context of its own, with
+// its own input, output and intermediate memories, and reads the constants of
+// the model from the memories the contexts share.
+struct ExecutionContext {
+    // The memory of the context standing for a memory created by the import
+    // functions, the memory itself when it is shared.
+    memory* get(memory* pmem) const {
+        auto it = memories.find(pmem);
+        return it == memories.end() ? pmem : it->second;
+    }
+
+    std::map<const memory*, memory*> memories;
+    std::vector<std::unique_ptr<memory>> owned;
+    // the buffer the activations of the context are planned into
+    std::unique_ptr<void, void (*)(void*)> arena{nullptr, free};
+    std::vector<primitive> net;
+    // (view, base), pointed again at their base once the model inputs and
+    // outputs were bound to the buffers of a request
+    std::vector<std::pair<memory*, memory*>> views;
+    // the buffers of the model input and output memories, when they can't
+    // use the ones of the request
+    std::map<const memory*, void*> buffers;
+};
 
 class MklDnnPreparedModel : public IPreparedModel {
 public:
@@ -95,6 +127,18 @@ private:
     bool initializeRunTimeOperandInfo();
     void asyncExecute(const Request& request, const sp<IExecutionCallback>& callback);
 
+    // Creates a primitive of the plan on the memories of a context
+    typedef std::function<primitive(const ExecutionContext&)> Step;
+    void addStep(const std::vector<memory*>& memories, Step step);
+    memory* newActivation(const memory::primitive_desc& desc);
+    memory* newView(const memory::primitive_desc& desc, memory* base);
+    bool isActivation(const memory* pmem) const;
+    const memory* baseOf(const memory* pmem) const;
+    void planActivations();
+    std::unique_ptr<ExecutionContext> createContext(bool first);
+    ExecutionContext* acquireContext();
+    void releaseContext(ExecutionContext* context);
+
     bool importOperationConv2D(const Operation& operation);
     bool importOperationPool(const Operation& operation);
     bool importOperationActivation(const Operation& operation);
@@ -117,14 +161,48 @@ private:
     memory* insertReorderIfNeed(RunTimeOperandInfo* operand, memory::format format,
                                 memory::data_type type);
     memory* insertReorderIfNeed(RunTimeOperandInfo* operand, memory::desc desc);
+    memory* keepLayout(RunTimeOperandInfo* operand, memory::format plain, memory::data_type type);
     memory::data_type getOperandNeedType(const RunTimeOperandInfo& operand);
     memory* insertActivation(memory* pmem, FusedActivationFunc activation);
+    memory* fuseConvSum(const RunTimeOperandInfo& conv, const RunTimeOperandInfo& other,
+                        FusedActivationFunc activation);
 
     Model mModel;
     std::vector<RunTimeOperandInfo> mOperands;
     std::vector<RunTimePoolInfo> mPoolInfos;
-    std::vector<primitive> mNet;
     engine *cpu_engine;
+    // The plan: the steps in execution order, the memories they write, which
+    // each context has its own of, and the views on them (view, base). The
+    // memories of the plan go to the first context.
+    std::vector<Step> mSteps;
+    std::vector<memory*> mActivations;
+    std::vector<std::pair<memory*, memory*>> mViews;
+    // the memories each step reads or writes, and where the activations are
+    // in the arena of a context, those not live at the same time overlapping
+    std::vector<std::vector<memory*>> mStepMemories;
+    std::vector<size_t> mActivationOffsets;
+    size_t mArenaSize = 0;
+    // The convolutions without activation, by output. When an ADD is the only
+    // consumer of the output, the step is replaced by one accumulating into the
+    // other input of the ADD, with a sum post-op.
+    struct ConvStep {
+        size_t step;
+        mkldnn::convolution_forward::desc desc;
+        memory* src;
+        memory* weights;
+        memory* bias;
+    };
+    std::map<const memory*, ConvStep> mConvSteps;
+    // the reorders of the plan, and those to a plain format the operations
+    // accepting any layout did without, for the report of initialize()
+    size_t mReorderSteps = 0;
+    std::set<std::pair<const memory*, memory::format>> mAvoidedReorders;
+    // one context per execution running, created on demand
+    std::mutex mContextLock;
+    std::vector<std::unique_ptr<ExecutionContext>> mContexts;
+    std::vector<ExecutionContext*> mFreeContexts;
+    // phases of the executions, logged and in `lshal debug`
+    std::unique_ptr<LatencyStats> mLatency;
 };
 
 }  // namespace mkldnn_driver
@@ -21,8 +21,10 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := fp.cpp ncs_lib.cpp
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/../libncs/ncsdk-1.12.00.01/api/include \
                     $(LOCAL_PATH)/../graph_compiler_NCS \
-                    $(LOCAL_PATH)
+                    $(LOCAL_PATH) \
+                    $(LOCAL_PATH)/../../intel_nn_hal/fp16
 LOCAL_SHARED_LIBRARIES := libncsdk liblog libutils
+LOCAL_STATIC_LIBRARIES := libnnhal_fp16
 LOCAL_CPPFLAGS := -fexceptions -o3
 LOCAL_MODULE := libncs_nn_operation
 
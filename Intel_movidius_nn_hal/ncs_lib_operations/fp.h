@@ -13,7 +13,6 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-static unsigned half2float(unsigned short h);
 unsigned short float2half(unsigned f);
 void floattofp16(unsigned char *dst, float *src, unsigned nelem);
 void fp16tofloat(float *dst, unsigned char *src, unsigned nelem);
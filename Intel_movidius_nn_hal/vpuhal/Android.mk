@@ -57,6 +57,8 @@ LOCAL_SHARED_LIBRARIES := \
 										libncs_graph_compiler \
                     android.hidl.memory@1.0
 
+LOCAL_HEADER_LIBRARIES := libnnhal_common_headers
+
 include $(BUILD_SHARED_LIBRARY)
 
 include $(CLEAR_VARS)
@@ -20,6 +20,7 @@
 
 
 #include "HalInterfaces.h"
+#include "LatencyStats.h"
 
 //TODO check this files needed or not
 #include "VpuOperationsUtils.h"
@@ -36,6 +37,8 @@ namespace neuralnetworks {
 namespace V1_0 {
 namespace vpu_driver {
 
+using ::nnhal::LatencyStats;
+
 // Information we maintain about each operand during execution that
 // may change during execution.
 struct RunTimeOperandInfo {
@@ -90,11 +93,12 @@ public:
     // Executes the model. The results will be stored at the locations
     // specified in the constructor.
     // The model must outlive the executor.  We prevent it from being modified
-    // while this is executing.
+    // while this is executing. The phases from the input copy to the msync of
+    // the pools are marked on timer.
 
     int run(const Model& model, const Request& request,
             const std::vector<RunTimePoolInfo>& modelPoolInfos,
-            const std::vector<RunTimePoolInfo>& requestPoolInfos);
+            const std::vector<RunTimePoolInfo>& requestPoolInfos, LatencyStats::Timer& timer);
 
 private:
 
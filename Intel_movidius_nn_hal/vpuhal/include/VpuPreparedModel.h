@@ -28,6 +28,7 @@
 */
 
 #include <sys/mman.h>
+#include <memory>
 #include <string>
 #include <iostream>
 
@@ -67,6 +68,8 @@ private:
 
         Model mModel;
         std::vector<RunTimePoolInfo> mPoolInfos;
+        // phases of the executions, logged and in `lshal debug`
+        std::unique_ptr<LatencyStats> mLatency;
 };
 
 
@@ -25,6 +25,7 @@
 #include <thread>
 
 #include "VpuDriver.h"
+#include "LatencyStats.h"
 #include "VpuUtils.h"
 #include "VpuPreparedModel.h"
 #include "HalInterfaces.h"
@@ -125,6 +126,12 @@ Return<ErrorStatus> VpuDriver::prepareModel(const Model& model,
     return ErrorStatus::NONE;
 }
 
+Return<void> VpuDriver::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) return Void();
+    LatencyStats::dumpAll(fd->data[0]);
+    return Void();
+}
+
 //getStatus() function
 
 Return<DeviceStatus> VpuDriver::getStatus() {
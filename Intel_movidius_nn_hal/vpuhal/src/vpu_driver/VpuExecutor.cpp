@@ -162,7 +162,8 @@ static bool setInfoAndAllocateIfNeeded(RunTimeOperandInfo* info, const Shape& sh
 // by the caller.
 int VpuExecutor::run(const Model& model, const Request& request,
                      const std::vector<RunTimePoolInfo>& modelPoolInfos,
-                     const std::vector<RunTimePoolInfo>& requestPoolInfos) {
+                     const std::vector<RunTimePoolInfo>& requestPoolInfos,
+                     LatencyStats::Timer& timer) {
     VLOG(VPUEXE) << "VpuExecutor::run()";
     VLOG(VPUEXE) << "model: " << toString(model);
     VLOG(VPUEXE) << "request: " << toString(request);
@@ -203,8 +204,10 @@ int VpuExecutor::run(const Model& model, const Request& request,
     VLOG(VPUEXE) << "Output Num of Elements: " << output_num_elements;
 
     VLOG(VPUEXE) << "Got the input data request Starting to execute on VPU!";
+    timer.mark(LatencyStats::CONVERT_INPUTS);
 
     int val = ncs_execute((float*)network_input_buffer,input_num_elements,network_output_buffer, output_num_elements);
+    timer.mark(LatencyStats::INFER);
 
     if(val != 0)
       return ANEURALNETWORKS_OP_FAILED;
@@ -216,8 +219,8 @@ int VpuExecutor::run(const Model& model, const Request& request,
     free(network_input_buffer);
     free(network_output_buffer);
     nn_ops_vectors.clear();
+    timer.mark(LatencyStats::CONVERT_OUTPUTS);
 
-    
 
     for (auto runtimeInfo : modelPoolInfos) {
         runtimeInfo.update();
@@ -226,6 +229,7 @@ int VpuExecutor::run(const Model& model, const Request& request,
     for (auto runtimeInfo : requestPoolInfos) {
         runtimeInfo.update();
     }
+    timer.mark(LatencyStats::SYNC_POOLS);
 
     mModel = nullptr;
     mRequest = nullptr;
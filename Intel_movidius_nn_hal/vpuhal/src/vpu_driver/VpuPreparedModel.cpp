@@ -19,6 +19,7 @@
 
 #include "VpuPreparedModel.h"
 #include "VpuUtils.h"
+#include "ExecutionQueue.h"
 #include <string>
 #include <ctime>
 #include <android-base/logging.h>
@@ -57,6 +58,8 @@ namespace neuralnetworks {
 namespace V1_0 {
 namespace vpu_driver {
 
+using ::nnhal::ExecutionQueue;
+
 
 template <typename T>
 T getOperandConstVal(const Model& model, const Operand& operand)
@@ -182,6 +185,10 @@ bool VpuPreparedModel::initialize(const Model& model) {
       return false;
     }
 
+    char name[64];
+    snprintf(name, sizeof(name), "VPU model %p", this);
+    mLatency.reset(new LatencyStats(name));
+
     return true;
   }
 
@@ -1533,6 +1540,13 @@ bool VpuPreparedModel::validModel(const Model& model)
 }
 
 
+// Single NCS device, requests of all the models run one at a time.
+static ExecutionQueue& getExecutionQueue()
+{
+    static ExecutionQueue queue("vpu", 1, 32);
+    return queue;
+}
+
 // execute() function
 
 Return<ErrorStatus> VpuPreparedModel::execute(const Request& request,
@@ -1552,11 +1566,14 @@ Return<ErrorStatus> VpuPreparedModel::execute(const Request& request,
             return ErrorStatus::INVALID_ARGUMENT;
         }
 
-        // This thread is intentionally detached because the sample driver service
-        // is expected to live forever.
-        std::thread([this, request, callback]{ asyncExecute(request, callback); }).detach();
+        sp<VpuPreparedModel> self(this);
+        if (!getExecutionQueue().submit([self, request, callback]{
+                self->asyncExecute(request, callback); })) {
+            callback->notify(ErrorStatus::DEVICE_UNAVAILABLE);
+            return ErrorStatus::DEVICE_UNAVAILABLE;
+        }
 
-        ALOGD("Start execute thread done on VPU");
+        ALOGD("Request queued on VPU");
         return ErrorStatus::NONE;
 
 }
@@ -1576,20 +1593,25 @@ void VpuPreparedModel::deinitialize()
 
 void VpuPreparedModel::asyncExecute(const Request& request,
                                        const sp<IExecutionCallback>& callback) {
+    LatencyStats::Timer timer(mLatency.get());
     std::vector<RunTimePoolInfo> requestPoolInfos;
     if (!setRunTimePoolInfosFromHidlMemories(&requestPoolInfos, request.pools)) {
         callback->notify(ErrorStatus::GENERAL_FAILURE);
         return;
     }
+    timer.mark(LatencyStats::MAP_POOLS);
 
     VpuExecutor executor;
-    int n = executor.run(mModel, request, mPoolInfos, requestPoolInfos);
+    int n = executor.run(mModel, request, mPoolInfos, requestPoolInfos, timer);
     ErrorStatus executionStatus =
             n == ANEURALNETWORKS_NO_ERROR ? ErrorStatus::NONE : ErrorStatus::GENERAL_FAILURE;
     Return<void> returned = callback->notify(executionStatus);
     if (!returned.isOk()) {
         LOG(ERROR) << " hidl callback failed to return properly: " << returned.description();
     }
+    timer.mark(LatencyStats::NOTIFY);
+    // failed executions are left out of the latencies
+    if (n == ANEURALNETWORKS_NO_ERROR) timer.finish();
     VpuPreparedModel::network_count_ex = 0;
 }
 
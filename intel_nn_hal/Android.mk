@@ -12,12 +12,18 @@ LOCAL_MULTILIB := 64
 LOCAL_SRC_FILES := \
 	Driver.cpp \
 	PreparedModel.cpp \
+	PoolCache.cpp \
+	CompilationCache.cpp \
+	GraphDump.cpp \
+	LayerProfile.cpp \
 	Executor.cpp
 
 
 LOCAL_C_INCLUDES += \
 	$(LOCAL_PATH) \
-	$(LOCAL_PATH)/graphAPI
+	$(LOCAL_PATH)/graphAPI \
+	$(LOCAL_PATH)/fp16 \
+	$(LOCAL_PATH)/layout
 
 LOCAL_C_INCLUDES += \
 	$(LOCAL_PATH)/../../dldt/inference-engine/thirdparty/pugixml/src \
@@ -77,7 +83,8 @@ LOCAL_SHARED_LIBRARIES := \
 	android.hidl.memory@1.0 \
 	libinference_engine
 
-LOCAL_STATIC_LIBRARIES := libgraphAPI libpugixml libneuralnetworks_common
+LOCAL_STATIC_LIBRARIES := libgraphAPI libnnhal_layout libnnhal_fp16 libpugixml libneuralnetworks_common
+LOCAL_HEADER_LIBRARIES := libnnhal_common_headers
 
 include $(BUILD_SHARED_LIBRARY)
 ###############################################################
@@ -114,6 +121,8 @@ ZPATH := $(LOCAL_PATH)
 include $(CLEAR_VARS)
 
 include $(ZPATH)/graphAPI/graphAPI.mk
+include $(ZPATH)/fp16/fp16.mk
+include $(ZPATH)/layout/layout.mk
 include $(ZPATH)/graphTests/graphTests.mk
 include $(ZPATH)/dl/Android.mk
 #include $(ZPATH)/ncsdk2/api/src/Android.mk
@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CompilationCache"
+
+#include "CompilationCache.h"
+#include <android-base/properties.h>
+#include <dirent.h>
+#include <errno.h>
+#include <log/log.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <algorithm>
+#include <fstream>
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+// First line of the ports file, bump it when the entry format or the way the
+// HAL builds networks changes.
+static const char kFormat[] = "nnhal-compilation-cache 1";
+
+static const uint64_t kPrime1 = 11400714785074694791ULL;
+static const uint64_t kPrime2 = 14029467366897019727ULL;
+static const uint64_t kPrime3 = 1609587929392839161ULL;
+static const uint64_t kPrime4 = 9650029242287828579ULL;
+static const uint64_t kPrime5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t hashRound(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+    acc ^= hashRound(0, val);
+    return acc * kPrime1 + kPrime4;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* const end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        const uint8_t* const limit = end - 32;
+        uint64_t v1 = seed + kPrime1 + kPrime2;
+        uint64_t v2 = seed + kPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime1;
+        do {
+            v1 = hashRound(v1, read64(p));
+            v2 = hashRound(v2, read64(p + 8));
+            v3 = hashRound(v3, read64(p + 16));
+            v4 = hashRound(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + kPrime5;
+    }
+    h += size;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= hashRound(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+        h ^= uint64_t(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= (*p) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+static void append(std::string* s, const void* data, size_t size) {
+    s->append(static_cast<const char*>(data), size);
+}
+
+template <typename T>
+static void append(std::string* s, T value) {
+    append(s, &value, sizeof(value));
+}
+
+static void append(std::string* s, const hidl_vec<uint32_t>& vec) {
+    append(s, uint64_t(vec.size()));
+    append(s, vec.data(), vec.size() * sizeof(uint32_t));
+}
+
+CompilationCache& CompilationCache::get() {
+    static CompilationCache cache(
+        android::base::GetProperty("nn.hal.compile_cache_dir", ""),
+        android::base::GetUintProperty<uint32_t>("nn.hal.compile_cache_entries", 16));
+    return cache;
+}
+
+std::string CompilationCache::key(const Model& model, const Pools& pools,
+                                  const std::string& salt) {
+    // The structure of the model is small and goes in as is, the operand
+    // values and the pools only as their size and hash.
+    std::string bytes(kFormat);
+    bytes += '\n';
+    bytes += salt;
+    bytes += '\n';
+
+    append(&bytes, uint64_t(model.operands.size()));
+    for (const Operand& operand : model.operands) {
+        append(&bytes, uint32_t(operand.type));
+        append(&bytes, operand.dimensions);
+        append(&bytes, operand.numberOfConsumers);
+        append(&bytes, operand.scale);
+        append(&bytes, operand.zeroPoint);
+        append(&bytes, uint32_t(operand.lifetime));
+        append(&bytes, operand.location.poolIndex);
+        append(&bytes, operand.location.offset);
+        append(&bytes, operand.location.length);
+    }
+    append(&bytes, uint64_t(model.operations.size()));
+    for (const Operation& operation : model.operations) {
+        append(&bytes, uint32_t(operation.type));
+        append(&bytes, operation.inputs);
+        append(&bytes, operation.outputs);
+    }
+    append(&bytes, model.inputIndexes);
+    append(&bytes, model.outputIndexes);
+
+    append(&bytes, uint64_t(model.operandValues.size()));
+    append(&bytes, hashBytes(model.operandValues.data(), model.operandValues.size()));
+    append(&bytes, uint64_t(pools.size()));
+    for (const auto& pool : pools) {
+        append(&bytes, uint64_t(pool.second));
+        append(&bytes, hashBytes(pool.first, pool.second));
+    }
+
+    // two seeds, a 128-bit key
+    char name[33];
+    snprintf(name, sizeof(name), "%016llx%016llx",
+             (unsigned long long)hashBytes(bytes.data(), bytes.size(), 0),
+             (unsigned long long)hashBytes(bytes.data(), bytes.size(), kPrime5));
+    return name;
+}
+
+std::string CompilationCache::path(const std::string& key, const char* suffix) const {
+    return mDir + "/" + key + suffix;
+}
+
+bool CompilationCache::lookup(const std::string& key, Entry* entry) {
+    if (!enabled()) return false;
+    std::lock_guard<std::mutex> lock(mLock);
+
+    const std::string portsPath = path(key, ".ports");
+    std::ifstream ports(portsPath);
+    std::string line;
+    if (!ports || !std::getline(ports, line) || line != kFormat) return false;
+
+    entry->ports.clear();
+    uint32_t index;
+    std::string name;
+    while (ports >> index >> name) entry->ports[index] = name;
+
+    entry->xmlPath = path(key, ".xml");
+    entry->binPath = path(key, ".bin");
+    entry->blobPath = path(key, ".blob");
+    if (access(entry->blobPath.c_str(), R_OK) != 0) entry->blobPath.clear();
+    // the IR is kept with an exported network too, for when the import fails
+    if (access(entry->xmlPath.c_str(), R_OK) != 0 || access(entry->binPath.c_str(), R_OK) != 0) {
+        ALOGW("incomplete entry %s", key.c_str());
+        return false;
+    }
+
+    // the modification time of the ports file orders the entries for eviction
+    utime(portsPath.c_str(), nullptr);
+    return true;
+}
+
+bool CompilationCache::store(const std::string& key,
+                             const std::function<bool(const std::string&)>& write,
+                             const PortNames& ports) {
+    if (!enabled()) return false;
+    for (const auto& port : ports) {
+        if (port.second.empty() ||
+            port.second.find_first_of(" \t\n") != std::string::npos) {
+            ALOGW("can't store port name '%s'", port.second.c_str());
+            return false;
+        }
+    }
+
+    if (mkdir(mDir.c_str(), 0700) != 0 && errno != EEXIST) {
+        ALOGW("can't create %s: %s", mDir.c_str(), strerror(errno));
+        return false;
+    }
+
+    // written outside the lock, other models can still be looked up meanwhile
+    const std::string tmp = path(key, ".tmp") + std::to_string(getpid()) + "_" +
+                            std::to_string(gettid());
+    const char* suffixes[] = {".xml", ".bin", ".blob", ".ports"};
+    auto removeTmp = [&] {
+        for (const char* suffix : suffixes) unlink((tmp + suffix).c_str());
+    };
+
+    bool success = write(tmp);
+    if (success) {
+        std::ofstream out(tmp + ".ports");
+        out << kFormat << '\n';
+        for (const auto& port : ports) out << port.first << ' ' << port.second << '\n';
+        out.close();
+        success = !out.fail();
+    }
+    if (!success) {
+        ALOGW("failed to write entry %s", key.c_str());
+        removeTmp();
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    unlink(path(key, ".ports").c_str());
+    for (const char* suffix : suffixes) {
+        const std::string from = tmp + suffix;
+        const std::string to = path(key, suffix);
+        if (access(from.c_str(), F_OK) != 0) {
+            unlink(to.c_str());
+            continue;
+        }
+        // the ports file comes last in suffixes and completes the entry
+        if (rename(from.c_str(), to.c_str()) != 0) {
+            ALOGW("can't rename %s: %s", from.c_str(), strerror(errno));
+            removeTmp();
+            return false;
+        }
+    }
+    ALOGI("stored %s", key.c_str());
+
+    evict();
+    return true;
+}
+
+void CompilationCache::evict() {
+    DIR* dir = opendir(mDir.c_str());
+    if (dir == nullptr) return;
+
+    std::vector<std::pair<time_t, std::string>> entries;
+    static const std::string kPorts(".ports");
+    while (struct dirent* ent = readdir(dir)) {
+        std::string name(ent->d_name);
+        if (name.size() <= kPorts.size() ||
+            name.compare(name.size() - kPorts.size(), kPorts.size(), kPorts) != 0 ||
+            name.find(".tmp") != std::string::npos)
+            continue;
+        struct stat st;
+        if (stat((mDir + "/" + name).c_str(), &st) != 0) continue;
+        entries.emplace_back(st.st_mtime, name.substr(0, name.size() - kPorts.size()));
+    }
+    closedir(dir);
+
+    if (entries.size() <= mCapacity) return;
+    std::sort(entries.begin(), entries.end());
+    for (size_t i = 0; i + mCapacity < entries.size(); i++) {
+        const std::string& key = entries[i].second;
+        ALOGI("evicting %s", key.c_str());
+        unlink(path(key, ".ports").c_str());
+        unlink(path(key, ".xml").c_str());
+        unlink(path(key, ".bin").c_str());
+        unlink(path(key, ".blob").c_str());
+    }
+}
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
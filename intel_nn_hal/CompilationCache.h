@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_COMPILATION_CACHE_H
+#define ANDROID_ML_NN_COMPILATION_CACHE_H
+
+#include <android/hardware/neuralnetworks/1.0/types.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+// 64-bit xxHash of a buffer.
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+// Keeps the networks PreparedModel::initialize() builds on disk, so preparing a
+// model the service has seen before skips converting the operations. An entry
+// is keyed by a hash of the model (operands, operations, operand values and
+// the contents of its constant pools) and of a salt naming everything else the
+// built network depends on: the device, the plugin version and the HAL options.
+//
+// An entry holds the serialized IR (<key>.xml, <key>.bin), the executable
+// network exported by the plugin when the plugin can do that (<key>.blob), and
+// <key>.ports, the IR names of the model inputs and outputs. The ports file is
+// written last and marks the entry complete. At most `capacity` entries are
+// kept, the least recently used ones are removed when a new one is stored.
+class CompilationCache {
+public:
+    // (buffer, size) of each constant pool of the model
+    typedef std::vector<std::pair<const uint8_t*, size_t>> Pools;
+    // model input/output operand index -> IR data name
+    typedef std::map<uint32_t, std::string> PortNames;
+
+    struct Entry {
+        std::string xmlPath;
+        std::string binPath;
+        std::string blobPath;  // empty when the network was not exported
+        PortNames ports;
+    };
+
+    // An empty dir disables the cache.
+    explicit CompilationCache(const std::string& dir, size_t capacity = 16)
+          : mDir(dir), mCapacity(capacity) {}
+
+    // The cache shared by the prepared models, in the directory named by the
+    // nn.hal.compile_cache_dir property. Disabled when the property is not set.
+    static CompilationCache& get();
+
+    bool enabled() const { return !mDir.empty(); }
+
+    static std::string key(const Model& model, const Pools& pools, const std::string& salt);
+
+    bool lookup(const std::string& key, Entry* entry);
+
+    // write(base) creates base.xml, base.bin and optionally base.blob; they are
+    // written under a temporary name and moved in place with the port names.
+    bool store(const std::string& key, const std::function<bool(const std::string&)>& write,
+               const PortNames& ports);
+
+private:
+    std::string path(const std::string& key, const char* suffix) const;
+    void evict();
+
+    const std::string mDir;
+    const size_t mCapacity;
+    std::mutex mLock;
+};
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_COMPILATION_CACHE_H
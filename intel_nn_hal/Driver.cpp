@@ -24,6 +24,8 @@
 #endif
 #include <android-base/logging.h>
 #include <thread>
+#include "LatencyStats.h"
+#include "LayerProfile.h"
 #include "ValidateHal.h"
 
 namespace android {
@@ -102,6 +104,13 @@ Return<DeviceStatus> Driver::getStatus() {
     return DeviceStatus::AVAILABLE;
 }
 
+Return<void> Driver::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) return Void();
+    LatencyStats::dumpAll(fd->data[0]);
+    LayerProfile::dumpAll(fd->data[0]);
+    return Void();
+}
+
 Return<void> Driver::getCapabilities(getCapabilities_cb cb) {
     if (mName.compare("CPU") == 0) {
         ALOGI("Cpu driver getCapabilities()");
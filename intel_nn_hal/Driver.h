@@ -45,6 +45,9 @@ public:
     Return<DeviceStatus> getStatus() override;
     Return<void> getCapabilities(getCapabilities_cb _hidl_cb) override;
     Return<void> getSupportedOperations(const Model& model, getSupportedOperations_cb cb) override;
+    // `lshal debug` of the service: the execution latencies and the layer profiles
+    // of the prepared models
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
 protected:
     std::string mName;
 };
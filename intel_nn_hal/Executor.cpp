@@ -20,10 +20,16 @@
 #include <android-base/logging.h>
 #include <android/log.h>
 #include <log/log.h>
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <mutex>
 #include <thread>
+#include "ExecutionQueue.h"
+#include "GraphDump.h"
 #include "ValidateHal.h"
+#include "fp16.h"
+#include "layout.h"
 
 #define DISABLE_ALL_QUANT
 
@@ -35,6 +41,7 @@ namespace driver {
 namespace executor {
 
 using namespace android::nn;
+using ::nnhal::ExecutionQueue;
 
 // std::mutex g_num_mutex;
 
@@ -255,263 +262,6 @@ std::vector<uint32_t>& shapeToDims(const TensorDims& shape, Layout layout) {
     return dims;
 }
 
-unsigned short float2half(unsigned f) {
-    unsigned f_exp, f_sig;
-    unsigned short h_sgn, h_exp, h_sig;
-
-    h_sgn = (unsigned short)((f & 0x80000000u) >> 16);
-    f_exp = (f & 0x7f800000u);
-
-    /* Exponent overflow/NaN converts to signed inf/NaN */
-    if (f_exp >= 0x47800000u) {
-        if (f_exp == 0x7f800000u) {
-            /* Inf or NaN */
-            f_sig = (f & 0x007fffffu);
-            if (f_sig != 0) {
-                /* NaN - propagate the flag in the significand... */
-                unsigned short ret = (unsigned short)(0x7c00u + (f_sig >> 13));
-                /* ...but make sure it stays a NaN */
-                if (ret == 0x7c00u) {
-                    ret++;
-                }
-                return h_sgn + ret;
-            } else {
-                /* signed inf */
-                return (unsigned short)(h_sgn + 0x7c00u);
-            }
-        } else {
-            /* overflow to signed inf */
-#if NPY_HALF_GENERATE_OVERFLOW
-            npy_set_floatstatus_overflow();
-#endif
-            return (unsigned short)(h_sgn + 0x7c00u);
-        }
-    }
-
-    /* Exponent underflow converts to a subnormal half or signed zero */
-    if (f_exp <= 0x38000000u) {
-        /*
-         * Signed zeros, subnormal floats, and floats with small
-         * exponents all convert to signed zero halfs.
-         */
-        if (f_exp < 0x33000000u) {
-#if NPY_HALF_GENERATE_UNDERFLOW
-            /* If f != 0, it underflowed to 0 */
-            if ((f & 0x7fffffff) != 0) {
-                npy_set_floatstatus_underflow();
-            }
-#endif
-            return h_sgn;
-        }
-        /* Make the subnormal significand */
-        f_exp >>= 23;
-        f_sig = (0x00800000u + (f & 0x007fffffu));
-#if NPY_HALF_GENERATE_UNDERFLOW
-        /* If it's not exactly represented, it underflowed */
-        if ((f_sig & (((unsigned)1 << (126 - f_exp)) - 1)) != 0) {
-            npy_set_floatstatus_underflow();
-        }
-#endif
-        f_sig >>= (113 - f_exp);
-        /* Handle rounding by adding 1 to the bit beyond half precision */
-#if NPY_HALF_ROUND_TIES_TO_EVEN
-        /*
-         * If the last bit in the half significand is 0 (already even), and
-         * the remaining bit pattern is 1000...0, then we do not add one
-         * to the bit after the half significand.  In all other cases, we do.
-         */
-        if ((f_sig & 0x00003fffu) != 0x00001000u) {
-            f_sig += 0x00001000u;
-        }
-#else
-        f_sig += 0x00001000u;
-#endif
-        h_sig = (unsigned short)(f_sig >> 13);
-        /*
-         * If the rounding causes a bit to spill into h_exp, it will
-         * increment h_exp from zero to one and h_sig will be zero.
-         * This is the correct result.
-         */
-        return (unsigned short)(h_sgn + h_sig);
-    }
-
-    /* Regular case with no overflow or underflow */
-    h_exp = (unsigned short)((f_exp - 0x38000000u) >> 13);
-    /* Handle rounding by adding 1 to the bit beyond half precision */
-    f_sig = (f & 0x007fffffu);
-#if NPY_HALF_ROUND_TIES_TO_EVEN
-    /*
-     * If the last bit in the half significand is 0 (already even), and
-     * the remaining bit pattern is 1000...0, then we do not add one
-     * to the bit after the half significand.  In all other cases, we do.
-     */
-    if ((f_sig & 0x00003fffu) != 0x00001000u) {
-        f_sig += 0x00001000u;
-    }
-#else
-    f_sig += 0x00001000u;
-#endif
-    h_sig = (unsigned short)(f_sig >> 13);
-    /*
-     * If the rounding causes a bit to spill into h_exp, it will
-     * increment h_exp by one and h_sig will be zero.  This is the
-     * correct result.  h_exp may increment to 15, at greatest, in
-     * which case the result overflows to a signed inf.
-     */
-#if NPY_HALF_GENERATE_OVERFLOW
-    h_sig += h_exp;
-    if (h_sig == 0x7c00u) {
-        npy_set_floatstatus_overflow();
-    }
-    return h_sgn + h_sig;
-#else
-    return h_sgn + h_exp + h_sig;
-#endif
-}
-void floattofp16(short* dst, float* src, unsigned nelem) {
-    unsigned i;
-    unsigned short* _dst = (unsigned short*)dst;
-    unsigned* _src = (unsigned*)src;
-
-    for (i = 0; i < nelem; i++) _dst[i] = float2half(_src[i]);
-}
-
-// Function to convert F32 into F16
-// F32: exp_bias:127 SEEEEEEE EMMMMMMM MMMMMMMM MMMMMMMM.
-// F16: exp_bias:15  SEEEEEMM MMMMMMMM
-#define EXP_MASK_F32 0x7F800000U
-#define EXP_MASK_F16 0x7C00U
-
-// small helper function to represent uint32_t value as float32
-float asfloat(uint32_t v) { return *reinterpret_cast<float*>(&v); }
-
-// Function to convert F32 into F16
-float f16tof32(short x) {
-    // this is storage for output result
-    uint32_t u = x;
-
-    // get sign in 32bit format
-    uint32_t s = ((u & 0x8000) << 16);
-
-    // check for NAN and INF
-    if ((u & EXP_MASK_F16) == EXP_MASK_F16) {
-        // keep mantissa only
-        u &= 0x03FF;
-
-        // check if it is NAN and raise 10 bit to be align with intrin
-        if (u) {
-            u |= 0x0200;
-        }
-
-        u <<= (23 - 10);
-        u |= EXP_MASK_F32;
-        u |= s;
-    } else if ((x & EXP_MASK_F16) ==
-               0) {  // check for zero and denormals. both are converted to zero
-        u = s;
-    } else {
-        // abs
-        u = (u & 0x7FFF);
-
-        // shift mantissa and exp from f16 to f32 position
-        u <<= (23 - 10);
-
-        // new bias for exp (f16 bias is 15 and f32 bias is 127)
-        u += ((127 - 15) << 23);
-
-        // add sign
-        u |= s;
-    }
-
-    // finaly represent result as float and return
-    return *reinterpret_cast<float*>(&u);
-}
-
-// This function convert f32 to f16 with rounding to nearest value to minimize error
-// the denormal values are converted to 0.
-short f32tof16(float x) {
-    // create minimal positive normal f16 value in f32 format
-    // exp:-14,mantissa:0 -> 2^-14 * 1.0
-    static float min16 = asfloat((127 - 14) << 23);
-
-    // create maximal positive normal f16 value in f32 and f16 formats
-    // exp:15,mantissa:11111 -> 2^15 * 1.(11111)
-    static float max16 = asfloat(((127 + 15) << 23) | 0x007FE000);
-    static uint32_t max16f16 = ((15 + 15) << 10) | 0x3FF;
-
-    // define and declare variable for intermidiate and output result
-    // the union is used to simplify representation changing
-    union {
-        float f;
-        uint32_t u;
-    } v;
-    v.f = x;
-
-    // get sign in 16bit format
-    uint32_t s = (v.u >> 16) & 0x8000;  // sign 16:  00000000 00000000 10000000 00000000
-
-    // make it abs
-    v.u &= 0x7FFFFFFF;  // abs mask: 01111111 11111111 11111111 11111111
-
-    // check NAN and INF
-    if ((v.u & EXP_MASK_F32) == EXP_MASK_F32) {
-        if (v.u & 0x007FFFFF) {
-            return s | (v.u >> (23 - 10)) | 0x0200;  // return NAN f16
-        } else {
-            return s | (v.u >> (23 - 10));  // return INF f16
-        }
-    }
-
-    // to make f32 round to nearest f16
-    // create halfULP for f16 and add it to origin value
-    float halfULP = asfloat(v.u & EXP_MASK_F32) * asfloat((127 - 11) << 23);
-    v.f += halfULP;
-
-    // if input value is not fit normalized f16 then return 0
-    // denormals are not covered by this code and just converted to 0
-    if (v.f < min16 * 0.5F) {
-        return s;
-    }
-
-    // if input value between min16/2 and min16 then return min16
-    if (v.f < min16) {
-        return s | (1 << 10);
-    }
-
-    // if input value more than maximal allowed value for f16
-    // then return this maximal value
-    if (v.f >= max16) {
-        return max16f16 | s;
-    }
-
-    // change exp bias from 127 to 15
-    v.u -= ((127 - 15) << 23);
-
-    // round to f16
-    v.u >>= (23 - 10);
-
-    return v.u | s;
-}
-
-void f16tof32Arrays(float* dst, const short* src, uint32_t& nelem, float scale = 1,
-                    float bias = 0) {
-    VLOG(L1, "convert f16tof32Arrays...\n");
-    const short* _src = reinterpret_cast<const short*>(src);
-
-    for (uint32_t i = 0; i < nelem; i++) {
-        dst[i] = f16tof32(_src[i]) * scale + bias;
-    }
-}
-
-void f32tof16Arrays(short* dst, const float* src, uint32_t& nelem, float scale = 1,
-                    float bias = 0) {
-    VLOG(L1, "convert f32tof16Arrays...");
-    for (uint32_t i = 0; i < nelem; i++) {
-        dst[i] = f32tof16(src[i] * scale + bias);
-        // VLOG(L1, "element no: %d", i);
-    }
-}
-
 int sizeOfData(OperandType type, std::vector<uint32_t> dims) {
     int size;
     switch (type) {
@@ -537,10 +287,6 @@ int sizeOfData(OperandType type, std::vector<uint32_t> dims) {
     return size;
 }
 
-inline size_t getSizeFromInts(int lower, int higher) {
-    return (uint32_t)(lower) + ((uint64_t)(uint32_t)(higher) << 32);
-}
-
 template <typename T>
 T getScalarData(const RunTimeOperandInfo& info) {
     // TODO: Check buffer is at least as long as size of data.
@@ -551,37 +297,13 @@ T getScalarData(const RunTimeOperandInfo& info) {
 // TODO: short term, make share memory mapping and updating a utility function.
 // TODO: long term, implement mmap_fd as a hidl IMemory service.
 
-bool RunTimePoolInfo::set(const hidl_memory& hidlMemory) {
+bool RunTimePoolInfo::set(const hidl_memory& hidlMemory, PoolCache* cache) {
     this->hidlMemory = hidlMemory;
-    auto memType = hidlMemory.name();
-    if (memType == "ashmem") {
-        memory = mapMemory(hidlMemory);
-        if (memory == nullptr) {
-            LOG(ERROR) << "Can't map shared memory.";
-            return false;
-        }
-        memory->update();
-        buffer = reinterpret_cast<uint8_t*>(static_cast<void*>(memory->getPointer()));
-        if (buffer == nullptr) {
-            LOG(ERROR) << "Can't access shared memory.";
-            return false;
-        }
-        return true;
-    } else if (memType == "mmap_fd") {
-        size_t size = hidlMemory.size();
-        int fd = hidlMemory.handle()->data[0];
-        int prot = hidlMemory.handle()->data[1];
-        size_t offset = getSizeFromInts(hidlMemory.handle()->data[2], hidlMemory.handle()->data[3]);
-        buffer = static_cast<uint8_t*>(mmap(nullptr, size, prot, MAP_SHARED, fd, offset));
-        if (buffer == MAP_FAILED) {
-            LOG(ERROR) << "Can't mmap the file descriptor.";
-            return false;
-        }
-        return true;
-    } else {
-        LOG(ERROR) << "unsupported hidl_memory type";
-        return false;
-    }
+    mapping = cache != nullptr ? cache->acquire(hidlMemory) : mapPool(hidlMemory);
+    if (mapping == nullptr) return false;
+    memory = mapping->memory;
+    buffer = mapping->buffer;
+    return true;
 }
 
 // Making sure the output data are correctly updated after execution.
@@ -602,11 +324,11 @@ bool RunTimePoolInfo::update() {
 }
 
 bool setRunTimePoolInfosFromHidlMemories(std::vector<RunTimePoolInfo>* poolInfos,
-                                         const hidl_vec<hidl_memory>& pools) {
+                                         const hidl_vec<hidl_memory>& pools, PoolCache* cache) {
     poolInfos->resize(pools.size());
     for (size_t i = 0; i < pools.size(); i++) {
         auto& poolInfo = (*poolInfos)[i];
-        if (!poolInfo.set(pools[i])) {
+        if (!poolInfo.set(pools[i], cache)) {
             LOG(ERROR) << "Could not map pool";
             return false;
         }
@@ -736,13 +458,13 @@ OutputPort Executor::handleFusion(const OutputPort& out, int32_t fusedOp) {
     VLOG(L1, "fusedOp: %d", fusedOp);
     if (fusedOp == (int32_t)FusedActivationFunc::RELU) {
         VLOG(L1, "fusedOp is RELU");
-        return ReLU(out);
+        return ReLU(mNet.context(), out);
     } else if (fusedOp == (int32_t)FusedActivationFunc::RELU1) {
         VLOG(L1, "fusedOp is RELU1");
-        return Clamp(out, -1, 1);
+        return Clamp(mNet.context(), out, -1, 1);
     } else if (fusedOp == (int32_t)FusedActivationFunc::RELU6) {
         VLOG(L1, "fusedOp is RELU6");
-        return Clamp(out, 0, 6);
+        return Clamp(mNet.context(), out, 0, 6);
     }
 
     VLOG(L1, "No ActivationFunc");
@@ -1012,8 +734,13 @@ bool Executor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& modelPo
         }
     }
 
+    return updateRunTimeInfo(requestPoolInfos);
+}
+
+bool Executor::updateRunTimeInfo(const std::vector<RunTimePoolInfo>& requestPoolInfos) {
     // Adjust the runtime info for the arguments passed to the model,
     // modifying the buffer location, and possibly the dimensions.
+    // This is done for every request, the model operands are only set up once.
 
     auto updateForArguments = [this, &requestPoolInfos](
                                   const std::vector<uint32_t>& indexes,
@@ -1033,7 +760,8 @@ bool Executor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& modelPo
             }
             if (from.hasNoValue) {
                 to.lifetime = OperandLifeTime::NO_VALUE;
-                nnAssert(to.buffer == nullptr);
+                // may still point into the pools of the previous request
+                to.buffer = nullptr;
             } else {
                 auto poolIndex = from.location.poolIndex;
                 nnAssert(poolIndex < requestPoolInfos.size());
@@ -1048,6 +776,23 @@ bool Executor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& modelPo
     return true;
 }
 
+bool Executor::isCompatible(const Request& request) const {
+    if (!mPrepared) return true;
+
+    auto sameDims = [this](const std::vector<uint32_t>& indexes,
+                           const hidl_vec<RequestArgument>& arguments) {
+        if (indexes.size() != arguments.size()) return false;
+        for (size_t i = 0; i < indexes.size(); i++) {
+            const RequestArgument& from = arguments[i];
+            if (from.dimensions.size() > 0 && from.dimensions != mOperands[indexes[i]].dimensions)
+                return false;
+        }
+        return true;
+    };
+    return sameDims(mModel->inputIndexes, request.inputs) &&
+           sameDims(mModel->outputIndexes, request.outputs);
+}
+
 bool Executor::executeOperation(const Operation& operation) {
     VLOG(L1, "get operation %d ready to add", operation.type);
 
@@ -1203,22 +948,53 @@ void printOperandbuf(int level, const uint8_t* buffer, const std::vector<uint32_
 
 #endif
 
+bool Executor::prepare(const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                       const std::vector<RunTimePoolInfo>& requestPoolInfos) {
+    VLOG(L1, "prepare");
+
+    if (!initializeRunTimeInfo(modelPoolInfos, requestPoolInfos)) {
+        ALOGE("initializeRunTimeInfo failed");
+        return false;
+    }
+
+    // The model has serialized the operation in execution order.
+    for (const auto& operation : mModel->operations) {
+        if (!executeOperation(operation)) return false;
+    }
+
+    initializeInput();
+    finalizeOutput();
+
+    mNet.buildNetwork();
+    // debug graph, nn.hal.dump_graph
+    dumpGraph(mNet, InferenceEngine::TargetDeviceInfo::name(mTargetDevice));
+
+    VLOG(L1, "initialize ExecuteNetwork for device %s",
+         InferenceEngine::TargetDeviceInfo::name(mTargetDevice));
+    enginePtr = new ExecuteNetwork(mNet, mTargetDevice);
+    enginePtr->prepareInput();
+    enginePtr->loadNetwork();
+
+    mPrepared = true;
+    return true;
+}
+
 int Executor::run(const Model& model, const Request& request,
                   std::vector<RunTimePoolInfo>& modelPoolInfos,
                   std::vector<RunTimePoolInfo>& requestPoolInfos) {
     VLOG(L1, "run");
 
     mModel = &model;
-    mRequest = &request;  // TODO check if mRequest is needed
+    mRequest = &request;
 
-    initializeRunTimeInfo(modelPoolInfos, requestPoolInfos);
-
-    // The model has serialized the operation in execution order.
-    for (const auto& operation : mModel->operations) {
-        bool n = executeOperation(operation);
-        if (n) {
-            // return n;
+    if (!mPrepared) {
+        if (!prepare(modelPoolInfos, requestPoolInfos)) {
+            VLOG(L1, "failed to build the execution plan");
+            mRequest = nullptr;
+            return -1;
         }
+    } else {
+        updateRunTimeInfo(requestPoolInfos);
     }
 
     auto inOutData = [this, &requestPoolInfos](const std::vector<uint32_t>& indexes,
@@ -1261,23 +1037,6 @@ int Executor::run(const Model& model, const Request& request,
         }
     };
 
-    initializeInput();
-    finalizeOutput();
-
-    mNet.buildNetwork();
-    std::fstream dot;
-    std::string graphfile("/data/local/graphfile");
-    dot.open("/data/local/graph.dot", std::ios::out);
-    mNet.save(graphfile);
-    mNet.crateDotFile(dot);
-    dot.close();
-
-    VLOG(L1, "initialize ExecuteNetwork for device %s",
-         InferenceEngine::TargetDeviceInfo::name(mTargetDevice));
-    enginePtr = new ExecuteNetwork(mNet, mTargetDevice);
-    enginePtr->prepareInput();
-    enginePtr->loadNetwork();
-
     VLOG(L1, "pass request inputs/outputs buffer to network/model respectively");
 
     inOutData(mModel->inputIndexes, request.inputs, true, enginePtr, mPorts);
@@ -1286,7 +1045,12 @@ int Executor::run(const Model& model, const Request& request,
     VLOG(L1, "Run");
 
     // auto output = execute.Infer(input).wait();
-    enginePtr->Infer();
+    StatusCode status = enginePtr->Infer();
+    if (status != StatusCode::OK) {
+        VLOG(L1, "infer failed with status %d", status);
+        mRequest = nullptr;
+        return -1;
+    }
 
     //    VLOG(L1, "copy model output to request output");
 
@@ -1348,7 +1112,6 @@ int Executor::run(const Model& model, const Request& request,
     }
 #endif
 
-    mModel = nullptr;
     mRequest = nullptr;
 
     VLOG(L1, "Completed run normally");
@@ -1381,18 +1144,20 @@ bool Executor::operationAdd(const Operation& operation) {
     VLOG(L1, "isIn0Const = %d isIn1Const = %d \n", isIn0Const, isIn1Const);
     if (isIn0Const || isIn1Const) {
         if (isIn0Const && isIn1Const) {
-            VLOG(L1, "adding 2 constants, we can do it now and put const as output");
-            nnAssert(true);
-        }
-        // this will use ScaleShift
-        if (isIn0Const)  // if op.inputs[1] is a Model input
+            // the const folding pass of the document replaces the sum by its value
+            VLOG(L1, "adding 2 constants, folded to one const when the network is built");
+            auto in0 = GetConstOperandAsTensor(operation.inputs[0]);
+            auto in1 = GetConstOperandAsTensor(operation.inputs[1]);
+            out = Sum(mNet.context(), Const(mNet, in0, in0->getTensorDesc().getDims()),
+                      Const(mNet, in1, in1->getTensorDesc().getDims()));
+        } else if (isIn0Const)  // if op.inputs[1] is a Model input
             out = AddConst(mNet, getPort(operation.inputs[1]),
                            GetConstOperandAsTensor(operation.inputs[0]));
         else  // isIn1Const is const //op.inputs[0] is a Model input
             out = AddConst(mNet, getPort(operation.inputs[0]),
                            GetConstOperandAsTensor(operation.inputs[1]));
     } else {  // both inputs[0] & inputs[1] are model inputs
-        out = getPort(operation.inputs[0]) + getPort(operation.inputs[1]);
+        out = Sum(mNet.context(), getPort(operation.inputs[0]), getPort(operation.inputs[1]));
     }
     // check fusion
     VLOG(L1, "check fusion parameter = %d\n", PARAM_I32(2));
@@ -1548,7 +1313,7 @@ bool Executor::operationAveragePool2D(const Operation& operation) {
         }
     }
 
-    auto out = Pooling(input, kernel, stride, pad_start, pad_end, padType,
+    auto out = Pooling(mNet.context(), input, kernel, stride, pad_start, pad_end, padType,
                        InferenceEngine::PoolingLayer::PoolType::AVG);
     mPorts[operation.outputs[0]] = handleFusion(out, PARAM_I32(fusion_index));
 
@@ -1645,7 +1410,7 @@ bool Executor::operationMaxPool2D(const Operation& operation) {
         }
     }
 
-    auto out = Pooling(input, kernel, stride, pad_start, pad_end, padType,
+    auto out = Pooling(mNet.context(), input, kernel, stride, pad_start, pad_end, padType,
                        InferenceEngine::PoolingLayer::PoolType::MAX);
     mPorts[operation.outputs[0]] = handleFusion(out, PARAM_I32(fusion_index));
 
@@ -1664,7 +1429,7 @@ bool Executor::operationConCat(const Operation& operation) {
     auto n = operation.inputs.size() - 2;
     std::vector<OutputPort> inputs;
     for (int i = 0; i < n; i++) inputs.push_back(getPort(operation.inputs[i]));
-    auto out = Concat(inputs, PARAM_I32(n));
+    auto out = Concat(mNet.context(), inputs, PARAM_I32(n));
     mPorts[operation.outputs[0]] = handleFusion(out, PARAM_I32(n + 1));
 
     return true;
@@ -1913,7 +1678,7 @@ bool Executor::operationConv2D(const Operation& operation) {
 
     // auto out = Convolution(input, prms) + bias;
     prms.biases = static_cast<IRBlob::Ptr>(bias);
-    auto out = Convolution(input, prms);
+    auto out = Convolution(mNet.context(), input, prms);
 
     if (fusion_index < 0) {
         VLOG(L1, "invalid fusion index");
@@ -2186,7 +1951,7 @@ bool Executor::operationDepthwiseConv2D(const Operation& operation) {
 
     // auto out = Convolution(input, prms) + bias;
     prms.biases = static_cast<IRBlob::Ptr>(bias);
-    auto out = Convolution(input, prms);
+    auto out = Convolution(mNet.context(), input, prms);
 
     if (fusion_index < 0) {
         VLOG(L1, "invalid fusion index");
@@ -2305,7 +2070,7 @@ bool Executor::operationFullyConnected(const Operation& operation) {
                  strechDim, outDims[strechDim]);
         }
 
-        input = Reshape(outDims, input);
+        input = Reshape(mNet.context(), outDims, input);
 
         /*
                 //Reshape
@@ -2357,7 +2122,7 @@ bool Executor::operationFullyConnected(const Operation& operation) {
         weights->getTensorDesc().setDims(dims);
         //WA end
     */
-    auto out = weights * input + bias;
+    auto out = AddTryConst(mNet.context(), FullyConnected(mNet.context(), weights, input), bias);
 
     mPorts[operation.outputs[0]] = handleFusion(out, PARAM_I32(3));
 
@@ -2381,7 +2146,7 @@ bool Executor::operationL2Normalization(const Operation& operation) {
      */
     // mPorts[operation.outputs[0]] = L2Normalization(getPort(operation.inputs[0]), true, false);
     mPorts[operation.outputs[0]] =
-        L2Normalization(getPort(operation.inputs[0]), false, false);  // passing accross false
+        L2Normalization(mNet.context(), getPort(operation.inputs[0]), false, false);  // passing accross false
     return true;
 }
 
@@ -2402,14 +2167,14 @@ bool Executor::operationLRN(const Operation& operation) {
     int size = PARAM_I32(1);
     float k = PARAM_FP(2);
     // mPorts[operation.outputs[0]] = LRN(getPort(operation.inputs[0]), alpha, beta, size, true, k);
-    mPorts[operation.outputs[0]] = LRN(getPort(operation.inputs[0]), alpha, beta, size, false, k);
+    mPorts[operation.outputs[0]] = LRN(mNet.context(), getPort(operation.inputs[0]), alpha, beta, size, false, k);
 
     return true;
 }
 
 bool Executor::operationLogisticSigmoid(const Operation& operation) {
     VLOG(L1, "OperationType::LOGISTIC");
-    mPorts[operation.outputs[0]] = Sigmoid(getPort(operation.inputs[0]));
+    mPorts[operation.outputs[0]] = Sigmoid(mNet.context(), getPort(operation.inputs[0]));
 
     return true;
 }
@@ -2424,13 +2189,14 @@ bool Executor::operationLSTM(const Operation& operation)
 */
 bool Executor::operationMUL(const Operation& operation) {
     mPorts[operation.outputs[0]] =
-        handleFusion(getPort(operation.inputs[0]) * getPort(operation.inputs[1]), PARAM_I32(2));
+        handleFusion(Mul(mNet.context(), getPort(operation.inputs[0]), getPort(operation.inputs[1])),
+                     PARAM_I32(2));
     return true;
 }
 
 bool Executor::operationRELU(const Operation& operation) {
     VLOG(L1, "OperationType::RELU");
-    mPorts[operation.outputs[0]] = ReLU(getPort(operation.inputs[0]));
+    mPorts[operation.outputs[0]] = ReLU(mNet.context(), getPort(operation.inputs[0]));
     return true;
 }
 
@@ -2453,7 +2219,7 @@ bool Executor::operationRELU1(const Operation& operation) {
      * 0: The output tensor of same shape as input0.
      */
 
-    mPorts[operation.outputs[0]] = Clamp(getPort(operation.inputs[0]), -1, 1);
+    mPorts[operation.outputs[0]] = Clamp(mNet.context(), getPort(operation.inputs[0]), -1, 1);
     return true;
 }
 
@@ -2476,7 +2242,7 @@ bool Executor::operationRELU6(const Operation& operation) {
      * 0: The output tensor of same shape as input0.
      */
 
-    mPorts[operation.outputs[0]] = Clamp(getPort(operation.inputs[0]), 0, 6);
+    mPorts[operation.outputs[0]] = Clamp(mNet.context(), getPort(operation.inputs[0]), 0, 6);
     return true;
 }
 
@@ -2547,7 +2313,7 @@ bool Executor::operationReshape(const Operation& operation) {
         nnAssert(false);
     }
     // Note: " error [VPU] Unsupported 1 D dimensions" for reshape output and fix me
-    mPorts[operation.outputs[0]] = Reshape(outDims, input);
+    mPorts[operation.outputs[0]] = Reshape(mNet.context(), outDims, input);
 
     return true;
 }
@@ -2612,7 +2378,7 @@ bool Executor::operationSoftmax(const Operation& operation) {
         }
     */
 
-    mPorts[operation.outputs[0]] = Softmax(input);
+    mPorts[operation.outputs[0]] = Softmax(mNet.context(), input);
     float beta /*scale*/ = PARAM_FP(1);
     /*
         if (scale != 1.0f) {
@@ -2632,7 +2398,7 @@ bool Executor::operationSoftmax(const Operation& operation) {
 
 bool Executor::operationTANH(const Operation& operation) {
     VLOG(L1, "OperationType::TANH");
-    mPorts[operation.outputs[0]] = Tanh(getPort(operation.inputs[0]));
+    mPorts[operation.outputs[0]] = Tanh(mNet.context(), getPort(operation.inputs[0]));
 
     return true;
 }
@@ -2746,86 +2512,37 @@ IRBlob::Ptr VpuExecutor::GetConstWeightsOperandAsTensor(uint32_t index) {
 #ifndef MYRIAD_FP32  // Myriad only supprts FP16
         vec<unsigned int> order;
         Layout layout;
-        Layout input_layout;
         if (op.dimensions.size() == 4) {
-            order = {3, 0, 1, 2};         // IHWO -> OIHW for depth conv
-            layout = Layout::OIHW;        // weights layout
-            input_layout = Layout::NHWC;  // same memory layout as OHWI
+            order = {3, 0, 1, 2};   // IHWO -> OIHW for depth conv
+            layout = Layout::OIHW;  // weights layout
         } else if (op.dimensions.size() == 2) {
             order = {0, 1};
             layout = Layout::NC;
-            input_layout = Layout::NC;
         } else {
             order = {0};  //(op.dimensions.size() < 2)
             layout = Layout::C;
-            input_layout = Layout::C;
         }
 
         auto inputDims = toDims(op.dimensions);
-        TensorDesc td(InferenceEngine::Precision::FP16, inputDims, input_layout);
-        // todo: create a readOnly blob that accepts const pointers
-        InferenceEngine::TBlob<short>::Ptr blob =
-            std::make_shared<InferenceEngine::TBlob<short>>(td);
-        blob->allocate();
-        auto mem = blob->data();
-        short* fp16Array = mem.as<short*>();
-        // convert from [(float *)buf, len] to fp16Array,
         uint32_t nelem = getNumberOfElements(op.dimensions);
-        // short *inputFilter_fp16 = new short[nelem];
-
         size_t fp16Array_length = nelem * sizeof(short);
 
-        VLOGDIMS(L1, permuteDims(toDims(op.dimensions), order), "weights/bias dims");
+        VLOGDIMS(L1, permuteDims(inputDims, order), "weights/bias dims");
         VLOG(L1,
              "Model buffer oplength = %d bytes nelem= %d fp16Array_length= %d bytes sizeof model "
              "buf= %d bytes\n",
              len, nelem, fp16Array_length, sizeof(buf));
 
-        f32tof16Arrays(fp16Array, (float*)buf, nelem);  // OHWI memory layout
-        // floattofp16(fp16Array, (float *)buf, nelem);
-
-        if (inputDims.size() != 4) {
-            // InferenceEngine::TBlob<short>::Ptr blob =
-            // std::make_shared<InferenceEngine::TBlob<short>>(td,(short *)inputFilter_fp16,
-            // fp16Array_length);
-            return blob;
-        } else {
-            TensorDesc td(InferenceEngine::Precision::FP16, permuteDims(inputDims, order), layout);
-            InferenceEngine::TBlob<short>::Ptr blob_oihw =
-                std::make_shared<InferenceEngine::TBlob<short>>(td);
-            blob_oihw->allocate();
-
-            auto dims_ohwi = inputDims;  // toDims(op.dimensions);
-            size_t out_depth = dims_ohwi[0];
-            size_t in_depth = dims_ohwi[3];
-            size_t height = dims_ohwi[1];
-            size_t width = dims_ohwi[2];
-            size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-            // const short* inputFilter = reinterpret_cast<const short *>(buf); //OHWI memory layout
-
-            for (size_t i = 0; i < in_depth; i++) {
-                for (size_t o = 0; o < out_depth; o++) {
-                    for (size_t h = 0; h < height; h++) {
-                        for (size_t w = 0; w < width; w++) {
-                            size_t offset_ohwi = o * height * width * in_depth +
-                                                 h * width * in_depth + w * in_depth +
-                                                 i;  // similar to NHWC memory layout
-                            // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)] =
-                            // inputFilter[offset_ohwi];
-                            blob_oihw->buffer().as<short*>()[offset++] =
-                                blob->buffer().as<short*>()[offset_ohwi];
-                            // size_t offset_oihw = o*in_depth*height*width + i*height*width +
-                            // h*width + w; //similar to NCHW memory layout
-                            // blob->buffer().as<float*>()[offset_oihw] = inputFilter[offset_ohwi];
-                            // VLOG(L1, "offset_ohwi= %d offset_oihw= %d", offset_ohwi,
-                            // offset_oihw);
-                        }
-                    }
-                }
-            }
+        // convert from [(float *)buf, len] straight into the final layout; the model buffer has
+        // NHWC memory layout and is read only once
+        TensorDesc td(InferenceEngine::Precision::FP16, permuteDims(inputDims, order), layout);
+        InferenceEngine::TBlob<short>::Ptr blob =
+            std::make_shared<InferenceEngine::TBlob<short>>(td);
+        blob->allocate();
+        layout::permuteToFp16(blob->buffer().as<short*>(), reinterpret_cast<const float*>(buf),
+                              inputDims, order);
 
-            return blob_oihw;
-        }
+        return blob;
 
 #else  // FP32 support
         vec<unsigned int> order;
@@ -2879,86 +2596,37 @@ IRBlob::Ptr VpuExecutor::GetConstOperandAsTensor(uint32_t index) {
 
         vec<unsigned int> order;
         Layout layout;
-        Layout input_layout;
         if (op.dimensions.size() == 4) {
-            order = {0, 3, 1, 2};         // nhwc -> nchw
-            layout = Layout::OIHW;        // weights layout
-            input_layout = Layout::NHWC;  // same memory layout as OHWI
+            order = {0, 3, 1, 2};   // nhwc -> nchw
+            layout = Layout::OIHW;  // weights layout
         } else if (op.dimensions.size() == 2) {
             order = {0, 1};
             layout = Layout::NC;
-            input_layout = Layout::NC;
         } else {
             order = {0};  //(op.dimensions.size() < 2)
             layout = Layout::C;
-            input_layout = Layout::C;
         }
 
         auto inputDims = toDims(op.dimensions);
-        TensorDesc td(InferenceEngine::Precision::FP16, inputDims, input_layout);
-        // todo: create a readOnly blob that accepts const pointers
-        InferenceEngine::TBlob<short>::Ptr blob =
-            std::make_shared<InferenceEngine::TBlob<short>>(td);
-        blob->allocate();
-        auto mem = blob->data();
-        short* fp16Array = mem.as<short*>();
-        // convert from [(float *)buf, len] to fp16Array,
         uint32_t nelem = getNumberOfElements(op.dimensions);
-        // short *inputFilter_fp16 = new short[nelem];
-
         size_t fp16Array_length = nelem * sizeof(short);
 
-        VLOGDIMS(L1, permuteDims(toDims(op.dimensions), order), "weights/bias dims");
+        VLOGDIMS(L1, permuteDims(inputDims, order), "weights/bias dims");
         VLOG(L1,
              "Model buffer oplength = %d bytes nelem= %d fp16Array_length= %d bytes sizeof model "
              "buf= %d bytes\n",
              len, nelem, fp16Array_length, sizeof(buf));
 
-        f32tof16Arrays(fp16Array, (float*)buf, nelem);  // OHWI memory layout
-        // floattofp16(fp16Array, (float *)buf, nelem);
-
-        if (inputDims.size() != 4) {
-            // InferenceEngine::TBlob<short>::Ptr blob =
-            // std::make_shared<InferenceEngine::TBlob<short>>(td,(short *)inputFilter_fp16,
-            // fp16Array_length);
-            return blob;
-        } else {
-            TensorDesc td(InferenceEngine::Precision::FP16, permuteDims(inputDims, order), layout);
-            InferenceEngine::TBlob<short>::Ptr blob_oihw =
-                std::make_shared<InferenceEngine::TBlob<short>>(td);
-            blob_oihw->allocate();
-
-            auto dims_ohwi = inputDims;  // toDims(op.dimensions);
-            size_t out_depth = dims_ohwi[0];
-            size_t in_depth = dims_ohwi[3];
-            size_t height = dims_ohwi[1];
-            size_t width = dims_ohwi[2];
-            size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-            // const short* inputFilter = reinterpret_cast<const short *>(buf); //OHWI memory layout
-
-            for (size_t o = 0; o < out_depth; o++) {
-                for (size_t i = 0; i < in_depth; i++) {
-                    for (size_t h = 0; h < height; h++) {
-                        for (size_t w = 0; w < width; w++) {
-                            size_t offset_ohwi = o * height * width * in_depth +
-                                                 h * width * in_depth + w * in_depth +
-                                                 i;  // similar to NHWC memory layout
-                            // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)] =
-                            // inputFilter[offset_ohwi];
-                            blob_oihw->buffer().as<short*>()[offset++] =
-                                blob->buffer().as<short*>()[offset_ohwi];
-                            // size_t offset_oihw = o*in_depth*height*width + i*height*width +
-                            // h*width + w; //similar to NCHW memory layout
-                            // blob->buffer().as<float*>()[offset_oihw] = inputFilter[offset_ohwi];
-                            // VLOG(L1, "offset_ohwi= %d offset_oihw= %d", offset_ohwi,
-                            // offset_oihw);
-                        }
-                    }
-                }
-            }
+        // convert from [(float *)buf, len] straight into the final layout; the model buffer has
+        // NHWC memory layout and is read only once
+        TensorDesc td(InferenceEngine::Precision::FP16, permuteDims(inputDims, order), layout);
+        InferenceEngine::TBlob<short>::Ptr blob =
+            std::make_shared<InferenceEngine::TBlob<short>>(td);
+        blob->allocate();
+        layout::permuteToFp16(blob->buffer().as<short*>(), reinterpret_cast<const float*>(buf),
+                              inputDims, order);
 
-            return blob_oihw;
-        }
+        return blob;
 
 #else  // FP32 support
         vec<unsigned int> order;
@@ -3044,35 +2712,9 @@ Blob::Ptr VpuExecutor::GetInOutOperandAsBlob(RunTimeOperandInfo& op, const uint8
                         std::make_shared<InferenceEngine::TBlob<float>>(td);
                     blob->allocate();
 
-                    auto dims_nhwc = inputDims;  // toDims(op.dimensions);
-                    size_t batch = dims_nhwc[0];
-                    size_t in_depth = dims_nhwc[3];  // channels
-                    size_t height = dims_nhwc[1];
-                    size_t width = dims_nhwc[2];
-                    size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-                    const float* input = reinterpret_cast<const float*>(buf);  // OHWI memory layout
-
                     // convert NHWC -> NCHW
-
-                    for (size_t b = 0; b < batch; b++) {
-                        for (size_t i = 0; i < in_depth; i++) {
-                            for (size_t h = 0; h < height; h++) {
-                                for (size_t w = 0; w < width; w++) {
-                                    size_t offset_nhwc = b * height * width * in_depth +
-                                                         h * width * in_depth + w * in_depth +
-                                                         i;  // similar to NHWC memory layout
-                                    blob->buffer().as<float*>()[offset++] = input[offset_nhwc];
-                                    // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)]
-                                    // = input[offset_nhwc]; size_t offset_nchw =
-                                    // b*in_depth*height*width + i*height*width + h*width + w;
-                                    // //similar to NCHW memory layout
-                                    // blob->buffer().as<float*>()[offset_oihw] =
-                                    // inputFilter[offset_ohwi]; VLOG(L1, "offset_nhwc= %d
-                                    // offset_nchw= %d", offset_nhwc, offset_nchw);
-                                }
-                            }
-                        }
-                    }
+                    layout::permute(blob->buffer().as<float*>(),
+                                    reinterpret_cast<const float*>(buf), inputDims, order);
 
                     return blob;
                 }
@@ -3144,7 +2786,7 @@ Blob::Ptr VpuExecutor::GetInOutOperandAsBlob(RunTimeOperandInfo& op, const uint8
             if (buf == nullptr) {
                 VLOG(L1, "Request model input buffer is null pointer");
             } else {
-                f32tof16Arrays(fp16Array, (float*)buf, nelem);
+                fp16::f32tof16Arrays(fp16Array, (float*)buf, nelem);
             }
 
             return blob;
@@ -3179,7 +2821,7 @@ Blob::Ptr VpuExecutor::GetInOutOperandAsBlob(RunTimeOperandInfo& op, const uint8
                 nnAssert(false);
             }
             // need memcpy after infer output ??
-            f16tof32Arrays((float*)buf, fp16Array, length);
+            fp16::f16tof32Arrays((float*)buf, fp16Array, length);
 
             return blob;
         }
@@ -3242,31 +2884,11 @@ IRBlob::Ptr CpuExecutor::GetConstWeightsOperandAsTensor(uint32_t index) {
                     std::make_shared<InferenceEngine::TBlob<float>>(td);
                 blob->allocate();
 
-                auto dims_ohwi = inputDims;  // toDims(op.dimensions);
-                size_t out_depth = dims_ohwi[0];
-                size_t in_depth = dims_ohwi[3];
-                size_t height = dims_ohwi[1];
-                size_t width = dims_ohwi[2];
-                size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-                const float* inputFilter =
-                    reinterpret_cast<const float*>(buf);  // OHWI memory layout
-
                 // convert OHWI -> OIHW
-
                 // for depth conv need reorder as IOHW since for tflite O is always 1 and IE expects
                 // reorder to [in_channels, depth_multiplier, filter_height, filter_width]
-                for (size_t i = 0; i < in_depth; i++) {
-                    for (size_t o = 0; o < out_depth; o++) {
-                        for (size_t h = 0; h < height; h++) {
-                            for (size_t w = 0; w < width; w++) {
-                                size_t offset_ohwi = o * height * width * in_depth +
-                                                     h * width * in_depth + w * in_depth +
-                                                     i;  // similar to NHWC memory layout
-                                blob->buffer().as<float*>()[offset++] = inputFilter[offset_ohwi];
-                            }
-                        }
-                    }
-                }
+                layout::permute(blob->buffer().as<float*>(), reinterpret_cast<const float*>(buf),
+                                inputDims, order);
 
                 return blob;
             }
@@ -3333,34 +2955,8 @@ IRBlob::Ptr CpuExecutor::GetConstOperandAsTensor(uint32_t index) {
                     std::make_shared<InferenceEngine::TBlob<float>>(td);
                 blob->allocate();
 
-                auto dims_ohwi = inputDims;  // toDims(op.dimensions);
-                size_t out_depth = dims_ohwi[0];
-                size_t in_depth = dims_ohwi[3];
-                size_t height = dims_ohwi[1];
-                size_t width = dims_ohwi[2];
-                size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-                const float* inputFilter =
-                    reinterpret_cast<const float*>(buf);  // OHWI memory layout
-
-                for (size_t o = 0; o < out_depth; o++) {
-                    for (size_t i = 0; i < in_depth; i++) {
-                        for (size_t h = 0; h < height; h++) {
-                            for (size_t w = 0; w < width; w++) {
-                                size_t offset_ohwi = o * height * width * in_depth +
-                                                     h * width * in_depth + w * in_depth +
-                                                     i;  // similar to NHWC memory layout
-                                // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)]
-                                // = inputFilter[offset_ohwi];
-                                blob->buffer().as<float*>()[offset++] = inputFilter[offset_ohwi];
-                                // size_t offset_oihw = o*in_depth*height*width + i*height*width +
-                                // h*width + w; //similar to NCHW memory layout
-                                // blob->buffer().as<float*>()[offset_oihw] =
-                                // inputFilter[offset_ohwi]; VLOG(L1, "offset_ohwi= %d offset_oihw=
-                                // %d", offset_ohwi, offset_oihw);
-                            }
-                        }
-                    }
-                }
+                layout::permute(blob->buffer().as<float*>(), reinterpret_cast<const float*>(buf),
+                                inputDims, order);
 
                 return blob;
             }
@@ -3425,35 +3021,9 @@ Blob::Ptr CpuExecutor::GetInOutOperandAsBlob(RunTimeOperandInfo& op, const uint8
                         std::make_shared<InferenceEngine::TBlob<float>>(td);
                     blob->allocate();
 
-                    auto dims_nhwc = inputDims;  // toDims(op.dimensions);
-                    size_t batch = dims_nhwc[0];
-                    size_t in_depth = dims_nhwc[3];  // channels
-                    size_t height = dims_nhwc[1];
-                    size_t width = dims_nhwc[2];
-                    size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-                    const float* input = reinterpret_cast<const float*>(buf);  // OHWI memory layout
-
                     // convert NHWC -> NCHW
-
-                    for (size_t b = 0; b < batch; b++) {
-                        for (size_t i = 0; i < in_depth; i++) {
-                            for (size_t h = 0; h < height; h++) {
-                                for (size_t w = 0; w < width; w++) {
-                                    size_t offset_nhwc = b * height * width * in_depth +
-                                                         h * width * in_depth + w * in_depth +
-                                                         i;  // similar to NHWC memory layout
-                                    blob->buffer().as<float*>()[offset++] = input[offset_nhwc];
-                                    // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)]
-                                    // = input[offset_nhwc]; size_t offset_nchw =
-                                    // b*in_depth*height*width + i*height*width + h*width + w;
-                                    // //similar to NCHW memory layout
-                                    // blob->buffer().as<float*>()[offset_oihw] =
-                                    // inputFilter[offset_ohwi]; VLOG(L1, "offset_nhwc= %d
-                                    // offset_nchw= %d", offset_nhwc, offset_nchw);
-                                }
-                            }
-                        }
-                    }
+                    layout::permute(blob->buffer().as<float*>(),
+                                    reinterpret_cast<const float*>(buf), inputDims, order);
 
                     return blob;
                 }
@@ -3619,25 +3189,56 @@ bool PreparedModel::isOperationSupported(const Operation& operation, const Model
 
 void PreparedModel::asyncExecute(const Request& request, const sp<IExecutionCallback>& callback) {
     std::vector<RunTimePoolInfo> requestPoolInfos;
-    if (!executor::setRunTimePoolInfosFromHidlMemories(&requestPoolInfos, request.pools)) {
+    if (!executor::setRunTimePoolInfosFromHidlMemories(&requestPoolInfos, request.pools,
+                                                       &mRequestPoolCache)) {
         callback->notify(ErrorStatus::GENERAL_FAILURE);
         return;
     }
 
-    if (mTargetDevice == TargetDevice::eCPU) {
-        CpuExecutor executor;
-        int n = executor.run(mModel, request, mPoolInfos, requestPoolInfos);
-    } else if (mTargetDevice == TargetDevice::eMYRIAD) {
-        VpuExecutor executor;
-        int n = executor.run(mModel, request, mPoolInfos, requestPoolInfos);
-    }
-
-    Return<void> returned = callback->notify(ErrorStatus::NONE);
+    int n = -1;
+    bool firstRequest = false;
+    auto start = std::chrono::steady_clock::now();
+    {
+        // The executor keeps per-request state, so requests on the same model are serialized.
+        std::lock_guard<std::mutex> lock(mExecutorLock);
+        if (mExecutor == nullptr || !mExecutor->isCompatible(request)) {
+            if (mTargetDevice == TargetDevice::eCPU)
+                mExecutor.reset(new CpuExecutor());
+            else if (mTargetDevice == TargetDevice::eMYRIAD)
+                mExecutor.reset(new VpuExecutor());
+        }
+        if (mExecutor != nullptr) {
+            firstRequest = !mExecutor->isPrepared();
+            n = mExecutor->run(mModel, request, mPoolInfos, requestPoolInfos);
+            // do not keep a half built plan around
+            if (n != 0) mExecutor.reset();
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    VLOG(L1, "%s request latency %lld us", firstRequest ? "first (build)" : "steady-state",
+         static_cast<long long>(elapsed));
+
+    Return<void> returned =
+        callback->notify(n == 0 ? ErrorStatus::NONE : ErrorStatus::GENERAL_FAILURE);
     if (!returned.isOk()) {
         ALOGE("hidl callback failed to return properly: %s", returned.description().c_str());
     }
 }
 
+// One queue per target device, shared by all the models prepared for it. The CPU
+// plugin already spreads each inference over the cores, the VPU runs one at a time.
+static ExecutionQueue& getExecutionQueue(TargetDevice device) {
+    if (device == TargetDevice::eCPU) {
+        static ExecutionQueue cpuQueue("nnhal-cpu",
+                                       std::max(1u, std::thread::hardware_concurrency() / 2), 32);
+        return cpuQueue;
+    }
+    static ExecutionQueue vpuQueue("nnhal-vpu", 1, 32);
+    return vpuQueue;
+}
+
 Return<ErrorStatus> PreparedModel::execute(const Request& request,
                                            const sp<IExecutionCallback>& callback) {
     VLOG(L1, "Begin to execute");
@@ -3651,11 +3252,14 @@ Return<ErrorStatus> PreparedModel::execute(const Request& request,
         return ErrorStatus::INVALID_ARGUMENT;
     }
 
-    // This thread is intentionally detached because the vpu driver service
-    // is expected to live forever.
-    std::thread([this, request, callback] { asyncExecute(request, callback); }).detach();
+    sp<PreparedModel> self(this);
+    if (!getExecutionQueue(mTargetDevice)
+             .submit([self, request, callback] { self->asyncExecute(request, callback); })) {
+        callback->notify(ErrorStatus::DEVICE_UNAVAILABLE);
+        return ErrorStatus::DEVICE_UNAVAILABLE;
+    }
 
-    VLOG(L1, "Start execute thread done");
+    VLOG(L1, "Request queued");
 
     return ErrorStatus::NONE;
 }
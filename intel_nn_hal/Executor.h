@@ -24,8 +24,11 @@
 #include <sys/mman.h>
 #include <string>
 #include <fstream>
+#include <memory>
+#include <mutex>
 
 #include "IENetwork.h"
+#include "PoolCache.h"
 
 using ::android::hidl::memory::V1_0::IMemory;
 using namespace IRBuilder;
@@ -92,14 +95,18 @@ struct RunTimePoolInfo {
     sp<IMemory> memory;
     hidl_memory hidlMemory;
     uint8_t* buffer;
+    // keeps the pool mapped while it is in use
+    std::shared_ptr<MappedPool> mapping;
 
-    bool set(const hidl_memory& hidlMemory);
+    bool set(const hidl_memory& hidlMemory, PoolCache* cache = nullptr);
     bool update();
 };
 
 
+// The mappings are looked up in the cache first when one is given.
 bool setRunTimePoolInfosFromHidlMemories(std::vector<RunTimePoolInfo>* poolInfos,
-                                         const hidl_vec<hidl_memory>& pools);
+                                         const hidl_vec<hidl_memory>& pools,
+                                         PoolCache* cache = nullptr);
 
 
 
@@ -107,34 +114,47 @@ bool setRunTimePoolInfosFromHidlMemories(std::vector<RunTimePoolInfo>* poolInfos
 class Executor {
 public:
     Executor()
-          :mTargetDevice(TargetDevice::eMYRIAD), mNet("nnNet"), enginePtr(nullptr) {
-        IRBuilder::g_layer_precision = InferenceEngine::Precision::FP16;
+          :mTargetDevice(TargetDevice::eMYRIAD), mNet("nnNet", layerPrecision(TargetDevice::eMYRIAD)),
+           enginePtr(nullptr) {
     }
 
     Executor(const TargetDevice device)
-          :mTargetDevice(device), mNet("nnNet"), enginePtr(nullptr) {
-        if (mTargetDevice == TargetDevice::eCPU)
-           IRBuilder::g_layer_precision = InferenceEngine::Precision::FP32;
-        else if (mTargetDevice == TargetDevice::eMYRIAD)
-           IRBuilder::g_layer_precision = InferenceEngine::Precision::FP16;
+          :mTargetDevice(device), mNet("nnNet", layerPrecision(device)), enginePtr(nullptr) {
+    }
+
+    // precision of the layers built for the device
+    static InferenceEngine::Precision layerPrecision(TargetDevice device) {
+        if (device == TargetDevice::eCPU)
+           return InferenceEngine::Precision::FP32;
+        else if (device == TargetDevice::eMYRIAD)
+           return InferenceEngine::Precision::FP16;
         else
-           IRBuilder::g_layer_precision = InferenceEngine::Precision::UNSPECIFIED;
+           return InferenceEngine::Precision::UNSPECIFIED;
     }
 
-    ~Executor() {deinitialize();}
+    virtual ~Executor() {deinitialize();}
     //bool initialize();
     // Executes the model. The results will be stored at the locations
     // specified in the constructor.
     // The model must outlive the executor.  We prevent it from being modified
     // while this is executing.
+    // The IR graph and the executable network are built on the first call only,
+    // later calls just bind the request buffers and run the inference.
     int run(const Model& model, const Request& request,
             std::vector<RunTimePoolInfo>& modelPoolInfos,
             std::vector<RunTimePoolInfo>& requestPoolInfos);
+    bool isPrepared() const { return mPrepared; }
+    // Whether the request can reuse the network built for the previous ones,
+    // i.e. it does not override the dimensions the network was built with.
+    bool isCompatible(const Request& request) const;
 
 protected:
     void deinitialize();
+    bool prepare(const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                 const std::vector<RunTimePoolInfo>& requestPoolInfos);
     bool initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& modelPoolInfos,
                                             const std::vector<RunTimePoolInfo>& requestPoolInfos);
+    bool updateRunTimeInfo(const std::vector<RunTimePoolInfo>& requestPoolInfos);
 
     bool executeOperation(const Operation& operation);
 
@@ -185,9 +205,10 @@ protected:
     IRDocument mNet;
     std::vector<OutputPort> mPorts;  //typedef std::shared_ptr<Data> DataPtr;
     ExecuteNetwork* enginePtr;
+    bool mPrepared = false;
 
-    // The model and the request that we'll execute. Only valid while run()
-    // is being executed.
+    // The model the network was built from, it must outlive the executor.
+    // The request is only valid while run() is being executed.
     const Model* mModel = nullptr;
     const Request* mRequest = nullptr;
 
@@ -220,18 +241,9 @@ public:
 
 class PreparedModel : public IPreparedModel {
 public:
-    PreparedModel(const Model& model) : mModel(model), mTargetDevice(TargetDevice::eMYRIAD) {
-        IRBuilder::g_layer_precision = InferenceEngine::Precision::FP16;
-    }
+    PreparedModel(const Model& model) : mModel(model), mTargetDevice(TargetDevice::eMYRIAD) {}
     PreparedModel(const TargetDevice device, const Model& model)
-          :mTargetDevice(device), mModel(model) {
-        if (mTargetDevice == TargetDevice::eCPU)
-           IRBuilder::g_layer_precision = InferenceEngine::Precision::FP32;
-        else if (mTargetDevice == TargetDevice::eMYRIAD)
-           IRBuilder::g_layer_precision = InferenceEngine::Precision::FP16;
-        else
-           IRBuilder::g_layer_precision = InferenceEngine::Precision::UNSPECIFIED;
-    }
+          :mTargetDevice(device), mModel(model) {}
     ~PreparedModel() override {}
     bool initialize();
     static bool isOperationSupported(const Operation& operation, const Model& model);
@@ -243,7 +255,13 @@ private:
 
     Model mModel;
     std::vector<RunTimePoolInfo> mPoolInfos;
+    // request pools stay mapped across executions
+    PoolCache mRequestPoolCache;
     TargetDevice mTargetDevice;
+    // Execution plan built on the first request and reused by the following
+    // ones, guarded by mExecutorLock.
+    std::unique_ptr<Executor> mExecutor;
+    std::mutex mExecutorLock;
 
 };
 
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GraphDump"
+
+#include "GraphDump.h"
+#include <android-base/properties.h>
+#include <log/log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include "ExecutionQueue.h"
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+using ::nnhal::ExecutionQueue;
+
+bool graphDumpEnabled() {
+    const char* env = getenv("NNHAL_DUMP_GRAPH");
+    if (env != nullptr && *env != '\0' && strcmp(env, "0") != 0) return true;
+    return android::base::GetBoolProperty("nn.hal.dump_graph", false);
+}
+
+static void writeFile(const std::string& path, const std::string& data, bool binary) {
+    std::ofstream file(path, binary ? std::ios::out | std::ios::binary : std::ios::out);
+    file.write(data.data(), data.size());
+    file.close();
+    if (file.fail()) ALOGW("failed to write %s", path.c_str());
+}
+
+void dumpGraph(IRBuilder::IRDocument& doc, const std::string& tag) {
+    if (!graphDumpEnabled()) return;
+
+    // one writer, a few dumps may wait for it before prepare blocks on the queue
+    static ExecutionQueue writer("GraphDump", 1, 4);
+    static std::atomic<unsigned> count(0);
+
+    std::ostringstream name;
+    name << android::base::GetProperty("nn.hal.dump_dir", "/data/local") << "/nnhal_"
+         << getpid() << "_" << count++ << "_" << tag;
+
+    auto xml = std::make_shared<std::ostringstream>();
+    auto bin = std::make_shared<std::ostringstream>(std::ios::out | std::ios::binary);
+    auto dot = std::make_shared<std::ostringstream>();
+    doc.save(*xml, *bin);
+    doc.crateDotFile(*dot);
+
+    const std::string base = name.str();
+    writer.submit([base, xml, bin, dot] {
+        writeFile(base + ".xml", xml->str(), false);
+        writeFile(base + ".bin", bin->str(), true);
+        writeFile(base + ".dot", dot->str(), false);
+        ALOGI("dumped %s", base.c_str());
+    });
+}
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_GRAPH_DUMP_H
+#define ANDROID_ML_NN_GRAPH_DUMP_H
+
+#include <string>
+#include "IRDocument.h"
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+// Debug dumps of the networks the HAL builds: the IR (.xml and .bin) and a
+// graphviz file (.dot). Off by default, enabled with the nn.hal.dump_graph
+// property or the NNHAL_DUMP_GRAPH environment variable. The files go to the
+// nn.hal.dump_dir directory (/data/local by default) and are named
+// nnhal_<pid>_<n>_<tag>, n counting the networks dumped by the process.
+bool graphDumpEnabled();
+
+// Serializes doc into memory on the calling thread, a background thread writes
+// the files. Does nothing when the dumps are disabled.
+void dumpGraph(IRBuilder::IRDocument& doc, const std::string& tag);
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_GRAPH_DUMP_H
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LayerProfile"
+
+#include "LayerProfile.h"
+#include <android-base/properties.h>
+#include <ctype.h>
+#include <log/log.h>
+#include <stdio.h>
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <sstream>
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+// inferences the percentiles are taken over
+static const size_t kWindow = 1000;
+
+static std::mutex sProfilesLock;
+static std::set<LayerProfile*> sProfiles;
+
+uint32_t LayerProfile::interval() {
+    return android::base::GetUintProperty<uint32_t>("nn.hal.profile_layers", 0);
+}
+
+LayerProfile::LayerProfile(const std::string& name, const Operations& operations,
+                           uint32_t interval)
+      : mName(name), mOperations(operations), mInterval(interval) {
+    std::lock_guard<std::mutex> lock(sProfilesLock);
+    sProfiles.insert(this);
+}
+
+LayerProfile::~LayerProfile() {
+    std::lock_guard<std::mutex> lock(sProfilesLock);
+    sProfiles.erase(this);
+}
+
+void LayerProfile::Samples::add(long long us) {
+    const uint32_t value = static_cast<uint32_t>(
+        std::min<long long>(std::max(us, 0LL), std::numeric_limits<uint32_t>::max()));
+    if (window.size() < kWindow) {
+        window.push_back(value);
+    } else {
+        window[next] = value;
+        next = (next + 1) % kWindow;
+    }
+    count++;
+}
+
+uint32_t LayerProfile::Samples::percentile(int p) const {
+    if (window.empty()) return 0;
+    std::vector<uint32_t> sorted(window);
+    auto nth = sorted.begin() + (sorted.size() - 1) * p / 100;
+    std::nth_element(sorted.begin(), nth, sorted.end());
+    return *nth;
+}
+
+// The plugins add layers of their own, reorders for instance, named after the
+// layer they serve: those go with the longest layer name they start with.
+int LayerProfile::operationOf(const std::string& layerName) const {
+    auto it = mOperations.find(layerName);
+    if (it != mOperations.end()) return it->second;
+    int operation = -1;
+    size_t longest = 0;
+    for (const auto& op : mOperations) {
+        const size_t size = op.first.size();
+        // Conv-1 is not a prefix of Conv-12
+        if (size > longest && layerName.compare(0, size, op.first) == 0 &&
+            !isdigit(static_cast<unsigned char>(layerName[size]))) {
+            longest = size;
+            operation = op.second;
+        }
+    }
+    return operation;
+}
+
+void LayerProfile::add(const Counts& counts) {
+    if (counts.empty()) return;
+
+    std::string text;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        std::map<int, long long> operationTimes;
+        for (const auto& count : counts) {
+            const auto& info = count.second;
+            // fused into another layer or not needed
+            if (info.status != InferenceEngine::InferenceEngineProfileInfo::EXECUTED) continue;
+
+            auto it = mLayers.find(count.first);
+            if (it == mLayers.end()) {
+                it = mLayers.emplace(count.first, Layer()).first;
+                it->second.operation = operationOf(count.first);
+                it->second.layerType = info.layer_type;
+                it->second.execType = info.exec_type;
+            }
+            it->second.times.add(info.realTime_uSec);
+            operationTimes[it->second.operation] += info.realTime_uSec;
+        }
+        for (const auto& op : operationTimes) mOperationTimes[op.first].add(op.second);
+
+        mInferences++;
+        if (mInterval == 0 || mInferences % mInterval != 0) return;
+        text = summary();
+    }
+
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) ALOGI("%s", line.c_str());
+}
+
+// The slowest layers first. Operation -1 stands for the layers of no
+// operation: the ones a graph pass or the plugin created, and all of them for a
+// network from the compilation cache.
+std::string LayerProfile::summary() {
+    std::vector<std::pair<uint32_t, const std::string*>> order;
+    for (const auto& layer : mLayers)
+        order.emplace_back(layer.second.times.percentile(50), &layer.first);
+    std::sort(order.begin(), order.end(),
+              [](const std::pair<uint32_t, const std::string*>& a,
+                 const std::pair<uint32_t, const std::string*>& b) { return a.first > b.first; });
+
+    std::ostringstream out;
+    out << mName << ": " << mInferences << " inferences, p50/p99 of the last "
+        << std::min<uint64_t>(mInferences, kWindow) << " in us\n";
+    char line[256];
+    out << "  by operation:\n";
+    for (const auto& op : mOperationTimes) {
+        snprintf(line, sizeof(line), "  operation %3d  p50 %8u  p99 %8u\n", op.first,
+                 op.second.percentile(50), op.second.percentile(99));
+        out << line;
+    }
+    out << "  by layer, slowest first:\n";
+    for (const auto& entry : order) {
+        const Layer& layer = mLayers[*entry.second];
+        snprintf(line, sizeof(line), "  operation %3d  p50 %8u  p99 %8u  %s %s (%s)\n",
+                 layer.operation, layer.times.percentile(50), layer.times.percentile(99),
+                 entry.second->c_str(), layer.layerType.c_str(), layer.execType.c_str());
+        out << line;
+    }
+    return out.str();
+}
+
+void LayerProfile::dumpAll(int fd) {
+    std::lock_guard<std::mutex> lock(sProfilesLock);
+    if (sProfiles.empty()) {
+        dprintf(fd, "no profiled networks, set nn.hal.profile_layers before preparing models\n");
+        return;
+    }
+    for (LayerProfile* profile : sProfiles) {
+        std::string text;
+        {
+            std::lock_guard<std::mutex> profileLock(profile->mLock);
+            text = profile->summary();
+        }
+        dprintf(fd, "%s\n", text.c_str());
+    }
+}
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
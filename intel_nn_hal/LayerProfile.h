@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_LAYER_PROFILE_H
+#define ANDROID_ML_NN_LAYER_PROFILE_H
+
+#include <ie_common.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+// Execution times of the layers of one network, as the plugin reports them
+// after each inference when the network is loaded with PERF_COUNT. Off by
+// default; the nn.hal.profile_layers property sets the number of inferences
+// between two summaries in the log (tag LayerProfile), 0 disables it.
+//
+// Each layer is reported with the NNAPI operation it was built for, so a
+// regression points to an operation of the model. The summaries give the p50
+// and p99 of the last inferences per layer and per operation. They are also
+// written by dumpAll(), behind `lshal debug` of the driver.
+class LayerProfile {
+public:
+    // IR layer name -> operation index in the model
+    typedef std::map<std::string, int> Operations;
+    typedef std::map<std::string, InferenceEngine::InferenceEngineProfileInfo> Counts;
+
+    // Inferences between two summaries, 0 when profiling is off.
+    static uint32_t interval();
+
+    LayerProfile(const std::string& name, const Operations& operations, uint32_t interval);
+    ~LayerProfile();
+
+    // The counts of one inference.
+    void add(const Counts& counts);
+
+    // Summary of every profiled network still prepared.
+    static void dumpAll(int fd);
+
+private:
+    // The times of the last kWindow inferences, in microseconds.
+    struct Samples {
+        std::vector<uint32_t> window;
+        size_t next = 0;
+        uint64_t count = 0;
+
+        void add(long long us);
+        uint32_t percentile(int p) const;
+    };
+
+    struct Layer {
+        int operation = -1;
+        std::string layerType;
+        std::string execType;
+        Samples times;
+    };
+
+    int operationOf(const std::string& layerName) const;
+    std::string summary();
+
+    const std::string mName;
+    const Operations mOperations;
+    const uint32_t mInterval;
+    std::mutex mLock;
+    std::map<std::string, Layer> mLayers;
+    std::map<int, Samples> mOperationTimes;  // sum of the layers of an operation
+    uint64_t mInferences = 0;
+};
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_LAYER_PROFILE_H
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "PoolCache"
+
+#include "PoolCache.h"
+#include <android-base/logging.h>
+#include <hidlmemory/mapping.h>
+#include <log/log.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+static inline size_t getSizeFromInts(int lower, int higher) {
+    return (uint32_t)(lower) + ((uint64_t)(uint32_t)(higher) << 32);
+}
+
+MappedPool::~MappedPool() {
+    if (mmapped && buffer != nullptr) munmap(buffer, size);
+}
+
+std::shared_ptr<MappedPool> mapPool(const hidl_memory& hidlMemory) {
+    std::shared_ptr<MappedPool> pool = std::make_shared<MappedPool>();
+    pool->size = hidlMemory.size();
+    auto memType = hidlMemory.name();
+    if (memType == "ashmem") {
+        pool->memory = mapMemory(hidlMemory);
+        if (pool->memory == nullptr) {
+            LOG(ERROR) << "Can't map shared memory.";
+            return nullptr;
+        }
+        pool->memory->update();
+        pool->buffer = reinterpret_cast<uint8_t*>(static_cast<void*>(pool->memory->getPointer()));
+        if (pool->buffer == nullptr) {
+            LOG(ERROR) << "Can't access shared memory.";
+            return nullptr;
+        }
+    } else if (memType == "mmap_fd") {
+        const native_handle_t* handle = hidlMemory.handle();
+        if (handle == nullptr || handle->numFds < 1 || handle->numInts < 3) {
+            LOG(ERROR) << "Invalid mmap_fd handle.";
+            return nullptr;
+        }
+        int fd = handle->data[0];
+        int prot = handle->data[1];
+        size_t offset = getSizeFromInts(handle->data[2], handle->data[3]);
+        void* buffer = mmap(nullptr, pool->size, prot, MAP_SHARED, fd, offset);
+        if (buffer == MAP_FAILED) {
+            LOG(ERROR) << "Can't mmap the file descriptor.";
+            return nullptr;
+        }
+        pool->buffer = static_cast<uint8_t*>(buffer);
+        pool->mmapped = true;
+    } else {
+        LOG(ERROR) << "unsupported hidl_memory type";
+        return nullptr;
+    }
+    return pool;
+}
+
+// Only mmap_fd pools of regular files have a key. Every ashmem region
+// fstat()s as the same /dev/ashmem device and inode, whatever the hidl type
+// it was passed as, and on older kernels every dma-buf as the same anon
+// inode, so nothing tells two regions of the same size apart: they are
+// mapped for each execution.
+bool PoolCache::getKey(const hidl_memory& hidlMemory, Key* key) {
+    if (hidlMemory.name() != "mmap_fd") return false;
+    const native_handle_t* handle = hidlMemory.handle();
+    if (handle == nullptr || handle->numFds < 1 || handle->numInts < 3) return false;
+
+    struct stat st;
+    if (fstat(handle->data[0], &st) != 0 || !S_ISREG(st.st_mode)) return false;
+
+    int prot = handle->data[1];
+    size_t offset = getSizeFromInts(handle->data[2], handle->data[3]);
+    *key = Key(st.st_dev, st.st_ino, offset, hidlMemory.size(), prot);
+    return true;
+}
+
+std::shared_ptr<MappedPool> PoolCache::acquire(const hidl_memory& hidlMemory) {
+    Key key;
+    if (!getKey(hidlMemory, &key)) return mapPool(hidlMemory);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    auto found = mEntries.find(key);
+    if (found != mEntries.end()) {
+        mHits++;
+        mLru.splice(mLru.begin(), mLru, found->second);
+        auto& pool = found->second->second;
+        if (pool->memory != nullptr) pool->memory->update();
+        return pool;
+    }
+
+    mMisses++;
+    std::shared_ptr<MappedPool> pool = mapPool(hidlMemory);
+    if (pool == nullptr) return nullptr;
+
+    mLru.emplace_front(key, pool);
+    mEntries[key] = mLru.begin();
+    while (mLru.size() > mCapacity) {
+        // executions still holding the pool keep it mapped until they finish
+        mEntries.erase(mLru.back().first);
+        mLru.pop_back();
+    }
+    ALOGD("mapped pool %p size %zu, %zu pools cached (%zu hits, %zu misses)", pool->buffer,
+          pool->size, mLru.size(), mHits, mMisses);
+    return pool;
+}
+
+void PoolCache::clear() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mEntries.clear();
+    mLru.clear();
+}
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
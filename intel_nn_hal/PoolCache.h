@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_POOL_CACHE_H
+#define ANDROID_ML_NN_POOL_CACHE_H
+
+#include <android/hidl/memory/1.0/IMemory.h>
+#include <hidl/HidlSupport.h>
+#include <sys/types.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+using ::android::hidl::memory::V1_0::IMemory;
+
+// A hidl_memory mapped into the driver address space. The mapping is released
+// (unmapped) when the last reference to it goes away.
+struct MappedPool {
+    sp<IMemory> memory;  // set for ashmem
+    uint8_t* buffer = nullptr;
+    size_t size = 0;
+    bool mmapped = false;  // mmap_fd, owns the mapping
+
+    ~MappedPool();
+};
+
+// Maps the memory without any caching.
+std::shared_ptr<MappedPool> mapPool(const hidl_memory& hidlMemory);
+
+// Keeps the request memory pools mapped across executions. Clients usually pass
+// the same shared memory for every frame, but every call carries its own
+// duplicated file descriptor, so entries are keyed by the identity of the
+// memory behind the descriptor (device, inode, offset, size) rather than by the
+// handle. Only mmap_fd pools of regular files are cached: ashmem regions all
+// share the inode of /dev/ashmem, dma-bufs may share an anon inode, so they are
+// mapped for every execution. At most `capacity` pools are kept, the least
+// recently used one is dropped first; a pool still referenced by a running
+// execution stays mapped until that execution releases it.
+class PoolCache {
+public:
+    explicit PoolCache(size_t capacity = 8) : mCapacity(capacity) {}
+
+    std::shared_ptr<MappedPool> acquire(const hidl_memory& hidlMemory);
+    void clear();
+
+    size_t hits() const { return mHits; }
+    size_t misses() const { return mMisses; }
+
+private:
+    typedef std::tuple<dev_t, ino_t, size_t, size_t, int> Key;
+    typedef std::list<std::pair<Key, std::shared_ptr<MappedPool>>> LruList;
+
+    static bool getKey(const hidl_memory& hidlMemory, Key* key);
+
+    const size_t mCapacity;
+    std::mutex mLock;
+    LruList mLru;  // most recently used first
+    std::map<Key, LruList::iterator> mEntries;
+    size_t mHits = 0;
+    size_t mMisses = 0;
+};
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_POOL_CACHE_H
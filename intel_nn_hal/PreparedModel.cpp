@@ -18,11 +18,21 @@
 
 #include "PreparedModel.h"
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <android/log.h>
 #include <log/log.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <thread>
+#include "ExecutionQueue.h"
+#include "GraphDump.h"
+#include "LayerProfile.h"
+#include "ReadOnlyBlob.h"
 #include "ValidateHal.h"
+#include "fp16.h"
+#include "layout.h"
 
 #define DISABLE_ALL_QUANT
 //#define NN_DEBUG
@@ -101,6 +111,7 @@ namespace V1_0 {
 namespace driver {
 
 using namespace android::nn;
+using ::nnhal::ExecutionQueue;
 
 enum PaddingScheme {
     kPaddingUnknown = 0,
@@ -250,263 +261,6 @@ std::vector<uint32_t>& shapeToDims(const TensorDims& shape, Layout layout) {
     return dims;
 }
 
-unsigned short float2half(unsigned f) {
-    unsigned f_exp, f_sig;
-    unsigned short h_sgn, h_exp, h_sig;
-
-    h_sgn = (unsigned short)((f & 0x80000000u) >> 16);
-    f_exp = (f & 0x7f800000u);
-
-    /* Exponent overflow/NaN converts to signed inf/NaN */
-    if (f_exp >= 0x47800000u) {
-        if (f_exp == 0x7f800000u) {
-            /* Inf or NaN */
-            f_sig = (f & 0x007fffffu);
-            if (f_sig != 0) {
-                /* NaN - propagate the flag in the significand... */
-                unsigned short ret = (unsigned short)(0x7c00u + (f_sig >> 13));
-                /* ...but make sure it stays a NaN */
-                if (ret == 0x7c00u) {
-                    ret++;
-                }
-                return h_sgn + ret;
-            } else {
-                /* signed inf */
-                return (unsigned short)(h_sgn + 0x7c00u);
-            }
-        } else {
-            /* overflow to signed inf */
-#if NPY_HALF_GENERATE_OVERFLOW
-            npy_set_floatstatus_overflow();
-#endif
-            return (unsigned short)(h_sgn + 0x7c00u);
-        }
-    }
-
-    /* Exponent underflow converts to a subnormal half or signed zero */
-    if (f_exp <= 0x38000000u) {
-        /*
-         * Signed zeros, subnormal floats, and floats with small
-         * exponents all convert to signed zero halfs.
-         */
-        if (f_exp < 0x33000000u) {
-#if NPY_HALF_GENERATE_UNDERFLOW
-            /* If f != 0, it underflowed to 0 */
-            if ((f & 0x7fffffff) != 0) {
-                npy_set_floatstatus_underflow();
-            }
-#endif
-            return h_sgn;
-        }
-        /* Make the subnormal significand */
-        f_exp >>= 23;
-        f_sig = (0x00800000u + (f & 0x007fffffu));
-#if NPY_HALF_GENERATE_UNDERFLOW
-        /* If it's not exactly represented, it underflowed */
-        if ((f_sig & (((unsigned)1 << (126 - f_exp)) - 1)) != 0) {
-            npy_set_floatstatus_underflow();
-        }
-#endif
-        f_sig >>= (113 - f_exp);
-        /* Handle rounding by adding 1 to the bit beyond half precision */
-#if NPY_HALF_ROUND_TIES_TO_EVEN
-        /*
-         * If the last bit in the half significand is 0 (already even), and
-         * the remaining bit pattern is 1000...0, then we do not add one
-         * to the bit after the half significand.  In all other cases, we do.
-         */
-        if ((f_sig & 0x00003fffu) != 0x00001000u) {
-            f_sig += 0x00001000u;
-        }
-#else
-        f_sig += 0x00001000u;
-#endif
-        h_sig = (unsigned short)(f_sig >> 13);
-        /*
-         * If the rounding causes a bit to spill into h_exp, it will
-         * increment h_exp from zero to one and h_sig will be zero.
-         * This is the correct result.
-         */
-        return (unsigned short)(h_sgn + h_sig);
-    }
-
-    /* Regular case with no overflow or underflow */
-    h_exp = (unsigned short)((f_exp - 0x38000000u) >> 13);
-    /* Handle rounding by adding 1 to the bit beyond half precision */
-    f_sig = (f & 0x007fffffu);
-#if NPY_HALF_ROUND_TIES_TO_EVEN
-    /*
-     * If the last bit in the half significand is 0 (already even), and
-     * the remaining bit pattern is 1000...0, then we do not add one
-     * to the bit after the half significand.  In all other cases, we do.
-     */
-    if ((f_sig & 0x00003fffu) != 0x00001000u) {
-        f_sig += 0x00001000u;
-    }
-#else
-    f_sig += 0x00001000u;
-#endif
-    h_sig = (unsigned short)(f_sig >> 13);
-    /*
-     * If the rounding causes a bit to spill into h_exp, it will
-     * increment h_exp by one and h_sig will be zero.  This is the
-     * correct result.  h_exp may increment to 15, at greatest, in
-     * which case the result overflows to a signed inf.
-     */
-#if NPY_HALF_GENERATE_OVERFLOW
-    h_sig += h_exp;
-    if (h_sig == 0x7c00u) {
-        npy_set_floatstatus_overflow();
-    }
-    return h_sgn + h_sig;
-#else
-    return h_sgn + h_exp + h_sig;
-#endif
-}
-void floattofp16(short* dst, float* src, unsigned nelem) {
-    unsigned i;
-    unsigned short* _dst = (unsigned short*)dst;
-    unsigned* _src = (unsigned*)src;
-
-    for (i = 0; i < nelem; i++) _dst[i] = float2half(_src[i]);
-}
-
-// Function to convert F32 into F16
-// F32: exp_bias:127 SEEEEEEE EMMMMMMM MMMMMMMM MMMMMMMM.
-// F16: exp_bias:15  SEEEEEMM MMMMMMMM
-#define EXP_MASK_F32 0x7F800000U
-#define EXP_MASK_F16 0x7C00U
-
-// small helper function to represent uint32_t value as float32
-float asfloat(uint32_t v) { return *reinterpret_cast<float*>(&v); }
-
-// Function to convert F32 into F16
-float f16tof32(short x) {
-    // this is storage for output result
-    uint32_t u = x;
-
-    // get sign in 32bit format
-    uint32_t s = ((u & 0x8000) << 16);
-
-    // check for NAN and INF
-    if ((u & EXP_MASK_F16) == EXP_MASK_F16) {
-        // keep mantissa only
-        u &= 0x03FF;
-
-        // check if it is NAN and raise 10 bit to be align with intrin
-        if (u) {
-            u |= 0x0200;
-        }
-
-        u <<= (23 - 10);
-        u |= EXP_MASK_F32;
-        u |= s;
-    } else if ((x & EXP_MASK_F16) ==
-               0) {  // check for zero and denormals. both are converted to zero
-        u = s;
-    } else {
-        // abs
-        u = (u & 0x7FFF);
-
-        // shift mantissa and exp from f16 to f32 position
-        u <<= (23 - 10);
-
-        // new bias for exp (f16 bias is 15 and f32 bias is 127)
-        u += ((127 - 15) << 23);
-
-        // add sign
-        u |= s;
-    }
-
-    // finaly represent result as float and return
-    return *reinterpret_cast<float*>(&u);
-}
-
-// This function convert f32 to f16 with rounding to nearest value to minimize error
-// the denormal values are converted to 0.
-short f32tof16(float x) {
-    // create minimal positive normal f16 value in f32 format
-    // exp:-14,mantissa:0 -> 2^-14 * 1.0
-    static float min16 = asfloat((127 - 14) << 23);
-
-    // create maximal positive normal f16 value in f32 and f16 formats
-    // exp:15,mantissa:11111 -> 2^15 * 1.(11111)
-    static float max16 = asfloat(((127 + 15) << 23) | 0x007FE000);
-    static uint32_t max16f16 = ((15 + 15) << 10) | 0x3FF;
-
-    // define and declare variable for intermidiate and output result
-    // the union is used to simplify representation changing
-    union {
-        float f;
-        uint32_t u;
-    } v;
-    v.f = x;
-
-    // get sign in 16bit format
-    uint32_t s = (v.u >> 16) & 0x8000;  // sign 16:  00000000 00000000 10000000 00000000
-
-    // make it abs
-    v.u &= 0x7FFFFFFF;  // abs mask: 01111111 11111111 11111111 11111111
-
-    // check NAN and INF
-    if ((v.u & EXP_MASK_F32) == EXP_MASK_F32) {
-        if (v.u & 0x007FFFFF) {
-            return s | (v.u >> (23 - 10)) | 0x0200;  // return NAN f16
-        } else {
-            return s | (v.u >> (23 - 10));  // return INF f16
-        }
-    }
-
-    // to make f32 round to nearest f16
-    // create halfULP for f16 and add it to origin value
-    float halfULP = asfloat(v.u & EXP_MASK_F32) * asfloat((127 - 11) << 23);
-    v.f += halfULP;
-
-    // if input value is not fit normalized f16 then return 0
-    // denormals are not covered by this code and just converted to 0
-    if (v.f < min16 * 0.5F) {
-        return s;
-    }
-
-    // if input value between min16/2 and min16 then return min16
-    if (v.f < min16) {
-        return s | (1 << 10);
-    }
-
-    // if input value more than maximal allowed value for f16
-    // then return this maximal value
-    if (v.f >= max16) {
-        return max16f16 | s;
-    }
-
-    // change exp bias from 127 to 15
-    v.u -= ((127 - 15) << 23);
-
-    // round to f16
-    v.u >>= (23 - 10);
-
-    return v.u | s;
-}
-
-void f16tof32Arrays(float* dst, const short* src, uint32_t& nelem, float scale = 1,
-                    float bias = 0) {
-    VLOG(L1, "convert f16tof32Arrays...\n");
-    const short* _src = reinterpret_cast<const short*>(src);
-
-    for (uint32_t i = 0; i < nelem; i++) {
-        dst[i] = f16tof32(_src[i]) * scale + bias;
-    }
-}
-
-void f32tof16Arrays(short* dst, const float* src, uint32_t& nelem, float scale = 1,
-                    float bias = 0) {
-    VLOG(L1, "convert f32tof16Arrays...");
-    for (uint32_t i = 0; i < nelem; i++) {
-        dst[i] = f32tof16(src[i] * scale + bias);
-        // VLOG(L1, "element no: %d", i);
-    }
-}
-
 int sizeOfData(OperandType type, std::vector<uint32_t> dims) {
     int size;
     switch (type) {
@@ -532,10 +286,6 @@ int sizeOfData(OperandType type, std::vector<uint32_t> dims) {
     return size;
 }
 
-inline size_t getSizeFromInts(int lower, int higher) {
-    return (uint32_t)(lower) + ((uint64_t)(uint32_t)(higher) << 32);
-}
-
 template <typename T>
 T getScalarData(const RunTimeOperandInfo& info) {
     // TODO: Check buffer is at least as long as size of data.
@@ -545,37 +295,13 @@ T getScalarData(const RunTimeOperandInfo& info) {
 
 // TODO: short term, make share memory mapping and updating a utility function.
 // TODO: long term, implement mmap_fd as a hidl IMemory service.
-bool RunTimePoolInfo::set(const hidl_memory& hidlMemory) {
+bool RunTimePoolInfo::set(const hidl_memory& hidlMemory, PoolCache* cache) {
     this->hidlMemory = hidlMemory;
-    auto memType = hidlMemory.name();
-    if (memType == "ashmem") {
-        memory = mapMemory(hidlMemory);
-        if (memory == nullptr) {
-            LOG(ERROR) << "Can't map shared memory.";
-            return false;
-        }
-        memory->update();
-        buffer = reinterpret_cast<uint8_t*>(static_cast<void*>(memory->getPointer()));
-        if (buffer == nullptr) {
-            LOG(ERROR) << "Can't access shared memory.";
-            return false;
-        }
-        return true;
-    } else if (memType == "mmap_fd") {
-        size_t size = hidlMemory.size();
-        int fd = hidlMemory.handle()->data[0];
-        int prot = hidlMemory.handle()->data[1];
-        size_t offset = getSizeFromInts(hidlMemory.handle()->data[2], hidlMemory.handle()->data[3]);
-        buffer = static_cast<uint8_t*>(mmap(nullptr, size, prot, MAP_SHARED, fd, offset));
-        if (buffer == MAP_FAILED) {
-            LOG(ERROR) << "Can't mmap the file descriptor.";
-            return false;
-        }
-        return true;
-    } else {
-        LOG(ERROR) << "unsupported hidl_memory type";
-        return false;
-    }
+    mapping = cache != nullptr ? cache->acquire(hidlMemory) : mapPool(hidlMemory);
+    if (mapping == nullptr) return false;
+    memory = mapping->memory;
+    buffer = mapping->buffer;
+    return true;
 }
 
 // Making sure the output data are correctly updated after execution.
@@ -596,11 +322,11 @@ bool RunTimePoolInfo::update() {
 }
 
 bool setRunTimePoolInfosFromHidlMemories(std::vector<RunTimePoolInfo>* poolInfos,
-                                         const hidl_vec<hidl_memory>& pools) {
+                                         const hidl_vec<hidl_memory>& pools, PoolCache* cache) {
     poolInfos->resize(pools.size());
     for (size_t i = 0; i < pools.size(); i++) {
         auto& poolInfo = (*poolInfos)[i];
-        if (!poolInfo.set(pools[i])) {
+        if (!poolInfo.set(pools[i], cache)) {
             LOG(ERROR) << "Could not map pool";
             return false;
         }
@@ -731,13 +457,13 @@ OutputPort PreparedModel::handleFusion(const OutputPort& out, int32_t fusedOp) {
     VLOG(L1, "fusedOp: %d", fusedOp);
     if (fusedOp == (int32_t)FusedActivationFunc::RELU) {
         VLOG(L1, "fusedOp is RELU");
-        return ReLU(out);
+        return ReLU(mNet.context(), out);
     } else if (fusedOp == (int32_t)FusedActivationFunc::RELU1) {
         VLOG(L1, "fusedOp is RELU1");
-        return Clamp(out, -1, 1);
+        return Clamp(mNet.context(), out, -1, 1);
     } else if (fusedOp == (int32_t)FusedActivationFunc::RELU6) {
         VLOG(L1, "fusedOp is RELU6");
-        return Clamp(out, 0, 6);
+        return Clamp(mNet.context(), out, 0, 6);
     }
 
     VLOG(L1, "No ActivationFunc");
@@ -920,6 +646,60 @@ OutputPort PreparedModel::getPort(int index) {
     return nullptr;
 }
 
+// FP32 data of a constant operand used where it is, the CPU plugin reads the
+// weights while it loads the network and keeps its own copy.
+Blob::Ptr PreparedModel::wrapConstOperand(uint32_t index, const TensorDesc& td) {
+    const auto& op = mModel.operands[index];
+    uint32_t len;
+    const uint8_t* buf = GetOperandMemory(mModel, index, len);
+    std::shared_ptr<MappedPool> mapping;
+    if (op.lifetime == OperandLifeTime::CONSTANT_REFERENCE)
+        mapping = mPoolInfos[op.location.poolIndex].mapping;
+    return std::make_shared<ReadOnlyBlob<float>>(td, reinterpret_cast<const float*>(buf),
+                                                 len / sizeof(float), mapping);
+}
+
+Blob::Ptr PreparedModel::getConstBlob(uint32_t index) { return cachedConstBlob(index, false); }
+
+Blob::Ptr PreparedModel::getConstWeightsBlob(uint32_t index) {
+    return cachedConstBlob(index, true);
+}
+
+PreparedModel::ConstRegion PreparedModel::constRegion(uint32_t index, bool weights) const {
+    const auto& op = mModel.operands[index];
+    ConstRegion region;
+    region.lifetime = op.lifetime;
+    region.poolIndex = op.location.poolIndex;
+    region.offset = op.location.offset;
+    region.length = op.location.length;
+    region.weights = weights;
+    region.type = op.type;
+    region.dimensions.assign(op.dimensions.begin(), op.dimensions.end());
+    return region;
+}
+
+// Operands sharing their bytes, tied weights or a shared bias, get the same
+// blob, converted once; IRDocument then also writes its data to the .bin once.
+Blob::Ptr PreparedModel::cachedConstBlob(uint32_t index, bool weights) {
+    auto& blobs = weights ? mConstWeightsBlobs : mConstBlobs;
+    auto it = blobs.find(index);
+    if (it != blobs.end()) return it->second;
+
+    const ConstRegion region = constRegion(index, weights);
+    Blob::Ptr blob;
+    auto rit = mConstRegionBlobs.find(region);
+    if (rit != mConstRegionBlobs.end() && rit->second) {
+        VLOG(L1, "operand %d shares its blob", index);
+        blob = rit->second;
+    } else {
+        blob = weights ? GetConstWeightsOperandAsTensor(index) : GetConstOperandAsTensor(index);
+        if (!blob) return nullptr;
+        mConstRegionBlobs[region] = blob;
+    }
+    blobs[index] = blob;
+    return blob;
+}
+
 // uint8_t* buffer;
 // The length of the buffer.
 // uint32_t length;
@@ -1011,6 +791,77 @@ bool PreparedModel::initializeRunTimeOperandInfo() {
     return true;
 }
 
+// Converting the weights and biases is most of the cost of initialize(). The
+// conversions don't depend on each other, so the constant operands the
+// operations will ask for are converted here on a pool of threads, before the
+// graph is stitched together serially from the ready blobs. A conversion that
+// fails leaves no blob, the operation converts it again and reports the error.
+// Operands sharing a region of memory are converted once.
+void PreparedModel::convertConstOperands() {
+    std::vector<std::pair<uint32_t, bool>> jobs;  // operand index, as weights
+    std::vector<ConstRegion> regions;
+    auto add = [&](uint32_t index, bool weights) {
+        if (!isConst(index)) return;
+        ConstRegion region = constRegion(index, weights);
+        // one conversion per region, a failed one is left to the operation
+        if (!mConstRegionBlobs.emplace(region, nullptr).second) return;
+        jobs.emplace_back(index, weights);
+        regions.push_back(std::move(region));
+    };
+    for (const auto& operation : mModel.operations) {
+        switch (operation.type) {
+            case OperationType::CONV_2D:
+            case OperationType::FULLY_CONNECTED:
+                add(operation.inputs[1], false);
+                add(operation.inputs[2], false);
+                break;
+            case OperationType::DEPTHWISE_CONV_2D:
+                add(operation.inputs[1], true);
+                add(operation.inputs[2], false);
+                break;
+            case OperationType::ADD:
+                add(operation.inputs[0], false);
+                add(operation.inputs[1], false);
+                break;
+            default:
+                break;
+        }
+    }
+    if (jobs.empty()) return;
+
+    const size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    size_t threads = android::base::GetUintProperty<uint32_t>("nn.hal.prepare_threads", 0);
+    if (threads == 0) threads = cpus;
+    threads = std::min(threads, jobs.size());
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Blob::Ptr> blobs(jobs.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&] {
+        // the transforms of one blob share the cpus left to this thread
+        layout::setThreadMaxThreads(std::max<size_t>(1, cpus / threads));
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+            try {
+                blobs[i] = jobs[i].second ? GetConstWeightsOperandAsTensor(jobs[i].first)
+                                          : GetConstOperandAsTensor(jobs[i].first);
+            } catch (const std::exception& ex) {
+                ALOGW("converting operand %u failed: %s", jobs[i].first, ex.what());
+            }
+        }
+        layout::setThreadMaxThreads(0);
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& thread : pool) thread.join();
+
+    for (size_t i = 0; i < jobs.size(); i++) mConstRegionBlobs[regions[i]] = blobs[i];
+    VLOG(L1, "converted %zu constant operands on %zu threads in %lld ms", jobs.size(), threads,
+         static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    std::chrono::steady_clock::now() - start)
+                                    .count()));
+}
+
 bool PreparedModel::initialize() {
     VLOG(L1, "initialize");
     bool success = false;
@@ -1038,7 +889,40 @@ bool PreparedModel::initialize() {
         return false;
     }
 
-    for (const auto& operation : mModel.operations) {
+    // Opt-in: bind the NHWC request buffers without permuting them. Inputs converted
+    // to FP16 for the Myriad get a copy anyway and keep the NCHW layout.
+    mNhwcInput = android::base::GetBoolProperty("nn.hal.nhwc_input", false);
+#ifdef MYRIAD_FP16
+    if (mTargetDevice == TargetDevice::eMYRIAD) mNhwcInput = false;
+#endif
+
+    // IRDocument::Pass bits of the graph passes run when the network is built
+    mNet.setPasses(android::base::GetUintProperty<uint32_t>("nn.hal.graph_passes",
+                                                             IRDocument::kAllPasses));
+
+    mMaxBatch = requestedBatch();
+
+    // The layers of a network from the compilation cache can't be traced back to
+    // the operations, a profiled model is always built.
+    const uint32_t profileInterval = LayerProfile::interval();
+
+    // the latency is reported for a network built here or from the cache alike
+    char name[64];
+    snprintf(name, sizeof(name), "%s model %p",
+             InferenceEngine::TargetDeviceInfo::name(mTargetDevice), this);
+    mLatency.reset(new LatencyStats(name));
+
+    std::string cacheKey;
+    if (CompilationCache::get().enabled()) {
+        cacheKey = compilationCacheKey();
+        if (profileInterval == 0 && initializeFromCache(cacheKey)) return true;
+    }
+
+    convertConstOperands();
+
+    for (uint32_t i = 0; i < mModel.operations.size(); i++) {
+        const auto& operation = mModel.operations[i];
+        mNet.context().setOperation(i);
         VLOG(L1, "get operation %d ready to add", operation.type);
         dumpOperation(operation);
         switch (operation.type) {
@@ -1100,6 +984,12 @@ bool PreparedModel::initialize() {
         }
         VLOG(L1, "convert operation %d success", operation.type);
     }
+    mNet.context().setOperation(-1);
+
+    // the layers hold the blobs from here on
+    mConstBlobs.clear();
+    mConstWeightsBlobs.clear();
+    mConstRegionBlobs.clear();
 
     initializeInput();
     finalizeOutput();
@@ -1107,24 +997,100 @@ bool PreparedModel::initialize() {
     // initialize IE operation input/output ports
     //    convertModel(mNet);
 
-    // debug graph
     mNet.buildNetwork();
-    std::fstream dot;
-    std::string graphfile("/data/local/graphfile");
-    dot.open("/data/local/graph.dot", std::ios::out);
-    mNet.save(graphfile);
-    mNet.crateDotFile(dot);
-    dot.close();
+    // debug graph, nn.hal.dump_graph
+    dumpGraph(mNet, InferenceEngine::TargetDeviceInfo::name(mTargetDevice));
 
     VLOG(L1, "initialize ExecuteNetwork for device %s",
          InferenceEngine::TargetDeviceInfo::name(mTargetDevice));
     enginePtr = new ExecuteNetwork(mNet, mTargetDevice);
-    enginePtr->prepareInput();
-    enginePtr->loadNetwork();
+    enginePtr->prepareInput(mNhwcInput);
+    enginePtr->enablePerfCount(profileInterval > 0);
+    enginePtr->enableDynamicBatch(mMaxBatch);
+    // size of the infer request pool, the device default when unset
+    enginePtr->loadNetwork(android::base::GetUintProperty<uint32_t>("nn.hal.infer_requests", 0));
+    if (profileInterval > 0) {
+        mLayerProfile.reset(
+            new LayerProfile(name, mNet.context().operations(), profileInterval));
+    }
+    // executions failing with DEVICE_UNAVAILABLE past it, 0 waits forever
+    enginePtr->setInferTimeout(
+        android::base::GetIntProperty<int64_t>("nn.hal.infer_timeout_ms", 10000));
+    initializeBatching();
+
+    if (!cacheKey.empty()) storeToCache(cacheKey);
 
     return true;
 }
 
+// Everything besides the model the network built by initialize() depends on
+// goes in the salt.
+std::string PreparedModel::compilationCacheKey() {
+    CompilationCache::Pools pools;
+    for (size_t i = 0; i < mPoolInfos.size(); i++)
+        pools.emplace_back(mPoolInfos[i].buffer, mModel.pools[i].size());
+
+    std::string salt = InferenceEngine::TargetDeviceInfo::name(mTargetDevice);
+    salt += " " + ExecuteNetwork::pluginVersion(mTargetDevice);
+    salt += std::string(" ") + mNet.precision().name();
+    salt += mNhwcInput ? " nhwc" : " nchw";
+    salt += " passes " + std::to_string(mNet.passes());
+    if (mMaxBatch > 1) salt += " batch " + std::to_string(mMaxBatch);
+    return CompilationCache::key(mModel, pools, salt);
+}
+
+// On a hit the operations are not converted: the cached network is imported,
+// or read and loaded when the plugin can't import it, and only the ports of
+// the model inputs and outputs are recreated, by name, for asyncExecute().
+bool PreparedModel::initializeFromCache(const std::string& key) {
+    CompilationCache::Entry entry;
+    if (!CompilationCache::get().lookup(key, &entry)) return false;
+
+    std::vector<uint32_t> indexes(mModel.inputIndexes);
+    indexes.insert(indexes.end(), mModel.outputIndexes.begin(), mModel.outputIndexes.end());
+    for (uint32_t index : indexes) {
+        if (entry.ports.find(index) == entry.ports.end()) {
+            ALOGW("compilation cache entry %s misses operand %u", key.c_str(), index);
+            return false;
+        }
+    }
+
+    const size_t numRequests =
+        android::base::GetUintProperty<uint32_t>("nn.hal.infer_requests", 0);
+    std::unique_ptr<ExecuteNetwork> engine(new ExecuteNetwork(mTargetDevice));
+    engine->enableDynamicBatch(mMaxBatch);
+    if (entry.blobPath.empty() || !engine->importNetwork(entry.blobPath, numRequests)) {
+        if (!engine->readNetwork(entry.xmlPath, entry.binPath)) return false;
+        engine->prepareInput(mNhwcInput);
+        engine->loadNetwork(numRequests);
+    }
+
+    for (uint32_t index : indexes)
+        mPorts[index] =
+            std::make_shared<InferenceEngine::Data>(entry.ports[index], Precision::FP32);
+    engine->setInferTimeout(
+        android::base::GetIntProperty<int64_t>("nn.hal.infer_timeout_ms", 10000));
+    enginePtr = engine.release();
+    initializeBatching();
+    ALOGI("network for device %s from compilation cache %s",
+          InferenceEngine::TargetDeviceInfo::name(mTargetDevice), key.c_str());
+    return true;
+}
+
+void PreparedModel::storeToCache(const std::string& key) {
+    CompilationCache::PortNames ports;
+    for (uint32_t index : mModel.inputIndexes) ports[index] = mPorts[index]->name;
+    for (uint32_t index : mModel.outputIndexes) ports[index] = mPorts[index]->name;
+
+    CompilationCache::get().store(key,
+                                  [this](const std::string& base) {
+                                      mNet.save(base);
+                                      enginePtr->exportNetwork(base + ".blob");
+                                      return true;
+                                  },
+                                  ports);
+}
+
 void PreparedModel::deinitialize() {
     VLOG(L1, "deinitialize");
     delete enginePtr;
@@ -1183,22 +1149,70 @@ void printOperandbuf(int level, const uint8_t* buffer, const std::vector<uint32_
 
 #endif
 
+// One queue per target device, shared by all the models prepared for it. The CPU
+// plugin already spreads each inference over the cores, the VPU runs one at a time.
+static ExecutionQueue& getExecutionQueue(TargetDevice device) {
+    if (device == TargetDevice::eCPU) {
+        static ExecutionQueue cpuQueue("nnhal-cpu",
+                                       std::max(1u, std::thread::hardware_concurrency() / 2), 32);
+        return cpuQueue;
+    }
+    static ExecutionQueue vpuQueue("nnhal-vpu", 1, 32);
+    return vpuQueue;
+}
+
+// Drops the reference on a worker. The last one deletes the ExecuteNetwork,
+// which waits for the plugin threads and must not run on one of them.
+static void releaseOnWorker(TargetDevice device, sp<PreparedModel>& model) {
+    std::function<void()> release = [model] {};
+    model.clear();
+    getExecutionQueue(device).post(std::move(release));
+}
+
+// Holds the model for an inference until the plugin completed it, past a
+// timeout too: the ExecuteNetwork never goes while the device runs one of its
+// requests. The completion drops it on a plugin thread, the model on a worker.
+class ModelHold {
+public:
+    ModelHold(PreparedModel* model, TargetDevice device) : mModel(model), mDevice(device) {}
+    ~ModelHold() { releaseOnWorker(mDevice, mModel); }
+
+    PreparedModel* get() const { return mModel.get(); }
+
+private:
+    sp<PreparedModel> mModel;
+    TargetDevice mDevice;
+};
+
 void PreparedModel::asyncExecute(const Request& request, const sp<IExecutionCallback>& callback) {
+    LatencyStats::Timer timer(mLatency.get());
     std::vector<RunTimePoolInfo> requestPoolInfos;
-    if (!setRunTimePoolInfosFromHidlMemories(&requestPoolInfos, request.pools)) {
+    if (!setRunTimePoolInfosFromHidlMemories(&requestPoolInfos, request.pools,
+                                             &mRequestPoolCache)) {
         callback->notify(ErrorStatus::GENERAL_FAILURE);
         return;
     }
+    timer.mark(LatencyStats::MAP_POOLS);
 
     // std::vector<IRBlob::Ptr> input;
     // std::vector<TBlob<float>::Ptr> output;
-    auto inOutData = [this, &requestPoolInfos](const std::vector<uint32_t>& indexes,
-                                               const hidl_vec<RequestArgument>& arguments,
-                                               bool inputFromRequest, ExecuteNetwork* enginePtr,
-                                               std::vector<OutputPort> mPorts) {
+    // Requests run concurrently, each binds its buffers to its own infer request
+    // and works on a copy of the operand info.
+    const int requestId = enginePtr->acquireInferRequest();
+    if (requestId < 0) {
+        callback->notify(ErrorStatus::DEVICE_UNAVAILABLE);
+        return;
+    }
+    VLOG(L1, "using infer request %d", requestId);
+    timer.mark(LatencyStats::WAIT_REQUEST);
+
+    auto inOutData = [this, &requestPoolInfos, requestId, &timer](
+                         const std::vector<uint32_t>& indexes,
+                         const hidl_vec<RequestArgument>& arguments, bool inputFromRequest,
+                         ExecuteNetwork* enginePtr, const std::vector<OutputPort>& mPorts) {
         // do memcpy for input data
         for (size_t i = 0; i < indexes.size(); i++) {
-            RunTimeOperandInfo& operand = mOperands[indexes[i]];
+            RunTimeOperandInfo operand = mOperands[indexes[i]];
             const RequestArgument& arg = arguments[i];
             auto poolIndex = arg.location.poolIndex;
             nnAssert(poolIndex < requestPoolInfos.size());
@@ -1223,10 +1237,12 @@ void PreparedModel::asyncExecute(const Request& request, const sp<IExecutionCall
                 auto inputBlob = GetInOutOperandAsBlob(
                     operand, const_cast<uint8_t*>(r.buffer + arg.location.offset),
                     operand.length);  // if not doing memcpy
+                timer.mark(LatencyStats::CONVERT_INPUTS);
                 VLOG(L1, "setBlob for mPorts[%d]->name %s", indexes[i],
                      mPorts[indexes[i]]->name.c_str());
-                enginePtr->setBlob(mPorts[indexes[i]]->name,
+                enginePtr->setBlob(requestId, mPorts[indexes[i]]->name,
                                    inputBlob);  // setInputBlob(const std::string &,IRBlob::Ptr);
+                timer.mark(LatencyStats::SET_BLOB);
 
             } else {
                 // inference engine output pointer pass to model/request oputput
@@ -1246,7 +1262,9 @@ void PreparedModel::asyncExecute(const Request& request, const sp<IExecutionCall
                 auto outputBlob = GetInOutOperandAsBlob(
                     operand, const_cast<uint8_t*>(r.buffer + arg.location.offset),
                     operand.length);  // if not doing memcpy
-                enginePtr->setBlob(mPorts[indexes[i]]->name, outputBlob);
+                enginePtr->setBlob(requestId, mPorts[indexes[i]]->name, outputBlob);
+                // the outputs are written in place, nothing to convert
+                timer.mark(LatencyStats::SET_BLOB);
 
                 // memcpy(r.buffer + arg.location.offset, tmpbuffer, operand.length);
             }
@@ -1266,22 +1284,65 @@ void PreparedModel::asyncExecute(const Request& request, const sp<IExecutionCall
 
     VLOG(L1, "Run");
 
-    // auto output = execute.Infer(input).wait();
-    enginePtr->Infer();
+    // The worker is free for the next request as soon as the inference started,
+    // the plugin completes it on its own thread. The completion keeps the request
+    // pools, which the blobs point into, mapped, and the model alive until the
+    // plugin is done with them, also when the caller was told of a timeout.
+    auto pools = std::make_shared<std::vector<RunTimePoolInfo>>(std::move(requestPoolInfos));
+    auto hold = std::make_shared<ModelHold>(this, mTargetDevice);
+    enginePtr->InferAsync(requestId, [hold, requestId, pools, callback, timer](StatusCode status) {
+        hold->get()->finishExecute(requestId, status, *pools, callback, timer);
+    });
+}
+
+static ErrorStatus toErrorStatus(StatusCode status) {
+    switch (status) {
+        case StatusCode::OK:
+            return ErrorStatus::NONE;
+        case StatusCode::RESULT_NOT_READY:  // timed out
+        case StatusCode::REQUEST_BUSY:
+            return ErrorStatus::DEVICE_UNAVAILABLE;
+        default:
+            return ErrorStatus::GENERAL_FAILURE;
+    }
+}
+
+void PreparedModel::finishExecute(int requestId, StatusCode status,
+                                  std::vector<RunTimePoolInfo>& requestPoolInfos,
+                                  const sp<IExecutionCallback>& callback,
+                                  LatencyStats::Timer timer) {
+    timer.mark(LatencyStats::INFER);
+    // failed executions are left out of the latencies
+    if (status != StatusCode::OK) {
+        ALOGE("infer request %d failed with status %d", requestId, status);
+        enginePtr->releaseInferRequest(requestId);
+        Return<void> returned = callback->notify(toErrorStatus(status));
+        if (!returned.isOk()) {
+            ALOGE("hidl callback failed to return properly: %s", returned.description().c_str());
+        }
+        return;
+    }
 
     //    VLOG(L1, "copy model output to request output");
 
+    // read before the request runs another inference
+    if (mLayerProfile) {
+        mLayerProfile->add(enginePtr->getPerformanceCounts(requestId));
+        timer.skip();
+    }
+
     VLOG(L1, "update shared memories");
-    for (auto runtimeInfo : requestPoolInfos) {
+    for (auto& runtimeInfo : requestPoolInfos) {
         runtimeInfo.update();
     }
+    timer.mark(LatencyStats::SYNC_POOLS);
 
 #ifdef NN_DEBUG
     {
         VLOG(L1, "Model output0 are:");
         const RunTimeOperandInfo& output = mOperands[mModel.outputIndexes[0]];
         InferenceEngine::TBlob<float>::Ptr outBlob =
-            enginePtr->getBlob(mPorts[mModel.outputIndexes[0]]->name);
+            enginePtr->getBlob(requestId, mPorts[mModel.outputIndexes[0]]->name);
 
         auto nelem = (outBlob->size() > 20 ? 20 : outBlob->size());
         for (int i = 0; i < nelem; i++) {
@@ -1297,7 +1358,7 @@ void PreparedModel::asyncExecute(const Request& request, const sp<IExecutionCall
         VLOG(L1, "Model input0 are:");
         const RunTimeOperandInfo& input = mOperands[mModel.inputIndexes[0]];
         InferenceEngine::TBlob<float>::Ptr inBlob =
-            enginePtr->getBlob(mPorts[mModel.inputIndexes[0]]->name);
+            enginePtr->getBlob(requestId, mPorts[mModel.inputIndexes[0]]->name);
         nelem = (inBlob->size() > 20 ? 20 : inBlob->size());
         for (int i = 0; i < nelem; i++) {
             VLOG(L1, "inBlob elements %d = %f", i, inBlob->readOnly()[i]);
@@ -1325,10 +1386,14 @@ void PreparedModel::asyncExecute(const Request& request, const sp<IExecutionCall
     }
 #endif
 
+    enginePtr->releaseInferRequest(requestId);
+
     Return<void> returned = callback->notify(ErrorStatus::NONE);
     if (!returned.isOk()) {
         ALOGE("hidl callback failed to return properly: %s", returned.description().c_str());
     }
+    timer.mark(LatencyStats::NOTIFY);
+    timer.finish();
 }
 
 Return<ErrorStatus> PreparedModel::execute(const Request& request,
@@ -1351,15 +1416,230 @@ Return<ErrorStatus> PreparedModel::execute(const Request& request,
         return ErrorStatus::INVALID_ARGUMENT;
     }
 
-    // This thread is intentionally detached because the vpu driver service
-    // is expected to live forever.
-    std::thread([this, request, callback] { asyncExecute(request, callback); }).detach();
+    if (mBatcher) {
+        // the inference is sized for the operands of the model, nothing else
+        auto fits = [this](const hidl_vec<RequestArgument>& arguments,
+                           const hidl_vec<uint32_t>& indexes) {
+            for (size_t i = 0; i < arguments.size(); i++) {
+                const auto& dims = mModel.operands[indexes[i]].dimensions;
+                if (arguments[i].hasNoValue ||
+                    arguments[i].location.length != sizeof(float) * getNumberOfElements(dims))
+                    return false;
+            }
+            return true;
+        };
+        if (!fits(request.inputs, mModel.inputIndexes) ||
+            !fits(request.outputs, mModel.outputIndexes)) {
+            ALOGE("request arguments do not fit the batched inference");
+            callback->notify(ErrorStatus::INVALID_ARGUMENT);
+            return ErrorStatus::INVALID_ARGUMENT;
+        }
+        BatchedRequest batched;
+        batched.request = request;
+        batched.callback = callback;
+        if (mBatcher->add(std::move(batched)) && !submitCollector())
+            return ErrorStatus::DEVICE_UNAVAILABLE;
+        VLOG(L1, "Request batched");
+        return ErrorStatus::NONE;
+    }
+
+    sp<PreparedModel> self(this);
+    if (!getExecutionQueue(mTargetDevice)
+             .submit([self, request, callback] { self->asyncExecute(request, callback); })) {
+        callback->notify(ErrorStatus::DEVICE_UNAVAILABLE);
+        return ErrorStatus::DEVICE_UNAVAILABLE;
+    }
 
-    VLOG(L1, "Start execute thread done");
+    VLOG(L1, "Request queued");
 
     return ErrorStatus::NONE;
 }
 
+// Opt-in: up to nn.hal.max_batch concurrent requests run as one inference, the
+// first one waits at most nn.hal.batch_window_us for the others. The requests
+// are stacked on the batch dimension, so the model inputs and outputs need one
+// of size 1, and only the CPU plugin runs partial batches.
+size_t PreparedModel::requestedBatch() {
+    const size_t batch = android::base::GetUintProperty<uint32_t>("nn.hal.max_batch", 0);
+    if (batch <= 1) return 1;
+    if (mTargetDevice != TargetDevice::eCPU) {
+        ALOGW("nn.hal.max_batch is not supported on %s",
+              InferenceEngine::TargetDeviceInfo::name(mTargetDevice));
+        return 1;
+    }
+    std::vector<uint32_t> indexes(mModel.inputIndexes);
+    indexes.insert(indexes.end(), mModel.outputIndexes.begin(), mModel.outputIndexes.end());
+    for (uint32_t index : indexes) {
+        const Operand& operand = mModel.operands[index];
+        const auto& dims = operand.dimensions;
+        if (operand.type != OperandType::TENSOR_FLOAT32 ||
+            (dims.size() != 2 && dims.size() != 4) || dims[0] != 1 ||
+            std::find(dims.begin(), dims.end(), 0) != dims.end()) {
+            ALOGI("operand %u can't be batched, requests run one by one", index);
+            return 1;
+        }
+    }
+    return batch;
+}
+
+// After the network was loaded. Each infer request gets blobs for a full batch,
+// bound once, shaped like the blobs of a single request otherwise.
+void PreparedModel::initializeBatching() {
+    mMaxBatch = enginePtr->getMaxBatch();
+    if (mMaxBatch <= 1) return;
+
+    std::vector<uint32_t> indexes(mModel.inputIndexes);
+    indexes.insert(indexes.end(), mModel.outputIndexes.begin(), mModel.outputIndexes.end());
+    mBatchBlobs.resize(enginePtr->numInferRequests());
+    for (size_t id = 0; id < mBatchBlobs.size(); id++) {
+        for (uint32_t index : indexes) {
+            RunTimeOperandInfo operand = mOperands[index];
+            uint32_t length = 0;
+            Blob::Ptr sample = GetInOutOperandAsBlob(operand, nullptr, length);
+            SizeVector dims = sample->getTensorDesc().getDims();
+            dims[0] = mMaxBatch;
+            Layout layout = sample->getTensorDesc().getLayout();
+            if (operand.lifetime == OperandLifeTime::MODEL_INPUT && mNhwcInput &&
+                dims.size() == 4)
+                layout = Layout::NHWC;
+            auto blob = std::make_shared<InferenceEngine::TBlob<float>>(
+                TensorDesc(sample->getTensorDesc().getPrecision(), dims, layout));
+            blob->allocate();
+            enginePtr->setBlob(static_cast<int>(id), mPorts[index]->name, blob);
+            mBatchBlobs[id][index] = blob;
+        }
+    }
+
+    const uint32_t windowUs =
+        android::base::GetUintProperty<uint32_t>("nn.hal.batch_window_us", 2000);
+    char name[64];
+    snprintf(name, sizeof(name), "%s model %p batcher",
+             InferenceEngine::TargetDeviceInfo::name(mTargetDevice), this);
+    mBatcher.reset(new RequestBatcher<BatchedRequest>(name, mMaxBatch,
+                                                      std::chrono::microseconds(windowUs)));
+    ALOGI("batches of up to %zu requests within %u us", mMaxBatch, windowUs);
+}
+
+// Has a worker gather the batches. The requests waiting for it fail when
+// the queue is shutting down.
+bool PreparedModel::submitCollector() {
+    sp<PreparedModel> self(this);
+    if (getExecutionQueue(mTargetDevice).submit([self] { self->collectBatch(); })) return true;
+    for (auto& batched : mBatcher->drain())
+        batched.callback->notify(ErrorStatus::DEVICE_UNAVAILABLE);
+    return false;
+}
+
+// Takes the batches until none is left. A worker does not submit another
+// collector, it would block on a full queue the workers have to drain.
+void PreparedModel::collectBatch() {
+    bool more = true;
+    while (more) {
+        std::vector<BatchedRequest> batch = mBatcher->take(&more);
+        VLOG(L1, "batch of %zu requests", batch.size());
+        asyncExecuteBatch(batch);
+    }
+}
+
+// As asyncExecute() for several requests: their inputs are copied to their
+// slice of the batch blobs, NHWC inputs permuted to NCHW on the way.
+void PreparedModel::asyncExecuteBatch(std::vector<BatchedRequest>& batch) {
+    LatencyStats::Timer timer(mLatency.get());
+    auto mapped = std::make_shared<std::vector<BatchedRequest>>();
+    for (auto& batched : batch) {
+        if (!setRunTimePoolInfosFromHidlMemories(&batched.poolInfos, batched.request.pools,
+                                                 &mRequestPoolCache)) {
+            batched.callback->notify(ErrorStatus::GENERAL_FAILURE);
+            continue;
+        }
+        mapped->push_back(std::move(batched));
+    }
+    if (mapped->empty()) return;
+    timer.mark(LatencyStats::MAP_POOLS);
+
+    const int requestId = enginePtr->acquireInferRequest();
+    if (requestId < 0) {
+        for (auto& batched : *mapped) batched.callback->notify(ErrorStatus::DEVICE_UNAVAILABLE);
+        return;
+    }
+    VLOG(L1, "using infer request %d for %zu requests", requestId, mapped->size());
+    timer.mark(LatencyStats::WAIT_REQUEST);
+
+    for (size_t slot = 0; slot < mapped->size(); slot++) {
+        const BatchedRequest& batched = (*mapped)[slot];
+        for (size_t i = 0; i < mModel.inputIndexes.size(); i++) {
+            const uint32_t index = mModel.inputIndexes[i];
+            const DataLocation& location = batched.request.inputs[i].location;
+            Blob::Ptr& blob = mBatchBlobs[requestId][index];
+            const size_t bytes = blob->byteSize() / mMaxBatch;
+            uint8_t* dst = blob->buffer().as<uint8_t*>() + slot * bytes;
+            const uint8_t* src = batched.poolInfos[location.poolIndex].buffer + location.offset;
+            if (blob->getTensorDesc().getLayout() == Layout::NCHW)
+                layout::permute(reinterpret_cast<float*>(dst), reinterpret_cast<const float*>(src),
+                                toDims(mOperands[index].dimensions), {0, 3, 1, 2});
+            else
+                memcpy(dst, src, bytes);
+        }
+    }
+    timer.mark(LatencyStats::CONVERT_INPUTS);
+
+    if (!enginePtr->setBatch(requestId, mapped->size())) {
+        enginePtr->releaseInferRequest(requestId);
+        for (auto& batched : *mapped) batched.callback->notify(ErrorStatus::GENERAL_FAILURE);
+        return;
+    }
+    timer.mark(LatencyStats::SET_BLOB);
+
+    auto hold = std::make_shared<ModelHold>(this, mTargetDevice);
+    enginePtr->InferAsync(requestId, [hold, requestId, mapped, timer](StatusCode status) {
+        hold->get()->finishBatch(requestId, status, *mapped, timer);
+    });
+}
+
+void PreparedModel::finishBatch(int requestId, StatusCode status,
+                                std::vector<BatchedRequest>& batch, LatencyStats::Timer timer) {
+    timer.mark(LatencyStats::INFER);
+    if (status != StatusCode::OK) {
+        ALOGE("infer request %d failed with status %d on a batch of %zu", requestId, status,
+              batch.size());
+        enginePtr->releaseInferRequest(requestId);
+        for (auto& batched : batch) batched.callback->notify(toErrorStatus(status));
+        return;
+    }
+
+    if (mLayerProfile) {
+        mLayerProfile->add(enginePtr->getPerformanceCounts(requestId));
+        timer.skip();
+    }
+
+    for (size_t slot = 0; slot < batch.size(); slot++) {
+        BatchedRequest& batched = batch[slot];
+        for (size_t i = 0; i < mModel.outputIndexes.size(); i++) {
+            const DataLocation& location = batched.request.outputs[i].location;
+            const Blob::Ptr& blob = mBatchBlobs[requestId][mModel.outputIndexes[i]];
+            const size_t bytes = blob->byteSize() / mMaxBatch;
+            memcpy(batched.poolInfos[location.poolIndex].buffer + location.offset,
+                   blob->cbuffer().as<const uint8_t*>() + slot * bytes, bytes);
+        }
+    }
+    timer.mark(LatencyStats::CONVERT_OUTPUTS);
+    enginePtr->releaseInferRequest(requestId);
+
+    for (auto& batched : batch)
+        for (auto& runtimeInfo : batched.poolInfos) runtimeInfo.update();
+    timer.mark(LatencyStats::SYNC_POOLS);
+
+    for (auto& batched : batch) {
+        Return<void> returned = batched.callback->notify(ErrorStatus::NONE);
+        if (!returned.isOk()) {
+            ALOGE("hidl callback failed to return properly: %s",
+                  returned.description().c_str());
+        }
+    }
+    timer.mark(LatencyStats::NOTIFY);
+    timer.finish();
+}
+
 template <typename T>
 T getOperandConstVal(const Model& model, const Operand& operand) {
     const T* data = reinterpret_cast<const T*>(&model.operandValues[operand.location.offset]);
@@ -1518,18 +1798,20 @@ bool PreparedModel::operationAdd(const Operation& operation) {
     VLOG(L1, "isIn0Const = %d isIn1Const = %d \n", isIn0Const, isIn1Const);
     if (isIn0Const || isIn1Const) {
         if (isIn0Const && isIn1Const) {
-            VLOG(L1, "adding 2 constants, we can do it now and put const as output");
-            nnAssert(true);
-        }
-        // this will use ScaleShift
-        if (isIn0Const)  // if op.inputs[1] is a Model input
+            // the const folding pass of the document replaces the sum by its value
+            VLOG(L1, "adding 2 constants, folded to one const when the network is built");
+            auto in0 = getConstBlob(operation.inputs[0]);
+            auto in1 = getConstBlob(operation.inputs[1]);
+            out = Sum(mNet.context(), Const(mNet, in0, in0->getTensorDesc().getDims()),
+                      Const(mNet, in1, in1->getTensorDesc().getDims()));
+        } else if (isIn0Const)  // if op.inputs[1] is a Model input
             out = AddConst(mNet, getPort(operation.inputs[1]),
-                           GetConstOperandAsTensor(operation.inputs[0]));
+                           getConstBlob(operation.inputs[0]));
         else  // isIn1Const is const //op.inputs[0] is a Model input
             out = AddConst(mNet, getPort(operation.inputs[0]),
-                           GetConstOperandAsTensor(operation.inputs[1]));
+                           getConstBlob(operation.inputs[1]));
     } else {  // both inputs[0] & inputs[1] are model inputs
-        out = getPort(operation.inputs[0]) + getPort(operation.inputs[1]);
+        out = Sum(mNet.context(), getPort(operation.inputs[0]), getPort(operation.inputs[1]));
     }
     // check fusion
     VLOG(L1, "check fusion parameter = %d\n", PARAM_I32(2));
@@ -1685,7 +1967,7 @@ bool PreparedModel::operationAveragePool2D(const Operation& operation) {
         }
     }
 
-    auto out = Pooling(input, kernel, stride, pad_start, pad_end, padType,
+    auto out = Pooling(mNet.context(), input, kernel, stride, pad_start, pad_end, padType,
                        InferenceEngine::PoolingLayer::PoolType::AVG);
     mPorts[operation.outputs[0]] = handleFusion(out, PARAM_I32(fusion_index));
 
@@ -1782,7 +2064,7 @@ bool PreparedModel::operationMaxPool2D(const Operation& operation) {
         }
     }
 
-    auto out = Pooling(input, kernel, stride, pad_start, pad_end, padType,
+    auto out = Pooling(mNet.context(), input, kernel, stride, pad_start, pad_end, padType,
                        InferenceEngine::PoolingLayer::PoolType::MAX);
     mPorts[operation.outputs[0]] = handleFusion(out, PARAM_I32(fusion_index));
 
@@ -1807,7 +2089,7 @@ bool PreparedModel::operationConCat(const Operation& operation) {
 	axis = PARAM_I32(n);
 
     for (int i = 0; i < n; i++) inputs.push_back(getPort(operation.inputs[i]));
-    auto out = Concat(inputs, axis);
+    auto out = Concat(mNet.context(), inputs, axis);
     mPorts[operation.outputs[0]] = out;
 
     return true;
@@ -1905,9 +2187,9 @@ bool PreparedModel::operationConv2D(const Operation& operation) {
     ***/
 
     auto input = getPort(operation.inputs[0]);
-    auto filter = GetConstOperandAsTensor(operation.inputs[1]);  // OIHW
+    auto filter = getConstBlob(operation.inputs[1]);  // OIHW
     // auto filter = GetConstWeightsOperandAsTensor(operation.inputs[1]);
-    auto bias = GetConstOperandAsTensor(operation.inputs[2]);
+    auto bias = getConstBlob(operation.inputs[2]);
 
     const auto inputDims = input->getTensorDesc().getDims();
     const auto filterDims = filter->getTensorDesc().getDims();
@@ -2059,7 +2341,7 @@ bool PreparedModel::operationConv2D(const Operation& operation) {
 
     // auto out = Convolution(input, prms) + bias;
     prms.biases = static_cast<IRBlob::Ptr>(bias);
-    auto out = Convolution(input, prms);
+    auto out = Convolution(mNet.context(), input, prms);
 
     if (fusion_index < 0) {
         VLOG(L1, "invalid fusion index");
@@ -2171,9 +2453,9 @@ bool PreparedModel::operationDepthwiseConv2D(const Operation& operation) {
     auto input = getPort(operation.inputs[0]);
     // auto filter = GetConstOperandAsTensor(operation.inputs[1]); //NCHW [1, depth_out,
     // filter_height, filter_width]
-    auto filter = GetConstWeightsOperandAsTensor(
+    auto filter = getConstWeightsBlob(
         operation.inputs[1]);  //[depth_out, 1, filter_height, filter_width] OIHW
-    auto bias = GetConstOperandAsTensor(operation.inputs[2]);
+    auto bias = getConstBlob(operation.inputs[2]);
 
     const auto inputDims = input->getTensorDesc().getDims();
     const auto filterDims = filter->getTensorDesc().getDims();
@@ -2331,7 +2613,7 @@ bool PreparedModel::operationDepthwiseConv2D(const Operation& operation) {
 
     // auto out = Convolution(input, prms) + bias;
     prms.biases = static_cast<IRBlob::Ptr>(bias);
-    auto out = Convolution(input, prms);
+    auto out = Convolution(mNet.context(), input, prms);
 
     if (fusion_index < 0) {
         VLOG(L1, "invalid fusion index");
@@ -2396,8 +2678,8 @@ bool PreparedModel::operationFullyConnected(const Operation& operation) {
      */
 
     auto input = getPort(operation.inputs[0]);
-    auto weights = GetConstOperandAsTensor(operation.inputs[1]);
-    auto bias = GetConstOperandAsTensor(operation.inputs[2]);
+    auto weights = getConstBlob(operation.inputs[1]);
+    auto bias = getConstBlob(operation.inputs[2]);
 
     auto inputDims = input->getTensorDesc().getDims();
     for (auto i = 0; i < inputDims.size(); i++) VLOG(L1, "input dims[%d] = %d ", i, inputDims[i]);
@@ -2450,7 +2732,7 @@ bool PreparedModel::operationFullyConnected(const Operation& operation) {
                  strechDim, outDims[strechDim]);
         }
 
-        input = Reshape(outDims, input);
+        input = Reshape(mNet.context(), outDims, input);
 
         /*
                 //Reshape
@@ -2502,7 +2784,7 @@ bool PreparedModel::operationFullyConnected(const Operation& operation) {
         weights->getTensorDesc().setDims(dims);
         //WA end
     */
-    auto out = weights * input + bias;
+    auto out = AddTryConst(mNet.context(), FullyConnected(mNet.context(), weights, input), bias);
 
     mPorts[operation.outputs[0]] = handleFusion(out, PARAM_I32(3));
 
@@ -2526,7 +2808,7 @@ bool PreparedModel::operationL2Normalization(const Operation& operation) {
      */
     // mPorts[operation.outputs[0]] = L2Normalization(getPort(operation.inputs[0]), true, false);
     mPorts[operation.outputs[0]] =
-        L2Normalization(getPort(operation.inputs[0]), false, false);  // passing accross false
+        L2Normalization(mNet.context(), getPort(operation.inputs[0]), false, false);  // passing accross false
     return true;
 }
 
@@ -2547,14 +2829,14 @@ bool PreparedModel::operationLRN(const Operation& operation) {
     int size = PARAM_I32(1);
     float k = PARAM_FP(2);
     // mPorts[operation.outputs[0]] = LRN(getPort(operation.inputs[0]), alpha, beta, size, true, k);
-    mPorts[operation.outputs[0]] = LRN(getPort(operation.inputs[0]), alpha, beta, size, false, k);
+    mPorts[operation.outputs[0]] = LRN(mNet.context(), getPort(operation.inputs[0]), alpha, beta, size, false, k);
 
     return true;
 }
 
 bool PreparedModel::operationLogisticSigmoid(const Operation& operation) {
     VLOG(L1, "OperationType::LOGISTIC");
-    mPorts[operation.outputs[0]] = Sigmoid(getPort(operation.inputs[0]));
+    mPorts[operation.outputs[0]] = Sigmoid(mNet.context(), getPort(operation.inputs[0]));
 
     return true;
 }
@@ -2569,13 +2851,14 @@ bool PreparedModel::operationLSTM(const Operation& operation)
 */
 bool PreparedModel::operationMUL(const Operation& operation) {
     mPorts[operation.outputs[0]] =
-        handleFusion(getPort(operation.inputs[0]) * getPort(operation.inputs[1]), PARAM_I32(2));
+        handleFusion(Mul(mNet.context(), getPort(operation.inputs[0]), getPort(operation.inputs[1])),
+                     PARAM_I32(2));
     return true;
 }
 
 bool PreparedModel::operationRELU(const Operation& operation) {
     VLOG(L1, "OperationType::RELU");
-    mPorts[operation.outputs[0]] = ReLU(getPort(operation.inputs[0]));
+    mPorts[operation.outputs[0]] = ReLU(mNet.context(), getPort(operation.inputs[0]));
     return true;
 }
 
@@ -2598,7 +2881,7 @@ bool PreparedModel::operationRELU1(const Operation& operation) {
      * 0: The output tensor of same shape as input0.
      */
 
-    mPorts[operation.outputs[0]] = Clamp(getPort(operation.inputs[0]), -1, 1);
+    mPorts[operation.outputs[0]] = Clamp(mNet.context(), getPort(operation.inputs[0]), -1, 1);
     return true;
 }
 
@@ -2621,7 +2904,7 @@ bool PreparedModel::operationRELU6(const Operation& operation) {
      * 0: The output tensor of same shape as input0.
      */
 
-    mPorts[operation.outputs[0]] = Clamp(getPort(operation.inputs[0]), 0, 6);
+    mPorts[operation.outputs[0]] = Clamp(mNet.context(), getPort(operation.inputs[0]), 0, 6);
     return true;
 }
 
@@ -2692,7 +2975,7 @@ bool PreparedModel::operationReshape(const Operation& operation) {
         nnAssert(false);
     }
     // Note: " error [VPU] Unsupported 1 D dimensions" for reshape output and fix me
-    mPorts[operation.outputs[0]] = Reshape(outDims, input);
+    mPorts[operation.outputs[0]] = Reshape(mNet.context(), outDims, input);
 
     return true;
 }
@@ -2757,7 +3040,7 @@ bool PreparedModel::operationSoftmax(const Operation& operation) {
         }
     */
 
-    mPorts[operation.outputs[0]] = Softmax(input);
+    mPorts[operation.outputs[0]] = Softmax(mNet.context(), input);
     float beta /*scale*/ = PARAM_FP(1);
     /*
         if (scale != 1.0f) {
@@ -2777,7 +3060,7 @@ bool PreparedModel::operationSoftmax(const Operation& operation) {
 
 bool PreparedModel::operationTANH(const Operation& operation) {
     VLOG(L1, "OperationType::TANH");
-    mPorts[operation.outputs[0]] = Tanh(getPort(operation.inputs[0]));
+    mPorts[operation.outputs[0]] = Tanh(mNet.context(), getPort(operation.inputs[0]));
 
     return true;
 }
@@ -2890,86 +3173,37 @@ IRBlob::Ptr VpuPreparedModel::GetConstWeightsOperandAsTensor(uint32_t index) {
 #ifndef MYRIAD_FP32  // Myriad only supprts FP16
         vec<unsigned int> order;
         Layout layout;
-        Layout input_layout;
         if (op.dimensions.size() == 4) {
-            order = {3, 0, 1, 2};         // IHWO -> OIHW for depth conv
-            layout = Layout::OIHW;        // weights layout
-            input_layout = Layout::NHWC;  // same memory layout as OHWI
+            order = {3, 0, 1, 2};   // IHWO -> OIHW for depth conv
+            layout = Layout::OIHW;  // weights layout
         } else if (op.dimensions.size() == 2) {
             order = {0, 1};
             layout = Layout::NC;
-            input_layout = Layout::NC;
         } else {
             order = {0};  //(op.dimensions.size() < 2)
             layout = Layout::C;
-            input_layout = Layout::C;
         }
 
         auto inputDims = toDims(op.dimensions);
-        TensorDesc td(InferenceEngine::Precision::FP16, inputDims, input_layout);
-        // todo: create a readOnly blob that accepts const pointers
-        InferenceEngine::TBlob<short>::Ptr blob =
-            std::make_shared<InferenceEngine::TBlob<short>>(td);
-        blob->allocate();
-        auto mem = blob->data();
-        short* fp16Array = mem.as<short*>();
-        // convert from [(float *)buf, len] to fp16Array,
         uint32_t nelem = getNumberOfElements(op.dimensions);
-        // short *inputFilter_fp16 = new short[nelem];
-
         size_t fp16Array_length = nelem * sizeof(short);
 
-        VLOGDIMS(L1, permuteDims(toDims(op.dimensions), order), "weights/bias dims");
+        VLOGDIMS(L1, permuteDims(inputDims, order), "weights/bias dims");
         VLOG(L1,
              "Model buffer oplength = %d bytes nelem= %d fp16Array_length= %d bytes sizeof model "
              "buf= %d bytes\n",
              len, nelem, fp16Array_length, sizeof(buf));
 
-        f32tof16Arrays(fp16Array, (float*)buf, nelem);  // OHWI memory layout
-        // floattofp16(fp16Array, (float *)buf, nelem);
-
-        if (inputDims.size() != 4) {
-            // InferenceEngine::TBlob<short>::Ptr blob =
-            // std::make_shared<InferenceEngine::TBlob<short>>(td,(short *)inputFilter_fp16,
-            // fp16Array_length);
-            return blob;
-        } else {
-            TensorDesc td(InferenceEngine::Precision::FP16, permuteDims(inputDims, order), layout);
-            InferenceEngine::TBlob<short>::Ptr blob_oihw =
-                std::make_shared<InferenceEngine::TBlob<short>>(td);
-            blob_oihw->allocate();
-
-            auto dims_ohwi = inputDims;  // toDims(op.dimensions);
-            size_t out_depth = dims_ohwi[0];
-            size_t in_depth = dims_ohwi[3];
-            size_t height = dims_ohwi[1];
-            size_t width = dims_ohwi[2];
-            size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-            // const short* inputFilter = reinterpret_cast<const short *>(buf); //OHWI memory layout
-
-            for (size_t i = 0; i < in_depth; i++) {
-                for (size_t o = 0; o < out_depth; o++) {
-                    for (size_t h = 0; h < height; h++) {
-                        for (size_t w = 0; w < width; w++) {
-                            size_t offset_ohwi = o * height * width * in_depth +
-                                                 h * width * in_depth + w * in_depth +
-                                                 i;  // similar to NHWC memory layout
-                            // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)] =
-                            // inputFilter[offset_ohwi];
-                            blob_oihw->buffer().as<short*>()[offset++] =
-                                blob->buffer().as<short*>()[offset_ohwi];
-                            // size_t offset_oihw = o*in_depth*height*width + i*height*width +
-                            // h*width + w; //similar to NCHW memory layout
-                            // blob->buffer().as<float*>()[offset_oihw] = inputFilter[offset_ohwi];
-                            // VLOG(L1, "offset_ohwi= %d offset_oihw= %d", offset_ohwi,
-                            // offset_oihw);
-                        }
-                    }
-                }
-            }
+        // convert from [(float *)buf, len] straight into the final layout; the model buffer has
+        // NHWC memory layout and is read only once
+        TensorDesc td(InferenceEngine::Precision::FP16, permuteDims(inputDims, order), layout);
+        InferenceEngine::TBlob<short>::Ptr blob =
+            std::make_shared<InferenceEngine::TBlob<short>>(td);
+        blob->allocate();
+        layout::permuteToFp16(blob->buffer().as<short*>(), reinterpret_cast<const float*>(buf),
+                              inputDims, order);
 
-            return blob_oihw;
-        }
+        return blob;
 #else  // FP32 support
         vec<unsigned int> order;
         Layout layout;
@@ -3021,86 +3255,37 @@ IRBlob::Ptr VpuPreparedModel::GetConstOperandAsTensor(uint32_t index) {
 
         vec<unsigned int> order;
         Layout layout;
-        Layout input_layout;
         if (op.dimensions.size() == 4) {
-            order = {0, 3, 1, 2};         // nhwc -> nchw
-            layout = Layout::OIHW;        // weights layout
-            input_layout = Layout::NHWC;  // same memory layout as OHWI
+            order = {0, 3, 1, 2};   // nhwc -> nchw
+            layout = Layout::OIHW;  // weights layout
         } else if (op.dimensions.size() == 2) {
             order = {0, 1};
             layout = Layout::NC;
-            input_layout = Layout::NC;
         } else {
             order = {0};  //(op.dimensions.size() < 2)
             layout = Layout::C;
-            input_layout = Layout::C;
         }
 
         auto inputDims = toDims(op.dimensions);
-        TensorDesc td(InferenceEngine::Precision::FP16, inputDims, input_layout);
-        // todo: create a readOnly blob that accepts const pointers
-        InferenceEngine::TBlob<short>::Ptr blob =
-            std::make_shared<InferenceEngine::TBlob<short>>(td);
-        blob->allocate();
-        auto mem = blob->data();
-        short* fp16Array = mem.as<short*>();
-        // convert from [(float *)buf, len] to fp16Array,
         uint32_t nelem = getNumberOfElements(op.dimensions);
-        // short *inputFilter_fp16 = new short[nelem];
-
         size_t fp16Array_length = nelem * sizeof(short);
 
-        VLOGDIMS(L1, permuteDims(toDims(op.dimensions), order), "weights/bias dims");
+        VLOGDIMS(L1, permuteDims(inputDims, order), "weights/bias dims");
         VLOG(L1,
              "Model buffer oplength = %d bytes nelem= %d fp16Array_length= %d bytes sizeof model "
              "buf= %d bytes\n",
              len, nelem, fp16Array_length, sizeof(buf));
 
-        f32tof16Arrays(fp16Array, (float*)buf, nelem);  // OHWI memory layout
-        // floattofp16(fp16Array, (float *)buf, nelem);
-
-        if (inputDims.size() != 4) {
-            // InferenceEngine::TBlob<short>::Ptr blob =
-            // std::make_shared<InferenceEngine::TBlob<short>>(td,(short *)inputFilter_fp16,
-            // fp16Array_length);
-            return blob;
-        } else {
-            TensorDesc td(InferenceEngine::Precision::FP16, permuteDims(inputDims, order), layout);
-            InferenceEngine::TBlob<short>::Ptr blob_oihw =
-                std::make_shared<InferenceEngine::TBlob<short>>(td);
-            blob_oihw->allocate();
-
-            auto dims_ohwi = inputDims;  // toDims(op.dimensions);
-            size_t out_depth = dims_ohwi[0];
-            size_t in_depth = dims_ohwi[3];
-            size_t height = dims_ohwi[1];
-            size_t width = dims_ohwi[2];
-            size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-            // const short* inputFilter = reinterpret_cast<const short *>(buf); //OHWI memory layout
-
-            for (size_t o = 0; o < out_depth; o++) {
-                for (size_t i = 0; i < in_depth; i++) {
-                    for (size_t h = 0; h < height; h++) {
-                        for (size_t w = 0; w < width; w++) {
-                            size_t offset_ohwi = o * height * width * in_depth +
-                                                 h * width * in_depth + w * in_depth +
-                                                 i;  // similar to NHWC memory layout
-                            // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)] =
-                            // inputFilter[offset_ohwi];
-                            blob_oihw->buffer().as<short*>()[offset++] =
-                                blob->buffer().as<short*>()[offset_ohwi];
-                            // size_t offset_oihw = o*in_depth*height*width + i*height*width +
-                            // h*width + w; //similar to NCHW memory layout
-                            // blob->buffer().as<float*>()[offset_oihw] = inputFilter[offset_ohwi];
-                            // VLOG(L1, "offset_ohwi= %d offset_oihw= %d", offset_ohwi,
-                            // offset_oihw);
-                        }
-                    }
-                }
-            }
+        // convert from [(float *)buf, len] straight into the final layout; the model buffer has
+        // NHWC memory layout and is read only once
+        TensorDesc td(InferenceEngine::Precision::FP16, permuteDims(inputDims, order), layout);
+        InferenceEngine::TBlob<short>::Ptr blob =
+            std::make_shared<InferenceEngine::TBlob<short>>(td);
+        blob->allocate();
+        layout::permuteToFp16(blob->buffer().as<short*>(), reinterpret_cast<const float*>(buf),
+                              inputDims, order);
 
-            return blob_oihw;
-        }
+        return blob;
 #else  // FP32 support
         vec<unsigned int> order;
         Layout layout;
@@ -3179,40 +3364,19 @@ Blob::Ptr VpuPreparedModel::GetInOutOperandAsBlob(RunTimeOperandInfo& op, const
                     InferenceEngine::TBlob<float>::Ptr blob =
                         std::make_shared<InferenceEngine::TBlob<float>>(td, (float*)buf, len);
                     return blob;
+                } else if (mNhwcInput) {
+                    // the network input is NHWC, wrap the request buffer without a copy
+                    TensorDesc nhwc(InferenceEngine::Precision::FP32,
+                                    permuteDims(inputDims, order), Layout::NHWC);
+                    return InferenceEngine::make_shared_blob<float>(nhwc, (float*)buf, len);
                 } else {
                     InferenceEngine::TBlob<float>::Ptr blob =
                         std::make_shared<InferenceEngine::TBlob<float>>(td);
                     blob->allocate();
 
-                    auto dims_nhwc = inputDims;  // toDims(op.dimensions);
-                    size_t batch = dims_nhwc[0];
-                    size_t in_depth = dims_nhwc[3];  // channels
-                    size_t height = dims_nhwc[1];
-                    size_t width = dims_nhwc[2];
-                    size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-                    const float* input = reinterpret_cast<const float*>(buf);  // OHWI memory layout
-
                     // convert NHWC -> NCHW
-
-                    for (size_t b = 0; b < batch; b++) {
-                        for (size_t i = 0; i < in_depth; i++) {
-                            for (size_t h = 0; h < height; h++) {
-                                for (size_t w = 0; w < width; w++) {
-                                    size_t offset_nhwc = b * height * width * in_depth +
-                                                         h * width * in_depth + w * in_depth +
-                                                         i;  // similar to NHWC memory layout
-                                    blob->buffer().as<float*>()[offset++] = input[offset_nhwc];
-                                    // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)]
-                                    // = input[offset_nhwc]; size_t offset_nchw =
-                                    // b*in_depth*height*width + i*height*width + h*width + w;
-                                    // //similar to NCHW memory layout
-                                    // blob->buffer().as<float*>()[offset_oihw] =
-                                    // inputFilter[offset_ohwi]; VLOG(L1, "offset_nhwc= %d
-                                    // offset_nchw= %d", offset_nhwc, offset_nchw);
-                                }
-                            }
-                        }
-                    }
+                    layout::permute(blob->buffer().as<float*>(),
+                                    reinterpret_cast<const float*>(buf), inputDims, order);
 
                     return blob;
                 }
@@ -3288,7 +3452,7 @@ Blob::Ptr VpuPreparedModel::GetInOutOperandAsBlob(RunTimeOperandInfo& op, const
             if (buf == nullptr) {
                 VLOG(L1, "Request model input buffer is null pointer");
             } else {
-                f32tof16Arrays(fp16Array, (float*)buf, nelem);
+                fp16::f32tof16Arrays(fp16Array, (float*)buf, nelem);
             }
 
             return blob;
@@ -3323,7 +3487,7 @@ Blob::Ptr VpuPreparedModel::GetInOutOperandAsBlob(RunTimeOperandInfo& op, const
                 nnAssert(false);
             }
             // need memcpy after infer output ??
-            f16tof32Arrays((float*)buf, fp16Array, length);
+            fp16::f16tof32Arrays((float*)buf, fp16Array, length);
 
             return blob;
         }
@@ -3376,46 +3540,19 @@ IRBlob::Ptr CpuPreparedModel::GetConstWeightsOperandAsTensor(uint32_t index) {
             blob->allocate();
             return blob;
         } else {
-            if (inputDims.size() != 4) {
-                InferenceEngine::TBlob<float>::Ptr blob =
-                    std::make_shared<InferenceEngine::TBlob<float>>(td, (float*)buf, len);
-                return blob;
+            if (layout::keepsOrder(inputDims, order)) {
+                // already in the IE order (not 4-D, 1x1 kernels): no copy
+                return wrapConstOperand(index, td);
             } else {
                 InferenceEngine::TBlob<float>::Ptr blob =
                     std::make_shared<InferenceEngine::TBlob<float>>(td);
                 blob->allocate();
 
-                auto dims_ohwi = inputDims;  // toDims(op.dimensions);
-                size_t out_depth = dims_ohwi[0];
-                size_t in_depth = dims_ohwi[3];
-                size_t height = dims_ohwi[1];
-                size_t width = dims_ohwi[2];
-                size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-                const float* inputFilter =
-                    reinterpret_cast<const float*>(buf);  // OHWI memory layout
-
                 // convert OHWI -> OIHW
-
                 // for depth conv need reorder as IOHW since for tflite O is always 1 and IE expects
                 // reorder to [in_channels, depth_multiplier, filter_height, filter_width]
-                for (size_t i = 0; i < in_depth; i++) {
-                    for (size_t o = 0; o < out_depth; o++) {
-                        for (size_t h = 0; h < height; h++) {
-                            for (size_t w = 0; w < width; w++) {
-                                size_t offset_ohwi = o * height * width * in_depth +
-                                                     h * width * in_depth + w * in_depth +
-                                                     i;  // similar to NHWC memory layout
-                                blob->buffer().as<float*>()[offset++] = inputFilter[offset_ohwi];
-                                // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)]
-                                // = inputFilter[offset_ohwi]; size_t offset_oihw =
-                                // o*in_depth*height*width + i*height*width + h*width + w; //similar
-                                // to NCHW memory layout blob->buffer().as<float*>()[offset_oihw] =
-                                // inputFilter[offset_ohwi]; VLOG(L1, "offset_ohwi= %d offset_oihw=
-                                // %d", offset_ohwi, offset_oihw);
-                            }
-                        }
-                    }
-                }
+                layout::permute(blob->buffer().as<float*>(), reinterpret_cast<const float*>(buf),
+                                inputDims, order);
 
                 return blob;
             }
@@ -3472,43 +3609,16 @@ IRBlob::Ptr CpuPreparedModel::GetConstOperandAsTensor(uint32_t index) {
             blob->allocate();
             return blob;
         } else {
-            if (inputDims.size() != 4) {
-                InferenceEngine::TBlob<float>::Ptr blob =
-                    std::make_shared<InferenceEngine::TBlob<float>>(td, (float*)buf, len);
-                return blob;
+            if (layout::keepsOrder(inputDims, order)) {
+                // already in the IE order (not 4-D, 1x1 kernels): no copy
+                return wrapConstOperand(index, td);
             } else {
                 InferenceEngine::TBlob<float>::Ptr blob =
                     std::make_shared<InferenceEngine::TBlob<float>>(td);
                 blob->allocate();
 
-                auto dims_ohwi = inputDims;  // toDims(op.dimensions);
-                size_t out_depth = dims_ohwi[0];
-                size_t in_depth = dims_ohwi[3];
-                size_t height = dims_ohwi[1];
-                size_t width = dims_ohwi[2];
-                size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-                const float* inputFilter =
-                    reinterpret_cast<const float*>(buf);  // OHWI memory layout
-
-                for (size_t o = 0; o < out_depth; o++) {
-                    for (size_t i = 0; i < in_depth; i++) {
-                        for (size_t h = 0; h < height; h++) {
-                            for (size_t w = 0; w < width; w++) {
-                                size_t offset_ohwi = o * height * width * in_depth +
-                                                     h * width * in_depth + w * in_depth +
-                                                     i;  // similar to NHWC memory layout
-                                // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)]
-                                // = inputFilter[offset_ohwi];
-                                blob->buffer().as<float*>()[offset++] = inputFilter[offset_ohwi];
-                                // size_t offset_oihw = o*in_depth*height*width + i*height*width +
-                                // h*width + w; //similar to NCHW memory layout
-                                // blob->buffer().as<float*>()[offset_oihw] =
-                                // inputFilter[offset_ohwi]; VLOG(L1, "offset_ohwi= %d offset_oihw=
-                                // %d", offset_ohwi, offset_oihw);
-                            }
-                        }
-                    }
-                }
+                layout::permute(blob->buffer().as<float*>(), reinterpret_cast<const float*>(buf),
+                                inputDims, order);
 
                 return blob;
             }
@@ -3568,40 +3678,19 @@ Blob::Ptr CpuPreparedModel::GetInOutOperandAsBlob(RunTimeOperandInfo& op, const
                     InferenceEngine::TBlob<float>::Ptr blob =
                         std::make_shared<InferenceEngine::TBlob<float>>(td, (float*)buf, len);
                     return blob;
+                } else if (mNhwcInput) {
+                    // the network input is NHWC, wrap the request buffer without a copy
+                    TensorDesc nhwc(InferenceEngine::Precision::FP32,
+                                    permuteDims(inputDims, order), Layout::NHWC);
+                    return InferenceEngine::make_shared_blob<float>(nhwc, (float*)buf, len);
                 } else {
                     InferenceEngine::TBlob<float>::Ptr blob =
                         std::make_shared<InferenceEngine::TBlob<float>>(td);
                     blob->allocate();
 
-                    auto dims_nhwc = inputDims;  // toDims(op.dimensions);
-                    size_t batch = dims_nhwc[0];
-                    size_t in_depth = dims_nhwc[3];  // channels
-                    size_t height = dims_nhwc[1];
-                    size_t width = dims_nhwc[2];
-                    size_t offset = 0;  // blob->size() == o*i*h*w and simlar to nchw memory layout
-                    const float* input = reinterpret_cast<const float*>(buf);  // OHWI memory layout
-
                     // convert NHWC -> NCHW
-
-                    for (size_t b = 0; b < batch; b++) {
-                        for (size_t i = 0; i < in_depth; i++) {
-                            for (size_t h = 0; h < height; h++) {
-                                for (size_t w = 0; w < width; w++) {
-                                    size_t offset_nhwc = b * height * width * in_depth +
-                                                         h * width * in_depth + w * in_depth +
-                                                         i;  // similar to NHWC memory layout
-                                    blob->buffer().as<float*>()[offset++] = input[offset_nhwc];
-                                    // blob->buffer().as<float*>()[blob->getTensorDesc().offset(offset++)]
-                                    // = input[offset_nhwc]; size_t offset_nchw =
-                                    // b*in_depth*height*width + i*height*width + h*width + w;
-                                    // //similar to NCHW memory layout
-                                    // blob->buffer().as<float*>()[offset_oihw] =
-                                    // inputFilter[offset_ohwi]; VLOG(L1, "offset_nhwc= %d
-                                    // offset_nchw= %d", offset_nhwc, offset_nchw);
-                                }
-                            }
-                        }
-                    }
+                    layout::permute(blob->buffer().as<float*>(),
+                                    reinterpret_cast<const float*>(buf), inputDims, order);
 
                     return blob;
                 }
@@ -24,10 +24,18 @@
 #include <sys/mman.h>
 #include <string>
 #include <fstream>
+#include <map>
+#include <tuple>
 
+#include "CompilationCache.h"
 #include "IENetwork.h"
+#include "LatencyStats.h"
+#include "LayerProfile.h"
+#include "PoolCache.h"
+#include "RequestBatcher.h"
 
 using ::android::hidl::memory::V1_0::IMemory;
+using ::nnhal::LatencyStats;
 using namespace IRBuilder;
 using namespace InferenceEngine;
 
@@ -90,14 +98,18 @@ struct RunTimePoolInfo {
     sp<IMemory> memory;
     hidl_memory hidlMemory;
     uint8_t* buffer;
+    // keeps the pool mapped while it is in use
+    std::shared_ptr<MappedPool> mapping;
 
-    bool set(const hidl_memory& hidlMemory);
+    bool set(const hidl_memory& hidlMemory, PoolCache* cache = nullptr);
     bool update();
 };
 
 
+// The mappings are looked up in the cache first when one is given.
 bool setRunTimePoolInfosFromHidlMemories(std::vector<RunTimePoolInfo>* poolInfos,
-                                         const hidl_vec<hidl_memory>& pools);
+                                         const hidl_vec<hidl_memory>& pools,
+                                         PoolCache* cache = nullptr);
 
 
 
@@ -109,19 +121,22 @@ bool setRunTimePoolInfosFromHidlMemories(std::vector<RunTimePoolInfo>* poolInfos
 class PreparedModel : public IPreparedModel {
 public:
     PreparedModel(const Model& model)
-          :mTargetDevice(TargetDevice::eMYRIAD), mModel(model), mNet("nnNet"), enginePtr(nullptr) {
-        IRBuilder::g_layer_precision = InferenceEngine::Precision::FP16;
+          :mTargetDevice(TargetDevice::eMYRIAD), mModel(model), mNet("nnNet", layerPrecision(TargetDevice::eMYRIAD)),
+           enginePtr(nullptr) {
     }
 
     PreparedModel(const TargetDevice device, const Model& model)
-          :mTargetDevice(device), mModel(model), mNet("nnNet"), enginePtr(nullptr) {
-        if (mTargetDevice == TargetDevice::eCPU)
-           IRBuilder::g_layer_precision = InferenceEngine::Precision::FP32;
-           //using type = typename InferenceEngine::PrecisionTrait<IRBuilder::g_layer_precision>::value_type;
-        else if (mTargetDevice == TargetDevice::eMYRIAD)
-           IRBuilder::g_layer_precision = InferenceEngine::Precision::FP16;
+          :mTargetDevice(device), mModel(model), mNet("nnNet", layerPrecision(device)), enginePtr(nullptr) {
+    }
+
+    // precision of the layers built for the device
+    static InferenceEngine::Precision layerPrecision(TargetDevice device) {
+        if (device == TargetDevice::eCPU)
+           return InferenceEngine::Precision::FP32;
+        else if (device == TargetDevice::eMYRIAD)
+           return InferenceEngine::Precision::FP16;
         else
-           IRBuilder::g_layer_precision = InferenceEngine::Precision::UNSPECIFIED;
+           return InferenceEngine::Precision::UNSPECIFIED;
     }
 
     ~PreparedModel() override {deinitialize();}
@@ -133,7 +148,27 @@ public:
 protected:
     void deinitialize();
     bool initializeRunTimeOperandInfo();
+    std::string compilationCacheKey();
+    bool initializeFromCache(const std::string& key);
+    void storeToCache(const std::string& key);
     void asyncExecute(const Request& request, const sp<IExecutionCallback>& callback);
+    void finishExecute(int requestId, StatusCode status,
+                       std::vector<RunTimePoolInfo>& requestPoolInfos,
+                       const sp<IExecutionCallback>& callback, LatencyStats::Timer timer);
+
+    // A request waiting for the others of its batch, nn.hal.max_batch
+    struct BatchedRequest {
+        Request request;
+        sp<IExecutionCallback> callback;
+        std::vector<RunTimePoolInfo> poolInfos;
+    };
+    size_t requestedBatch();
+    void initializeBatching();
+    bool submitCollector();
+    void collectBatch();
+    void asyncExecuteBatch(std::vector<BatchedRequest>& batch);
+    void finishBatch(int requestId, StatusCode status, std::vector<BatchedRequest>& batch,
+                     LatencyStats::Timer timer);
 
     bool operationAdd(const Operation& operation);
     bool operationAveragePool2D(const Operation& operation);
@@ -172,18 +207,61 @@ protected:
     virtual Blob::Ptr GetConstOperandAsTensor(uint32_t index);
     virtual Blob::Ptr GetInOutOperandAsBlob(RunTimeOperandInfo& op, const uint8_t *buf, uint32_t& len);
     virtual Blob::Ptr GetConstWeightsOperandAsTensor(uint32_t index);
+    Blob::Ptr wrapConstOperand(uint32_t index, const TensorDesc& td);
     void SetOperandMemory(const Model &model, uint32_t index, uint32_t &len_out, const uint8_t *buf);
     void SetOperandFromTensor(uint8_t* buf, uint32_t &length, Blob::Ptr infOutput);
     bool isConst(int index);
     OutputPort getPort(int index);
+    // The bytes of a constant operand and the way they are converted. Operands
+    // with the same region convert to the same blob.
+    struct ConstRegion {
+        OperandLifeTime lifetime;  // CONSTANT_COPY: offset into operandValues
+        uint32_t poolIndex;
+        uint32_t offset;
+        uint32_t length;
+        bool weights;  // GetConstWeightsOperandAsTensor() layout
+        OperandType type;
+        std::vector<uint32_t> dimensions;
+
+        bool operator<(const ConstRegion& other) const {
+            return std::tie(lifetime, poolIndex, offset, length, weights, type, dimensions) <
+                   std::tie(other.lifetime, other.poolIndex, other.offset, other.length,
+                            other.weights, other.type, other.dimensions);
+        }
+    };
+    ConstRegion constRegion(uint32_t index, bool weights) const;
+    Blob::Ptr cachedConstBlob(uint32_t index, bool weights);
+    void convertConstOperands();
+    Blob::Ptr getConstBlob(uint32_t index);
+    Blob::Ptr getConstWeightsBlob(uint32_t index);
 
     TargetDevice mTargetDevice;
     Model mModel;
     std::vector<RunTimeOperandInfo> mOperands;
     std::vector<RunTimePoolInfo> mPoolInfos;
+    // request pools stay mapped across executions
+    PoolCache mRequestPoolCache;
     IRDocument mNet;
     std::vector<OutputPort> mPorts;  //typedef std::shared_ptr<Data> DataPtr;
+    // Blobs of the constant operands while the network is built, by operand
+    // index as GetConstOperandAsTensor() and GetConstWeightsOperandAsTensor()
+    // return them, and by region, filled by convertConstOperands() and on demand.
+    std::map<uint32_t, Blob::Ptr> mConstBlobs;
+    std::map<uint32_t, Blob::Ptr> mConstWeightsBlobs;
+    std::map<ConstRegion, Blob::Ptr> mConstRegionBlobs;
     ExecuteNetwork* enginePtr;
+    // 4-D inputs are bound in NHWC, the request layout, instead of permuted to NCHW
+    bool mNhwcInput = false;
+    // layer times of the inferences, nn.hal.profile_layers
+    std::unique_ptr<LayerProfile> mLayerProfile;
+    // phases of the executions, logged and in `lshal debug`
+    std::unique_ptr<LatencyStats> mLatency;
+    // Batches of concurrent requests, one inference each, when nn.hal.max_batch
+    // is set. The inputs are stacked into blobs of the infer request, by
+    // request id then operand index, and the outputs copied back from them.
+    size_t mMaxBatch = 1;
+    std::unique_ptr<RequestBatcher<BatchedRequest>> mBatcher;
+    std::vector<std::map<uint32_t, Blob::Ptr>> mBatchBlobs;
 
 };
 
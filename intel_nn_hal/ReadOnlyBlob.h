@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_READ_ONLY_BLOB_H
+#define ANDROID_ML_NN_READ_ONLY_BLOB_H
+
+#include <ie_blob.h>
+#include <memory>
+#include "PoolCache.h"
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+// A blob over constant operand memory the model already holds, a mapped
+// CONSTANT_REFERENCE pool or the CONSTANT_COPY operand values, instead of a
+// copy of it. The blob neither allocates nor frees the memory. It keeps the pool
+// mapped while the network uses it. The layers and the plugins only read
+// weights and biases; the data must not be written through buffer().
+template <typename T>
+class ReadOnlyBlob : public InferenceEngine::TBlob<T> {
+public:
+    typedef std::shared_ptr<ReadOnlyBlob<T>> Ptr;
+
+    // mapping is null for memory owned by the model
+    ReadOnlyBlob(const InferenceEngine::TensorDesc& tensorDesc, const T* data, size_t size,
+                 std::shared_ptr<MappedPool> mapping)
+          : InferenceEngine::TBlob<T>(tensorDesc, const_cast<T*>(data), size),
+            mMapping(std::move(mapping)) {}
+
+private:
+    std::shared_ptr<MappedPool> mMapping;
+};
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_READ_ONLY_BLOB_H
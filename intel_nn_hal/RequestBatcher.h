@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_REQUEST_BATCHER_H
+#define ANDROID_ML_NN_REQUEST_BATCHER_H
+
+#include <log/log.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+// Gathers the requests arriving within a short window into batches of up to
+// maxBatch. The batcher has no thread of its own: add() tells the caller when
+// a collector has to be started, the collector calls take() on a worker until
+// no item is left, each take() waits until the batch is full or the window of
+// its oldest request is over. There is at most one collector at a time.
+template <typename T>
+class RequestBatcher {
+public:
+    RequestBatcher(const std::string& name, size_t maxBatch, std::chrono::microseconds window)
+        : mName(name), mMaxBatch(maxBatch > 0 ? maxBatch : 1), mWindow(window) {}
+
+    size_t maxBatch() const { return mMaxBatch; }
+
+    // Queues the item. Returns true when the caller has to start a collector.
+    bool add(T item) {
+        std::unique_lock<std::mutex> lock(mLock);
+        Pending pending;
+        pending.item = std::move(item);
+        pending.arrived = std::chrono::steady_clock::now();
+        mPending.push_back(std::move(pending));
+        if (!mCollecting) {
+            mCollecting = true;
+            return true;
+        }
+        const bool full = mPending.size() >= mMaxBatch;
+        lock.unlock();
+        if (full) mFull.notify_one();
+        return false;
+    }
+
+    // The next batch, at least one item. Sets *more when items are left, the
+    // collector takes them next.
+    std::vector<T> take(bool* more) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mFull.wait_until(lock, mPending.front().arrived + mWindow,
+                         [this] { return mPending.size() >= mMaxBatch; });
+
+        std::vector<T> batch;
+        while (!mPending.empty() && batch.size() < mMaxBatch) {
+            batch.push_back(std::move(mPending.front().item));
+            mPending.pop_front();
+        }
+        mCollecting = !mPending.empty();
+        *more = mCollecting;
+
+        mBatches++;
+        mItems += batch.size();
+        if (mBatches % kStatsLogInterval == 0) {
+            ALOGD("%s: %.2f requests per batch over %llu batches", mName.c_str(),
+                  static_cast<double>(mItems) / mBatches,
+                  static_cast<unsigned long long>(mBatches));
+        }
+        return batch;
+    }
+
+    // Hands back the items of a collector that could not be started.
+    std::vector<T> drain() {
+        std::lock_guard<std::mutex> lock(mLock);
+        std::vector<T> items;
+        for (auto& pending : mPending) items.push_back(std::move(pending.item));
+        mPending.clear();
+        mCollecting = false;
+        return items;
+    }
+
+private:
+    struct Pending {
+        T item;
+        std::chrono::steady_clock::time_point arrived;
+    };
+
+    static const uint64_t kStatsLogInterval = 256;
+
+    const std::string mName;
+    const size_t mMaxBatch;
+    const std::chrono::microseconds mWindow;
+
+    std::mutex mLock;
+    std::condition_variable mFull;
+    std::deque<Pending> mPending;
+    bool mCollecting = false;
+
+    uint64_t mBatches = 0;
+    uint64_t mItems = 0;
+};
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_REQUEST_BATCHER_H
@@ -0,0 +1,474 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ModelBuilder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cmath>
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+// the weights of each operand start on a cache line, as the runtime lays them out
+static const size_t kWeightsAlignment = 64;
+
+static size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t elementCount(const std::vector<uint32_t>& dims) {
+    size_t count = 1;
+    for (auto d : dims) count *= d;
+    return count;
+}
+
+std::shared_ptr<SharedPool> SharedPool::create(size_t size) {
+    if (size == 0) size = 1;
+    const char* dir = getenv("TMPDIR");
+    std::string path = std::string(dir != nullptr && *dir ? dir : "/tmp") + "/nnhal-bench-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemp(name.data());
+    if (fd < 0) return nullptr;
+    unlink(name.data());
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+
+    // fd, prot, offset low and high bits, as the runtime fills mmap_fd handles
+    native_handle_t* handle = native_handle_create(1, 3);
+    handle->data[0] = fd;
+    handle->data[1] = PROT_READ | PROT_WRITE;
+    handle->data[2] = 0;
+    handle->data[3] = 0;
+
+    std::shared_ptr<SharedPool> pool(new SharedPool());
+    pool->mData = static_cast<uint8_t*>(data);
+    pool->mSize = size;
+    pool->mMemory = hidl_memory("mmap_fd", hidl_handle(handle), size);
+    return pool;
+}
+
+SharedPool::~SharedPool() {
+    if (mData != nullptr) munmap(mData, mSize);
+}
+
+ModelBuilder::ModelBuilder() : mRandom(1) {}
+
+uint32_t ModelBuilder::addOperand(OperandType type, const Dims& dims, OperandLifeTime lifetime) {
+    Operand operand = {};
+    operand.type = type;
+    operand.dimensions = dims;
+    operand.lifetime = lifetime;
+    mModel.operands.push_back(operand);
+    return mModel.operands.size() - 1;
+}
+
+uint32_t ModelBuilder::addInput(const Dims& dims) {
+    uint32_t index = addOperand(OperandType::TENSOR_FLOAT32, dims, OperandLifeTime::MODEL_INPUT);
+    mModel.inputIndexes.push_back(index);
+    return index;
+}
+
+void ModelBuilder::addOutput(uint32_t index) {
+    mModel.operands[index].lifetime = OperandLifeTime::MODEL_OUTPUT;
+    mModel.outputIndexes.push_back(index);
+}
+
+uint32_t ModelBuilder::addTensor(const Dims& dims) {
+    return addOperand(OperandType::TENSOR_FLOAT32, dims, OperandLifeTime::TEMPORARY_VARIABLE);
+}
+
+uint32_t ModelBuilder::addConstCopy(OperandType type, const Dims& dims, const void* data,
+                                    size_t length) {
+    uint32_t index = addOperand(type, dims, OperandLifeTime::CONSTANT_COPY);
+    auto& values = mModel.operandValues;
+    size_t offset = alignUp(values.size(), 4);
+    values.resize(offset + length);
+    memcpy(&values[offset], data, length);
+    mModel.operands[index].location = {0, uint32_t(offset), uint32_t(length)};
+    return index;
+}
+
+uint32_t ModelBuilder::addInt32(int32_t value) {
+    return addConstCopy(OperandType::INT32, {}, &value, sizeof(value));
+}
+
+uint32_t ModelBuilder::addFloat32(float value) {
+    return addConstCopy(OperandType::FLOAT32, {}, &value, sizeof(value));
+}
+
+uint32_t ModelBuilder::addWeights(const Dims& dims, uint32_t fanIn) {
+    uint32_t index =
+        addOperand(OperandType::TENSOR_FLOAT32, dims, OperandLifeTime::CONSTANT_REFERENCE);
+    const size_t count = elementCount(dims);
+    const size_t offset = alignUp(mWeights.size(), kWeightsAlignment);
+    mWeights.resize(offset + count * sizeof(float));
+
+    const float range = std::sqrt(3.0f / fanIn);
+    std::uniform_real_distribution<float> distribution(-range, range);
+    float* values = reinterpret_cast<float*>(&mWeights[offset]);
+    for (size_t i = 0; i < count; i++) values[i] = distribution(mRandom);
+
+    mModel.operands[index].location = {0, uint32_t(offset), uint32_t(count * sizeof(float))};
+    return index;
+}
+
+uint32_t ModelBuilder::addOperation(OperationType type, const std::vector<uint32_t>& inputs,
+                                    const Dims& outputDims) {
+    uint32_t output = addTensor(outputDims);
+    Operation operation;
+    operation.type = type;
+    operation.inputs = inputs;
+    operation.outputs = {output};
+    mModel.operations.push_back(operation);
+    return output;
+}
+
+uint32_t ModelBuilder::conv(uint32_t input, uint32_t depth, uint32_t kernel, uint32_t stride,
+                            uint32_t padBegin, uint32_t padEnd,
+                            FusedActivationFunc activation) {
+    const Dims in = dims(input);
+    const uint32_t fanIn = kernel * kernel * in[3];
+    uint32_t filter = addWeights({depth, kernel, kernel, in[3]}, fanIn);
+    uint32_t bias = addWeights({depth}, fanIn);
+    const uint32_t height = (in[1] + padBegin + padEnd - kernel) / stride + 1;
+    const uint32_t width = (in[2] + padBegin + padEnd - kernel) / stride + 1;
+    return addOperation(OperationType::CONV_2D,
+                        {input, filter, bias, addInt32(padBegin), addInt32(padEnd),
+                         addInt32(padBegin), addInt32(padEnd), addInt32(stride), addInt32(stride),
+                         addInt32(int32_t(activation))},
+                        {in[0], height, width, depth});
+}
+
+uint32_t ModelBuilder::depthwiseConv(uint32_t input, uint32_t kernel, uint32_t stride,
+                                     uint32_t padBegin, uint32_t padEnd,
+                                     FusedActivationFunc activation) {
+    const Dims in = dims(input);
+    const uint32_t fanIn = kernel * kernel;
+    uint32_t filter = addWeights({1, kernel, kernel, in[3]}, fanIn);
+    uint32_t bias = addWeights({in[3]}, fanIn);
+    const uint32_t height = (in[1] + padBegin + padEnd - kernel) / stride + 1;
+    const uint32_t width = (in[2] + padBegin + padEnd - kernel) / stride + 1;
+    return addOperation(OperationType::DEPTHWISE_CONV_2D,
+                        {input, filter, bias, addInt32(padBegin), addInt32(padEnd),
+                         addInt32(padBegin), addInt32(padEnd), addInt32(stride), addInt32(stride),
+                         addInt32(1), addInt32(int32_t(activation))},
+                        {in[0], height, width, in[3]});
+}
+
+uint32_t ModelBuilder::pool(OperationType type, uint32_t input, uint32_t kernel,
+                            uint32_t stride) {
+    const Dims in = dims(input);
+    const uint32_t height = (in[1] - kernel) / stride + 1;
+    const uint32_t width = (in[2] - kernel) / stride + 1;
+    return addOperation(type,
+                        {input, addInt32(0), addInt32(0), addInt32(0), addInt32(0),
+                         addInt32(stride), addInt32(stride), addInt32(kernel), addInt32(kernel),
+                         addInt32(int32_t(FusedActivationFunc::NONE))},
+                        {in[0], height, width, in[3]});
+}
+
+uint32_t ModelBuilder::maxPool(uint32_t input, uint32_t kernel, uint32_t stride) {
+    return pool(OperationType::MAX_POOL_2D, input, kernel, stride);
+}
+
+uint32_t ModelBuilder::averagePool(uint32_t input, uint32_t kernel, uint32_t stride) {
+    return pool(OperationType::AVERAGE_POOL_2D, input, kernel, stride);
+}
+
+uint32_t ModelBuilder::lrn(uint32_t input, int32_t radius, float bias, float alpha, float beta) {
+    return addOperation(
+        OperationType::LOCAL_RESPONSE_NORMALIZATION,
+        {input, addInt32(radius), addFloat32(bias), addFloat32(alpha), addFloat32(beta)},
+        dims(input));
+}
+
+uint32_t ModelBuilder::fullyConnected(uint32_t input, uint32_t units,
+                                      FusedActivationFunc activation) {
+    const Dims in = dims(input);
+    const uint32_t inputSize = elementCount(in) / in[0];
+    uint32_t weights = addWeights({units, inputSize}, inputSize);
+    uint32_t bias = addWeights({units}, inputSize);
+    return addOperation(OperationType::FULLY_CONNECTED,
+                        {input, weights, bias, addInt32(int32_t(activation))}, {in[0], units});
+}
+
+uint32_t ModelBuilder::reshape(uint32_t input, const Dims& dims) {
+    std::vector<int32_t> shape(dims.begin(), dims.end());
+    uint32_t shapeIndex = addConstCopy(OperandType::TENSOR_INT32, {uint32_t(shape.size())},
+                                       shape.data(), shape.size() * sizeof(int32_t));
+    return addOperation(OperationType::RESHAPE, {input, shapeIndex}, dims);
+}
+
+uint32_t ModelBuilder::softmax(uint32_t input, float beta) {
+    return addOperation(OperationType::SOFTMAX, {input, addFloat32(beta)}, dims(input));
+}
+
+Model ModelBuilder::finish() {
+    for (const auto& operation : mModel.operations)
+        for (auto index : operation.inputs) mModel.operands[index].numberOfConsumers++;
+
+    if (!mWeights.empty()) {
+        auto pool = SharedPool::create(mWeights.size());
+        if (pool == nullptr) {
+            fprintf(stderr, "cannot create a pool of %zu bytes\n", mWeights.size());
+            abort();
+        }
+        memcpy(pool->data(), mWeights.data(), mWeights.size());
+        // the driver maps the file again, it outlives this mapping
+        mModel.pools = {pool->memory()};
+    }
+    mWeights.clear();
+    return mModel;
+}
+
+Model createMobileNet() {
+    const auto RELU6 = FusedActivationFunc::RELU6;
+    ModelBuilder builder;
+    uint32_t out = builder.addInput({1, 224, 224, 3});
+    // TensorFlow SAME padding: all of it at the end for stride 2
+    out = builder.conv(out, 32, 3, 2, 0, 1, RELU6);
+
+    const struct {
+        uint32_t depth;
+        uint32_t stride;
+    } blocks[] = {{64, 1},  {128, 2}, {128, 1}, {256, 2}, {256, 1}, {512, 2},  {512, 1},
+                  {512, 1}, {512, 1}, {512, 1}, {512, 1}, {1024, 2}, {1024, 1}};
+    for (const auto& block : blocks) {
+        if (block.stride == 1)
+            out = builder.depthwiseConv(out, 3, 1, 1, 1, RELU6);
+        else
+            out = builder.depthwiseConv(out, 3, 2, 0, 1, RELU6);
+        out = builder.conv(out, block.depth, 1, 1, 0, 0, RELU6);
+    }
+
+    out = builder.averagePool(out, 7, 1);
+    out = builder.conv(out, 1001, 1, 1, 0, 0, FusedActivationFunc::NONE);
+    out = builder.reshape(out, {1, 1001});
+    out = builder.softmax(out, 1.0f);
+    builder.addOutput(out);
+    return builder.finish();
+}
+
+Model createAlexNet() {
+    const auto RELU = FusedActivationFunc::RELU;
+    ModelBuilder builder;
+    uint32_t out = builder.addInput({1, 227, 227, 3});
+    out = builder.conv(out, 96, 11, 4, 0, 0, RELU);
+    out = builder.lrn(out, 2, 1.0f, 1e-4f, 0.75f);
+    out = builder.maxPool(out, 3, 2);
+    out = builder.conv(out, 256, 5, 1, 2, 2, RELU);
+    out = builder.lrn(out, 2, 1.0f, 1e-4f, 0.75f);
+    out = builder.maxPool(out, 3, 2);
+    out = builder.conv(out, 384, 3, 1, 1, 1, RELU);
+    out = builder.conv(out, 384, 3, 1, 1, 1, RELU);
+    out = builder.conv(out, 256, 3, 1, 1, 1, RELU);
+    out = builder.maxPool(out, 3, 2);
+    out = builder.fullyConnected(out, 4096, RELU);
+    out = builder.fullyConnected(out, 4096, RELU);
+    out = builder.fullyConnected(out, 1000, FusedActivationFunc::NONE);
+    out = builder.softmax(out, 1.0f);
+    builder.addOutput(out);
+    return builder.finish();
+}
+
+// Model files: a magic and a version, then every field in order, host byte
+// order. Vectors are preceded by their size.
+static const char kMagic[8] = {'N', 'N', 'H', 'A', 'L', 'M', 'D', 'L'};
+static const uint32_t kVersion = 1;
+
+namespace {
+
+class Writer {
+public:
+    explicit Writer(FILE* file) : mFile(file) {}
+    bool ok() const { return mOk; }
+
+    void bytes(const void* data, size_t size) {
+        if (mOk && size > 0) mOk = fwrite(data, 1, size, mFile) == size;
+    }
+    template <typename T>
+    void value(T v) {
+        bytes(&v, sizeof(v));
+    }
+    template <typename T>
+    void vec(const hidl_vec<T>& v) {
+        value(uint64_t(v.size()));
+        bytes(v.data(), v.size() * sizeof(T));
+    }
+
+private:
+    FILE* mFile;
+    bool mOk = true;
+};
+
+class Reader {
+public:
+    explicit Reader(FILE* file) : mFile(file) {}
+    bool ok() const { return mOk; }
+
+    void bytes(void* data, size_t size) {
+        if (mOk && size > 0) mOk = fread(data, 1, size, mFile) == size;
+    }
+    template <typename T>
+    T value() {
+        T v = T();
+        bytes(&v, sizeof(v));
+        return v;
+    }
+    // refuses sizes past the end of the file
+    template <typename T>
+    void vec(hidl_vec<T>* v) {
+        uint64_t size = value<uint64_t>();
+        if (!mOk || size > remaining() / sizeof(T)) {
+            mOk = false;
+            return;
+        }
+        v->resize(size);
+        bytes(v->data(), size * sizeof(T));
+    }
+    uint64_t remaining() {
+        long position = ftell(mFile);
+        fseek(mFile, 0, SEEK_END);
+        long end = ftell(mFile);
+        fseek(mFile, position, SEEK_SET);
+        return position < 0 || end < position ? 0 : uint64_t(end - position);
+    }
+
+private:
+    FILE* mFile;
+    bool mOk = true;
+};
+
+}  // namespace
+
+bool saveModel(const Model& model, const std::string& path) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    Writer out(file);
+    out.bytes(kMagic, sizeof(kMagic));
+    out.value(kVersion);
+
+    out.value(uint64_t(model.operands.size()));
+    for (const auto& operand : model.operands) {
+        out.value(operand.type);
+        out.vec(operand.dimensions);
+        out.value(operand.numberOfConsumers);
+        out.value(operand.scale);
+        out.value(operand.zeroPoint);
+        out.value(operand.lifetime);
+        out.value(operand.location);
+    }
+    out.value(uint64_t(model.operations.size()));
+    for (const auto& operation : model.operations) {
+        out.value(operation.type);
+        out.vec(operation.inputs);
+        out.vec(operation.outputs);
+    }
+    out.vec(model.inputIndexes);
+    out.vec(model.outputIndexes);
+    out.vec(model.operandValues);
+
+    out.value(uint64_t(model.pools.size()));
+    for (const auto& memory : model.pools) {
+        const native_handle_t* handle = memory.handle();
+        if (memory.name() != "mmap_fd" || handle == nullptr || handle->numFds < 1) {
+            fclose(file);
+            return false;
+        }
+        void* data = mmap(nullptr, memory.size(), PROT_READ, MAP_SHARED, handle->data[0], 0);
+        if (data == MAP_FAILED) {
+            fclose(file);
+            return false;
+        }
+        out.value(uint64_t(memory.size()));
+        out.bytes(data, memory.size());
+        munmap(data, memory.size());
+    }
+    bool ok = out.ok();
+    return fclose(file) == 0 && ok;
+}
+
+bool loadModel(const std::string& path, Model* model) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) return false;
+    Reader in(file);
+    char magic[sizeof(kMagic)];
+    in.bytes(magic, sizeof(magic));
+    if (!in.ok() || memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+        in.value<uint32_t>() != kVersion) {
+        fclose(file);
+        return false;
+    }
+
+    Model loaded;
+    uint64_t count = in.value<uint64_t>();
+    for (uint64_t i = 0; i < count && in.ok(); i++) {
+        Operand operand;
+        operand.type = in.value<OperandType>();
+        in.vec(&operand.dimensions);
+        operand.numberOfConsumers = in.value<uint32_t>();
+        operand.scale = in.value<float>();
+        operand.zeroPoint = in.value<int32_t>();
+        operand.lifetime = in.value<OperandLifeTime>();
+        operand.location = in.value<DataLocation>();
+        loaded.operands.push_back(operand);
+    }
+    count = in.value<uint64_t>();
+    for (uint64_t i = 0; i < count && in.ok(); i++) {
+        Operation operation;
+        operation.type = in.value<OperationType>();
+        in.vec(&operation.inputs);
+        in.vec(&operation.outputs);
+        loaded.operations.push_back(operation);
+    }
+    in.vec(&loaded.inputIndexes);
+    in.vec(&loaded.outputIndexes);
+    in.vec(&loaded.operandValues);
+
+    count = in.value<uint64_t>();
+    for (uint64_t i = 0; i < count && in.ok(); i++) {
+        uint64_t size = in.value<uint64_t>();
+        if (size > in.remaining()) break;
+        auto pool = SharedPool::create(size);
+        if (pool == nullptr) break;
+        in.bytes(pool->data(), size);
+        loaded.pools.push_back(pool->memory());
+    }
+    bool ok = in.ok() && loaded.pools.size() == count;
+    fclose(file);
+    if (ok) *model = loaded;
+    return ok;
+}
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_BENCHMARK_MODEL_BUILDER_H
+#define ANDROID_ML_NN_BENCHMARK_MODEL_BUILDER_H
+
+#include <android/hardware/neuralnetworks/1.0/types.h>
+#include <stdint.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+namespace driver {
+
+// Shared memory as the runtime hands it to the driver: an mmap_fd hidl_memory
+// over an unlinked temporary file, mapped here as well to fill or read it.
+class SharedPool {
+public:
+    static std::shared_ptr<SharedPool> create(size_t size);
+    ~SharedPool();
+
+    uint8_t* data() const { return mData; }
+    size_t size() const { return mSize; }
+    const hidl_memory& memory() const { return mMemory; }
+
+private:
+    SharedPool() {}
+
+    uint8_t* mData = nullptr;
+    size_t mSize = 0;
+    hidl_memory mMemory;
+};
+
+// Builds a float NNAPI model operation by operation, the way an application
+// does through the NDK: scalars are CONSTANT_COPY operands, weights go to one
+// CONSTANT_REFERENCE pool, filled with random values of a fixed seed.
+class ModelBuilder {
+public:
+    typedef std::vector<uint32_t> Dims;
+
+    ModelBuilder();
+
+    uint32_t addInput(const Dims& dims);
+    void addOutput(uint32_t index);
+
+    // NHWC layers, explicit padding (left and top, right and bottom)
+    uint32_t conv(uint32_t input, uint32_t depth, uint32_t kernel, uint32_t stride,
+                  uint32_t padBegin, uint32_t padEnd, FusedActivationFunc activation);
+    uint32_t depthwiseConv(uint32_t input, uint32_t kernel, uint32_t stride, uint32_t padBegin,
+                           uint32_t padEnd, FusedActivationFunc activation);
+    uint32_t maxPool(uint32_t input, uint32_t kernel, uint32_t stride);
+    uint32_t averagePool(uint32_t input, uint32_t kernel, uint32_t stride);
+    uint32_t lrn(uint32_t input, int32_t radius, float bias, float alpha, float beta);
+    uint32_t fullyConnected(uint32_t input, uint32_t units, FusedActivationFunc activation);
+    uint32_t reshape(uint32_t input, const Dims& dims);
+    uint32_t softmax(uint32_t input, float beta);
+
+    const Dims& dims(uint32_t index) const { return mModel.operands[index].dimensions; }
+
+    // The weights are copied into the pool, the builder is done.
+    Model finish();
+
+private:
+    uint32_t addOperand(OperandType type, const Dims& dims, OperandLifeTime lifetime);
+    uint32_t addTensor(const Dims& dims);
+    uint32_t addInt32(int32_t value);
+    uint32_t addFloat32(float value);
+    uint32_t addConstCopy(OperandType type, const Dims& dims, const void* data, size_t length);
+    // fanIn scales the random values so that the activations neither vanish nor blow up
+    uint32_t addWeights(const Dims& dims, uint32_t fanIn);
+    uint32_t addOperation(OperationType type, const std::vector<uint32_t>& inputs,
+                          const Dims& outputDims);
+    uint32_t pool(OperationType type, uint32_t input, uint32_t kernel, uint32_t stride);
+
+    Model mModel;
+    std::vector<uint8_t> mWeights;
+    std::mt19937 mRandom;
+};
+
+// MobileNet v1 1.0 224 and AlexNet (without the groups), for the CPU and VPU
+// graph builders: the layer shapes are the ones of the real networks.
+Model createMobileNet();
+Model createAlexNet();
+
+// The operands and operations of the model with the content of its pools, to
+// run the same model on another build box. Returns false on I/O errors.
+bool saveModel(const Model& model, const std::string& path);
+bool loadModel(const std::string& path, Model* model);
+
+// Elements of a float tensor.
+size_t elementCount(const std::vector<uint32_t>& dims);
+
+}  // namespace driver
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_BENCHMARK_MODEL_BUILDER_H
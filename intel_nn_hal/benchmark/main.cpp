@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host benchmark of the prepared model: builds the network of an NNAPI model
+// with the IE plugins of the build box and runs requests through execute() as
+// the runtime does, from several clients at once. Reports the prepare time,
+// the first inference, and the steady-state throughput and latency.
+
+#include <android-base/properties.h>
+#include <android/log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LatencyStats.h"
+#include "LayerProfile.h"
+#include "ModelBuilder.h"
+#include "PreparedModel.h"
+
+using namespace android::hardware::neuralnetworks::V1_0;
+using namespace android::hardware::neuralnetworks::V1_0::driver;
+using android::sp;
+using android::hardware::Return;
+using android::hardware::Void;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Options {
+    std::string model = "mobilenet";
+    std::string save;
+    std::string device = "CPU";
+    int concurrency = 1;
+    int iterations = 100;
+    int warmup = 5;
+    std::string json;
+};
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --model mobilenet|alexnet|FILE  model to run, FILE from --save (mobilenet)\n"
+            "  --save FILE         write the model to FILE before running it\n"
+            "  --device CPU|MYRIAD target device (CPU)\n"
+            "  --concurrency N     clients executing at the same time (1)\n"
+            "  --iterations N      measured executions per client (100)\n"
+            "  --warmup N          executions per client before measuring (5)\n"
+            "  --prop KEY=VALUE    set a property before preparing, e.g. nn.hal.infer_requests=4\n"
+            "  --json FILE         write the results to FILE as JSON\n"
+            "  --verbose           print the logs of the HAL\n",
+            name);
+}
+
+bool parseOptions(int argc, char** argv, Options* options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--verbose") {
+            __android_log_min_priority = ANDROID_LOG_VERBOSE;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--model") {
+            options->model = value;
+        } else if (arg == "--save") {
+            options->save = value;
+        } else if (arg == "--device") {
+            options->device = value;
+        } else if (arg == "--concurrency") {
+            options->concurrency = atoi(value.c_str());
+        } else if (arg == "--iterations") {
+            options->iterations = atoi(value.c_str());
+        } else if (arg == "--warmup") {
+            options->warmup = atoi(value.c_str());
+        } else if (arg == "--json") {
+            options->json = value;
+        } else if (arg == "--prop") {
+            size_t equal = value.find('=');
+            if (equal == std::string::npos) return false;
+            android::base::SetProperty(value.substr(0, equal), value.substr(equal + 1));
+        } else {
+            return false;
+        }
+    }
+    return options->concurrency > 0 && options->iterations > 0 && options->warmup >= 0 &&
+           (options->device == "CPU" || options->device == "MYRIAD");
+}
+
+// The client side of one execution at a time.
+class ExecutionCallback : public IExecutionCallback {
+public:
+    Return<void> notify(ErrorStatus status) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStatus = status;
+        mDone = true;
+        mCondition.notify_all();
+        return Void();
+    }
+
+    ErrorStatus wait() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mCondition.wait(lock, [this] { return mDone; });
+        mDone = false;
+        return mStatus;
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    bool mDone = false;
+    ErrorStatus mStatus = ErrorStatus::NONE;
+};
+
+size_t operandBytes(const Operand& operand) {
+    size_t size = operand.type == OperandType::TENSOR_QUANT8_ASYMM ? 1 : 4;
+    return size * elementCount(operand.dimensions);
+}
+
+// One pool per input and output, random inputs, as an application would
+// allocate them once and reuse them for every frame.
+struct Client {
+    std::vector<std::shared_ptr<SharedPool>> pools;
+    Request request;
+    sp<ExecutionCallback> callback = new ExecutionCallback();
+    std::vector<double> latencies;  // ms
+
+    bool create(const Model& model, unsigned seed) {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+        auto add = [&](uint32_t index, bool input) {
+            const Operand& operand = model.operands[index];
+            auto pool = SharedPool::create(operandBytes(operand));
+            if (pool == nullptr) return false;
+            if (input && operand.type == OperandType::TENSOR_FLOAT32) {
+                float* values = reinterpret_cast<float*>(pool->data());
+                for (size_t i = 0; i < elementCount(operand.dimensions); i++)
+                    values[i] = distribution(random);
+            }
+            RequestArgument argument = {};
+            argument.location = {uint32_t(pools.size()), 0, uint32_t(operandBytes(operand))};
+            (input ? request.inputs : request.outputs).push_back(argument);
+            request.pools.push_back(pool->memory());
+            pools.push_back(pool);
+            return true;
+        };
+        for (auto index : model.inputIndexes)
+            if (!add(index, true)) return false;
+        for (auto index : model.outputIndexes)
+            if (!add(index, false)) return false;
+        return true;
+    }
+
+    bool run(const sp<PreparedModel>& preparedModel) {
+        ErrorStatus status = preparedModel->execute(request, callback);
+        if (status != ErrorStatus::NONE) return false;
+        return callback->wait() == ErrorStatus::NONE;
+    }
+};
+
+double percentile(const std::vector<double>& sorted, int p) {
+    if (sorted.empty()) return 0;
+    return sorted[std::min(sorted.size() - 1, (sorted.size() - 1) * p / 100)];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    Model model;
+    if (options.model == "mobilenet") {
+        model = createMobileNet();
+    } else if (options.model == "alexnet") {
+        model = createAlexNet();
+    } else if (!loadModel(options.model, &model)) {
+        fprintf(stderr, "cannot load model %s\n", options.model.c_str());
+        return 1;
+    }
+    if (!options.save.empty() && !saveModel(model, options.save)) {
+        fprintf(stderr, "cannot save model to %s\n", options.save.c_str());
+        return 1;
+    }
+    size_t weights = 0;
+    for (const auto& pool : model.pools) weights += pool.size();
+    printf("model        %s (%zu operations, %.1f MB of weights)\n", options.model.c_str(),
+           model.operations.size(), weights / 1048576.0);
+    printf("device       %s\n", options.device.c_str());
+
+    auto start = Clock::now();
+    sp<PreparedModel> preparedModel;
+    if (options.device == "CPU")
+        preparedModel = new CpuPreparedModel(model);
+    else
+        preparedModel = new VpuPreparedModel(model);
+    if (!preparedModel->initialize()) {
+        fprintf(stderr, "failed to prepare the model\n");
+        return 1;
+    }
+    const double prepareMs = msSince(start);
+    printf("prepare      %.1f ms\n", prepareMs);
+
+    std::vector<Client> clients(options.concurrency);
+    for (size_t i = 0; i < clients.size(); i++) {
+        if (!clients[i].create(model, i + 1)) {
+            fprintf(stderr, "cannot allocate the request pools\n");
+            return 1;
+        }
+    }
+
+    start = Clock::now();
+    if (!clients[0].run(preparedModel)) {
+        fprintf(stderr, "first execution failed\n");
+        return 1;
+    }
+    const double firstMs = msSince(start);
+    printf("first        %.1f ms\n", firstMs);
+
+    // The clients start together once all of them are warm.
+    std::mutex lock;
+    std::condition_variable condition;
+    int warm = 0;
+    bool failed = false;
+    Clock::time_point steadyStart;
+    std::vector<std::thread> threads;
+    for (auto& client : clients) {
+        threads.emplace_back([&] {
+            bool ok = true;
+            for (int i = 0; i < options.warmup && ok; i++) ok = client.run(preparedModel);
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if (++warm == options.concurrency) {
+                    steadyStart = Clock::now();
+                    condition.notify_all();
+                }
+                condition.wait(guard, [&] { return warm == options.concurrency; });
+            }
+            client.latencies.reserve(options.iterations);
+            for (int i = 0; i < options.iterations && ok; i++) {
+                auto begin = Clock::now();
+                ok = client.run(preparedModel);
+                client.latencies.push_back(msSince(begin));
+            }
+            if (!ok) {
+                std::lock_guard<std::mutex> guard(lock);
+                failed = true;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    const double steadyMs = msSince(steadyStart);
+    if (failed) {
+        fprintf(stderr, "execution failed\n");
+        return 1;
+    }
+
+    std::vector<double> latencies;
+    for (const auto& client : clients)
+        latencies.insert(latencies.end(), client.latencies.begin(), client.latencies.end());
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (double latency : latencies) mean += latency;
+    mean /= latencies.size();
+    const double throughput = latencies.size() * 1000.0 / steadyMs;
+
+    printf("steady state %d clients, %zu executions in %.2f s\n", options.concurrency,
+           latencies.size(), steadyMs / 1000.0);
+    printf("throughput   %.1f inferences/s\n", throughput);
+    printf("latency ms   mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", mean,
+           percentile(latencies, 50), percentile(latencies, 90), percentile(latencies, 99),
+           latencies.back());
+    // where the time goes inside the HAL, and per layer with nn.hal.profile_layers
+    fflush(stdout);
+    LatencyStats::dumpAll(STDOUT_FILENO);
+    if (LayerProfile::interval() > 0) LayerProfile::dumpAll(STDOUT_FILENO);
+
+    if (!options.json.empty()) {
+        FILE* file = fopen(options.json.c_str(), "w");
+        if (file == nullptr) {
+            fprintf(stderr, "cannot write %s\n", options.json.c_str());
+            return 1;
+        }
+        fprintf(file,
+                "{\"model\": \"%s\", \"device\": \"%s\", \"concurrency\": %d, "
+                "\"executions\": %zu, \"prepare_ms\": %.3f, \"first_ms\": %.3f, "
+                "\"throughput\": %.3f, \"latency_ms\": {\"mean\": %.3f, \"p50\": %.3f, "
+                "\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}}\n",
+                options.model.c_str(), options.device.c_str(), options.concurrency,
+                latencies.size(), prepareMs, firstMs, throughput, mean,
+                percentile(latencies, 50), percentile(latencies, 90), percentile(latencies, 99),
+                latencies.back());
+        fclose(file);
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_BENCHMARK_STUB_VALIDATE_HAL_H
+#define ANDROID_ML_NN_BENCHMARK_STUB_VALIDATE_HAL_H
+
+#include <android/hardware/neuralnetworks/1.0/types.h>
+
+namespace android {
+namespace nn {
+
+// The arguments of the request against the model inputs and outputs and the
+// request pools. The benchmark builds its own requests, the checks stop at
+// what the HAL relies on when it binds the buffers.
+bool validateRequest(const hardware::neuralnetworks::V1_0::Request& request,
+                     const hardware::neuralnetworks::V1_0::Model& model);
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_BENCHMARK_STUB_VALIDATE_HAL_H
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for the LOG() streams of libbase, printed through liblog.
+
+#ifndef ANDROID_ML_NN_BENCHMARK_STUB_ANDROID_BASE_LOGGING_H
+#define ANDROID_ML_NN_BENCHMARK_STUB_ANDROID_BASE_LOGGING_H
+
+#include <android/log.h>
+#include <sstream>
+
+namespace android {
+namespace base {
+
+enum LogSeverity {
+    VERBOSE,
+    DEBUG,
+    INFO,
+    WARNING,
+    ERROR,
+    FATAL,
+};
+
+class LogMessage {
+public:
+    explicit LogMessage(LogSeverity severity) : mSeverity(severity) {}
+    ~LogMessage() {
+        __android_log_print(ANDROID_LOG_VERBOSE + mSeverity, "nnhal", "%s",
+                            mStream.str().c_str());
+    }
+    std::ostream& stream() { return mStream; }
+
+private:
+    LogSeverity mSeverity;
+    std::ostringstream mStream;
+};
+
+}  // namespace base
+}  // namespace android
+
+#define LOG(severity) ::android::base::LogMessage(::android::base::severity).stream()
+
+#endif  // ANDROID_ML_NN_BENCHMARK_STUB_ANDROID_BASE_LOGGING_H
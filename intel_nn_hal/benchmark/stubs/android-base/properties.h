@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for the system properties of libbase. The properties live in
+// the process: the benchmark sets them from its command line before the model
+// is prepared, unset ones read as their default.
+
+#ifndef ANDROID_ML_NN_BENCHMARK_STUB_ANDROID_BASE_PROPERTIES_H
+#define ANDROID_ML_NN_BENCHMARK_STUB_ANDROID_BASE_PROPERTIES_H
+
+#include <errno.h>
+#include <stdlib.h>
+#include <limits>
+#include <string>
+
+namespace android {
+namespace base {
+
+std::string GetProperty(const std::string& key, const std::string& default_value);
+bool SetProperty(const std::string& key, const std::string& value);
+
+inline bool GetBoolProperty(const std::string& key, bool default_value) {
+    std::string value = GetProperty(key, "");
+    if (value == "1" || value == "y" || value == "yes" || value == "on" || value == "true")
+        return true;
+    if (value == "0" || value == "n" || value == "no" || value == "off" || value == "false")
+        return false;
+    return default_value;
+}
+
+template <typename T>
+T GetIntProperty(const std::string& key, T default_value,
+                 T min = std::numeric_limits<T>::min(),
+                 T max = std::numeric_limits<T>::max()) {
+    std::string value = GetProperty(key, "");
+    if (value.empty()) return default_value;
+    char* end = nullptr;
+    errno = 0;
+    long long result = strtoll(value.c_str(), &end, 0);
+    if (errno != 0 || *end != '\0' || result < min || result > max) return default_value;
+    return static_cast<T>(result);
+}
+
+template <typename T>
+T GetUintProperty(const std::string& key, T default_value,
+                  T max = std::numeric_limits<T>::max()) {
+    std::string value = GetProperty(key, "");
+    if (value.empty() || value[0] == '-') return default_value;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long result = strtoull(value.c_str(), &end, 0);
+    if (errno != 0 || *end != '\0' || result > max) return default_value;
+    return static_cast<T>(result);
+}
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_BENCHMARK_STUB_ANDROID_BASE_PROPERTIES_H
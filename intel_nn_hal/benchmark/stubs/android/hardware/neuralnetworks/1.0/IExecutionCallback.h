@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_BENCHMARK_STUB_NEURALNETWORKS_V1_0_IEXECUTIONCALLBACK_H
+#define ANDROID_ML_NN_BENCHMARK_STUB_NEURALNETWORKS_V1_0_IEXECUTIONCALLBACK_H
+
+#include <android/hardware/neuralnetworks/1.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+
+struct IExecutionCallback : public virtual RefBase {
+    virtual Return<void> notify(ErrorStatus status) = 0;
+};
+
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_BENCHMARK_STUB_NEURALNETWORKS_V1_0_IEXECUTIONCALLBACK_H
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for the types hidl-gen generates from
+// hardware/interfaces/neuralnetworks/1.0/types.hal, same values and layout.
+
+#ifndef ANDROID_ML_NN_BENCHMARK_STUB_NEURALNETWORKS_V1_0_TYPES_H
+#define ANDROID_ML_NN_BENCHMARK_STUB_NEURALNETWORKS_V1_0_TYPES_H
+
+#include <stdint.h>
+#include <string>
+#include "hidl/HidlSupport.h"
+
+namespace android {
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+
+enum class OperandType : int32_t {
+    FLOAT32 = 0,
+    INT32 = 1,
+    UINT32 = 2,
+    TENSOR_FLOAT32 = 3,
+    TENSOR_INT32 = 4,
+    TENSOR_QUANT8_ASYMM = 5,
+    OEM = 10000,
+    TENSOR_OEM_BYTE = 10001,
+};
+
+enum class OperationType : int32_t {
+    ADD = 0,
+    AVERAGE_POOL_2D = 1,
+    CONCATENATION = 2,
+    CONV_2D = 3,
+    DEPTHWISE_CONV_2D = 4,
+    DEPTH_TO_SPACE = 5,
+    DEQUANTIZE = 6,
+    EMBEDDING_LOOKUP = 7,
+    FLOOR = 8,
+    FULLY_CONNECTED = 9,
+    HASHTABLE_LOOKUP = 10,
+    L2_NORMALIZATION = 11,
+    L2_POOL_2D = 12,
+    LOCAL_RESPONSE_NORMALIZATION = 13,
+    LOGISTIC = 14,
+    LSH_PROJECTION = 15,
+    LSTM = 16,
+    MAX_POOL_2D = 17,
+    MUL = 18,
+    RELU = 19,
+    RELU1 = 20,
+    RELU6 = 21,
+    RESHAPE = 22,
+    RESIZE_BILINEAR = 23,
+    RNN = 24,
+    SOFTMAX = 25,
+    SPACE_TO_DEPTH = 26,
+    SVDF = 27,
+    TANH = 28,
+    OEM_OPERATION = 10000,
+};
+
+enum class FusedActivationFunc : int32_t {
+    NONE = 0,
+    RELU = 1,
+    RELU1 = 2,
+    RELU6 = 3,
+};
+
+enum class OperandLifeTime : int32_t {
+    TEMPORARY_VARIABLE = 0,
+    MODEL_INPUT = 1,
+    MODEL_OUTPUT = 2,
+    CONSTANT_COPY = 3,
+    CONSTANT_REFERENCE = 4,
+    NO_VALUE = 5,
+};
+
+enum class DeviceStatus : int32_t {
+    AVAILABLE = 0,
+    BUSY = 1,
+    OFFLINE = 2,
+    UNKNOWN = 3,
+};
+
+enum class ErrorStatus : int32_t {
+    NONE = 0,
+    DEVICE_UNAVAILABLE = 1,
+    GENERAL_FAILURE = 2,
+    OUTPUT_INSUFFICIENT_SIZE = 3,
+    INVALID_ARGUMENT = 4,
+};
+
+struct PerformanceInfo {
+    float execTime;
+    float powerUsage;
+};
+
+struct Capabilities {
+    PerformanceInfo float32Performance;
+    PerformanceInfo quantized8Performance;
+};
+
+struct DataLocation {
+    uint32_t poolIndex;
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct Operand {
+    OperandType type;
+    hidl_vec<uint32_t> dimensions;
+    uint32_t numberOfConsumers;
+    float scale;
+    int32_t zeroPoint;
+    OperandLifeTime lifetime;
+    DataLocation location;
+};
+
+struct Operation {
+    OperationType type;
+    hidl_vec<uint32_t> inputs;
+    hidl_vec<uint32_t> outputs;
+};
+
+struct Model {
+    hidl_vec<Operand> operands;
+    hidl_vec<Operation> operations;
+    hidl_vec<uint32_t> inputIndexes;
+    hidl_vec<uint32_t> outputIndexes;
+    hidl_vec<uint8_t> operandValues;
+    hidl_vec<hidl_memory> pools;
+};
+
+struct RequestArgument {
+    bool hasNoValue;
+    DataLocation location;
+    hidl_vec<uint32_t> dimensions;
+};
+
+struct Request {
+    hidl_vec<RequestArgument> inputs;
+    hidl_vec<RequestArgument> outputs;
+    hidl_vec<hidl_memory> pools;
+};
+
+std::string toString(OperandType type);
+std::string toString(OperationType type);
+std::string toString(OperandLifeTime lifetime);
+std::string toString(ErrorStatus status);
+std::string toString(const Operand& operand);
+std::string toString(const Operation& operation);
+std::string toString(const Model& model);
+std::string toString(const Request& request);
+
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_BENCHMARK_STUB_NEURALNETWORKS_V1_0_TYPES_H
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// On the host the request and model pools are mmap_fd memories, there is no
+// ashmem allocator behind IMemory.
+
+#ifndef ANDROID_ML_NN_BENCHMARK_STUB_HIDL_MEMORY_V1_0_IMEMORY_H
+#define ANDROID_ML_NN_BENCHMARK_STUB_HIDL_MEMORY_V1_0_IMEMORY_H
+
+#include <stdint.h>
+#include "hidl/HidlSupport.h"
+
+namespace android {
+namespace hidl {
+namespace memory {
+namespace V1_0 {
+
+struct IMemory : public virtual RefBase {
+    virtual void update() = 0;
+    virtual void commit() = 0;
+    virtual void* getPointer() = 0;
+    virtual uint64_t getSize() = 0;
+};
+
+}  // namespace V1_0
+}  // namespace memory
+}  // namespace hidl
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_BENCHMARK_STUB_HIDL_MEMORY_V1_0_IMEMORY_H
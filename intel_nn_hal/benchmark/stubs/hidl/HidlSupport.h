@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for libhidlbase: the HIDL containers as plain standard library
+// types, handles without binder, and Return<> values that are always ok.
+
+#ifndef ANDROID_ML_NN_BENCHMARK_STUB_HIDL_SUPPORT_H
+#define ANDROID_ML_NN_BENCHMARK_STUB_HIDL_SUPPORT_H
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "utils/RefBase.h"
+
+typedef struct native_handle {
+    int version;  // sizeof(native_handle_t)
+    int numFds;
+    int numInts;
+    int data[0];  // numFds file descriptors, then numInts ints
+} native_handle_t;
+
+native_handle_t* native_handle_create(int numFds, int numInts);
+// closes the file descriptors
+int native_handle_close(const native_handle_t* h);
+int native_handle_delete(native_handle_t* h);
+
+namespace android {
+namespace hardware {
+
+template <typename T>
+class hidl_vec : public std::vector<T> {
+public:
+    using std::vector<T>::vector;
+    hidl_vec() {}
+    hidl_vec(const std::vector<T>& other) : std::vector<T>(other) {}
+    hidl_vec(std::vector<T>&& other) : std::vector<T>(std::move(other)) {}
+};
+
+class hidl_string : public std::string {
+public:
+    using std::string::string;
+    hidl_string() {}
+    hidl_string(const std::string& other) : std::string(other) {}
+};
+
+// Owns a copy of the native handle, the last copy closes the descriptors.
+class hidl_handle {
+public:
+    hidl_handle() {}
+    hidl_handle(native_handle_t* handle)
+          : mHandle(handle, [](native_handle_t* h) {
+                native_handle_close(h);
+                native_handle_delete(h);
+            }) {}
+
+    const native_handle_t* getNativeHandle() const { return mHandle.get(); }
+    const native_handle_t* operator->() const { return mHandle.get(); }
+    operator const native_handle_t*() const { return mHandle.get(); }
+
+private:
+    std::shared_ptr<native_handle_t> mHandle;
+};
+
+class hidl_memory {
+public:
+    hidl_memory() : mSize(0) {}
+    hidl_memory(const hidl_string& name, const hidl_handle& handle, size_t size)
+          : mName(name), mHandle(handle), mSize(size) {}
+
+    const hidl_string& name() const { return mName; }
+    const native_handle_t* handle() const { return mHandle.getNativeHandle(); }
+    size_t size() const { return mSize; }
+
+private:
+    hidl_string mName;
+    hidl_handle mHandle;
+    size_t mSize;
+};
+
+// A transaction that never fails: there is no binder in between.
+template <typename T>
+class Return {
+public:
+    Return(T value) : mValue(value) {}
+    bool isOk() const { return true; }
+    std::string description() const { return "OK"; }
+    operator T() const { return mValue; }
+    T withDefault(T) const { return mValue; }
+
+private:
+    T mValue;
+};
+
+template <>
+class Return<void> {
+public:
+    bool isOk() const { return true; }
+    std::string description() const { return "OK"; }
+};
+
+inline Return<void> Void() {
+    return Return<void>();
+}
+
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_BENCHMARK_STUB_HIDL_SUPPORT_H
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_BENCHMARK_STUB_HIDLMEMORY_MAPPING_H
+#define ANDROID_ML_NN_BENCHMARK_STUB_HIDLMEMORY_MAPPING_H
+
+#include <android/hidl/memory/1.0/IMemory.h>
+
+namespace android {
+namespace hardware {
+
+// ashmem cannot be mapped on the host, the callers fail as for a bad memory
+inline sp<hidl::memory::V1_0::IMemory> mapMemory(const hidl_memory& /*memory*/) {
+    return nullptr;
+}
+
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_BENCHMARK_STUB_HIDLMEMORY_MAPPING_H
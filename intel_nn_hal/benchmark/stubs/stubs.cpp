@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The host implementations behind the stub headers.
+
+#include <android-base/properties.h>
+#include <android/hardware/neuralnetworks/1.0/types.h>
+#include <android/log.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include "ValidateHal.h"
+
+int __android_log_min_priority = ANDROID_LOG_WARN;
+
+int __android_log_print(int prio, const char* tag, const char* fmt, ...) {
+    if (prio < __android_log_min_priority) return 0;
+    static const char kLevels[] = "??VDIWEFS";
+    static std::mutex lock;
+    char message[1024];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+    std::lock_guard<std::mutex> guard(lock);
+    return fprintf(stderr, "%c %s: %s\n", kLevels[prio < 0 || prio > 8 ? 0 : prio],
+                   tag ? tag : "nnhal", message);
+}
+
+native_handle_t* native_handle_create(int numFds, int numInts) {
+    native_handle_t* h = static_cast<native_handle_t*>(
+        malloc(sizeof(native_handle_t) + sizeof(int) * (numFds + numInts)));
+    if (h == nullptr) return nullptr;
+    h->version = sizeof(native_handle_t);
+    h->numFds = numFds;
+    h->numInts = numInts;
+    return h;
+}
+
+int native_handle_close(const native_handle_t* h) {
+    if (h == nullptr) return 0;
+    for (int i = 0; i < h->numFds; i++) close(h->data[i]);
+    return 0;
+}
+
+int native_handle_delete(native_handle_t* h) {
+    free(h);
+    return 0;
+}
+
+namespace android {
+namespace base {
+
+static std::mutex sPropertiesLock;
+static std::map<std::string, std::string> sProperties;
+
+std::string GetProperty(const std::string& key, const std::string& default_value) {
+    std::lock_guard<std::mutex> lock(sPropertiesLock);
+    auto it = sProperties.find(key);
+    return it == sProperties.end() || it->second.empty() ? default_value : it->second;
+}
+
+bool SetProperty(const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(sPropertiesLock);
+    sProperties[key] = value;
+    return true;
+}
+
+}  // namespace base
+
+namespace hardware {
+namespace neuralnetworks {
+namespace V1_0 {
+
+std::string toString(OperandType type) {
+    return std::to_string(static_cast<int32_t>(type));
+}
+
+std::string toString(OperationType type) {
+    return std::to_string(static_cast<int32_t>(type));
+}
+
+std::string toString(OperandLifeTime lifetime) {
+    return std::to_string(static_cast<int32_t>(lifetime));
+}
+
+std::string toString(ErrorStatus status) {
+    return std::to_string(static_cast<int32_t>(status));
+}
+
+template <typename T>
+static std::string toString(const hidl_vec<T>& vec) {
+    std::ostringstream out;
+    out << "[";
+    for (size_t i = 0; i < vec.size(); i++) out << (i ? ", " : "") << vec[i];
+    out << "]";
+    return out.str();
+}
+
+std::string toString(const Operand& operand) {
+    std::ostringstream out;
+    out << "{.type = " << toString(operand.type)
+        << ", .dimensions = " << toString(operand.dimensions)
+        << ", .numberOfConsumers = " << operand.numberOfConsumers
+        << ", .scale = " << operand.scale << ", .zeroPoint = " << operand.zeroPoint
+        << ", .lifetime = " << toString(operand.lifetime) << ", .location = {"
+        << operand.location.poolIndex << ", " << operand.location.offset << ", "
+        << operand.location.length << "}}";
+    return out.str();
+}
+
+std::string toString(const Operation& operation) {
+    return "{.type = " + toString(operation.type) + ", .inputs = " + toString(operation.inputs) +
+           ", .outputs = " + toString(operation.outputs) + "}";
+}
+
+std::string toString(const Model& model) {
+    std::ostringstream out;
+    out << "{" << model.operands.size() << " operands, " << model.operations.size()
+        << " operations, .inputIndexes = " << toString(model.inputIndexes)
+        << ", .outputIndexes = " << toString(model.outputIndexes) << ", "
+        << model.operandValues.size() << " bytes of values, " << model.pools.size()
+        << " pools}";
+    return out.str();
+}
+
+std::string toString(const Request& request) {
+    std::ostringstream out;
+    out << "{" << request.inputs.size() << " inputs, " << request.outputs.size() << " outputs, "
+        << request.pools.size() << " pools}";
+    return out.str();
+}
+
+}  // namespace V1_0
+}  // namespace neuralnetworks
+}  // namespace hardware
+
+namespace nn {
+
+using namespace hardware;
+using namespace hardware::neuralnetworks::V1_0;
+
+static bool validateArguments(const hidl_vec<RequestArgument>& arguments,
+                              const hidl_vec<uint32_t>& indexes, const Model& model,
+                              const Request& request) {
+    if (arguments.size() != indexes.size()) return false;
+    for (size_t i = 0; i < arguments.size(); i++) {
+        const RequestArgument& argument = arguments[i];
+        if (argument.hasNoValue) continue;
+        const DataLocation& location = argument.location;
+        if (location.poolIndex >= request.pools.size()) return false;
+        const uint64_t end = uint64_t(location.offset) + location.length;
+        if (end > request.pools[location.poolIndex].size()) return false;
+        if (!argument.dimensions.empty() &&
+            argument.dimensions.size() != model.operands[indexes[i]].dimensions.size())
+            return false;
+    }
+    return true;
+}
+
+bool validateRequest(const Request& request, const Model& model) {
+    return validateArguments(request.inputs, model.inputIndexes, model, request) &&
+           validateArguments(request.outputs, model.outputIndexes, model, request);
+}
+
+}  // namespace nn
+}  // namespace android
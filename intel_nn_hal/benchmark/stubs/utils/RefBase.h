@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for libutils: intrusive strong references only, what the HAL
+// uses of RefBase and sp<>.
+
+#ifndef ANDROID_ML_NN_BENCHMARK_STUB_REF_BASE_H
+#define ANDROID_ML_NN_BENCHMARK_STUB_REF_BASE_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace android {
+
+class RefBase {
+public:
+    void incStrong(const void* /*id*/) const { mStrong.fetch_add(1, std::memory_order_relaxed); }
+    void decStrong(const void* /*id*/) const {
+        if (mStrong.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+protected:
+    RefBase() {}
+    virtual ~RefBase() {}
+
+private:
+    RefBase(const RefBase&) = delete;
+    RefBase& operator=(const RefBase&) = delete;
+
+    mutable std::atomic<int> mStrong{0};
+};
+
+template <typename T>
+class sp {
+public:
+    sp() : mPtr(nullptr) {}
+    sp(std::nullptr_t) : mPtr(nullptr) {}
+    sp(T* other) : mPtr(other) { acquire(); }
+    sp(const sp<T>& other) : mPtr(other.mPtr) { acquire(); }
+    template <typename U>
+    sp(const sp<U>& other) : mPtr(other.get()) { acquire(); }
+    ~sp() { release(); }
+
+    sp& operator=(const sp<T>& other) {
+        T* old = mPtr;
+        mPtr = other.mPtr;
+        acquire();
+        if (old) old->decStrong(this);
+        return *this;
+    }
+
+    T* get() const { return mPtr; }
+    T* operator->() const { return mPtr; }
+    T& operator*() const { return *mPtr; }
+    void clear() {
+        release();
+        mPtr = nullptr;
+    }
+
+    bool operator==(std::nullptr_t) const { return mPtr == nullptr; }
+    bool operator!=(std::nullptr_t) const { return mPtr != nullptr; }
+    bool operator==(const sp<T>& other) const { return mPtr == other.mPtr; }
+    bool operator!=(const sp<T>& other) const { return mPtr != other.mPtr; }
+
+private:
+    void acquire() {
+        if (mPtr) mPtr->incStrong(this);
+    }
+    void release() {
+        if (mPtr) mPtr->decStrong(this);
+    }
+
+    T* mPtr;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_BENCHMARK_STUB_REF_BASE_H
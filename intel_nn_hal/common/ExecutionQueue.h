@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_EXECUTION_QUEUE_H
+#define ANDROID_ML_NN_EXECUTION_QUEUE_H
+
+#include <log/log.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace nnhal {
+
+// Fixed pool of worker threads fed by a bounded multi-producer/multi-consumer
+// request queue. execute() submits the request and returns, a worker picks it
+// up; when the queue is full submit() blocks, which gives backpressure to the
+// clients instead of spawning an unbounded number of threads.
+class ExecutionQueue {
+public:
+    enum class Ordering {
+        FIFO,      // requests run in submission order
+        PRIORITY,  // higher priority first, submission order among equals
+    };
+
+    struct Stats {
+        size_t depth;        // requests waiting right now
+        size_t maxDepth;     // highest depth seen
+        uint64_t completed;  // requests handed to a worker
+        int64_t avgWaitUs;   // average time spent in the queue
+        int64_t maxWaitUs;   // longest time spent in the queue
+    };
+
+    ExecutionQueue(const char* name, size_t numWorkers, size_t capacity,
+                   Ordering ordering = Ordering::FIFO)
+        : mName(name), mCapacity(capacity > 0 ? capacity : 1), mOrdering(ordering) {
+        if (numWorkers == 0) numWorkers = 1;
+        for (size_t i = 0; i < numWorkers; i++)
+            mWorkers.emplace_back([this] { workerLoop(); });
+        ALOGI("%s: %zu workers, queue capacity %zu, %s ordering", mName, numWorkers, mCapacity,
+              mOrdering == Ordering::FIFO ? "fifo" : "priority");
+    }
+
+    ~ExecutionQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mShutdown = true;
+        }
+        mNotEmpty.notify_all();
+        mNotFull.notify_all();
+        for (auto& worker : mWorkers) worker.join();
+    }
+
+    // Queues the task, blocking while the queue is full. Returns false if the
+    // queue is shutting down and the task was not queued. The task is kept
+    // until it ran: a strong reference it captures keeps its object alive.
+    bool submit(std::function<void()> task, int priority = 0) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mNotFull.wait(lock, [this] { return mShutdown || mQueue.size() < mCapacity; });
+        return enqueue(lock, std::move(task), priority);
+    }
+
+    // As submit() but never blocks, the task goes past the capacity. For the
+    // threads the queue must not hold up: its workers and the plugin threads.
+    bool post(std::function<void()> task, int priority = 0) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return enqueue(lock, std::move(task), priority);
+    }
+
+    Stats getStats() {
+        std::lock_guard<std::mutex> lock(mLock);
+        Stats stats;
+        stats.depth = mQueue.size();
+        stats.maxDepth = mMaxDepth;
+        stats.completed = mCompleted;
+        stats.avgWaitUs = mCompleted ? mTotalWaitUs / static_cast<int64_t>(mCompleted) : 0;
+        stats.maxWaitUs = mMaxWaitUs;
+        return stats;
+    }
+
+private:
+    struct Item {
+        std::function<void()> task;
+        int priority;
+        uint64_t sequence;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    // std::priority_queue pops the largest element first
+    struct Order {
+        bool operator()(const Item& a, const Item& b) const {
+            if (a.priority != b.priority) return a.priority < b.priority;
+            return a.sequence > b.sequence;
+        }
+    };
+
+    static const uint64_t kStatsLogInterval = 256;
+
+    bool enqueue(std::unique_lock<std::mutex>& lock, std::function<void()> task, int priority) {
+        if (mShutdown) return false;
+
+        Item item;
+        item.task = std::move(task);
+        item.priority = mOrdering == Ordering::PRIORITY ? priority : 0;
+        item.sequence = mSequence++;
+        item.enqueued = std::chrono::steady_clock::now();
+        mQueue.push(std::move(item));
+        if (mQueue.size() > mMaxDepth) mMaxDepth = mQueue.size();
+        lock.unlock();
+
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    void workerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mLock);
+                mNotEmpty.wait(lock, [this] { return mShutdown || !mQueue.empty(); });
+                if (mQueue.empty()) return;  // shutting down
+
+                // top() is const, the item is popped right after
+                Item& item = const_cast<Item&>(mQueue.top());
+                task = std::move(item.task);
+                int64_t waitUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now() - item.enqueued)
+                                     .count();
+                mQueue.pop();
+
+                mCompleted++;
+                mTotalWaitUs += waitUs;
+                if (waitUs > mMaxWaitUs) mMaxWaitUs = waitUs;
+                if (mCompleted % kStatsLogInterval == 0) {
+                    ALOGD("%s: depth %zu (max %zu), wait avg %lld us max %lld us over %llu requests",
+                          mName, mQueue.size(), mMaxDepth,
+                          static_cast<long long>(mTotalWaitUs / static_cast<int64_t>(mCompleted)),
+                          static_cast<long long>(mMaxWaitUs),
+                          static_cast<unsigned long long>(mCompleted));
+                }
+            }
+            mNotFull.notify_one();
+            task();
+        }
+    }
+
+    const char* mName;
+    const size_t mCapacity;
+    const Ordering mOrdering;
+
+    std::mutex mLock;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+    std::priority_queue<Item, std::vector<Item>, Order> mQueue;
+    std::vector<std::thread> mWorkers;
+    bool mShutdown = false;
+    uint64_t mSequence = 0;
+
+    size_t mMaxDepth = 0;
+    uint64_t mCompleted = 0;
+    int64_t mTotalWaitUs = 0;
+    int64_t mMaxWaitUs = 0;
+};
+
+}  // namespace nnhal
+
+#endif  // ANDROID_ML_NN_EXECUTION_QUEUE_H
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_LATENCY_STATS_H
+#define ANDROID_ML_NN_LATENCY_STATS_H
+
+#include <log/log.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace nnhal {
+
+// Histogram of durations in microseconds. record() only increments atomic
+// counters, so the executions of a model never wait on each other. Below 16 us
+// a bucket is 1 us wide, above each power of two is split in 8 buckets: the
+// percentiles are within 12.5%.
+class LatencyHistogram {
+public:
+    LatencyHistogram() {
+        for (auto& bucket : mBuckets) bucket = 0;
+    }
+
+    void record(int64_t us) {
+        if (us < 0) us = 0;
+        mBuckets[bucketOf(static_cast<uint64_t>(us))].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mSumUs.fetch_add(us, std::memory_order_relaxed);
+        int64_t max = mMaxUs.load(std::memory_order_relaxed);
+        while (us > max && !mMaxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return mCount.load(std::memory_order_relaxed); }
+    int64_t maxUs() const { return mMaxUs.load(std::memory_order_relaxed); }
+    int64_t meanUs() const {
+        uint64_t n = count();
+        return n ? mSumUs.load(std::memory_order_relaxed) / static_cast<int64_t>(n) : 0;
+    }
+
+    // Upper bound of the bucket holding the p-th percentile, 0 when empty.
+    // Recording may go on meanwhile, the result is then only approximate.
+    int64_t percentileUs(int p) const {
+        uint64_t counts[kNumBuckets];
+        uint64_t total = 0;
+        for (int i = 0; i < kNumBuckets; i++) {
+            counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0) return 0;
+        const uint64_t rank = (total * p + 99) / 100;  // 1-based
+        uint64_t seen = 0;
+        for (int i = 0; i < kNumBuckets; i++) {
+            seen += counts[i];
+            if (seen >= rank) return std::min<int64_t>(upperBoundOf(i), maxUs());
+        }
+        return maxUs();
+    }
+
+private:
+    static const int kLinear = 16;
+    static const int kSubBuckets = 8;
+    // up to 2^32 us
+    static const int kNumBuckets = kLinear + (32 - 4) * kSubBuckets;
+
+    static int bucketOf(uint64_t us) {
+        if (us < kLinear) return static_cast<int>(us);
+        int exponent = 63 - __builtin_clzll(us);
+        if (exponent > 31) return kNumBuckets - 1;
+        int sub = static_cast<int>(us >> (exponent - 3)) & (kSubBuckets - 1);
+        return kLinear + (exponent - 4) * kSubBuckets + sub;
+    }
+
+    static int64_t upperBoundOf(int bucket) {
+        if (bucket < kLinear) return bucket;
+        int exponent = (bucket - kLinear) / kSubBuckets + 4;
+        int sub = (bucket - kLinear) % kSubBuckets;
+        int64_t width = int64_t(1) << (exponent - 3);
+        return (kSubBuckets + sub) * width + width - 1;
+    }
+
+    std::atomic<uint64_t> mBuckets[kNumBuckets];
+    std::atomic<uint64_t> mCount{0};
+    std::atomic<int64_t> mSumUs{0};
+    std::atomic<int64_t> mMaxUs{0};
+};
+
+// Where the time of the executions of one prepared model goes, phase by phase.
+// Every kSummaryInterval executions a summary line is logged, and dumpAll()
+// writes the summaries of all the models for `lshal debug`.
+class LatencyStats {
+public:
+    enum Phase {
+        MAP_POOLS,        // mapping the request memory pools
+        WAIT_REQUEST,     // waiting for a free infer request
+        CONVERT_INPUTS,   // copying, converting or permuting the inputs
+        SET_BLOB,         // binding the request buffers to the network
+        INFER,            // on the device, until the HAL hears of the completion
+        CONVERT_OUTPUTS,  // copying or converting the outputs
+        SYNC_POOLS,       // RunTimePoolInfo::update(), the msync of the outputs
+        NOTIFY,           // the callback of the client
+        TOTAL,            // the whole execution
+        kNumPhases
+    };
+
+    static const char* phaseName(Phase phase) {
+        static const char* const kNames[kNumPhases] = {"map",   "wait",  "input",  "setblob",
+                                                       "infer", "output", "msync", "notify",
+                                                       "total"};
+        return kNames[phase];
+    }
+
+    // The phases of one execution. mark() gives the time since the previous
+    // mark to a phase, a phase can be marked several times. A copy may move to
+    // the thread completing the execution.
+    class Timer {
+    public:
+        // does nothing without stats
+        explicit Timer(LatencyStats* stats = nullptr) : mStats(stats) {
+            for (auto& us : mPhaseUs) us = -1;
+            if (mStats) mStart = mLast = std::chrono::steady_clock::now();
+        }
+
+        void mark(Phase phase) {
+            if (!mStats) return;
+            auto now = std::chrono::steady_clock::now();
+            int64_t us =
+                std::chrono::duration_cast<std::chrono::microseconds>(now - mLast).count();
+            mPhaseUs[phase] = mPhaseUs[phase] < 0 ? us : mPhaseUs[phase] + us;
+            mLast = now;
+        }
+
+        // Leaves the time since the previous mark out of the phases, not out of
+        // the total.
+        void skip() {
+            if (mStats) mLast = std::chrono::steady_clock::now();
+        }
+
+        // Records the phases marked and the total, once.
+        void finish() {
+            if (!mStats) return;
+            mPhaseUs[TOTAL] = std::chrono::duration_cast<std::chrono::microseconds>(
+                                  std::chrono::steady_clock::now() - mStart)
+                                  .count();
+            mStats->add(mPhaseUs);
+            mStats = nullptr;
+        }
+
+    private:
+        LatencyStats* mStats;
+        std::chrono::steady_clock::time_point mStart;
+        std::chrono::steady_clock::time_point mLast;
+        int64_t mPhaseUs[kNumPhases];  // -1 when not marked
+    };
+
+    explicit LatencyStats(const std::string& name) : mName(name) {
+        std::lock_guard<std::mutex> lock(registryLock());
+        registry().insert(this);
+    }
+
+    ~LatencyStats() {
+        std::lock_guard<std::mutex> lock(registryLock());
+        registry().erase(this);
+    }
+
+    const LatencyHistogram& histogram(Phase phase) const { return mPhases[phase]; }
+
+    // One line: the p50/p99 of each phase seen so far, in us.
+    std::string summary() const {
+        std::string line = mName + ": " + std::to_string(mPhases[TOTAL].count()) +
+                           " executions, p50/p99 us";
+        for (int i = 0; i < kNumPhases; i++) {
+            const LatencyHistogram& histogram = mPhases[i];
+            if (histogram.count() == 0) continue;
+            char text[64];
+            snprintf(text, sizeof(text), " %s %lld/%lld", phaseName(static_cast<Phase>(i)),
+                     static_cast<long long>(histogram.percentileUs(50)),
+                     static_cast<long long>(histogram.percentileUs(99)));
+            line += text;
+        }
+        return line;
+    }
+
+    // The summary of every model still prepared.
+    static void dumpAll(int fd) {
+        std::lock_guard<std::mutex> lock(registryLock());
+        for (const LatencyStats* stats : registry()) dprintf(fd, "%s\n", stats->summary().c_str());
+    }
+
+private:
+    static const uint64_t kSummaryInterval = 256;
+
+    void add(const int64_t (&phaseUs)[kNumPhases]) {
+        for (int i = 0; i < kNumPhases; i++)
+            if (phaseUs[i] >= 0) mPhases[i].record(phaseUs[i]);
+        uint64_t executions = mExecutions.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (executions % kSummaryInterval == 0) ALOGI("%s", summary().c_str());
+    }
+
+    static std::mutex& registryLock() {
+        static std::mutex lock;
+        return lock;
+    }
+
+    static std::set<const LatencyStats*>& registry() {
+        static std::set<const LatencyStats*> stats;
+        return stats;
+    }
+
+    const std::string mName;
+    LatencyHistogram mPhases[kNumPhases];
+    std::atomic<uint64_t> mExecutions{0};
+};
+
+}  // namespace nnhal
+
+#endif  // ANDROID_ML_NN_LATENCY_STATS_H
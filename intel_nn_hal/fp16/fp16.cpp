@@ -0,0 +1,685 @@
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fp16.h"
+
+#include <string.h>
+#include <atomic>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define FP16_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace fp16 {
+
+// F32: exp_bias:127 SEEEEEEE EMMMMMMM MMMMMMMM MMMMMMMM.
+// F16: exp_bias:15  SEEEEEMM MMMMMMMM
+#define EXP_MASK_F32 0x7F800000U
+#define EXP_MASK_F16 0x7C00U
+
+static inline float asfloat(uint32_t v) {
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+static inline uint32_t asuint(float f) {
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    return v;
+}
+
+//
+// Scalar references. These are the conversions the HALs have always used and
+// define the results of every vector kernel below.
+//
+
+float f16tof32(short x) {
+    // this is storage for output result
+    uint32_t u = x;
+
+    // get sign in 32bit format
+    uint32_t s = ((u & 0x8000) << 16);
+
+    // check for NAN and INF
+    if ((u & EXP_MASK_F16) == EXP_MASK_F16) {
+        // keep mantissa only
+        u &= 0x03FF;
+
+        // check if it is NAN and raise 10 bit to be align with intrin
+        if (u) {
+            u |= 0x0200;
+        }
+
+        u <<= (23 - 10);
+        u |= EXP_MASK_F32;
+        u |= s;
+    } else if ((x & EXP_MASK_F16) == 0) {
+        // check for zero and denormals. both are converted to zero
+        u = s;
+    } else {
+        // abs
+        u = (u & 0x7FFF);
+
+        // shift mantissa and exp from f16 to f32 position
+        u <<= (23 - 10);
+
+        // new bias for exp (f16 bias is 15 and f32 bias is 127)
+        u += ((127 - 15) << 23);
+
+        // add sign
+        u |= s;
+    }
+
+    // finaly represent result as float and return
+    return asfloat(u);
+}
+
+// This function convert f32 to f16 with rounding to nearest value to minimize error
+// the denormal values are converted to 0.
+short f32tof16(float x) {
+    // create minimal positive normal f16 value in f32 format
+    // exp:-14,mantissa:0 -> 2^-14 * 1.0
+    static float min16 = asfloat((127 - 14) << 23);
+
+    // create maximal positive normal f16 value in f32 and f16 formats
+    // exp:15,mantissa:11111 -> 2^15 * 1.(11111)
+    static float max16 = asfloat(((127 + 15) << 23) | 0x007FE000);
+    static uint32_t max16f16 = ((15 + 15) << 10) | 0x3FF;
+
+    // define and declare variable for intermidiate and output result
+    // the union is used to simplify representation changing
+    union {
+        float f;
+        uint32_t u;
+    } v;
+    v.f = x;
+
+    // get sign in 16bit format
+    uint32_t s = (v.u >> 16) & 0x8000;  // sign 16:  00000000 00000000 10000000 00000000
+
+    // make it abs
+    v.u &= 0x7FFFFFFF;  // abs mask: 01111111 11111111 11111111 11111111
+
+    // check NAN and INF
+    if ((v.u & EXP_MASK_F32) == EXP_MASK_F32) {
+        if (v.u & 0x007FFFFF) {
+            return s | (v.u >> (23 - 10)) | 0x0200;  // return NAN f16
+        } else {
+            return s | (v.u >> (23 - 10));  // return INF f16
+        }
+    }
+
+    // to make f32 round to nearest f16
+    // create halfULP for f16 and add it to origin value
+    float halfULP = asfloat(v.u & EXP_MASK_F32) * asfloat((127 - 11) << 23);
+    v.f += halfULP;
+
+    // if input value is not fit normalized f16 then return 0
+    // denormals are not covered by this code and just converted to 0
+    if (v.f < min16 * 0.5F) {
+        return s;
+    }
+
+    // if input value between min16/2 and min16 then return min16
+    if (v.f < min16) {
+        return s | (1 << 10);
+    }
+
+    // if input value more than maximal allowed value for f16
+    // then return this maximal value
+    if (v.f >= max16) {
+        return max16f16 | s;
+    }
+
+    // change exp bias from 127 to 15
+    v.u -= ((127 - 15) << 23);
+
+    // round to f16
+    v.u >>= (23 - 10);
+
+    return v.u | s;
+}
+
+unsigned half2float(unsigned short h) {
+    unsigned short h_exp, h_sig;
+    unsigned f_sgn, f_exp, f_sig;
+
+    h_exp = (h & 0x7c00u);
+    f_sgn = ((unsigned)h & 0x8000u) << 16;
+    switch (h_exp) {
+        case 0x0000u: /* 0 or subnormal */
+            h_sig = (h & 0x03ffu);
+            /* Signed zero */
+            if (h_sig == 0) {
+                return f_sgn;
+            }
+            /* Subnormal */
+            h_sig <<= 1;
+            while ((h_sig & 0x0400u) == 0) {
+                h_sig <<= 1;
+                h_exp++;
+            }
+            f_exp = ((unsigned)(127 - 15 - h_exp)) << 23;
+            f_sig = ((unsigned)(h_sig & 0x03ffu)) << 13;
+            return f_sgn + f_exp + f_sig;
+        case 0x7c00u: /* inf or NaN */
+            /* All-ones exponent and a copy of the significand */
+            return f_sgn + 0x7f800000u + (((unsigned)(h & 0x03ffu)) << 13);
+        default: /* normalized */
+            /* Just need to adjust the exponent and shift */
+            return f_sgn + (((unsigned)(h & 0x7fffu) + 0x1c000u) << 13);
+    }
+}
+
+unsigned short float2half(unsigned f) {
+    unsigned f_exp, f_sig;
+    unsigned short h_sgn, h_exp, h_sig;
+
+    h_sgn = (unsigned short)((f & 0x80000000u) >> 16);
+    f_exp = (f & 0x7f800000u);
+
+    /* Exponent overflow/NaN converts to signed inf/NaN */
+    if (f_exp >= 0x47800000u) {
+        if (f_exp == 0x7f800000u) {
+            /* Inf or NaN */
+            f_sig = (f & 0x007fffffu);
+            if (f_sig != 0) {
+                /* NaN - propagate the flag in the significand... */
+                unsigned short ret = (unsigned short)(0x7c00u + (f_sig >> 13));
+                /* ...but make sure it stays a NaN */
+                if (ret == 0x7c00u) {
+                    ret++;
+                }
+                return h_sgn + ret;
+            } else {
+                /* signed inf */
+                return (unsigned short)(h_sgn + 0x7c00u);
+            }
+        } else {
+            /* overflow to signed inf */
+            return (unsigned short)(h_sgn + 0x7c00u);
+        }
+    }
+
+    /* Exponent underflow converts to a subnormal half or signed zero */
+    if (f_exp <= 0x38000000u) {
+        /*
+         * Signed zeros, subnormal floats, and floats with small
+         * exponents all convert to signed zero halfs.
+         */
+        if (f_exp < 0x33000000u) {
+            return h_sgn;
+        }
+        /* Make the subnormal significand */
+        f_exp >>= 23;
+        f_sig = (0x00800000u + (f & 0x007fffffu));
+        f_sig >>= (113 - f_exp);
+        /* Handle rounding by adding 1 to the bit beyond half precision */
+        f_sig += 0x00001000u;
+        h_sig = (unsigned short)(f_sig >> 13);
+        /*
+         * If the rounding causes a bit to spill into h_exp, it will
+         * increment h_exp from zero to one and h_sig will be zero.
+         * This is the correct result.
+         */
+        return (unsigned short)(h_sgn + h_sig);
+    }
+
+    /* Regular case with no overflow or underflow */
+    h_exp = (unsigned short)((f_exp - 0x38000000u) >> 13);
+    /* Handle rounding by adding 1 to the bit beyond half precision */
+    f_sig = (f & 0x007fffffu);
+    f_sig += 0x00001000u;
+    h_sig = (unsigned short)(f_sig >> 13);
+    /*
+     * If the rounding causes a bit to spill into h_exp, it will
+     * increment h_exp by one and h_sig will be zero.  This is the
+     * correct result.  h_exp may increment to 15, at greatest, in
+     * which case the result overflows to a signed inf.
+     */
+    return h_sgn + h_exp + h_sig;
+}
+
+static void f32tof16Scalar(short* dst, const float* src, size_t nelem, float scale, float bias) {
+    for (size_t i = 0; i < nelem; i++) dst[i] = f32tof16(src[i] * scale + bias);
+}
+
+static void f16tof32Scalar(float* dst, const short* src, size_t nelem, float scale, float bias) {
+    for (size_t i = 0; i < nelem; i++) dst[i] = f16tof32(src[i]) * scale + bias;
+}
+
+static void floattofp16Scalar(unsigned short* dst, const float* src, size_t nelem) {
+    for (size_t i = 0; i < nelem; i++) dst[i] = float2half(asuint(src[i]));
+}
+
+static void fp16tofloatScalar(float* dst, const unsigned short* src, size_t nelem) {
+    for (size_t i = 0; i < nelem; i++) dst[i] = asfloat(half2float(src[i]));
+}
+
+//
+// Vector kernels, written once with the GCC/clang vector extensions and
+// instantiated per instruction set. Every lane computes all the cases of the
+// scalar reference and the right one is picked with masks, so there are no
+// branches in the loop. The remainder that does not fill a vector goes
+// through the scalar reference.
+//
+
+#if defined(FP16_X86) || defined(__aarch64__)
+#define FP16_INLINE static inline __attribute__((always_inline))
+
+template <int N>
+struct Vec;
+
+template <>
+struct Vec<4> {
+    typedef float F __attribute__((vector_size(16)));
+    typedef int32_t I __attribute__((vector_size(16)));
+    typedef uint32_t U __attribute__((vector_size(16)));
+    typedef int16_t I16 __attribute__((vector_size(8)));
+    typedef uint16_t U16 __attribute__((vector_size(8)));
+};
+
+template <>
+struct Vec<8> {
+    typedef float F __attribute__((vector_size(32)));
+    typedef int32_t I __attribute__((vector_size(32)));
+    typedef uint32_t U __attribute__((vector_size(32)));
+    typedef int16_t I16 __attribute__((vector_size(16)));
+    typedef uint16_t U16 __attribute__((vector_size(16)));
+};
+
+// mask lanes are all ones or all zeros, as produced by the vector compares
+template <typename T, typename M>
+FP16_INLINE T select(M mask, T a, T b) {
+    return (T)(((M)a & mask) | ((M)b & ~mask));
+}
+
+template <int N>
+FP16_INLINE typename Vec<N>::U f32tof16Lanes(typename Vec<N>::F x) {
+    typedef typename Vec<N>::F F;
+    typedef typename Vec<N>::U U;
+    typedef typename Vec<N>::I I;
+
+    const float min16 = asfloat((127 - 14) << 23);
+    const float max16 = asfloat(((127 + 15) << 23) | 0x007FE000);
+    const float ulpScale = asfloat((127 - 11) << 23);
+
+    U u = (U)x;
+    U s = (u >> 16) & 0x8000;
+    U a = u & 0x7FFFFFFF;
+
+    // NAN and INF
+    I special = (I)((a & EXP_MASK_F32) == EXP_MASK_F32);
+    U nanBit = (U)((a & 0x007FFFFF) != 0) & 0x0200;
+    U specialBits = s | (a >> (23 - 10)) | nanBit;
+
+    F v = (F)a + (F)(a & EXP_MASK_F32) * ulpScale;
+
+    U r = (((U)v - ((127 - 15) << 23)) >> (23 - 10)) | s;
+    r = select((I)(v >= max16), s | (((15 + 15) << 10) | 0x3FF), r);
+    r = select((I)(v < min16), s | (1 << 10), r);
+    r = select((I)(v < min16 * 0.5F), s, r);
+    return select(special, specialBits, r);
+}
+
+template <int N>
+FP16_INLINE typename Vec<N>::F f16tof32Lanes(typename Vec<N>::U u) {
+    typedef typename Vec<N>::F F;
+    typedef typename Vec<N>::U U;
+    typedef typename Vec<N>::I I;
+
+    U s = (u & 0x8000) << 16;
+    U e = u & EXP_MASK_F16;
+
+    U m = u & 0x03FF;
+    U specialBits = ((m | ((U)(m != 0) & 0x0200)) << (23 - 10)) | EXP_MASK_F32 | s;
+    U normalBits = (((u & 0x7FFF) << (23 - 10)) + ((127 - 15) << 23)) | s;
+
+    U r = select((I)(e == 0), s, normalBits);
+    return (F)select((I)(e == EXP_MASK_F16), specialBits, r);
+}
+
+template <int N>
+FP16_INLINE typename Vec<N>::U float2halfLanes(typename Vec<N>::U f) {
+    typedef typename Vec<N>::F F;
+    typedef typename Vec<N>::U U;
+    typedef typename Vec<N>::I I;
+
+    U sgn = (f >> 16) & 0x8000;
+    U fexp = f & 0x7f800000u;
+    U fsig = f & 0x007fffffu;
+
+    // overflow and INF, then NaN keeping the top of the significand
+    U nan = 0x7c00u + (fsig >> 13);
+    nan += (U)(nan == 0x7c00u) & 1;
+    U special = select((I)((fexp == 0x7f800000u) & (fsig != 0)), nan, U{} + 0x7c00u);
+
+    // normal halfs, the rounding carry spills into the exponent
+    U normal = ((fexp - 0x38000000u) >> 13) + ((fsig + 0x00001000u) >> 13);
+
+    // subnormal halfs: |f| * 2^24 is exact and below 1024, adding 0.5 and
+    // truncating rounds the same way as the shift and add of the reference
+    F scaled = (F)(f & 0x7fffffffu) * asfloat((127 + 24) << 23) + 0.5F;
+    U subnormal = (U)__builtin_convertvector(scaled, I);
+
+    U h = select((I)(fexp <= 0x38000000u), subnormal, normal);
+    h = select((I)(fexp < 0x33000000u), U{}, h);
+    h = select((I)(fexp >= 0x47800000u), special, h);
+    return sgn + h;
+}
+
+template <int N>
+FP16_INLINE typename Vec<N>::U half2floatLanes(typename Vec<N>::U h) {
+    typedef typename Vec<N>::F F;
+    typedef typename Vec<N>::U U;
+    typedef typename Vec<N>::I I;
+
+    U sgn = (h & 0x8000u) << 16;
+    U hexp = h & 0x7c00u;
+
+    U normal = ((h & 0x7fffu) + 0x1c000u) << 13;
+    U special = 0x7f800000u + ((h & 0x03ffu) << 13);
+    // zero and subnormal halfs are sig * 2^-24, exact in float
+    F sub = __builtin_convertvector((I)(h & 0x03ffu), F) * asfloat((127 - 24) << 23);
+
+    U r = select((I)(hexp == 0), (U)sub, normal);
+    r = select((I)(hexp == 0x7c00u), special, r);
+    return sgn | r;
+}
+
+template <int N>
+FP16_INLINE void f32tof16Kernel(short* dst, const float* src, size_t nelem, float scale,
+                                float bias) {
+    typedef typename Vec<N>::F F;
+    typedef typename Vec<N>::I16 I16;
+
+    size_t i = 0;
+    for (; i + N <= nelem; i += N) {
+        F x;
+        memcpy(&x, src + i, sizeof(x));
+        I16 h = __builtin_convertvector(f32tof16Lanes<N>(x * scale + bias), I16);
+        memcpy(dst + i, &h, sizeof(h));
+    }
+    f32tof16Scalar(dst + i, src + i, nelem - i, scale, bias);
+}
+
+template <int N>
+FP16_INLINE void f16tof32Kernel(float* dst, const short* src, size_t nelem, float scale,
+                                float bias) {
+    typedef typename Vec<N>::F F;
+    typedef typename Vec<N>::U U;
+    typedef typename Vec<N>::U16 U16;
+
+    size_t i = 0;
+    for (; i + N <= nelem; i += N) {
+        U16 h;
+        memcpy(&h, src + i, sizeof(h));
+        F x = f16tof32Lanes<N>(__builtin_convertvector(h, U)) * scale + bias;
+        memcpy(dst + i, &x, sizeof(x));
+    }
+    f16tof32Scalar(dst + i, src + i, nelem - i, scale, bias);
+}
+
+template <int N>
+FP16_INLINE void floattofp16Kernel(unsigned short* dst, const float* src, size_t nelem) {
+    typedef typename Vec<N>::U U;
+    typedef typename Vec<N>::U16 U16;
+
+    size_t i = 0;
+    for (; i + N <= nelem; i += N) {
+        U f;
+        memcpy(&f, src + i, sizeof(f));
+        U16 h = __builtin_convertvector(float2halfLanes<N>(f), U16);
+        memcpy(dst + i, &h, sizeof(h));
+    }
+    floattofp16Scalar(dst + i, src + i, nelem - i);
+}
+
+template <int N>
+FP16_INLINE void fp16tofloatKernel(float* dst, const unsigned short* src, size_t nelem) {
+    typedef typename Vec<N>::U U;
+    typedef typename Vec<N>::U16 U16;
+
+    size_t i = 0;
+    for (; i + N <= nelem; i += N) {
+        U16 h;
+        memcpy(&h, src + i, sizeof(h));
+        U f = half2floatLanes<N>(__builtin_convertvector(h, U));
+        memcpy(dst + i, &f, sizeof(f));
+    }
+    fp16tofloatScalar(dst + i, src + i, nelem - i);
+}
+
+#define FP16_DEFINE_KERNELS(suffix, attr, width)                                               \
+    attr static void f32tof16##suffix(short* dst, const float* src, size_t nelem, float scale, \
+                                      float bias) {                                            \
+        f32tof16Kernel<width>(dst, src, nelem, scale, bias);                                   \
+    }                                                                                          \
+    attr static void f16tof32##suffix(float* dst, const short* src, size_t nelem, float scale, \
+                                      float bias) {                                            \
+        f16tof32Kernel<width>(dst, src, nelem, scale, bias);                                   \
+    }                                                                                          \
+    attr static void floattofp16##suffix(unsigned short* dst, const float* src, size_t nelem) { \
+        floattofp16Kernel<width>(dst, src, nelem);                                             \
+    }                                                                                          \
+    attr static void fp16tofloat##suffix(float* dst, const unsigned short* src, size_t nelem) { \
+        fp16tofloatKernel<width>(dst, src, nelem);                                             \
+    }
+
+#ifdef FP16_X86
+FP16_DEFINE_KERNELS(SSE41, __attribute__((target("sse4.1"))), 4)
+FP16_DEFINE_KERNELS(AVX2, __attribute__((target("avx2"))), 8)
+
+// The F16C instructions only help the FP16 -> FP32 direction: converting the
+// other way rounds to nearest even and keeps FP16 denormals, which is not what
+// either reference does. Normal halfs convert exactly; the lanes the
+// references treat differently are patched from the integer path.
+__attribute__((target("avx2,f16c"))) static void f16tof32F16C(float* dst, const short* src,
+                                                               size_t nelem, float scale,
+                                                               float bias) {
+    typedef Vec<8>::F F;
+    typedef Vec<8>::I I;
+    typedef Vec<8>::U U;
+    typedef Vec<8>::U16 U16;
+
+    size_t i = 0;
+    for (; i + 8 <= nelem; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        U f = (U)_mm256_cvtph_ps(h);
+        // zero and denormal halfs are flushed to signed zero
+        U u = __builtin_convertvector((U16)h, U);
+        f = select((I)((u & EXP_MASK_F16) == 0), (u & 0x8000) << 16, f);
+        F x = (F)f * scale + bias;
+        memcpy(dst + i, &x, sizeof(x));
+    }
+    f16tof32Scalar(dst + i, src + i, nelem - i, scale, bias);
+}
+
+__attribute__((target("avx2,f16c"))) static void fp16tofloatF16C(float* dst,
+                                                                  const unsigned short* src,
+                                                                  size_t nelem) {
+    typedef Vec<8>::I I;
+    typedef Vec<8>::U U;
+    typedef Vec<8>::U16 U16;
+
+    size_t i = 0;
+    for (; i + 8 <= nelem; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        U f = (U)_mm256_cvtph_ps(h);
+        // the instruction quiets NaNs, the reference keeps the significand
+        U u = __builtin_convertvector((U16)h, U);
+        I nan = (I)(((u & 0x7c00u) == 0x7c00u) & ((u & 0x03ffu) != 0));
+        f = select(nan, (u & 0x8000u) << 16 | 0x7f800000u | (u & 0x03ffu) << 13, f);
+        memcpy(dst + i, &f, sizeof(f));
+    }
+    fp16tofloatScalar(dst + i, src + i, nelem - i);
+}
+#else
+// ARMv7 NEON flushes denormals to zero, only AArch64 gets a vector path
+FP16_DEFINE_KERNELS(NEON, , 4)
+#endif
+
+#endif  // FP16_X86 || __aarch64__
+
+//
+// Dispatch
+//
+
+namespace {
+
+struct Kernels {
+    void (*f32tof16)(short*, const float*, size_t, float, float);
+    void (*f16tof32)(float*, const short*, size_t, float, float);
+    void (*floattofp16)(unsigned short*, const float*, size_t);
+    void (*fp16tofloat)(float*, const unsigned short*, size_t);
+};
+
+const Kernels kScalarKernels = {f32tof16Scalar, f16tof32Scalar, floattofp16Scalar,
+                                fp16tofloatScalar};
+#ifdef FP16_X86
+const Kernels kSSE41Kernels = {f32tof16SSE41, f16tof32SSE41, floattofp16SSE41, fp16tofloatSSE41};
+const Kernels kAVX2Kernels = {f32tof16AVX2, f16tof32AVX2, floattofp16AVX2, fp16tofloatAVX2};
+const Kernels kF16CKernels = {f32tof16AVX2, f16tof32F16C, floattofp16AVX2, fp16tofloatF16C};
+#elif defined(__aarch64__)
+const Kernels kNEONKernels = {f32tof16NEON, f16tof32NEON, floattofp16NEON, fp16tofloatNEON};
+#endif
+
+const Kernels* kernelsFor(Isa isa) {
+    switch (isa) {
+#ifdef FP16_X86
+        case Isa::SSE41:
+            return &kSSE41Kernels;
+        case Isa::AVX2:
+            return &kAVX2Kernels;
+        case Isa::F16C:
+            return &kF16CKernels;
+#elif defined(__aarch64__)
+        case Isa::NEON:
+            return &kNEONKernels;
+#endif
+        default:
+            return &kScalarKernels;
+    }
+}
+
+#ifdef FP16_X86
+// AVX state has to be enabled by the OS as well as supported by the cpu
+bool osSupportsAvx() {
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (eax & 0x6) == 0x6;  // XMM and YMM state
+}
+#endif
+
+Isa probeIsa() {
+#ifdef FP16_X86
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return Isa::SCALAR;
+
+    bool sse41 = ecx & (1u << 19);
+    bool osxsave = ecx & (1u << 27);
+    bool avx = ecx & (1u << 28);
+    bool f16c = ecx & (1u << 29);
+    bool avx2 = false;
+    if (avx && osxsave && osSupportsAvx() && __get_cpuid_max(0, nullptr) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        avx2 = ebx & (1u << 5);
+    }
+
+    if (avx2 && f16c) return Isa::F16C;
+    if (avx2) return Isa::AVX2;
+    if (sse41) return Isa::SSE41;
+    return Isa::SCALAR;
+#elif defined(__aarch64__)
+    return Isa::NEON;
+#else
+    return Isa::SCALAR;
+#endif
+}
+
+bool supports(Isa best, Isa isa) {
+    switch (isa) {
+        case Isa::SCALAR:
+            return true;
+        case Isa::SSE41:
+            return best == Isa::SSE41 || best == Isa::AVX2 || best == Isa::F16C;
+        case Isa::AVX2:
+            return best == Isa::AVX2 || best == Isa::F16C;
+        default:
+            return best == isa;
+    }
+}
+
+std::atomic<const Kernels*>& activeKernels() {
+    static std::atomic<const Kernels*> kernels(kernelsFor(detectIsa()));
+    return kernels;
+}
+
+std::atomic<Isa>& activeIsa() {
+    static std::atomic<Isa> isa(detectIsa());
+    return isa;
+}
+
+}  // namespace
+
+Isa detectIsa() {
+    static const Isa isa = probeIsa();
+    return isa;
+}
+
+Isa currentIsa() { return activeIsa().load(std::memory_order_relaxed); }
+
+bool setIsa(Isa isa) {
+    if (!supports(detectIsa(), isa)) return false;
+    activeIsa().store(isa, std::memory_order_relaxed);
+    activeKernels().store(kernelsFor(isa), std::memory_order_release);
+    return true;
+}
+
+const char* isaName(Isa isa) {
+    switch (isa) {
+        case Isa::SCALAR:
+            return "scalar";
+        case Isa::SSE41:
+            return "sse4.1";
+        case Isa::AVX2:
+            return "avx2";
+        case Isa::F16C:
+            return "avx2+f16c";
+        case Isa::NEON:
+            return "neon";
+    }
+    return "unknown";
+}
+
+void f32tof16Arrays(short* dst, const float* src, size_t nelem, float scale, float bias) {
+    activeKernels().load(std::memory_order_acquire)->f32tof16(dst, src, nelem, scale, bias);
+}
+
+void f16tof32Arrays(float* dst, const short* src, size_t nelem, float scale, float bias) {
+    activeKernels().load(std::memory_order_acquire)->f16tof32(dst, src, nelem, scale, bias);
+}
+
+void floattofp16(unsigned short* dst, const float* src, size_t nelem) {
+    activeKernels().load(std::memory_order_acquire)->floattofp16(dst, src, nelem);
+}
+
+void fp16tofloat(float* dst, const unsigned short* src, size_t nelem) {
+    activeKernels().load(std::memory_order_acquire)->fp16tofloat(dst, src, nelem);
+}
+
+}  // namespace fp16
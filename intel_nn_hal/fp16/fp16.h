@@ -0,0 +1,68 @@
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// FP32 <-> FP16 array conversion with SSE4.1, AVX2, F16C and NEON kernels
+// picked at runtime. Two conversion flavours are kept, because the HALs
+// already depend on their exact results:
+//
+//  - f32tof16 / f16tof32: the Inference Engine convention used on the Myriad
+//    path. FP16 denormals are flushed to zero and FP32 values above the FP16
+//    range saturate to the largest finite FP16.
+//  - float2half / half2float: the numpy convention used by the NCS driver.
+//    Denormals are kept and out of range values become infinity.
+//
+// Every kernel returns exactly what the scalar reference returns, for every
+// input including NaN, infinity and denormals.
+namespace fp16 {
+
+enum class Isa {
+    SCALAR,
+    SSE41,
+    AVX2,
+    F16C,  // AVX2 plus the F16C conversion instructions
+    NEON,
+};
+
+// Best instruction set supported by the cpu, detected once.
+Isa detectIsa();
+// Instruction set the array functions currently use.
+Isa currentIsa();
+// Forces the instruction set used by the array functions (tests, benchmarks).
+// Returns false and keeps the current one if the cpu does not support it.
+bool setIsa(Isa isa);
+const char* isaName(Isa isa);
+
+// Scalar references.
+short f32tof16(float x);
+float f16tof32(short x);
+unsigned short float2half(unsigned f);
+unsigned half2float(unsigned short h);
+
+// dst[i] = f32tof16(src[i] * scale + bias)
+void f32tof16Arrays(short* dst, const float* src, size_t nelem, float scale = 1.0f,
+                    float bias = 0.0f);
+// dst[i] = f16tof32(src[i]) * scale + bias
+void f16tof32Arrays(float* dst, const short* src, size_t nelem, float scale = 1.0f,
+                    float bias = 0.0f);
+
+// dst[i] = float2half(src[i]) and dst[i] = half2float(src[i])
+void floattofp16(unsigned short* dst, const float* src, size_t nelem);
+void fp16tofloat(float* dst, const unsigned short* src, size_t nelem);
+
+}  // namespace fp16
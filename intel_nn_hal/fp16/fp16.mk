@@ -0,0 +1,45 @@
+LOCAL_PATH := $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libnnhal_fp16
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_OWNER := intel
+
+LOCAL_SRC_FILES := \
+	fp16.cpp
+
+LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)
+
+# The vector kernels must round exactly like the scalar references,
+# so multiply and add are never fused. The helpers taking vector types
+# are always inlined and never cross an ABI boundary, so the note that
+# their ABI depends on AVX does not apply.
+LOCAL_CFLAGS += \
+	-std=c++11 \
+	-fPIC \
+	-Wall \
+	-Wno-error \
+	-Wno-psabi \
+	-ffp-contract=off \
+	-O3
+
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := fp16test
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_OWNER := intel
+
+LOCAL_SRC_FILES := \
+	fp16_test.cpp
+
+LOCAL_CFLAGS += \
+	-std=c++11 \
+	-Wall \
+	-Wno-error \
+	-ffp-contract=off
+
+LOCAL_STATIC_LIBRARIES := libnnhal_fp16
+
+include $(BUILD_EXECUTABLE)
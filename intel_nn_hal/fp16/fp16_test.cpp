@@ -0,0 +1,202 @@
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks every vector kernel against the scalar references and times them.
+//   fp16test             all halfs, a stride of the floats, specials, benchmark
+//   fp16test --full      every float bit pattern as well (slow)
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "fp16.h"
+
+using namespace fp16;
+
+static const Isa kIsas[] = {Isa::SSE41, Isa::AVX2, Isa::F16C, Isa::NEON};
+
+static float bitsToFloat(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static uint32_t floatToBits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+// Float inputs: every stride-th bit pattern from first up, plus the values
+// around the boundaries the conversions care about.
+static std::vector<float> floatInputs(uint64_t first, uint64_t last, uint32_t stride) {
+    std::vector<float> in;
+    for (uint64_t u = first; u <= last; u += stride) in.push_back(bitsToFloat(uint32_t(u)));
+
+    const uint32_t edges[] = {0x00000000, 0x00000001, 0x007FFFFF, 0x00800000, 0x33000000,
+                              0x33800000, 0x38000000, 0x38800000, 0x387FC000, 0x477FE000,
+                              0x477FF000, 0x477FEFFF, 0x47800000, 0x7F7FFFFF, 0x7F800000,
+                              0x7F800001, 0x7F801FFF, 0x7F802000, 0x7FC00000, 0x7FFFFFFF};
+    for (uint32_t e : edges) {
+        for (int d = -2; d <= 2; d++) {
+            for (uint32_t sign : {0u, 0x80000000u})
+                in.push_back(bitsToFloat(((e + d) & 0x7FFFFFFF) | sign));
+        }
+    }
+    return in;
+}
+
+static std::vector<unsigned short> allHalfs() {
+    std::vector<unsigned short> in(65536);
+    for (uint32_t i = 0; i < in.size(); i++) in[i] = (unsigned short)i;
+    return in;
+}
+
+static int checkIsa(const std::vector<float>& floats, const std::vector<unsigned short>& halfs) {
+    int errors = 0;
+    const size_t nf = floats.size();
+    const size_t nh = halfs.size();
+    const short* shalfs = reinterpret_cast<const short*>(halfs.data());
+    const float affine[][2] = {{1.0f, 0.0f}, {0.5f, -3.0f}, {255.0f, 0.125f}};
+
+    std::vector<short> h16(nf);
+    std::vector<unsigned short> u16(nf);
+    std::vector<float> f32(nh);
+    std::vector<uint32_t> u32(nh);
+
+    for (const auto& a : affine) {
+        f32tof16Arrays(h16.data(), floats.data(), nf, a[0], a[1]);
+        for (size_t i = 0; i < nf && errors < 10; i++) {
+            short ref = f32tof16(floats[i] * a[0] + a[1]);
+            if (h16[i] != ref) {
+                printf("  f32tof16(%08x * %g + %g) = %04x, expected %04x\n",
+                       floatToBits(floats[i]), a[0], a[1], h16[i] & 0xFFFF, ref & 0xFFFF);
+                errors++;
+            }
+        }
+
+        f16tof32Arrays(f32.data(), shalfs, nh, a[0], a[1]);
+        for (size_t i = 0; i < nh && errors < 10; i++) {
+            uint32_t ref = floatToBits(f16tof32(shalfs[i]) * a[0] + a[1]);
+            if (floatToBits(f32[i]) != ref) {
+                printf("  f16tof32(%04x) * %g + %g = %08x, expected %08x\n", halfs[i], a[0],
+                       a[1], floatToBits(f32[i]), ref);
+                errors++;
+            }
+        }
+    }
+
+    floattofp16(u16.data(), floats.data(), nf);
+    for (size_t i = 0; i < nf && errors < 10; i++) {
+        unsigned short ref = float2half(floatToBits(floats[i]));
+        if (u16[i] != ref) {
+            printf("  float2half(%08x) = %04x, expected %04x\n", floatToBits(floats[i]), u16[i],
+                   ref);
+            errors++;
+        }
+    }
+
+    fp16tofloat(reinterpret_cast<float*>(u32.data()), halfs.data(), nh);
+    for (size_t i = 0; i < nh && errors < 10; i++) {
+        uint32_t ref = half2float(halfs[i]);
+        if (u32[i] != ref) {
+            printf("  half2float(%04x) = %08x, expected %08x\n", halfs[i], u32[i], ref);
+            errors++;
+        }
+    }
+
+    // lengths that leave a remainder for the scalar tail
+    for (size_t n = 1; n < 20; n++) {
+        std::vector<unsigned short> out(n + 1, 0xDEAD);
+        floattofp16(out.data(), floats.data() + 7, n);
+        if (out[n] != 0xDEAD || out[n - 1] != float2half(floatToBits(floats[6 + n]))) {
+            printf("  floattofp16 tail of %zu elements\n", n);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+static void benchmark(size_t nelem, int iterations) {
+    std::vector<float> src(nelem), back(nelem);
+    std::vector<short> half(nelem);
+    for (size_t i = 0; i < nelem; i++) src[i] = (float(i % 2048) - 1024.0f) / 7.0f;
+
+    printf("%-10s %14s %14s %14s %14s\n", "isa", "f32tof16", "f16tof32", "floattofp16",
+           "fp16tofloat");
+    Isa isas[] = {Isa::SCALAR, Isa::SSE41, Isa::AVX2, Isa::F16C, Isa::NEON};
+    for (Isa isa : isas) {
+        if (!setIsa(isa)) continue;
+        double mps[4];
+        for (int k = 0; k < 4; k++) {
+            auto start = std::chrono::steady_clock::now();
+            for (int it = 0; it < iterations; it++) {
+                switch (k) {
+                    case 0:
+                        f32tof16Arrays(half.data(), src.data(), nelem);
+                        break;
+                    case 1:
+                        f16tof32Arrays(back.data(), half.data(), nelem);
+                        break;
+                    case 2:
+                        floattofp16(reinterpret_cast<unsigned short*>(half.data()), src.data(),
+                                    nelem);
+                        break;
+                    case 3:
+                        fp16tofloat(back.data(), reinterpret_cast<unsigned short*>(half.data()),
+                                    nelem);
+                        break;
+                }
+            }
+            double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                           .count();
+            mps[k] = double(nelem) * iterations / s / 1e6;
+        }
+        printf("%-10s %10.0f M/s %10.0f M/s %10.0f M/s %10.0f M/s\n", isaName(isa), mps[0], mps[1],
+               mps[2], mps[3]);
+    }
+    setIsa(detectIsa());
+}
+
+int main(int argc, char** argv) {
+    bool full = argc > 1 && strcmp(argv[1], "--full") == 0;
+
+    printf("fp16: detected %s\n", isaName(detectIsa()));
+    std::vector<unsigned short> halfs = allHalfs();
+
+    // the full sweep goes through the float bit patterns 2^24 at a time
+    const uint64_t chunk = full ? (1ull << 24) : (1ull << 32);
+    const uint32_t stride = full ? 1 : 4099;
+    int failures = 0;
+    for (Isa isa : kIsas) {
+        if (!setIsa(isa)) continue;
+        int errors = 0;
+        uint64_t checked = 0;
+        for (uint64_t first = 0; first < (1ull << 32) && !errors; first += chunk) {
+            std::vector<float> floats = floatInputs(first, first + chunk - 1, stride);
+            errors += checkIsa(floats, halfs);
+            checked += floats.size();
+        }
+        printf("%-10s %s (%llu floats, %zu halfs)\n", isaName(isa), errors ? "FAILED" : "ok",
+               (unsigned long long)checked, halfs.size());
+        failures += errors;
+    }
+    setIsa(detectIsa());
+
+    // a convolution worth of weights, the size the Myriad path converts per layer
+    benchmark(1 << 20, 50);
+
+    return failures ? 1 : 0;
+}
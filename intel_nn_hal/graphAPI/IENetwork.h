@@ -33,7 +33,15 @@
 #include "ie_plugin_cpp.hpp"
 #include "ie_exception_conversion.hpp"
 #include "debug.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include <android/log.h>
 #include <log/log.h>
@@ -102,8 +110,42 @@ static void setConfig(std::map<std::string, std::string> &config) {
     //config[VPU_CONFIG_KEY(COMPUTE_LAYOUT)] = VPU_CONFIG_VALUE(NHWC);
 }
 
+// The Inference Engine in use has no OPTIMAL_NUMBER_OF_INFER_REQUESTS metric,
+// so the default size of the infer request pool is picked per device: the CPU
+// plugin gains from running a few requests side by side, the VPU does not.
+static size_t defaultNumInferRequests(TargetDevice target) {
+    if (target == TargetDevice::eCPU)
+        return std::max(1u, std::thread::hardware_concurrency() / 2);
+    return 1;
+}
+
+// Owns the executable network and a pool of infer requests created from it.
+// Concurrent executions each check out their own request with
+// acquireInferRequest() and hand it back with releaseInferRequest(); the
+// overloads without a request id use request 0 and are meant for callers
+// running one inference at a time.
 class ExecuteNetwork
 {
+public:
+    // Gets the status of an inference started with InferAsync(): OK, the error
+    // the plugin reported, or RESULT_NOT_READY when it timed out. What it
+    // captures is kept until the plugin completed the inference, past a timeout
+    // too, the buffers bound to the request must stay valid until then.
+    typedef std::function<void(StatusCode)> InferCallback;
+
+private:
+    // Completion state of one infer request, the user data of its IInferRequest
+    struct AsyncInfer {
+        ExecuteNetwork* owner = nullptr;
+        int id = 0;
+        InferCallback done;  // until the plugin completed the inference
+        bool running = false;
+        bool timedOut = false;   // the caller was told, done is only kept
+        bool reporting = false;  // the watchdog is calling done
+        bool releasePending = false;  // released by the caller while still running
+        std::chrono::steady_clock::time_point deadline;
+    };
+
     InferenceEnginePluginPtr enginePtr;
     ICNNNetwork *network;
     //IExecutableNetwork::Ptr pExeNet;
@@ -111,68 +153,358 @@ class ExecuteNetwork
     InputsDataMap inputInfo = {};
     OutputsDataMap outputInfo = {};
     IInferRequest::Ptr req;
-    InferRequest inferRequest;
+    std::vector<InferRequest> inferRequests;
+    std::vector<int> freeRequests;
+    std::mutex requestLock;
+    std::condition_variable requestReleased;
+    TargetDevice targetDevice = TargetDevice::eCPU;
     ResponseDesc resp;
+    // owns network when it was read from disk
+    std::shared_ptr<CNNNetReader> netReader;
+    // guarded by requestLock like the pool
+    std::vector<std::unique_ptr<AsyncInfer>> asyncInfers;
+    int callbacksRunning = 0;
+    int64_t inferTimeoutMs = 10000;
+    bool perfCount = false;
+    size_t maxBatch = 1;
+    std::thread watchdog;
+    std::condition_variable watchdogWake;
+    bool stopping = false;
+
+    void createInferRequests(size_t numRequests)
+    {
+        if (numRequests == 0) numRequests = defaultNumInferRequests(targetDevice);
+
+        std::lock_guard<std::mutex> lock(requestLock);
+        inferRequests.clear();
+        freeRequests.clear();
+        asyncInfers.clear();
+        for (size_t i = 0; i < numRequests; i++) {
+            inferRequests.push_back(executable_network.CreateInferRequest());
+            freeRequests.push_back(static_cast<int>(i));
+
+            std::unique_ptr<AsyncInfer> state(new AsyncInfer);
+            state->owner = this;
+            state->id = static_cast<int>(i);
+            IInferRequest::Ptr& request = inferRequests.back();
+            request->SetUserData(state.get(), &resp);
+            request->SetCompletionCallback(&ExecuteNetwork::onInferComplete);
+            asyncInfers.push_back(std::move(state));
+        }
+        ALOGI("%zu infer requests created", numRequests);
+    }
+
+    // Runs on a plugin thread
+    static void onInferComplete(IInferRequest::Ptr request, StatusCode status)
+    {
+        void* data = nullptr;
+        if (request->GetUserData(&data, nullptr) != StatusCode::OK || data == nullptr) return;
+        AsyncInfer* state = static_cast<AsyncInfer*>(data);
+        state->owner->inferCompleted(state, status);
+    }
+
+    void inferCompleted(AsyncInfer* state, StatusCode status)
+    {
+        InferCallback done;
+        bool timedOut;
+        {
+            std::unique_lock<std::mutex> lock(requestLock);
+            requestReleased.wait(lock, [state] { return !state->reporting; });
+            done = std::move(state->done);
+            state->done = nullptr;
+            timedOut = state->timedOut;
+            state->running = false;
+            if (state->releasePending) {
+                state->releasePending = false;
+                freeRequests.push_back(state->id);
+            }
+            if (done) callbacksRunning++;
+        }
+        requestReleased.notify_all();
+        if (!done) return;
+
+        // timed out, the caller knows and its buffers can go now
+        if (!timedOut) done(status);
+        done = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(requestLock);
+            callbacksRunning--;
+        }
+        requestReleased.notify_all();
+    }
+
+    // Tells the callers of the requests running past their deadline. The
+    // requests stay out of the pool, and their callbacks are kept, until the
+    // plugin completes them.
+    void watchdogLoop()
+    {
+        std::unique_lock<std::mutex> lock(requestLock);
+        while (!stopping) {
+            auto now = std::chrono::steady_clock::now();
+            auto next = now + std::chrono::hours(1);
+            for (auto& state : asyncInfers) {
+                if (!state->running || !state->done || state->timedOut) continue;
+                if (state->deadline > now) {
+                    next = std::min(next, state->deadline);
+                    continue;
+                }
+                ALOGE("infer request %d timed out after %lld ms", state->id,
+                      static_cast<long long>(inferTimeoutMs));
+                // inferCompleted() does not take done while it is called
+                state->timedOut = true;
+                state->reporting = true;
+                callbacksRunning++;
+                lock.unlock();
+                state->done(StatusCode::RESULT_NOT_READY);
+                lock.lock();
+                state->reporting = false;
+                callbacksRunning--;
+                requestReleased.notify_all();
+                next = now;  // rescan, the lock was dropped
+                break;
+            }
+            if (next > now) watchdogWake.wait_until(lock, next);
+        }
+    }
+
+    static InferenceEnginePluginPtr loadPlugin(TargetDevice target)
+    {
+        InferenceEngine::PluginDispatcher dispatcher({"/vendor/lib64","/vendor/lib","/system/lib64","/system/lib","","./"});
+        return dispatcher.getSuitablePlugin(target);
+    }
 
 public:
     ExecuteNetwork() : network(nullptr){}
-    ExecuteNetwork(IRDocument &doc, TargetDevice target = TargetDevice::eCPU) : network(nullptr)
+    ExecuteNetwork(IRDocument &doc, TargetDevice target = TargetDevice::eCPU)
+        : network(nullptr), targetDevice(target)
     {
-        InferenceEngine::PluginDispatcher dispatcher({"/vendor/lib64","/vendor/lib","/system/lib64","/system/lib","","./"});
-        enginePtr = dispatcher.getSuitablePlugin(target);
+        enginePtr = loadPlugin(target);
 
         network = doc.getNetwork();
         network->getInputsInfo(inputInfo);
         network->getOutputsInfo(outputInfo);
 
-        //size_t batch = 1;
-        //network->setBatchSize(batch);
-
         #ifdef NNLOG
         ALOGI("%s Plugin loaded",InferenceEngine::TargetDeviceInfo::name(target));
         #endif
     }
 
-    ExecuteNetwork(ExecutableNetwork& exeNet) : ExecuteNetwork(){
+    ExecuteNetwork(ExecutableNetwork& exeNet, size_t numRequests = 1) : ExecuteNetwork(){
     executable_network = exeNet;
-    inferRequest = executable_network.CreateInferRequest();
-    ALOGI("infer request created");
+    createInferRequests(numRequests);
+    }
 
+    // Without a network yet, for readNetwork() or importNetwork()
+    explicit ExecuteNetwork(TargetDevice target) : network(nullptr), targetDevice(target)
+    {
+        enginePtr = loadPlugin(target);
     }
 
-    //~ExecuteNetwork(){ }
-    void loadNetwork()
+    // Name and build of the plugin for the device, what a network it compiles depends on
+    static std::string pluginVersion(TargetDevice target)
     {
+        InferencePlugin plugin(loadPlugin(target));
+        const Version *version = plugin.GetVersion();
+        if (version == nullptr) return "unknown";
+        return std::string(version->description ? version->description : "") + " " +
+               (version->buildNumber ? version->buildNumber : "") + " api " +
+               std::to_string(version->apiVersion.major) + "." +
+               std::to_string(version->apiVersion.minor);
+    }
 
+    // Reads a network written by IRDocument::save(), loadNetwork() compiles it
+    bool readNetwork(const std::string& xmlPath, const std::string& binPath)
+    {
+        try {
+            netReader = std::make_shared<CNNNetReader>();
+            netReader->ReadNetwork(xmlPath);
+            netReader->ReadWeights(binPath);
+            network = &static_cast<ICNNNetwork&>(netReader->getNetwork());
+        } catch (const std::exception& e) {
+            ALOGW("can't read network %s: %s", xmlPath.c_str(), e.what());
+            netReader.reset();
+            network = nullptr;
+            return false;
+        }
+        network->getInputsInfo(inputInfo);
+        network->getOutputsInfo(outputInfo);
+        return true;
+    }
+
+    // Imports a network written by exportNetwork(), it is ready to infer
+    bool importNetwork(const std::string& path, size_t numRequests = 0)
+    {
         std::map<std::string, std::string> networkConfig;
         setConfig(networkConfig);
+        if (perfCount) networkConfig[PluginConfigParams::KEY_PERF_COUNT] = PluginConfigParams::YES;
+        if (maxBatch > 1)
+            networkConfig[PluginConfigParams::KEY_DYN_BATCH_ENABLED] = PluginConfigParams::YES;
+        try {
+            InferencePlugin plugin(enginePtr);
+            executable_network = plugin.ImportNetwork(path, networkConfig);
+        } catch (const std::exception& e) {
+            ALOGW("can't import network %s: %s", path.c_str(), e.what());
+            return false;
+        }
+        ALOGI("Network imported");
+        createInferRequests(numRequests);
+        return true;
+    }
+
+    // Not every plugin can export its executable networks, false then
+    bool exportNetwork(const std::string& path)
+    {
+        try {
+            executable_network.Export(path);
+        } catch (const std::exception& e) {
+            #ifdef NNLOG
+            ALOGI("network not exported: %s", e.what());
+            #endif
+            return false;
+        }
+        return true;
+    }
+
+    // Waits for the running inferences, they refer to the requests. A request
+    // the device still runs is never torn down, past the infer timeout too.
+    ~ExecuteNetwork()
+    {
+        std::unique_lock<std::mutex> lock(requestLock);
+        auto idle = [this] {
+            if (callbacksRunning > 0) return false;
+            for (auto& state : asyncInfers)
+                if (state->running) return false;
+            return true;
+        };
+        if (inferTimeoutMs > 0 &&
+            !requestReleased.wait_for(lock, std::chrono::milliseconds(inferTimeoutMs), idle))
+            ALOGE("waiting for infer requests the device did not complete");
+        requestReleased.wait(lock, idle);
+        stopping = true;
+        lock.unlock();
+        watchdogWake.notify_all();
+        if (watchdog.joinable()) watchdog.join();
+    }
+
+    // numRequests is the size of the infer request pool, 0 picks the device default
+    void loadNetwork(size_t numRequests = 0)
+    {
+
+        std::map<std::string, std::string> networkConfig;
+        setConfig(networkConfig);
+        if (perfCount) networkConfig[PluginConfigParams::KEY_PERF_COUNT] = PluginConfigParams::YES;
+        if (maxBatch > 1) {
+            // networks the plugin can't batch run one input at a time
+            if (network->setBatchSize(maxBatch, &resp) == StatusCode::OK) {
+                networkConfig[PluginConfigParams::KEY_DYN_BATCH_ENABLED] = PluginConfigParams::YES;
+            } else {
+                ALOGW("can't set the batch size to %zu: %s", maxBatch, resp.msg);
+                maxBatch = 1;
+            }
+        }
 
         InferencePlugin plugin(enginePtr);
         executable_network = plugin.LoadNetwork(*network, networkConfig);
         //std::cout << "Network loaded" << std::endl;
 	 ALOGI("Network loaded");
 
-        inferRequest = executable_network.CreateInferRequest();
+        createInferRequests(numRequests);
         //std::cout << "infer request created" << std::endl;
       }
 
-    void prepareInput()
+    size_t numInferRequests() const { return inferRequests.size(); }
+
+    // Blocks until an infer request is free and returns its id, -1 when none
+    // got free within the infer timeout
+    int acquireInferRequest()
+    {
+        std::unique_lock<std::mutex> lock(requestLock);
+        auto anyFree = [this] { return !freeRequests.empty(); };
+        if (inferTimeoutMs <= 0) {
+            requestReleased.wait(lock, anyFree);
+        } else if (!requestReleased.wait_for(lock, std::chrono::milliseconds(inferTimeoutMs),
+                                             anyFree)) {
+            ALOGE("no infer request free after %lld ms", static_cast<long long>(inferTimeoutMs));
+            return -1;
+        }
+        int id = freeRequests.back();
+        freeRequests.pop_back();
+        return id;
+    }
+
+    // A request that timed out goes back to the pool once the plugin completes it
+    void releaseInferRequest(int id)
+    {
+        {
+            std::lock_guard<std::mutex> lock(requestLock);
+            if (id < static_cast<int>(asyncInfers.size()) && asyncInfers[id]->running)
+                asyncInfers[id]->releasePending = true;
+            else
+                freeRequests.push_back(id);
+        }
+        requestReleased.notify_all();
+    }
+
+    // Also bounds the wait for a free request. 0 waits forever
+    void setInferTimeout(int64_t timeoutMs) { inferTimeoutMs = timeoutMs; }
+
+    // Has the plugin time the layers, set before loadNetwork() or importNetwork()
+    void enablePerfCount(bool enable) { perfCount = enable; }
+
+    // Sizes the network for batches of up to batch inputs, set before
+    // loadNetwork() or importNetwork(). The blobs of the requests then hold
+    // batch inputs and setBatch() tells how many of them the next inference
+    // runs, the plugin skips the others.
+    void enableDynamicBatch(size_t batch) { maxBatch = batch > 0 ? batch : 1; }
+
+    // 1 after loadNetwork() when the network can't be batched
+    size_t getMaxBatch() const { return maxBatch; }
+
+    bool setBatch(int id, size_t batch)
+    {
+        try {
+            inferRequests[id].SetBatch(static_cast<int>(batch));
+        } catch (const std::exception& e) {
+            ALOGE("infer request %d can't run a batch of %zu: %s", id, batch, e.what());
+            return false;
+        }
+        return true;
+    }
+
+    // Of the last inference of the request, layer name -> status, time and
+    // execution type; empty unless enablePerfCount()
+    std::map<std::string, InferenceEngineProfileInfo> getPerformanceCounts(int id)
+    {
+        std::map<std::string, InferenceEngineProfileInfo> counts;
+        if (!perfCount) return counts;
+        try {
+            counts = inferRequests[id].GetPerformanceCounts();
+        } catch (const std::exception& e) {
+            ALOGW("no performance counts for infer request %d: %s", id, e.what());
+        }
+        return counts;
+    }
+
+    // With nhwcInput the 4-D inputs are declared NHWC, so the callers can hand
+    // their NHWC buffers to the plugin as is instead of permuting them to NCHW.
+    void prepareInput(bool nhwcInput = false)
     {
 	  #ifdef NNLOG
-      ALOGI("Prepare input blob");
+      ALOGI("Prepare input blob, %s layout", nhwcInput ? "NHWC" : "NCHW");
 	  #endif
       Precision inputPrecision = Precision::FP32;
-      inputInfo.begin()->second->setPrecision(inputPrecision);
-      //inputInfo.begin()->second->setPrecision(Precision::U8);
-
-      auto inputDims = inputInfo.begin()->second->getTensorDesc().getDims();
-      if (inputDims.size() == 4)
-      inputInfo.begin()->second->setLayout(Layout::NCHW);
-      else if (inputDims.size() == 2)
-      inputInfo.begin()->second->setLayout(Layout::NC);
-      else
-      inputInfo.begin()->second->setLayout(Layout::C);
-
+      for (auto& input : inputInfo) {
+          input.second->setPrecision(inputPrecision);
+          //input.second->setPrecision(Precision::U8);
+
+          auto inputDims = input.second->getTensorDesc().getDims();
+          if (inputDims.size() == 4)
+          input.second->setLayout(nhwcInput ? Layout::NHWC : Layout::NCHW);
+          else if (inputDims.size() == 2)
+          input.second->setLayout(Layout::NC);
+          else
+          input.second->setLayout(Layout::C);
+      }
 
       //inputInfo.begin()->second->setPrecision(Precision::U8);
       //inputInfo.begin()->second->setLayout(Layout::NCHW);
@@ -204,6 +536,11 @@ public:
 
     //setBlob input/output blob for infer request
     void setBlob(const std::string& inName, const Blob::Ptr& inputBlob)
+    {
+        setBlob(0, inName, inputBlob);
+    }
+
+    void setBlob(int id, const std::string& inName, const Blob::Ptr& inputBlob)
     {
         #ifdef NNLOG
         ALOGI("setBlob input or output blob name : %s", inName.c_str());
@@ -211,7 +548,7 @@ public:
         #endif
 
         //inferRequest.SetBlob(inName.c_str(), inputBlob);
-        inferRequest.SetBlob(inName, inputBlob);
+        inferRequests[id].SetBlob(inName, inputBlob);
 
         //std::cout << "setBlob input or output name : " << inName << std::endl;
 
@@ -219,8 +556,12 @@ public:
 
      //for non aync infer request
     TBlob<float>::Ptr getBlob(const std::string& outName) {
+       return getBlob(0, outName);
+    }
+
+    TBlob<float>::Ptr getBlob(int id, const std::string& outName) {
        Blob::Ptr outputBlob;
-       outputBlob = inferRequest.GetBlob(outName);
+       outputBlob = inferRequests[id].GetBlob(outName);
        //std::cout << "GetBlob input or output name : " << outName << std::endl;
        #ifdef NNLOG
        ALOGI("Get input/output blob, name : ", outName.c_str());
@@ -229,41 +570,62 @@ public:
        //return outputBlob;
     }
 
-    void Infer() {
-        #ifdef NNLOG
-        ALOGI("Infer Network\n");
-        #endif
-//        inferRequest = executable_network.CreateInferRequest();
-/*
-        auto inName = inputInfo.begin()->first;
-        ALOGI("set input blob\n");
-        inferRequest.SetBlob(inName, in);
-
-        ALOGI("aks prepare output blob\n");
-        const std::string firstOutName = outputInfo.begin()->first;
-        InferenceEngine::TBlob<PrecisionTrait<Precision::FP32>::value_type>::Ptr outputBlob;
-        outputBlob = InferenceEngine::make_shared_blob<PrecisionTrait<Precision::FP32>::value_type,
-                InferenceEngine::SizeVector>(Precision::FP32, outputInfo.begin()->second->getDims());
-        outputBlob->allocate();
+    StatusCode Infer() {
+        return Infer(0);
+    }
 
-        ALOGI("set output blob\n");
-        inferRequest.SetBlob(firstOutName, outputBlob);
+    // Blocks until the inference completed or timed out
+    StatusCode Infer(int id) {
+        // shared, set_value() may still be running on the plugin thread when get() returns
+        auto result = std::make_shared<std::promise<StatusCode>>();
+        std::future<StatusCode> status = result->get_future();
+        InferAsync(id, [result](StatusCode code) { result->set_value(code); });
+        return status.get();
+    }
 
-*/
+    // Starts the inference and returns, done gets its status exactly once on a
+    // plugin thread, or on the calling thread when it could not be started.
+    // done is destroyed once the plugin completed the inference, on the
+    // completing thread.
+    void InferAsync(int id, InferCallback done) {
         #ifdef NNLOG
-        ALOGI("StartAsync scheduled");
+        ALOGI("Infer Network\n");
         #endif
-        inferRequest.StartAsync();  //for async infer
-        //ALOGI("async wait");
-        //inferRequest.Wait(1000);
-        inferRequest.Wait(10000); //check right value to infer
-        //inferRequest.Wait(IInferRequest::WaitMode::RESULT_READY);
-
-        //std::cout << "output name : " << firstOutName << std::endl;
+        AsyncInfer* state = asyncInfers[id].get();
+        bool busy;
+        {
+            std::lock_guard<std::mutex> lock(requestLock);
+            busy = state->running;
+            if (!busy) {
+                state->running = true;
+                state->timedOut = false;
+                state->done = std::move(done);
+                state->deadline = inferTimeoutMs > 0
+                    ? std::chrono::steady_clock::now() + std::chrono::milliseconds(inferTimeoutMs)
+                    : std::chrono::steady_clock::time_point::max();
+                if (inferTimeoutMs > 0 && !watchdog.joinable())
+                    watchdog = std::thread(&ExecuteNetwork::watchdogLoop, this);
+            }
+        }
+        if (busy) {
+            // still running an inference that timed out
+            ALOGE("infer request %d is busy", id);
+            done(StatusCode::REQUEST_BUSY);
+            return;
+        }
+        watchdogWake.notify_all();
+
+        try {
+            inferRequests[id].StartAsync();
+        } catch (const std::exception& e) {
+            ALOGE("infer request %d failed to start: %s", id, e.what());
+            // as if the plugin completed it, the watchdog may have told the caller
+            inferCompleted(state, StatusCode::GENERAL_ERROR);
+            return;
+        }
         #ifdef NNLOG
-        ALOGI("infer request completed");
+        ALOGI("StartAsync scheduled");
         #endif
-
-        return;
     }
+
 };
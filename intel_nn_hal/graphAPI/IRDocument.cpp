@@ -33,10 +33,14 @@
 //#define LOG_TAG "graphAPI"
 
 #include "IRDocument.h"
+#include <algorithm>
 #include <fstream>
+#include <limits>
 #include <locale>
+#include <set>
 #include "IRLayers.h"
 #include "cnn_network_impl.hpp"
+#include "fp16.h"
 
 #ifdef NNLOG
 #include <android/log.h>
@@ -50,8 +54,8 @@ using namespace InferenceEngine;
 class InternalNetworkImpl : public InferenceEngine::details::CNNNetworkImpl {
    public:
     InternalNetworkImpl() {}
-    InternalNetworkImpl(const std::string netName) : InternalNetworkImpl() {
-        setPrecision(IRBuilder::g_layer_precision);
+    InternalNetworkImpl(const std::string netName, Precision precision) : InternalNetworkImpl() {
+        setPrecision(precision);
         setName(netName);
     }
 
@@ -61,6 +65,8 @@ class InternalNetworkImpl : public InferenceEngine::details::CNNNetworkImpl {
 
     void addData(const DataPtr &data) { _data[data->name] = data; }
 
+    void removeData(const string &data_name) { _data.erase(data_name); }
+
     void addOutput(const DataPtr &data) {
         addData(data);
 
@@ -77,7 +83,15 @@ class InternalNetworkImpl : public InferenceEngine::details::CNNNetworkImpl {
     }
 };
 
-IRDocument::IRDocument(const std::string &cs) : _name(cs) { network = new InternalNetworkImpl(cs); }
+IRDocument::IRDocument(const std::string &cs, Precision precision)
+    : _context(precision), _name(cs) {
+    network = new InternalNetworkImpl(cs, precision);
+}
+
+void IRDocument::setPrecision(Precision precision) {
+    _context.setPrecision(precision);
+    network->setPrecision(precision);
+}
 
 IRDocument::~IRDocument() {
     delete network;
@@ -106,40 +120,305 @@ void IRDocument::process(const IRLayer &layer) {
     }
 }
 
-void IRDocument::optimize() {
-    for (auto it = _layers.begin(); it != _layers.end();) {
-        auto l = *it;
-        if (shouldRemove(l)) {
-            // l-in -> (l,l-out) -> (b-in list) ===> a-out -> (b-in list)
-            auto lin = l->input();
-            auto lout = output(l);
-
-            lin->inputTo.erase(l->name);
-
-            auto lout_targets = lout->inputTo;
-            for (auto i : lout_targets) {
-                lin->inputTo[i.first] = i.second;
-                // reaplce target input data from lout to lin
-                for (auto &tar_inp : i.second->insData) {
-                    if (tar_inp.lock() == lout) {
-                        tar_inp = lin;
-                        break;
-                    }
+bool IRDocument::isOutput(const DataPtr &data) const {
+    OutputsDataMap outputs;
+    network->getOutputsInfo(outputs);
+    return outputs.find(data->name) != outputs.end();
+}
+
+// The edges to l must already be gone, its output data go with it.
+void IRDocument::removeLayer(const IRLayer &l) {
+    _layers.erase(std::remove(_layers.begin(), _layers.end(), l), _layers.end());
+    for (auto &out : l->outData) network->removeData(out->name);
+    network->remove(l->name);
+}
+
+// by takes the place of l in the document, it already has the edges of l.
+void IRDocument::replaceLayer(const IRLayer &l, const IRLayer &by) {
+    std::replace(_layers.begin(), _layers.end(), l, by);
+    network->remove(l->name);
+    network->addLayer(by);
+}
+
+// l-in -> (l,l-out) -> (b-in list) ===> l-in -> (b-in list)
+// Not done when l-out is a network output, the output keeps its name.
+bool IRDocument::bypass(const IRLayer &l) {
+    if (l->insData.size() != 1 || l->outData.size() != 1) return false;
+    auto lin = l->input();
+    auto lout = output(l);
+    if (isOutput(lout)) return false;
+
+    lin->inputTo.erase(l->name);
+    for (auto i : lout->inputTo) {
+        lin->inputTo[i.first] = i.second;
+        // reaplce target input data from lout to lin
+        for (auto &tar_inp : i.second->insData) {
+            if (tar_inp.lock() == lout) tar_inp = lin;
+        }
+    }
+    removeLayer(l);
+    return true;
+}
+
+// into -> (into-out) -> l -> (l-out) ===> into -> (l-out)
+// For an l into now computes itself; l must be the only consumer of into-out.
+void IRDocument::absorb(const IRLayer &into, const IRLayer &l) {
+    auto mid = output(into);
+    for (auto &in : l->insData) {
+        auto data = in.lock();
+        if (data != mid) data->inputTo.erase(l->name);
+    }
+    auto lout = output(l);
+    lout->creatorLayer = into;
+    into->outData[0] = lout;
+    l->outData.clear();
+    network->removeData(mid->name);
+    removeLayer(l);
+}
+
+static bool isConstLayer(const IRLayer &l) {
+    return l && l->type == "Const" && l->blobs.find("custom") != l->blobs.end();
+}
+
+static bool isSum(const IRLayer &l) {
+    auto sum = std::dynamic_pointer_cast<EltwiseLayer>(l);
+    return sum && l->type == "Eltwise" && sum->_operation == EltwiseLayer::Sum &&
+           l->insData.size() == 2;
+}
+
+static IRLayer creatorOf(const InferenceEngine::DataWeakPtr &data) {
+    return data.lock()->creatorLayer.lock();
+}
+
+// a + b in a new blob, null when they don't match
+static Blob::Ptr addBlobs(const Blob::Ptr &a, const Blob::Ptr &b) {
+    if (a->size() != b->size() || a->precision() != b->precision()) return nullptr;
+    const size_t n = a->size();
+    if (a->precision() == Precision::FP32) {
+        auto sum = std::make_shared<TBlob<float>>(a->getTensorDesc());
+        sum->allocate();
+        const float *pa = a->cbuffer().as<const float *>();
+        const float *pb = b->cbuffer().as<const float *>();
+        float *ps = sum->buffer().as<float *>();
+        for (size_t i = 0; i < n; i++) ps[i] = pa[i] + pb[i];
+        return sum;
+    }
+    if (a->precision() == Precision::FP16) {
+        auto sum = std::make_shared<TBlob<short>>(a->getTensorDesc());
+        sum->allocate();
+        std::vector<float> fa(n), fb(n);
+        fp16::f16tof32Arrays(fa.data(), a->cbuffer().as<const short *>(), n);
+        fp16::f16tof32Arrays(fb.data(), b->cbuffer().as<const short *>(), n);
+        for (size_t i = 0; i < n; i++) fa[i] += fb[i];
+        fp16::f32tof16Arrays(sum->buffer().as<short *>(), fa.data(), n);
+        return sum;
+    }
+    return nullptr;
+}
+
+// [lo, hi] a ReLU or a Clamp clamps its input to, false for other layers
+static bool clampRange(const IRLayer &l, float *lo, float *hi) {
+    if (!l) return false;
+    if (l->type == "ReLU") {
+        auto relu = std::dynamic_pointer_cast<ReLULayer>(l);
+        if (!relu || relu->negative_slope != 0.f) return false;
+        *lo = 0.f;
+        *hi = std::numeric_limits<float>::infinity();
+        return true;
+    }
+    if (l->type == "Clamp") {
+        auto clamp = std::dynamic_pointer_cast<ClampLayer>(l);
+        if (!clamp) return false;
+        *lo = clamp->min_value;
+        *hi = clamp->max_value;
+        return true;
+    }
+    return false;
+}
+
+void IRDocument::removeIdentityReshapes() {
+    auto layers = _layers;
+    for (auto &l : layers) {
+        if (shouldRemove(l)) bypass(l);
+    }
+}
+
+// Only the dims of the last Reshape of a chain matter.
+void IRDocument::collapseReshapes() {
+    auto layers = _layers;
+    for (auto &l : layers) {
+        if (l->type != "Reshape") continue;
+        auto lin = l->input();
+        auto prev = lin->creatorLayer.lock();
+        if (!prev || prev->type != "Reshape" || lin->inputTo.size() != 1) continue;
+        bypass(prev);
+    }
+}
+
+// The ADD of two constant operands: the sum is computed now and the Eltwise
+// becomes a Const, later folds may chain on it.
+void IRDocument::foldConstAdds() {
+    auto layers = _layers;
+    for (auto &l : layers) {
+        if (!isSum(l)) continue;
+        auto c0 = creatorOf(l->insData[0]);
+        auto c1 = creatorOf(l->insData[1]);
+        if (!isConstLayer(c0) || !isConstLayer(c1)) continue;
+        auto values = addBlobs(c0->blobs["custom"], c1->blobs["custom"]);
+        if (!values) continue;
+
+        auto folded = Generic(_context, "Const");
+        folded->blobs["custom"] = values;
+        auto lout = output(l);
+        lout->creatorLayer = folded;
+        folded->outData.push_back(lout);
+        l->outData.clear();
+        // a constant added to itself is the same input twice, remove it once
+        DataPtr prevData;
+        for (auto &in : l->insData) {
+            auto data = in.lock();
+            if (data == prevData) continue;
+            prevData = data;
+            data->inputTo.erase(l->name);
+            if (data->inputTo.empty() && !isOutput(data)) removeLayer(data->creatorLayer.lock());
+        }
+        replaceLayer(l, folded);
+    }
+}
+
+// A per channel constant added to the output of a Convolution or a
+// FullyConnected, by a ScaleShift without weights or a Const and a sum (see
+// AddTryConst and AddConst), goes into the biases of the layer.
+void IRDocument::foldBiases() {
+    auto layers = _layers;
+    for (auto &l : layers) {
+        DataPtr lin;
+        Blob::Ptr bias;
+        IRLayer constLayer;
+        auto shift = std::dynamic_pointer_cast<ScaleShiftLayer>(l);
+        if (shift && l->type == "ScaleShift" && !shift->_weights && shift->_biases) {
+            lin = l->input();
+            bias = shift->_biases;
+        } else if (isSum(l)) {
+            for (int i = 0; i < 2; i++) {
+                auto c = creatorOf(l->insData[i]);
+                if (isConstLayer(c)) {
+                    constLayer = c;
+                    bias = c->blobs["custom"];
+                    lin = l->insData[1 - i].lock();
+                    break;
                 }
             }
+        }
+        if (!bias) continue;
+
+        auto prev = lin->creatorLayer.lock();
+        auto weightable = std::dynamic_pointer_cast<WeightableLayer>(prev);
+        if (!weightable || (prev->type != "Convolution" && prev->type != "FullyConnected"))
+            continue;
+        if (prev->outData.size() != 1 || lin->inputTo.size() != 1 || isOutput(lin)) continue;
+        auto dims = lin->getTensorDesc().getDims();
+        if (dims.size() < 2 || bias->size() != dims[1]) continue;
+
+        // the blobs may be shared or read only, the sum goes in a new one
+        if (weightable->_biases) bias = addBlobs(weightable->_biases, bias);
+        else if (bias->precision() != weightable->_weights->precision()) bias = nullptr;
+        if (!bias) continue;
+
+        weightable->_biases = bias;
+        prev->blobs["biases"] = bias;
+        absorb(prev, l);
+        if (constLayer) {
+            auto data = output(constLayer);
+            if (data->inputTo.empty() && !isOutput(data)) removeLayer(constLayer);
+        }
+    }
+}
 
-            it = _layers.erase(it);
-            network->remove(l->name);
+// Clamping to [lo1, hi1] then to [lo2, hi2] is clamping to the intersection, so
+// of two consecutive activations one is left. A fused activation of the HAL
+// operation often follows an explicit one.
+void IRDocument::foldActivations() {
+    auto layers = _layers;
+    for (auto &l : layers) {
+        float lo, hi, prevLo, prevHi;
+        if (!clampRange(l, &lo, &hi)) continue;
+        auto lin = l->input();
+        auto prev = lin->creatorLayer.lock();
+        if (!clampRange(prev, &prevLo, &prevHi)) continue;
+        if (lin->inputTo.size() != 1 || isOutput(lin)) continue;
+
+        const float newLo = std::max(lo, prevLo);
+        const float newHi = std::min(hi, prevHi);
+        if (newLo > newHi) continue;  // a constant output, left alone
+
+        IRLayer keep;
+        if (newLo == lo && newHi == hi) {
+            keep = l;
+        } else if (newLo == prevLo && newHi == prevHi) {
+            keep = prev;
+        } else {
+            // not the range of a ReLU, one of the two is a Clamp
+            keep = l->type == "Clamp" ? l : prev;
+            auto clamp = std::dynamic_pointer_cast<ClampLayer>(keep);
+            clamp->min_value = newLo;
+            clamp->max_value = newHi;
+            clamp->params["min"] = std::to_string(newLo);
+            clamp->params["max"] = std::to_string(newHi);
         }
-        else {
-            ++it;
+        if (keep == l)
+            bypass(prev);
+        else
+            absorb(prev, l);
+    }
+}
+
+// Layers none of the network outputs is computed from.
+void IRDocument::removeDeadLayers() {
+    OutputsDataMap outputs;
+    network->getOutputsInfo(outputs);
+    if (outputs.empty()) return;
+
+    std::set<std::string> live;
+    std::vector<IRLayer> stack;
+    for (auto &o : outputs) {
+        auto l = o.second->creatorLayer.lock();
+        if (l) stack.push_back(l);
+    }
+    while (!stack.empty()) {
+        auto l = stack.back();
+        stack.pop_back();
+        if (!live.insert(l->name).second) continue;
+        for (auto &in : l->insData) {
+            auto prev = creatorOf(in);
+            if (prev) stack.push_back(prev);
         }
     }
+
+    auto layers = _layers;
+    for (auto &l : layers) {
+        if (live.count(l->name)) continue;
+        for (auto &in : l->insData) in.lock()->inputTo.erase(l->name);
+        removeLayer(l);
+    }
+}
+
+void IRDocument::optimize() {
+    const size_t count = _layers.size();
+    if (_passes & kFoldConstAdd) foldConstAdds();
+    if (_passes & kCollapseReshapes) collapseReshapes();
+    if (_passes & kRemoveIdentityReshape) removeIdentityReshapes();
+    if (_passes & kFoldBias) foldBiases();
+    if (_passes & kFoldActivation) foldActivations();
+    if (_passes & kRemoveDeadLayers) removeDeadLayers();
+#ifdef NNLOG
+    ALOGI("optimize passes 0x%x: %zu layers, %zu left", _passes, count, _layers.size());
+#endif
 }
 
 void IRDocument::build() {
     if (_processed) return;
-    network->setPrecision(IRBuilder::g_layer_precision);
+    network->setPrecision(_context.precision());
     InputsDataMap inputs;
     network->getInputsInfo(inputs);
     for (auto i : inputs) {
@@ -196,10 +475,13 @@ void IRDocument::save(std::ostream &xml_os, std::ostream &bin_os) {
     pugi::xml_document doc;
 
     build();
+    // offsets of the blobs in bin_os, a previous save wrote them to another file
+    _segmentsMap.clear();
     pugi::xml_node root = doc.append_child("net");
     root.append_attribute("name").set_value(_name.c_str());
     root.append_attribute("version").set_value(2);
-    root.append_attribute("batch").set_value(1);
+    // the batch ExecuteNetwork sized the network for, the dims below include it
+    root.append_attribute("batch").set_value(static_cast<unsigned>(network->getBatchSize()));
     pugi::xml_node layers = root.append_child("layers");
     int id_cnt = 0;
     InputsDataMap netInputs;
@@ -280,7 +562,7 @@ InferenceEngine::InputInfo::Ptr IRDocument::createInput(const std::string &name,
         layout = InferenceEngine::Layout::C;
 
     std::cout << "createInput input data dims[0] " << dims[0] << "dims[1]" << dims[1] << std::endl;
-    TensorDesc td(IRBuilder::g_layer_precision, dims, layout);
+    TensorDesc td(_context.precision(), dims, layout);
 
     auto inputData = std::make_shared<InferenceEngine::Data>(name, td);
     InferenceEngine::InputInfo::Ptr info(new InferenceEngine::InputInfo());
@@ -365,7 +647,7 @@ void IRDocument::saveToIR(std::ostream &binFile, pugi::xml_node &parent, const I
     layer.append_attribute("type").set_value(irLayer->type.c_str());
     layer.append_attribute("id").set_value(irLayer->userValue.v_int);
     layer.append_attribute("precision")
-        .set_value(IRBuilder::g_layer_precision == Precision::FP16 ? "FP16" : "FP32");
+        .set_value(_context.precision() == Precision::FP16 ? "FP16" : "FP32");
 
     if (!irLayer->params.empty()) {
         auto attr = layer.append_child("data");  // todo: need to check for type and overide it
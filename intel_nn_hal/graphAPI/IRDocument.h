@@ -53,11 +53,13 @@ private:
     };
 
     InternalNetworkImpl *network;
+    BuilderContext _context;
     std::vector<IRLayer> _layers; // ordered by input propagation
     std::vector<Edge> _edges;
     std::string _name;
     size_t _layer_id_cnt = 1;
     bool _processed = false;
+    unsigned _passes = kAllPasses;
 
     std::map<const float *, size_t> _segmentsMap={}; //org
 
@@ -68,6 +70,21 @@ private:
     void optimize();
     void build();
 
+    // graph passes, see Pass
+    void removeIdentityReshapes();
+    void collapseReshapes();
+    void foldConstAdds();
+    void foldBiases();
+    void foldActivations();
+    void removeDeadLayers();
+
+    // helpers of the passes
+    bool isOutput(const InferenceEngine::DataPtr &data) const;
+    void removeLayer(const IRLayer &l);
+    void replaceLayer(const IRLayer &l, const IRLayer &by);
+    bool bypass(const IRLayer &l);
+    void absorb(const IRLayer &into, const IRLayer &l);
+
     // saving functions
     static void saveOutputToIR(pugi::xml_node &parent, const InferenceEngine::DataPtr &port);
     static void saveInputToIR(pugi::xml_node &parent, int index, const InferenceEngine::DataPtr &port);
@@ -82,10 +99,35 @@ private:
     IRDocument operator=(IRDocument &) = delete;
 
 public:
+    // Passes build() runs over the graph once the layers are collected. Each
+    // one removes layers without changing what the network computes; they are
+    // run in this order.
+    enum Pass : unsigned
+    {
+        kFoldConstAdd = 1 << 0,          // Const + Const ===> Const
+        kCollapseReshapes = 1 << 1,      // Reshape -> Reshape ===> Reshape
+        kRemoveIdentityReshape = 1 << 2, // Reshape to the dims of its input
+        kFoldBias = 1 << 3,              // Conv/FC -> add per channel const ===> Conv/FC with biases
+        kFoldActivation = 1 << 4,        // ReLU/Clamp -> ReLU/Clamp ===> ReLU or Clamp
+        kRemoveDeadLayers = 1 << 5,      // layers no output depends on
+        kAllPasses = (1 << 6) - 1
+    };
 
-    explicit IRDocument(const std::string &cs);
+    explicit IRDocument(const std::string &cs,
+                        InferenceEngine::Precision precision = InferenceEngine::Precision::UNSPECIFIED);
     ~IRDocument();
 
+    // passed to the layer factories building this document
+    BuilderContext &context() { return _context; }
+    InferenceEngine::Precision precision() const { return _context.precision(); }
+    void setPrecision(InferenceEngine::Precision precision);
+
+    // a mask of Pass, all of them by default; set before the network is built
+    unsigned passes() const { return _passes; }
+    void setPasses(unsigned passes) { _passes = passes; }
+    // layers of the document, after the passes once it is built
+    size_t layerCount() const { return _layers.size(); }
+
     void add(const IRLayer &ir_layer);
 
     // Products
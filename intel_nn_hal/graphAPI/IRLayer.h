@@ -31,6 +31,7 @@
  */
 
 #pragma once
+#include <map>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -101,6 +102,38 @@ struct DelayObj
 
 typedef InferenceEngine::SizeVector TensorDims;
 
+// State the layer factories share while one document is built: the precision
+// of the layers and the counter that keeps their names unique. Every
+// IRDocument owns one, so documents can be built on several threads at once.
+class BuilderContext
+{
+public:
+    explicit BuilderContext(InferenceEngine::Precision precision = InferenceEngine::Precision::UNSPECIFIED)
+        : _precision(precision) {}
+
+    InferenceEngine::Precision precision() const { return _precision; }
+    void setPrecision(InferenceEngine::Precision precision) { _precision = precision; }
+
+    // prefix followed by a number
+    std::string uniqueName(const std::string &prefix)
+    {
+        std::string name = prefix << _layer_name_count++;
+        if (_operation >= 0) _operations[name] = _operation;
+        return name;
+    }
+
+    // The layers named from now on are built for the operation index of the
+    // model, -1 for none. operations() maps the layer names back to them.
+    void setOperation(int index) { _operation = index; }
+    const std::map<std::string, int> &operations() const { return _operations; }
+
+private:
+    InferenceEngine::Precision _precision;
+    int _layer_name_count = 0;
+    int _operation = -1;
+    std::map<std::string, int> _operations;
+};
+
 inline size_t sizeOf(const TensorDims &dims)
 {
     size_t ret = dims[0];
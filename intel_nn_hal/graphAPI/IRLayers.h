@@ -48,9 +48,6 @@
 namespace IRBuilder
 {
 
-extern int layer_name_count;
-extern InferenceEngine::Precision g_layer_precision;
-
 inline OutputPort addOutput(const IRLayer &layer, const InferenceEngine::SizeVector &dims)
 {
     std::string d_name = layer->name;
@@ -64,23 +61,23 @@ inline OutputPort addOutput(const IRLayer &layer, const InferenceEngine::SizeVec
     if(dims.size() == 2)
     {
         std::cout << "addOutput dims size 2"<< std::endl;
-        InferenceEngine::TensorDesc td(g_layer_precision, dims, InferenceEngine::Layout::NC);
+        InferenceEngine::TensorDesc td(layer->precision, dims, InferenceEngine::Layout::NC);
         data = std::make_shared<InferenceEngine::Data>(d_name, td);
 
     }
     else if(dims.size() == 4)
     {
         std::cout << "addOutput dims size "<< dims.size()<<std::endl;
-        //InferenceEngine::TensorDesc td(g_layer_precision, dims, InferenceEngine::Layout::ANY);
-        InferenceEngine::TensorDesc td(g_layer_precision, dims, InferenceEngine::Layout::NCHW);
-        //InferenceEngine::TensorDesc td(g_layer_precision, dims, InferenceEngine::Layout::NHWC);
+        //InferenceEngine::TensorDesc td(layer->precision, dims, InferenceEngine::Layout::ANY);
+        InferenceEngine::TensorDesc td(layer->precision, dims, InferenceEngine::Layout::NCHW);
+        //InferenceEngine::TensorDesc td(layer->precision, dims, InferenceEngine::Layout::NHWC);
         data = std::make_shared<InferenceEngine::Data>(d_name, td);
 
     }
     else {
         std::cout << "addOutput dims size "<< dims.size()<<std::endl;
-        //InferenceEngine::TensorDesc td(g_layer_precision, dims, InferenceEngine::Layout::ANY);
-        InferenceEngine::TensorDesc td(g_layer_precision, dims, InferenceEngine::Layout::C);
+        //InferenceEngine::TensorDesc td(layer->precision, dims, InferenceEngine::Layout::ANY);
+        InferenceEngine::TensorDesc td(layer->precision, dims, InferenceEngine::Layout::C);
         data = std::make_shared<InferenceEngine::Data>(d_name, td);
     }
 
@@ -114,22 +111,20 @@ std::shared_ptr<T> As(const std::shared_ptr<S> &src)
 * @brief Creates a generic layer with one input and one output
 */
 
-inline IRLayer Generic(const std::string &type) {
-    std::string name = type + "-";  // todo: make it unique
-    name = name << layer_name_count++;
+inline IRLayer Generic(BuilderContext &ctx, const std::string &type) {
+    std::string name = ctx.uniqueName(type + "-");
     InferenceEngine::LayerParams prms;
-    prms.precision = g_layer_precision;
+    prms.precision = ctx.precision();
     prms.name = name;
     prms.type = type;
     return std::make_shared<InferenceEngine::CNNLayer>(prms);
 }
 
-inline IRLayer Generic(const std::string &type, const OutputPort &src)
+inline IRLayer Generic(BuilderContext &ctx, const std::string &type, const OutputPort &src)
 {
-    std::string name = type + "-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName(type + "-");
     InferenceEngine::LayerParams prms;
-    prms.precision = g_layer_precision;
+    prms.precision = ctx.precision();
     prms.name = name;
     auto layer = std::make_shared<InferenceEngine::CNNLayer>(prms);
     layer->type = type;
@@ -149,9 +144,9 @@ inline IRLayer LayerOf(const OutputPort &src)
   return src->creatorLayer.lock();
 }
 
-inline IRLayer Generic(const std::string &type, const IRLayer &src)
+inline IRLayer Generic(BuilderContext &ctx, const std::string &type, const IRLayer &src)
 {
-    return Generic(type, output(src));
+    return Generic(ctx, type, output(src));
 }
 
 template<typename T, typename A>
@@ -167,15 +162,14 @@ std::string dumpVec(std::vector<T, A> const &vec)
 
 namespace FCLayer
 {
-static IRLayer create(const IRBlob::Ptr &weights, const OutputPort &src)
+static IRLayer create(BuilderContext &ctx, const IRBlob::Ptr &weights, const OutputPort &src)
 {
     #ifdef NNLOG
     ALOGI("Create FC layer");
     #endif
-    std::string name = "FC-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("FC-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
 
     //auto inDims = src->getDims(); // (batch, IFM)
@@ -223,24 +217,21 @@ static IRLayer create(const IRBlob::Ptr &weights, const OutputPort &src)
 };
 
 
-inline InferenceEngine::CNNLayer::Ptr operator*(const IRBlob::Ptr &weights, const IRLayer &b)
+inline OutputPort FullyConnected(BuilderContext &ctx, const IRBlob::Ptr &weights, const IRLayer &b)
 {
-    std::cout << "FCLayer::create operator*(const IRBlob::Ptr &weights, const IRLayer &b)"<< std::endl;
-    return FCLayer::create(weights, output(b));
+    return output(FCLayer::create(ctx, weights, output(b)));
 }
 
-inline OutputPort operator*(const IRBlob::Ptr &weights, const OutputPort &op)
+inline OutputPort FullyConnected(BuilderContext &ctx, const IRBlob::Ptr &weights, const OutputPort &op)
 {
-    std::cout << "FCLayer::create operator*(const IRBlob::Ptr &weights, const OutputPort &op)"<< std::endl;
-    return output(FCLayer::create(weights, op));
+    return output(FCLayer::create(ctx, weights, op));
 }
 
-static OutputPort ScaleShiftNode(const OutputPort &src, const IRBlob::Ptr &scale, const IRBlob::Ptr &bias) {
+static OutputPort ScaleShiftNode(BuilderContext &ctx, const OutputPort &src, const IRBlob::Ptr &scale, const IRBlob::Ptr &bias) {
     std::cout << "ScaleShiftNode"<< std::endl;
-    std::string name = "ConstMul-";  // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("ConstMul-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     prm.type = "ScaleShift";
     auto l = std::make_shared<InferenceEngine::ScaleShiftLayer>(prm);
@@ -271,7 +262,7 @@ inline IRLayer AddConst(const IRLayer &lhs, const IRBlob::Ptr &biases)
 }
 */
 
-inline OutputPort AddTryConst(const OutputPort &src, const IRBlob::Ptr &biases) {
+inline OutputPort AddTryConst(BuilderContext &ctx, const OutputPort &src, const IRBlob::Ptr &biases) {
     auto fc = As<InferenceEngine::WeightableLayer>(LayerOf(src));
     if (fc) {
         // todo: check if biases was not lready being set
@@ -286,14 +277,10 @@ inline OutputPort AddTryConst(const OutputPort &src, const IRBlob::Ptr &biases)
     } else {
         // need to create an add with Const here using ScaleShift with no weights...
         // there are two options, scale shift with no weights, or cosnt with an Add
-        return ScaleShiftNode(src, nullptr, biases);
+        return ScaleShiftNode(ctx, src, nullptr, biases);
     }
 }
 
-
-inline OutputPort operator+(const OutputPort &src, const IRBlob::Ptr &biases) {
-    return AddTryConst(src, biases);
-}
 /*
 inline OutputPort operator+(const OutputPort &src, const IRBlob::Ptr &biases)
 {
@@ -304,12 +291,11 @@ inline OutputPort operator+(const OutputPort &src, const IRBlob::Ptr &biases)
 
 namespace ConvLayer
 {
-static IRLayer create(const OutputPort &src)
+static IRLayer create(BuilderContext &ctx, const OutputPort &src)
 {
-    std::string name = "Conv-"; // todo: make it unique
+    std::string name = ctx.uniqueName("Conv-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
-    name = name << layer_name_count++;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto conv_layer = std::make_shared<InferenceEngine::ConvolutionLayer>(prm);
     conv_layer->type = "Convolution";
@@ -361,9 +347,9 @@ inline size_t in_ch(const OutputPort &src)
     auto dims = src->getTensorDesc().getDims();
     return dims.size() == 4 ? dims[1] : dims[2];
 }
-inline OutputPort Convolution(const OutputPort &src, const ConvolutionParams &prms)
+inline OutputPort Convolution(BuilderContext &ctx, const OutputPort &src, const ConvolutionParams &prms)
 {
-    auto ret = As<InferenceEngine::ConvolutionLayer>(ConvLayer::create(src));
+    auto ret = As<InferenceEngine::ConvolutionLayer>(ConvLayer::create(ctx, src));
     auto inDims = src->getTensorDesc().getDims();
     IR_ASSERT(inDims.size() == 4);
     //IR_ASSERT(prms.kernel.size() * n(src) * prms.num_output_planes == prms.weights->size());
@@ -479,13 +465,12 @@ struct BatchNormParams
     IRBlob::Ptr bias;
 };
 
-inline IRLayer BatchNormalization(const OutputPort &src, BatchNormParams &prms)
+inline IRLayer BatchNormalization(BuilderContext &ctx, const OutputPort &src, BatchNormParams &prms)
 {
     auto inp = src;
-    std::string name = "BatchNormalization-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("BatchNormalization-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto l = std::make_shared<InferenceEngine::BatchNormalizationLayer>(prm);
     l->type = "BatchNormalization";
@@ -497,13 +482,12 @@ inline IRLayer BatchNormalization(const OutputPort &src, BatchNormParams &prms)
     return l;
 }
 
-inline OutputPort LRN(const OutputPort &src, float alpha, float beta, int local_size, bool isAcross=true, float k=1)
+inline OutputPort LRN(BuilderContext &ctx, const OutputPort &src, float alpha, float beta, int local_size, bool isAcross=true, float k=1)
 {
     auto inp = src;
-    std::string name = "Norm-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("Norm-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto l = std::make_shared<InferenceEngine::NormLayer>(prm);
     l->type = "Norm";
@@ -517,16 +501,15 @@ inline OutputPort LRN(const OutputPort &src, float alpha, float beta, int local_
     return addOutput(l, inp->getTensorDesc().getDims());
 }
 
-inline OutputPort Crop(const OutputPort &src,
+inline OutputPort Crop(BuilderContext &ctx, const OutputPort &src,
                          const std::vector<int> &axis,
                          const std::vector<int> &dim,
                          const std::vector<int> &offset)
 {
     auto inp = src;
-    std::string name = "Crop-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("Crop-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto l = std::make_shared<InferenceEngine::CropLayer>(prm);
     l->type = "Crop";
@@ -545,10 +528,9 @@ inline OutputPort Pooling(const OutputPort &inp,
                             InferenceEngine::PoolingLayer::PoolType type)
 {
     auto src = inp;
-    std::string name = "Pooling-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("Pooling-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto ret = std::make_shared<InferenceEngine::PoolingLayer>(prm);
     ret->type = "Pooling";
@@ -593,10 +575,9 @@ inline OutputPort Pooling(const OutputPort &inp,
                             InferenceEngine::PoolingLayer::PoolType type)
 {
       auto src = inp;
-      std::string name = "Pooling-"; // todo: make it unique
-      name = name << layer_name_count++;
+      std::string name = ctx.uniqueName("Pooling-");
       InferenceEngine::LayerParams prm;
-      prm.precision = g_layer_precision;
+      prm.precision = ctx.precision();
       prm.name = name;
       auto ret = std::make_shared<InferenceEngine::PoolingLayer>(prm);
       ret->type = "Pooling";
@@ -680,12 +661,11 @@ inline OutputPort Pooling(const OutputPort &inp,
 
 namespace SumLayer
 {
-   static IRLayer create(const OutputPort &src1, const OutputPort &src2)
+   static IRLayer create(BuilderContext &ctx, const OutputPort &src1, const OutputPort &src2)
    {
-       std::string name = "Sum-"; // todo: make it unique
-       name = name << layer_name_count++;
+       std::string name = ctx.uniqueName("Sum-");
        InferenceEngine::LayerParams prm;
-       prm.precision = g_layer_precision;
+       prm.precision = ctx.precision();
        prm.name = name;
        auto sum = std::make_shared<InferenceEngine::EltwiseLayer>(prm);
        sum->type = "Eltwise";
@@ -699,12 +679,11 @@ namespace SumLayer
 
 namespace MulLayer
 {
-static IRLayer create(const OutputPort &src1, const OutputPort &src2)
+static IRLayer create(BuilderContext &ctx, const OutputPort &src1, const OutputPort &src2)
 {
-    std::string name = "Mul-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("Mul-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto mul = std::make_shared<InferenceEngine::EltwiseLayer>(prm);
     mul->type = "Mul";
@@ -717,20 +696,19 @@ static IRLayer create(const OutputPort &src1, const OutputPort &src2)
 }
 };
 
-inline OutputPort operator*(const OutputPort &a, const OutputPort &b)
+inline OutputPort Mul(BuilderContext &ctx, const OutputPort &a, const OutputPort &b)
 {
-    return output(MulLayer::create(a, b));
+    return output(MulLayer::create(ctx, a, b));
 }
 
 namespace ScaleShift
 {
 
-static OutputPort Diagnoal(const Vector &weights, const OutputPort &src)
+static OutputPort Diagnoal(BuilderContext &ctx, const Vector &weights, const OutputPort &src)
 {
-    std::string name = "ConstMul-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("ConstMul-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto l = std::make_shared<InferenceEngine::ScaleShiftLayer>(prm);
     l->type = "ConstMul";
@@ -743,14 +721,14 @@ static OutputPort Diagnoal(const Vector &weights, const OutputPort &src)
 
     return output(l);
 }
-static InferenceEngine::CNNLayer::Ptr create(OutputPort src,
+static InferenceEngine::CNNLayer::Ptr create(BuilderContext &ctx,
+                                             OutputPort src,
                                              IRBlob::Ptr scale,
                                              IRBlob::Ptr bias)
 {
-    std::string name = "ConstMul-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("ConstMul-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto l = std::make_shared<InferenceEngine::ScaleShiftLayer>(prm);
     l->type = "ScaleShift";
@@ -763,16 +741,6 @@ static InferenceEngine::CNNLayer::Ptr create(OutputPort src,
 }
 };
 
-inline OutputPort operator*(const Vector &weights, const IRLayer &b)
-{
-    return (ScaleShift::Diagnoal(weights, output(b)));
-}
-
-inline OutputPort operator*(const Vector &weights, const OutputPort &op)
-{
-    return (ScaleShift::Diagnoal(weights, op));
-}
-
 namespace ActivationLayer
 {
 extern const std::string Sigmoid;
@@ -781,15 +749,14 @@ extern const std::string Tanh;
 
 extern const std::string ReLU;
 
-static IRLayer create(const OutputPort &src, const std::string &type)
+static IRLayer create(BuilderContext &ctx, const OutputPort &src, const std::string &type)
 {
-    std::string name = type + "-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName(type + "-");
     IRLayer layer;
     if((strncasecmp(type.c_str(), "relu", type.size()) == 0))
     {
         InferenceEngine::LayerParams prm;
-        prm.precision = g_layer_precision;
+        prm.precision = ctx.precision();
         prm.name = name;
         layer = std::make_shared<InferenceEngine::ReLULayer>(prm);
         layer->type = "ReLU";
@@ -797,7 +764,7 @@ static IRLayer create(const OutputPort &src, const std::string &type)
     else if((strncasecmp(type.c_str(), "tanh", type.size()) == 0))
     {
         InferenceEngine::LayerParams prm;
-        prm.precision = g_layer_precision;
+        prm.precision = ctx.precision();
         prm.name = name;
         layer = std::make_shared<InferenceEngine::TanHLayer>(prm);
         layer->type = "TanH";
@@ -805,7 +772,7 @@ static IRLayer create(const OutputPort &src, const std::string &type)
     else if((strncasecmp(type.c_str(), "sigmoid", type.size()) == 0))
     {
         InferenceEngine::LayerParams prm;
-        prm.precision = g_layer_precision;
+        prm.precision = ctx.precision();
         prm.name = name;
         layer = std::make_shared<InferenceEngine::SigmoidLayer>(prm);
         layer->type = "Sigmoid";
@@ -813,7 +780,7 @@ static IRLayer create(const OutputPort &src, const std::string &type)
     else
     {
         InferenceEngine::LayerParams prm;
-        prm.precision = g_layer_precision;
+        prm.precision = ctx.precision();
         prm.name = name;
         layer = std::make_shared<InferenceEngine::CNNLayer>(prm);
         layer->type = "Activation";
@@ -833,40 +800,39 @@ static IRLayer create(const OutputPort &src, const std::string &type)
     return layer;
 }
 
-static IRLayer create(const IRLayer &src, const std::string &type)
+static IRLayer create(BuilderContext &ctx, const IRLayer &src, const std::string &type)
 {
-    return create(output(src), type);
+    return create(ctx, output(src), type);
 }
 
 };
 
 template<typename T>
-OutputPort ReLU(const T &src)
+OutputPort ReLU(BuilderContext &ctx, const T &src)
 {
-    return output(ActivationLayer::create(src, ActivationLayer::ReLU));
+    return output(ActivationLayer::create(ctx, src, ActivationLayer::ReLU));
 }
 
 template<typename T>
-OutputPort Sigmoid(const T &src)
+OutputPort Sigmoid(BuilderContext &ctx, const T &src)
 {
-    return output(ActivationLayer::create(src, ActivationLayer::Sigmoid));
+    return output(ActivationLayer::create(ctx, src, ActivationLayer::Sigmoid));
 }
 
 template<typename T>
-OutputPort Tanh(const T &src)
+OutputPort Tanh(BuilderContext &ctx, const T &src)
 {
-    return output(ActivationLayer::create(src, ActivationLayer::Tanh));
+    return output(ActivationLayer::create(ctx, src, ActivationLayer::Tanh));
 }
 
 namespace SplitUtil
 {
 
-static IRLayer create(int size, const OutputPort &src, int axis = 1)
+static IRLayer create(BuilderContext &ctx, int size, const OutputPort &src, int axis = 1)
 {
-    std::string name = "Split-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("Split-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto me = std::make_shared<InferenceEngine::SplitLayer>(prm);
     me->type = "Split";
@@ -885,22 +851,21 @@ static IRLayer create(int size, const OutputPort &src, int axis = 1)
 }
 };
 
-inline std::vector<OutputPort> Split(const OutputPort &src, int splitElements, int axis = 1)
+inline std::vector<OutputPort> Split(BuilderContext &ctx, const OutputPort &src, int splitElements, int axis = 1)
 {
-    return SplitUtil::create(splitElements, src, axis)->outData;
+    return SplitUtil::create(ctx, splitElements, src, axis)->outData;
 }
 
-inline std::vector<OutputPort> Split(const IRLayer &src, int splitElements, int axis = 1)
+inline std::vector<OutputPort> Split(BuilderContext &ctx, const IRLayer &src, int splitElements, int axis = 1)
 {
-    return Split(output(src), splitElements, axis);
+    return Split(ctx, output(src), splitElements, axis);
 }
 
-inline OutputPort Concat(const std::vector<OutputPort> inputs, int axis = 1)
+inline OutputPort Concat(BuilderContext &ctx, const std::vector<OutputPort> inputs, int axis = 1)
 {
-    std::string name = "Concat-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("Concat-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto ret = std::make_shared<InferenceEngine::ConcatLayer>(prm);
     ret->type = "Concat";
@@ -920,12 +885,11 @@ inline OutputPort Concat(const std::vector<OutputPort> inputs, int axis = 1)
 }
 
 //template<typename T>
-inline OutputPort Clamp(const OutputPort &src, float min, float max)
+inline OutputPort Clamp(BuilderContext &ctx, const OutputPort &src, float min, float max)
 {
-    std::string name = "Clamp-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("Clamp-");
     InferenceEngine::LayerParams prms;
-    prms.precision = g_layer_precision;
+    prms.precision = ctx.precision();
     prms.name = name;
     auto layer = std::make_shared<InferenceEngine::ClampLayer>(prms);
     layer->type = "Clamp";
@@ -938,15 +902,15 @@ inline OutputPort Clamp(const OutputPort &src, float min, float max)
     return output(layer);
 }
 
-inline OutputPort L2Normalization(const OutputPort &src, bool isAcross, bool isShareChannel)
+inline OutputPort L2Normalization(BuilderContext &ctx, const OutputPort &src, bool isAcross, bool isShareChannel)
 {
-    auto layer = Generic("Normalize", src);
+    auto layer = Generic(ctx, "Normalize", src);
     addAttr(layer, "across_spatial", isAcross ? 1 : 0);
     addAttr(layer, "channel_shared", isShareChannel ? 1 : 0);
     return output(layer);
 }
 
-inline OutputPort Reshape(const TensorDims &newDims, const OutputPort &src)
+inline OutputPort Reshape(BuilderContext &ctx, const TensorDims &newDims, const OutputPort &src)
 {
     if(sizeOf(src->getTensorDesc().getDims()) != sizeOf(newDims)) THROW("Cannot reorder different volumes");
 
@@ -975,10 +939,9 @@ inline OutputPort Reshape(const TensorDims &newDims, const OutputPort &src)
 */
  //latest implementation
 
-    std::string name = "Reshape-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("Reshape-");
     InferenceEngine::LayerParams prms;
-    prms.precision = g_layer_precision;
+    prms.precision = ctx.precision();
     prms.name = name;
     auto layer = std::make_shared<InferenceEngine::ReshapeLayer>(prms);
     layer->type = "Reshape";
@@ -1026,7 +989,7 @@ inline OutputPort Reshape(const TensorDims &newDims, const OutputPort &src)
 
 }
 
-static OutputPort Softmax(const OutputPort &src)
+static OutputPort Softmax(BuilderContext &ctx, const OutputPort &src)
 {
 
     auto inputDims = src->getTensorDesc().getDims();
@@ -1052,10 +1015,9 @@ static OutputPort Softmax(const OutputPort &src)
     }
 
 */
-    std::string name = "Softmax-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("Softmax-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto l = std::make_shared<InferenceEngine::SoftMaxLayer>(prm);
     l->type = "SoftMax";
@@ -1071,12 +1033,11 @@ static OutputPort Softmax(const OutputPort &src)
 */
 }
 
-inline OutputPort Gather(const std::vector<OutputPort> inputs, int axis = 1)
+inline OutputPort Gather(BuilderContext &ctx, const std::vector<OutputPort> inputs, int axis = 1)
 {
-    std::string name = "Gather-"; // todo: make it unique
-    name = name << layer_name_count++;
+    std::string name = ctx.uniqueName("Gather-");
     InferenceEngine::LayerParams prm;
-    prm.precision = g_layer_precision;
+    prm.precision = ctx.precision();
     prm.name = name;
     auto ret = std::make_shared<InferenceEngine::GenericLayer>(prm);
     ret->type = "Gather";
@@ -1091,9 +1052,19 @@ inline OutputPort Gather(const std::vector<OutputPort> inputs, int axis = 1)
 }
 
 
-inline OutputPort operator+(const OutputPort &a, const OutputPort &b)
+inline OutputPort Sum(BuilderContext &ctx, const OutputPort &a, const OutputPort &b)
 {
-    return output(SumLayer::create(a, b));
+    return output(SumLayer::create(ctx, a, b));
+}
+
+// A layer without inputs, it is not reached from the network inputs and so is
+// added to the document right away.
+inline OutputPort Const(IRDocument &doc, const IRBlob::Ptr &values, const TensorDims &dims)
+{
+    auto constNode = Generic(doc.context(), "Const");
+    doc.add(constNode);
+    constNode->blobs["custom"] = values;
+    return addOutput(constNode, dims);
 }
 
 inline OutputPort AddConst(IRDocument &doc, const OutputPort &src, const IRBlob::Ptr &biases) {
@@ -1101,14 +1072,11 @@ inline OutputPort AddConst(IRDocument &doc, const OutputPort &src, const IRBlob:
     bool useScaleShift = false;
 
     if (useScaleShift) {
-        return ScaleShiftNode(src, nullptr, biases);
+        return ScaleShiftNode(doc.context(), src, nullptr, biases);
     }
     // use const layer with elment wise add
-    auto constNode = Generic("Const");
-    doc.add(constNode);
-    constNode->blobs["custom"] = biases;
-    const auto constOut = addOutput(constNode, src->getTensorDesc().getDims());
-    return src + constOut;
+    const auto constOut = Const(doc, biases, src->getTensorDesc().getDims());
+    return Sum(doc.context(), src, constOut);
 }
 
 }  // namespace IRBuilder
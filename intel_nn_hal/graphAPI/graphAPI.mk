@@ -12,6 +12,7 @@ LOCAL_SRC_FILES := \
   IRLayer.cpp
 
 LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../fp16 \
 	$(LOCAL_PATH)/../../../dldt/inference-engine/include \
 	$(LOCAL_PATH)/../../../dldt/inference-engine/src/inference_engine \
 	$(LOCAL_PATH)/../../../dldt/inference-engine/thirdparty/pugixml/src
@@ -36,6 +37,7 @@ LOCAL_CFLAGS += \
 	-DIMPLEMENT_INFERENCE_ENGINE_API
 #	-DNNLOG
 
+LOCAL_STATIC_LIBRARIES := libnnhal_fp16
 LOCAL_SHARED_LIBRARIES := liblog
 
 include $(BUILD_STATIC_LIBRARY)
@@ -45,7 +45,7 @@ LOCAL_CFLAGS += \
 	-DAKS \
 	-DIMPLEMENT_INFERENCE_ENGINE_API
 
-LOCAL_STATIC_LIBRARIES := libgraphAPI libpugixml
+LOCAL_STATIC_LIBRARIES := libgraphAPI libnnhal_fp16 libpugixml
 LOCAL_SHARED_LIBRARIES := libinference_engine liblog
 
 include $(BUILD_EXECUTABLE)
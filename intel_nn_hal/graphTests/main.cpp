@@ -1,3 +1,4 @@
+#include <chrono>
 #include <fstream>
 #include "helpers-test.hpp"
 
@@ -6,8 +7,15 @@
 
 using namespace IRBuilder;
 
+#ifdef ENABLE_MYRIAD
+static const InferenceEngine::Precision kLayerPrecision = InferenceEngine::Precision::FP16;
+#elif ENABLE_MKLDNN
+static const InferenceEngine::Precision kLayerPrecision = InferenceEngine::Precision::FP32;
+#endif
+
 template <typename T>
 void createAlexNet(IRDocument &doc) {
+    auto &ctx = doc.context();
     auto input = doc.createInput("in1", {1, 3, 227, 227});
 
     auto &pp = input->getPreProcess();
@@ -27,16 +35,16 @@ void createAlexNet(IRDocument &doc) {
     prms.num_output_planes = 96;
 
     auto b1 = readBlobFromFile<T>("AlexNet-bins/conv1_bias.bin");
-    auto c1 = Convolution(input->getInputData(), prms) + b1;
-    auto r1 = ReLU(c1);
+    auto c1 = AddTryConst(ctx, Convolution(ctx, input->getInputData(), prms), b1);
+    auto r1 = ReLU(ctx, c1);
     //<norm_data alpha = "9.9999997e-05" beta = "0.75" local-size = "5" region = "across" / >
-    auto n1 = LRN(r1, 0.0001f, 0.75f, 5, true);
+    auto n1 = LRN(ctx, r1, 0.0001f, 0.75f, 5, true);
     //<pooling_data kernel-x="3" kernel-y="3" pad-x="0" pad-y="0" stride-x="2" stride-y="2"
     //rounding-type="ceil" pool-method="max"/>
-    auto p1 = Pooling(n1, {3, 3}, {2, 2}, {0, 0}, PoolingLayer::MAX);
+    auto p1 = Pooling(ctx, n1, {3, 3}, {2, 2}, {0, 0}, PoolingLayer::MAX);
 
     /// 2nd part
-    auto s1 = Split(p1, 2);
+    auto s1 = Split(ctx, p1, 2);
     //<convolution_data stride-x="1" stride-y="1" pad-x="2" pad-y="2" kernel-x="5" kernel-y="5"
     //output="128" group="1"/>
     prms.kernel = {5, 5};
@@ -46,15 +54,17 @@ void createAlexNet(IRDocument &doc) {
     prms.num_output_planes = 128;
 
     prms.weights = readBlobFromFile<T>("AlexNet-bins/conv2_0_weights.bin");
-    auto c2_0 = Convolution(s1[0], prms) + readBlobFromFile<T>("AlexNet-bins/conv2_0_bias.bin");
+    auto c2_0 = AddTryConst(ctx, Convolution(ctx, s1[0], prms),
+                            readBlobFromFile<T>("AlexNet-bins/conv2_0_bias.bin"));
     prms.weights = readBlobFromFile<T>("AlexNet-bins/conv2_1_weights.bin");
-    auto c2_1 = Convolution(s1[1], prms) + readBlobFromFile<T>("AlexNet-bins/conv2_1_bias.bin");
-    auto c2 = Concat({c2_0, c2_1});
-    auto relu2 = ReLU(c2);
-    auto n2 = LRN(relu2, 0.0001f, 0.75f, 5, true);
+    auto c2_1 = AddTryConst(ctx, Convolution(ctx, s1[1], prms),
+                            readBlobFromFile<T>("AlexNet-bins/conv2_1_bias.bin"));
+    auto c2 = Concat(ctx, {c2_0, c2_1});
+    auto relu2 = ReLU(ctx, c2);
+    auto n2 = LRN(ctx, relu2, 0.0001f, 0.75f, 5, true);
     //<pooling_data kernel-x="3" kernel-y="3" pad-x="0" pad-y="0" stride-x="2" stride-y="2"
     //rounding-type="ceil" pool-method="max"/>
-    auto p2 = Pooling(n2, {3, 3}, {2, 2}, {0, 0}, PoolingLayer::MAX);
+    auto p2 = Pooling(ctx, n2, {3, 3}, {2, 2}, {0, 0}, PoolingLayer::MAX);
 
     // 3rd part
     //<convolution_data stride-x="1" stride-y="1" pad-x="1" pad-y="1" kernel-x="3" kernel-y="3"
@@ -65,48 +75,52 @@ void createAlexNet(IRDocument &doc) {
     prms.pad_end = {1, 1};
     prms.num_output_planes = 384;
     prms.weights = readBlobFromFile<T>("AlexNet-bins/conv3_weights.bin");
-    auto c3 = ReLU(Convolution(p2, prms) + readBlobFromFile<T>("AlexNet-bins/conv3_bias.bin"));
+    auto c3 = ReLU(ctx, AddTryConst(ctx, Convolution(ctx, p2, prms),
+                                    readBlobFromFile<T>("AlexNet-bins/conv3_bias.bin")));
 
     // 4th part
-    auto s4 = Split(c3, 2);
+    auto s4 = Split(ctx, c3, 2);
     //<convolution_data stride-x="1" stride-y="1" pad-x="1" pad-y="1" kernel-x="3" kernel-y="3"
     //output="192" group="1"/>
     prms.num_output_planes = 192;
     prms.weights = readBlobFromFile<T>("AlexNet-bins/conv4_0_weights.bin");
-    auto c4_0 =
-        ReLU(Convolution(s4[0], prms) + readBlobFromFile<T>("AlexNet-bins/conv4_0_bias.bin"));
+    auto c4_0 = ReLU(ctx, AddTryConst(ctx, Convolution(ctx, s4[0], prms),
+                                      readBlobFromFile<T>("AlexNet-bins/conv4_0_bias.bin")));
     prms.weights = readBlobFromFile<T>("AlexNet-bins/conv4_1_weights.bin");
-    auto c4_1 =
-        ReLU(Convolution(s4[1], prms) + readBlobFromFile<T>("AlexNet-bins/conv4_1_bias.bin"));
+    auto c4_1 = ReLU(ctx, AddTryConst(ctx, Convolution(ctx, s4[1], prms),
+                                      readBlobFromFile<T>("AlexNet-bins/conv4_1_bias.bin")));
 
     // 5th part
     //<convolution_data stride-x="1" stride-y="1" pad-x="1" pad-y="1" kernel-x="3" kernel-y="3"
     //output="128" group="1"/>
     prms.num_output_planes = 128;
     prms.weights = readBlobFromFile<T>("AlexNet-bins/conv5_0_weights.bin");
-    auto c5_0 =
-        ReLU(Convolution(c4_0, prms) + readBlobFromFile<T>("AlexNet-bins/conv5_0_bias.bin"));
+    auto c5_0 = ReLU(ctx, AddTryConst(ctx, Convolution(ctx, c4_0, prms),
+                                      readBlobFromFile<T>("AlexNet-bins/conv5_0_bias.bin")));
     prms.weights = readBlobFromFile<T>("AlexNet-bins/conv5_1_weights.bin");
-    auto c5_1 =
-        ReLU(Convolution(c4_1, prms) + readBlobFromFile<T>("AlexNet-bins/conv5_1_bias.bin"));
-    auto c5 = Concat({c5_0, c5_1});
+    auto c5_1 = ReLU(ctx, AddTryConst(ctx, Convolution(ctx, c4_1, prms),
+                                      readBlobFromFile<T>("AlexNet-bins/conv5_1_bias.bin")));
+    auto c5 = Concat(ctx, {c5_0, c5_1});
 
     //<pooling_data kernel-x="3" kernel-y="3" pad-x="0" pad-y="0" stride-x="2" stride-y="2"
     //rounding-type="ceil" pool-method="max"/>
-    auto p5 = Pooling(c5, {3, 3}, {2, 2}, {0, 0}, PoolingLayer::MAX);
+    auto p5 = Pooling(ctx, c5, {3, 3}, {2, 2}, {0, 0}, PoolingLayer::MAX);
 
     // fc6
     auto m = readBlobFromFile<T>("AlexNet-bins/fc6_weights.bin");
-    auto fc6 = ReLU(m * Reshape({1, 9216}, p5) + readBlobFromFile<T>("AlexNet-bins/fc6_bias.bin"));
+    auto fc6 = ReLU(ctx, AddTryConst(ctx, FullyConnected(ctx, m, Reshape(ctx, {1, 9216}, p5)),
+                                     readBlobFromFile<T>("AlexNet-bins/fc6_bias.bin")));
 
     // fc7
     m = readBlobFromFile<T>("AlexNet-bins/fc7_weights.bin");
-    auto fc7 = ReLU(m * fc6 + readBlobFromFile<T>("AlexNet-bins/fc7_bias.bin"));
+    auto fc7 = ReLU(ctx, AddTryConst(ctx, FullyConnected(ctx, m, fc6),
+                                     readBlobFromFile<T>("AlexNet-bins/fc7_bias.bin")));
     // fc8
     m = readBlobFromFile<T>("AlexNet-bins/fc8_weights.bin");
-    auto fc8 = m * fc7 + readBlobFromFile<T>("AlexNet-bins/fc8_bias.bin");
+    auto fc8 = AddTryConst(ctx, FullyConnected(ctx, m, fc7),
+                           readBlobFromFile<T>("AlexNet-bins/fc8_bias.bin"));
 
-    const OutputPort &output = Softmax(fc8);
+    const OutputPort &output = Softmax(ctx, fc8);
     doc.addOutput(output);
     return;
 }
@@ -120,7 +134,7 @@ inline void prompt(const char *msg = "press [ENTER] to contine") {
 
 bool testAlexNet() {
     std::string tmpStr;
-    IRDocument doc("my-alexnet");
+    IRDocument doc("my-alexnet", kLayerPrecision);
 
     tmpStr = FileUtils::GetCWD();
     std::cout << "starting from: " << tmpStr << std::endl;
@@ -201,7 +215,7 @@ bool testAffineLayer() {
     std::string tmpStr;
     try {
         std::string netName("TestNet");
-        IRDocument doc("TestNet");
+        IRDocument doc("TestNet", kLayerPrecision);
 
         size_t batch = 1;
 
@@ -287,7 +301,9 @@ bool testAffineLayer() {
         std::cout << "inputdata indatadim[0] " << indatadim[0] << " indatadim[1] " << indatadim[1]
                   << std::endl;
 
-        doc.addOutput(ReLU(weightsBlob * input->getInputData() + biasBlob));
+        auto &ctx = doc.context();
+        doc.addOutput(ReLU(
+            ctx, AddTryConst(ctx, FullyConnected(ctx, weightsBlob, input->getInputData()), biasBlob)));
 
         doc.buildNetwork();
         std::fstream dot;
@@ -372,11 +388,175 @@ bool testAffineLayer() {
     }
 }
 
+// Benchmark, not a test: times the first inference of a network (load +
+// inference) against the next ones on the loaded network, with ExecuteNetwork
+// alone. It bounds what caching an execution plan can save but does not go
+// through the HAL executor, nothing here checks its plan reuse.
+bool benchFirstRequestLatency(int iterations = 100) {
+    try {
+        IRDocument doc("LatencyNet", kLayerPrecision);
+
+        vec<uint32_t> indims = {1, 5};
+        auto input = doc.createInput("input", toDims(indims));
+
+        std::vector<float> wdata = {2.0f, 4.0f, 0.5f, 0.25f, 1.0f};
+        std::vector<float> bData = {1.0f};
+        vec<uint32_t> wdims = {1, 5};
+        vec<uint32_t> bdims = {1};
+#ifdef ENABLE_MYRIAD
+        TensorDesc td(InferenceEngine::Precision::FP16, toDims(wdims), Layout::NC);
+        InferenceEngine::TBlob<short>::Ptr weightsBlob =
+            std::make_shared<InferenceEngine::TBlob<short>>(td);
+        weightsBlob->allocate();
+        uint32_t nelem = getNumberOfElements(wdims);
+        f32tof16Arrays(weightsBlob->data().as<short *>(), wdata.data(), nelem);
+
+        TensorDesc td1(InferenceEngine::Precision::FP16, toDims(bdims), Layout::C);
+        InferenceEngine::TBlob<short>::Ptr biasBlob =
+            std::make_shared<InferenceEngine::TBlob<short>>(td1);
+        biasBlob->allocate();
+        uint32_t nelem1 = getNumberOfElements(bdims);
+        f32tof16Arrays(biasBlob->data().as<short *>(), bData.data(), nelem1);
+#elif ENABLE_MKLDNN
+        TensorDesc td(InferenceEngine::Precision::FP32, toDims(wdims), Layout::NC);
+        InferenceEngine::TBlob<float>::Ptr weightsBlob =
+            std::make_shared<InferenceEngine::TBlob<float>>(td);
+        weightsBlob->set(wdata);
+
+        TensorDesc td1(InferenceEngine::Precision::FP32, toDims(bdims), Layout::C);
+        InferenceEngine::TBlob<float>::Ptr biasBlob =
+            std::make_shared<InferenceEngine::TBlob<float>>(td1);
+        biasBlob->set(bData);
+#endif
+
+        auto &ctx = doc.context();
+        doc.addOutput(ReLU(
+            ctx, AddTryConst(ctx, FullyConnected(ctx, weightsBlob, input->getInputData()), biasBlob)));
+        doc.buildNetwork();
+
+        TensorDesc intd(InferenceEngine::Precision::FP32, toDims(indims), Layout::ANY);
+        InferenceEngine::TBlob<float>::Ptr inData =
+            std::make_shared<InferenceEngine::TBlob<float>>(intd);
+        inData->set({0.5f, 0.25f, 1.0f, 2.0f, 0.5f});
+
+        auto start = std::chrono::steady_clock::now();
+#ifdef ENABLE_MYRIAD
+        ExecuteNetwork executeNet(doc, TargetDevice::eMYRIAD);
+#elif ENABLE_MKLDNN
+        ExecuteNetwork executeNet(doc, TargetDevice::eCPU);
+#endif
+        executeNet.prepareInput();
+        executeNet.prepareOutput();
+        executeNet.loadNetwork();
+        executeNet.Infer(inData);
+        auto first = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) executeNet.Infer(inData);
+        auto steady = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count() /
+                      iterations;
+
+        std::cout << "first request: " << first << " us, steady-state: " << steady
+                  << " us per request (" << iterations << " iterations)" << std::endl;
+        ALOGI("first request: %lld us, steady-state: %lld us per request",
+              static_cast<long long>(first), static_cast<long long>(steady));
+        return true;
+    } catch (const std::exception &ex) {
+        std::cerr << ex.what();
+        return false;
+    }
+}
+
+// A blob of the layer precision holding values.
+static InferenceEngine::Blob::Ptr makeBlob(const std::vector<float> &values, const vec<uint32_t> &dims) {
+    Layout layout = dims.size() == 2 ? Layout::NC : Layout::C;
+#ifdef ENABLE_MYRIAD
+    TensorDesc td(InferenceEngine::Precision::FP16, toDims(dims), layout);
+    InferenceEngine::TBlob<short>::Ptr blob = std::make_shared<InferenceEngine::TBlob<short>>(td);
+    blob->allocate();
+    uint32_t nelem = getNumberOfElements(dims);
+    f32tof16Arrays(blob->data().as<short *>(), values.data(), nelem);
+#elif ENABLE_MKLDNN
+    TensorDesc td(InferenceEngine::Precision::FP32, toDims(dims), layout);
+    InferenceEngine::TBlob<float>::Ptr blob = std::make_shared<InferenceEngine::TBlob<float>>(td);
+    blob->set(values);
+#endif
+    return blob;
+}
+
+// 12 layers, each of the graph passes of IRDocument has something to remove:
+// FC -> +bias (Const, Sum) -> Reshape -> Reshape -> ReLU -> Clamp -> Sum -> output
+//                                        Const + Const (Sum) -^
+// and a ReLU of the input nothing uses.
+static void createPassesNet(IRDocument &doc) {
+    auto &ctx = doc.context();
+    auto input = doc.createInput("input", toDims({1, 4}));
+
+    auto weights = makeBlob(std::vector<float>(16, 0.25f), {4, 4});
+    auto fc = FullyConnected(ctx, weights, input->getInputData());
+    auto biased = AddConst(doc, fc, makeBlob({1.0f, 2.0f, 3.0f, 4.0f}, {4}));
+    auto flat = Reshape(ctx, toDims({4}), biased);
+    auto back = Reshape(ctx, toDims({1, 4}), flat);
+    auto act = Clamp(ctx, ReLU(ctx, back), 0, 6);
+
+    auto c0 = Const(doc, makeBlob({1.0f, 1.0f, 1.0f, 1.0f}, {1, 4}), toDims({1, 4}));
+    auto c1 = Const(doc, makeBlob({0.5f, 0.5f, 0.5f, 0.5f}, {1, 4}), toDims({1, 4}));
+    doc.addOutput(Sum(ctx, act, Sum(ctx, c0, c1)));
+
+    ReLU(ctx, input->getInputData());
+}
+
+// Counts the layers left by each pass alone and by all of them. Every layer
+// removed is one kernel less per inference.
+bool testGraphPasses() {
+    struct Case {
+        const char *name;
+        unsigned passes;
+        size_t layers;
+    };
+    const Case cases[] = {
+        {"none", 0, 12},
+        {"fold const add", IRDocument::kFoldConstAdd, 10},
+        {"collapse reshapes", IRDocument::kCollapseReshapes, 11},
+        // the two Reshapes only give back the dims of the FC once collapsed
+        {"identity reshape", IRDocument::kRemoveIdentityReshape, 12},
+        {"reshapes", IRDocument::kCollapseReshapes | IRDocument::kRemoveIdentityReshape, 10},
+        {"fold bias", IRDocument::kFoldBias, 10},
+        {"fold activation", IRDocument::kFoldActivation, 11},
+        {"dead layers", IRDocument::kRemoveDeadLayers, 11},
+        {"all", IRDocument::kAllPasses, 4},
+    };
+
+    bool success = true;
+    for (const Case &c : cases) {
+        try {
+            IRDocument doc("PassesNet", kLayerPrecision);
+            doc.setPasses(c.passes);
+            createPassesNet(doc);
+            doc.buildNetwork();
+            bool ok = doc.layerCount() == c.layers;
+            std::cout << (ok ? "[ OK ] " : "[FAIL] ") << c.name << ": " << doc.layerCount()
+                      << " layers, expected " << c.layers << std::endl;
+            success &= ok;
+        } catch (const std::exception &ex) {
+            std::cerr << c.name << ": " << ex.what() << std::endl;
+            success = false;
+        }
+    }
+    ALOGI("testGraphPasses %s", success ? "passed" : "failed");
+    return success;
+}
+
 template <typename T>
 bool testMKLBug() {
     std::string tmpStr;
     try {
-        IRDocument doc("test_bug");
+        IRDocument doc("test_bug", kLayerPrecision);
+        auto &ctx = doc.context();
 
         auto input = doc.createInput("in1", {1, 3, 227, 227});
 
@@ -389,15 +569,15 @@ bool testMKLBug() {
         prms.num_output_planes = 96;
 
         auto b1 = readBlobFromFile<T>("AlexNet-bins/conv1_bias.bin");
-        auto r1 = ReLU(Convolution(input->getInputData(), prms) + b1);
+        auto r1 = ReLU(ctx, AddTryConst(ctx, Convolution(ctx, input->getInputData(), prms), b1));
         //<norm_data alpha = "9.9999997e-05" beta = "0.75" local-size = "5" region = "across" / >
-        auto n1 = LRN(r1, 0.0001f, 0.75f, 5, true);
+        auto n1 = LRN(ctx, r1, 0.0001f, 0.75f, 5, true);
         //<pooling_data kernel-x="3" kernel-y="3" pad-x="0" pad-y="0" stride-x="2" stride-y="2"
         //rounding-type="ceil" pool-method="max"/>
-        auto p1 = Pooling(n1, {3, 3}, {2, 2}, {0, 0}, PoolingLayer::MAX);
+        auto p1 = Pooling(ctx, n1, {3, 3}, {2, 2}, {0, 0}, PoolingLayer::MAX);
 
         /// 2nd part
-        auto s1 = Split(p1, 2);
+        auto s1 = Split(ctx, p1, 2);
         //<convolution_data stride-x="1" stride-y="1" pad-x="2" pad-y="2" kernel-x="5" kernel-y="5"
         //output="128" group="1"/>
         prms.kernel = {5, 5};
@@ -406,15 +586,17 @@ bool testMKLBug() {
         prms.num_output_planes = 128;
 
         prms.weights = readBlobFromFile<T>("AlexNet-bins/conv2_0_weights.bin");
-        auto c2_0 = Convolution(s1[0], prms) + readBlobFromFile<T>("AlexNet-bins/conv2_0_bias.bin");
+        auto c2_0 = AddTryConst(ctx, Convolution(ctx, s1[0], prms),
+                                readBlobFromFile<T>("AlexNet-bins/conv2_0_bias.bin"));
         prms.weights = readBlobFromFile<T>("AlexNet-bins/conv2_1_weights.bin");
-        auto c2_1 = Convolution(s1[1], prms) + readBlobFromFile<T>("AlexNet-bins/conv2_1_bias.bin");
-        auto conv2 = Concat({c2_0, c2_1});
-        auto c2 = ReLU(conv2);
-        auto n2 = LRN(c2, 0.0001f, 0.75f, 5, true);
+        auto c2_1 = AddTryConst(ctx, Convolution(ctx, s1[1], prms),
+                                readBlobFromFile<T>("AlexNet-bins/conv2_1_bias.bin"));
+        auto conv2 = Concat(ctx, {c2_0, c2_1});
+        auto c2 = ReLU(ctx, conv2);
+        auto n2 = LRN(ctx, c2, 0.0001f, 0.75f, 5, true);
         //<pooling_data kernel-x="3" kernel-y="3" pad-x="0" pad-y="0" stride-x="2" stride-y="2"
         //rounding-type="ceil" pool-method="max"/>
-        auto p2 = Pooling(n2, {3, 3}, {2, 2}, {0, 0}, PoolingLayer::MAX);
+        auto p2 = Pooling(ctx, n2, {3, 3}, {2, 2}, {0, 0}, PoolingLayer::MAX);
 
         doc.addOutput(c2);
         doc.addOutput(p2);
@@ -443,16 +625,16 @@ int main(int argc, const char *argv[]) {
     std::string inp;
 
 #ifdef ENABLE_MYRIAD
-    IRBuilder::g_layer_precision = InferenceEngine::Precision::FP16;
     // testAlexNet();
     // testMKLBug<short>();
 #elif ENABLE_MKLDNN
-    IRBuilder::g_layer_precision = InferenceEngine::Precision::FP32;
     // testAlexNet();
     // testMKLBug<float>();
 #endif
 
     testAffineLayer();
+    benchFirstRequestLatency();
+    testGraphPasses();
 
     prompt("enter string to exit\n");
     return 0;
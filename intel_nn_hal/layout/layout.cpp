@@ -0,0 +1,358 @@
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "layout.h"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "fp16.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace layout {
+
+namespace {
+
+// Tiles are kTile x kTile elements: 4 KB of floats, a quarter of L1.
+const size_t kTile = 32;
+// Longest run converted to FP16 in one call while transposing.
+const size_t kRun = 256;
+// Below this many elements per thread a transform runs on the caller only.
+const size_t kMinWorkPerThread = 1 << 16;
+
+std::atomic<size_t> gMaxThreads(0);
+thread_local size_t tMaxThreads = 0;
+
+size_t maxThreads() {
+    size_t n = tMaxThreads ? tMaxThreads : gMaxThreads.load(std::memory_order_relaxed);
+    if (n == 0) n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Runs fn(u) for u in [0, units), spread over worker threads when there is
+// enough work for more than one.
+template <typename F>
+void parallelFor(size_t units, size_t workPerUnit, const F& fn) {
+    size_t threads = std::min(units, maxThreads());
+    threads = std::min(threads, std::max<size_t>(1, units * workPerUnit / kMinWorkPerThread));
+    if (threads <= 1) {
+        for (size_t u = 0; u < units; u++) fn(u);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&] {
+        for (size_t u = next++; u < units; u = next++) fn(u);
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& thread : pool) thread.join();
+}
+
+// The shape after dropping size one dimensions and merging the dimensions
+// that stay adjacent, e.g. OHWI {0, 3, 1, 2} becomes [O, H*W, I] {0, 2, 1}.
+struct Shape {
+    Dims dims;
+    Order order;
+};
+
+Shape simplify(const Dims& dims, const Order& order) {
+    const size_t n = dims.size();
+    std::vector<int> remap(n, -1);
+    Dims kept;
+    for (size_t a = 0; a < n; a++) {
+        if (dims[a] == 1) continue;
+        remap[a] = kept.size();
+        kept.push_back(dims[a]);
+    }
+    Order keptOrder;
+    for (size_t k = 0; k < n; k++) {
+        if (remap[order[k]] >= 0) keptOrder.push_back(remap[order[k]]);
+    }
+
+    // runs of src dimensions, in dst order: first src dimension and length
+    std::vector<std::pair<unsigned, unsigned>> runs;
+    for (unsigned a : keptOrder) {
+        if (!runs.empty() && runs.back().first + runs.back().second == a) {
+            runs.back().second++;
+        } else {
+            runs.push_back(std::make_pair(a, 1u));
+        }
+    }
+
+    std::vector<size_t> bySrc(runs.size());
+    for (size_t i = 0; i < bySrc.size(); i++) bySrc[i] = i;
+    std::sort(bySrc.begin(), bySrc.end(),
+              [&](size_t a, size_t b) { return runs[a].first < runs[b].first; });
+
+    Shape shape;
+    std::vector<unsigned> rank(runs.size());
+    for (size_t j = 0; j < bySrc.size(); j++) {
+        const auto& run = runs[bySrc[j]];
+        size_t d = 1;
+        for (unsigned k = 0; k < run.second; k++) d *= kept[run.first + k];
+        shape.dims.push_back(d);
+        rank[bySrc[j]] = j;
+    }
+    for (size_t i = 0; i < runs.size(); i++) shape.order.push_back(rank[i]);
+    return shape;
+}
+
+//
+// Block transposes: dst[c * ldd + r] = src[r * lds + c]
+//
+
+template <typename T>
+void transposeBlock(T* dst, size_t ldd, const T* src, size_t lds, size_t rows, size_t cols) {
+    for (size_t c = 0; c < cols; c++)
+        for (size_t r = 0; r < rows; r++) dst[c * ldd + r] = src[r * lds + c];
+}
+
+#ifdef __SSE2__
+template <>
+void transposeBlock<float>(float* dst, size_t ldd, const float* src, size_t lds, size_t rows,
+                           size_t cols) {
+    size_t r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        size_t c = 0;
+        for (; c + 4 <= cols; c += 4) {
+            __m128 r0 = _mm_loadu_ps(src + (r + 0) * lds + c);
+            __m128 r1 = _mm_loadu_ps(src + (r + 1) * lds + c);
+            __m128 r2 = _mm_loadu_ps(src + (r + 2) * lds + c);
+            __m128 r3 = _mm_loadu_ps(src + (r + 3) * lds + c);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(dst + (c + 0) * ldd + r, r0);
+            _mm_storeu_ps(dst + (c + 1) * ldd + r, r1);
+            _mm_storeu_ps(dst + (c + 2) * ldd + r, r2);
+            _mm_storeu_ps(dst + (c + 3) * ldd + r, r3);
+        }
+        for (; c < cols; c++)
+            for (size_t k = 0; k < 4; k++) dst[c * ldd + r + k] = src[(r + k) * lds + c];
+    }
+    for (; r < rows; r++)
+        for (size_t c = 0; c < cols; c++) dst[c * ldd + r] = src[r * lds + c];
+}
+
+template <>
+void transposeBlock<short>(short* dst, size_t ldd, const short* src, size_t lds, size_t rows,
+                           size_t cols) {
+    size_t r = 0;
+    for (; r + 8 <= rows; r += 8) {
+        size_t c = 0;
+        for (; c + 8 <= cols; c += 8) {
+            __m128i a[8], b[8], d[8];
+            for (int k = 0; k < 8; k++)
+                a[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (r + k) * lds + c));
+            for (int k = 0; k < 8; k += 2) {
+                b[k] = _mm_unpacklo_epi16(a[k], a[k + 1]);
+                b[k + 1] = _mm_unpackhi_epi16(a[k], a[k + 1]);
+            }
+            // b[0]: r0c0 r1c0 r0c1 r1c1 r0c2 r1c2 r0c3 r1c3, b[1]: columns 4-7
+            __m128i c0 = _mm_unpacklo_epi32(b[0], b[2]);
+            __m128i c1 = _mm_unpackhi_epi32(b[0], b[2]);
+            __m128i c2 = _mm_unpacklo_epi32(b[1], b[3]);
+            __m128i c3 = _mm_unpackhi_epi32(b[1], b[3]);
+            __m128i c4 = _mm_unpacklo_epi32(b[4], b[6]);
+            __m128i c5 = _mm_unpackhi_epi32(b[4], b[6]);
+            __m128i c6 = _mm_unpacklo_epi32(b[5], b[7]);
+            __m128i c7 = _mm_unpackhi_epi32(b[5], b[7]);
+            // c0: rows 0-3 of columns 0 and 1, c4: rows 4-7 of columns 0 and 1
+            d[0] = _mm_unpacklo_epi64(c0, c4);
+            d[1] = _mm_unpackhi_epi64(c0, c4);
+            d[2] = _mm_unpacklo_epi64(c1, c5);
+            d[3] = _mm_unpackhi_epi64(c1, c5);
+            d[4] = _mm_unpacklo_epi64(c2, c6);
+            d[5] = _mm_unpackhi_epi64(c2, c6);
+            d[6] = _mm_unpacklo_epi64(c3, c7);
+            d[7] = _mm_unpackhi_epi64(c3, c7);
+            for (int k = 0; k < 8; k++)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + (c + k) * ldd + r), d[k]);
+        }
+        for (; c < cols; c++)
+            for (size_t k = 0; k < 8; k++) dst[c * ldd + r + k] = src[(r + k) * lds + c];
+    }
+    for (; r < rows; r++)
+        for (size_t c = 0; c < cols; c++) dst[c * ldd + r] = src[r * lds + c];
+}
+#endif  // __SSE2__
+
+//
+// Element conversions applied while writing dst
+//
+
+struct Copy {
+    template <typename T>
+    void operator()(T* dst, const T* src, size_t n) const {
+        memcpy(dst, src, n * sizeof(T));
+    }
+};
+
+struct ToFp16 {
+    float scale, bias;
+    void operator()(short* dst, const float* src, size_t n) const {
+        fp16::f32tof16Arrays(dst, src, n, scale, bias);
+    }
+};
+
+// Contiguous copy, split in tiles so it can run in parallel.
+template <typename S, typename D, typename Convert>
+void copyLinear(D* dst, const S* src, size_t n, const Convert& convert) {
+    const size_t chunk = kMinWorkPerThread;
+    parallelFor((n + chunk - 1) / chunk, chunk, [&](size_t u) {
+        size_t begin = u * chunk;
+        convert(dst + begin, src + begin, std::min(chunk, n - begin));
+    });
+}
+
+// dst[b][c][r] = src[b][r][c]. A unit of work is one band of kTile src rows of
+// one batch, walked a tile at a time.
+template <typename T>
+void transposeBatched(T* dst, const T* src, size_t batch, size_t rows, size_t cols) {
+    const size_t bands = (rows + kTile - 1) / kTile;
+    parallelFor(batch * bands, kTile * cols, [&](size_t u) {
+        const size_t b = u / bands;
+        const size_t r0 = (u % bands) * kTile;
+        const size_t nr = std::min(kTile, rows - r0);
+        const T* s = src + b * rows * cols;
+        T* d = dst + b * rows * cols;
+        for (size_t c0 = 0; c0 < cols; c0 += kTile) {
+            const size_t nc = std::min(kTile, cols - c0);
+            transposeBlock(d + c0 * rows + r0, rows, s + r0 * cols + c0, cols, nr, nc);
+        }
+    });
+}
+
+// Same walk with the conversion fused in. The conversion runs along the longer
+// side, where the vector kernels get long runs: along src rows when the matrix
+// is wide, then the FP16 values are transposed; along dst rows when it is
+// tall, after transposing the floats. Either way each element is read and
+// written once, the intermediate tile stays in cache.
+void transposeBatched(short* dst, const float* src, size_t batch, size_t rows, size_t cols,
+                      const ToFp16& convert) {
+    const bool wide = cols >= kTile;
+    const size_t bandRows = wide ? kTile : kRun;
+    const size_t bands = (rows + bandRows - 1) / bandRows;
+    parallelFor(batch * bands, bandRows * cols, [&](size_t u) {
+        const size_t b = u / bands;
+        const size_t r0 = (u % bands) * bandRows;
+        const size_t nr = std::min(bandRows, rows - r0);
+        const float* s = src + b * rows * cols;
+        short* d = dst + b * rows * cols;
+        if (wide) {
+            std::vector<short> tile(kTile * kRun);
+            for (size_t c0 = 0; c0 < cols; c0 += kRun) {
+                const size_t nc = std::min(kRun, cols - c0);
+                for (size_t r = 0; r < nr; r++)
+                    convert(tile.data() + r * kRun, s + (r0 + r) * cols + c0, nc);
+                transposeBlock(d + c0 * rows + r0, rows, tile.data(), kRun, nr, nc);
+            }
+        } else {
+            std::vector<float> tile(kTile * kRun);
+            transposeBlock(tile.data(), kRun, s + r0 * cols, cols, nr, cols);
+            for (size_t c = 0; c < cols; c++) convert(d + c * rows + r0, tile.data() + c * kRun, nr);
+        }
+    });
+}
+
+template <typename T>
+void transposeBatched(T* dst, const T* src, size_t batch, size_t rows, size_t cols, const Copy&) {
+    transposeBatched(dst, src, batch, rows, cols);
+}
+
+// Any other order: walk dst in order and gather each innermost row from src.
+template <typename S, typename D, typename Convert>
+void permuteStrided(D* dst, const S* src, const Shape& shape, const Convert& convert) {
+    const size_t n = shape.dims.size();
+    Dims srcStride(n);
+    size_t stride = 1;
+    for (size_t a = n; a-- > 0;) {
+        srcStride[a] = stride;
+        stride *= shape.dims[a];
+    }
+    Dims dims(n), strides(n);
+    for (size_t k = 0; k < n; k++) {
+        dims[k] = shape.dims[shape.order[k]];
+        strides[k] = srcStride[shape.order[k]];
+    }
+
+    const size_t inner = dims[n - 1];
+    const size_t perOuter = stride / dims[0];
+    parallelFor(dims[0], perOuter, [&](size_t u) {
+        std::vector<S> row(inner);
+        Dims idx(n, 0);
+        D* d = dst + u * perOuter;
+        for (size_t done = 0; done < perOuter; done += inner) {
+            size_t offset = u * strides[0];
+            for (size_t k = 1; k + 1 < n; k++) offset += idx[k] * strides[k];
+            for (size_t i = 0; i < inner; i++) row[i] = src[offset + i * strides[n - 1]];
+            convert(d + done, row.data(), inner);
+            for (size_t k = n - 1; k-- > 1;) {
+                if (++idx[k] < dims[k]) break;
+                idx[k] = 0;
+            }
+        }
+    });
+}
+
+template <typename S, typename D, typename Convert>
+void run(D* dst, const S* src, const Dims& dims, const Order& order, const Convert& convert) {
+    size_t total = 1;
+    for (auto d : dims) total *= d;
+    if (total == 0) return;
+
+    Shape shape = simplify(dims, order);
+    const size_t n = shape.dims.size();
+    const Order& o = shape.order;
+    if (n <= 1) {
+        copyLinear(dst, src, total, convert);
+    } else if (n == 2 && o[0] == 1) {
+        transposeBatched(dst, src, 1, shape.dims[0], shape.dims[1], convert);
+    } else if (n == 3 && o[0] == 0 && o[1] == 2) {
+        transposeBatched(dst, src, shape.dims[0], shape.dims[1], shape.dims[2], convert);
+    } else {
+        permuteStrided(dst, src, shape, convert);
+    }
+}
+
+}  // namespace
+
+void permute(float* dst, const float* src, const Dims& dims, const Order& order) {
+    run(dst, src, dims, order, Copy());
+}
+
+void permute(short* dst, const short* src, const Dims& dims, const Order& order) {
+    run(dst, src, dims, order, Copy());
+}
+
+void permuteToFp16(short* dst, const float* src, const Dims& dims, const Order& order,
+                   float scale, float bias) {
+    run(dst, src, dims, order, ToFp16{scale, bias});
+}
+
+bool keepsOrder(const Dims& dims, const Order& order) {
+    return simplify(dims, order).order.size() <= 1;
+}
+
+void setMaxThreads(size_t threads) { gMaxThreads.store(threads, std::memory_order_relaxed); }
+
+void setThreadMaxThreads(size_t threads) { tMaxThreads = threads; }
+
+}  // namespace layout
@@ -0,0 +1,54 @@
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Tensor layout transforms (NHWC <-> NCHW, OHWI -> OIHW, IHWO -> OIHW, ...).
+//
+// An order follows permuteDims() in the HAL: dimension k of dst is dimension
+// order[k] of src, so {0, 3, 1, 2} turns NHWC into NCHW and OHWI into OIHW,
+// and {3, 0, 1, 2} turns IHWO into OIHW. Size one dimensions are dropped and
+// dimensions that stay next to each other are merged first, which turns all
+// the orders the HAL uses into a (batched) 2-D transpose. Those are done in
+// cache sized tiles with SSE2 block transposes, everything else goes through
+// a strided copy. Large tensors are split over several threads.
+namespace layout {
+
+typedef std::vector<size_t> Dims;
+typedef std::vector<unsigned int> Order;
+
+// dst must hold product(dims) elements and must not overlap src.
+void permute(float* dst, const float* src, const Dims& dims, const Order& order);
+void permute(short* dst, const short* src, const Dims& dims, const Order& order);
+
+// Permutes and converts with fp16::f32tof16(src * scale + bias) in one pass.
+void permuteToFp16(short* dst, const float* src, const Dims& dims, const Order& order,
+                   float scale = 1.0f, float bias = 0.0f);
+
+// True when the transform leaves every element where it is, e.g. OHWI -> OIHW
+// of a 1x1 kernel; the source can then be used as is.
+bool keepsOrder(const Dims& dims, const Order& order);
+
+// Caps the threads used for one transform, 0 means one per cpu.
+void setMaxThreads(size_t threads);
+
+// Caps the threads used for the transforms run by the calling thread, for
+// callers already running several transforms in parallel. Takes precedence
+// over setMaxThreads(), 0 clears it.
+void setThreadMaxThreads(size_t threads);
+
+}  // namespace layout
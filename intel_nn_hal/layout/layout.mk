@@ -0,0 +1,46 @@
+LOCAL_PATH := $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libnnhal_layout
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_OWNER := intel
+
+LOCAL_SRC_FILES := \
+	layout.cpp
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../fp16
+
+LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)
+
+LOCAL_CFLAGS += \
+	-std=c++11 \
+	-fPIC \
+	-Wall \
+	-Wno-error \
+	-O3
+
+LOCAL_STATIC_LIBRARIES := libnnhal_fp16
+
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := layouttest
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_OWNER := intel
+
+LOCAL_SRC_FILES := \
+	layout_test.cpp
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../fp16
+
+LOCAL_CFLAGS += \
+	-std=c++11 \
+	-Wall \
+	-Wno-error
+
+LOCAL_STATIC_LIBRARIES := libnnhal_layout libnnhal_fp16
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,174 @@
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks the layout transforms against a naive permute and times the weight
+// reorders of a conv net against the per-element loops they replace.
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "fp16.h"
+#include "layout.h"
+
+using layout::Dims;
+using layout::Order;
+
+template <typename S, typename D, typename Convert>
+static void naivePermute(D* dst, const S* src, const Dims& dims, const Order& order,
+                         Convert convert) {
+    const size_t n = dims.size();
+    Dims stride(n, 1);
+    for (size_t a = n - 1; a-- > 0;) stride[a] = stride[a + 1] * dims[a + 1];
+    size_t total = 1;
+    for (auto d : dims) total *= d;
+
+    Dims idx(n, 0);  // dst index
+    for (size_t i = 0; i < total; i++) {
+        size_t offset = 0;
+        for (size_t k = 0; k < n; k++) offset += idx[k] * stride[order[k]];
+        dst[i] = convert(src[offset]);
+        for (size_t k = n; k-- > 0;) {
+            if (++idx[k] < dims[order[k]]) break;
+            idx[k] = 0;
+        }
+    }
+}
+
+static int checkCase(const Dims& dims, const Order& order) {
+    size_t total = 1;
+    for (auto d : dims) total *= d;
+
+    std::vector<float> src(total);
+    for (size_t i = 0; i < total; i++) src[i] = float(i) * 0.25f - 1000.0f;
+    std::vector<short> src16(total);
+    for (size_t i = 0; i < total; i++) src16[i] = short(i * 7);
+
+    std::vector<float> got(total), want(total);
+    layout::permute(got.data(), src.data(), dims, order);
+    naivePermute(want.data(), src.data(), dims, order, [](float x) { return x; });
+    bool ok = memcmp(got.data(), want.data(), total * sizeof(float)) == 0;
+
+    std::vector<short> got16(total), want16(total);
+    layout::permute(got16.data(), src16.data(), dims, order);
+    naivePermute(want16.data(), src16.data(), dims, order, [](short x) { return x; });
+    ok = ok && memcmp(got16.data(), want16.data(), total * sizeof(short)) == 0;
+
+    layout::permuteToFp16(got16.data(), src.data(), dims, order, 0.5f, 1.0f);
+    naivePermute(want16.data(), src.data(), dims, order,
+                 [](float x) { return fp16::f32tof16(x * 0.5f + 1.0f); });
+    ok = ok && memcmp(got16.data(), want16.data(), total * sizeof(short)) == 0;
+
+    if (!ok) {
+        printf("  FAILED dims [");
+        for (auto d : dims) printf(" %zu", d);
+        printf(" ] order [");
+        for (auto o : order) printf(" %u", o);
+        printf(" ]\n");
+    }
+    return ok ? 0 : 1;
+}
+
+static int checkAll() {
+    const Order orders[] = {{0, 1, 2, 3}, {0, 3, 1, 2}, {3, 0, 1, 2}, {0, 2, 3, 1},
+                            {1, 0, 2, 3}, {3, 2, 1, 0}, {2, 0, 3, 1}};
+    const Dims shapes[] = {{1, 3, 3, 8},  {2, 5, 7, 3},   {4, 1, 1, 33}, {1, 9, 1, 1},
+                           {3, 17, 9, 40}, {64, 3, 3, 32}, {1, 1, 1, 1},  {2, 64, 64, 3}};
+    int failures = 0;
+    int cases = 0;
+    for (const auto& dims : shapes) {
+        for (const auto& order : orders) {
+            failures += checkCase(dims, order);
+            cases++;
+        }
+    }
+    failures += checkCase({37, 45}, {1, 0});
+    failures += checkCase({37, 45}, {0, 1});
+    failures += checkCase({100}, {0});
+    cases += 3;
+    // in place: 1x1 kernels, size one dimensions only moving around
+    bool inPlace = layout::keepsOrder({64, 1, 1, 32}, {0, 3, 1, 2}) &&
+                   layout::keepsOrder({1, 3, 3, 1}, {3, 0, 1, 2}) &&
+                   layout::keepsOrder({5, 7}, {0, 1}) &&
+                   !layout::keepsOrder({1, 3, 3, 8}, {3, 0, 1, 2}) &&
+                   !layout::keepsOrder({64, 3, 3, 32}, {0, 3, 1, 2});
+    if (!inPlace) printf("  FAILED keepsOrder\n");
+    failures += inPlace ? 0 : 1;
+    cases++;
+    printf("layout: %d cases, %d failed\n", cases, failures);
+    return failures;
+}
+
+// The loop GetConstOperandAsTensor used: OHWI -> OIHW through the blob.
+static void oldReorder(float* dst, const float* src, const Dims& d) {
+    size_t offset = 0;
+    for (size_t o = 0; o < d[0]; o++)
+        for (size_t i = 0; i < d[3]; i++)
+            for (size_t h = 0; h < d[1]; h++)
+                for (size_t w = 0; w < d[2]; w++)
+                    dst[offset++] = src[o * d[1] * d[2] * d[3] + h * d[2] * d[3] + w * d[3] + i];
+}
+
+template <typename F>
+static double timeMs(int iterations, F fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+               .count() /
+           iterations;
+}
+
+static void benchmark() {
+    // 3x3 convolutions of a VGG sized net, OHWI
+    const Dims layers[] = {{64, 3, 3, 64},   {128, 3, 3, 128}, {256, 3, 3, 256},
+                           {512, 3, 3, 256}, {512, 3, 3, 512}, {512, 3, 3, 512}};
+    const Order order = {0, 3, 1, 2};
+
+    size_t maxTotal = 0;
+    for (const auto& d : layers) maxTotal = std::max(maxTotal, d[0] * d[1] * d[2] * d[3]);
+    std::vector<float> src(maxTotal, 1.5f), dst(maxTotal);
+    std::vector<short> tmp16(maxTotal), dst16(maxTotal);
+
+    double oldMs = 0, newMs = 0, oldFp16Ms = 0, fusedMs = 0;
+    for (const auto& d : layers) {
+        const size_t total = d[0] * d[1] * d[2] * d[3];
+        oldMs += timeMs(5, [&] { oldReorder(dst.data(), src.data(), d); });
+        newMs += timeMs(5, [&] { layout::permute(dst.data(), src.data(), d, order); });
+        oldFp16Ms += timeMs(5, [&] {
+            fp16::f32tof16Arrays(tmp16.data(), src.data(), total);
+            layout::permute(dst16.data(), tmp16.data(), d, order);
+        });
+        fusedMs += timeMs(5, [&] { layout::permuteToFp16(dst16.data(), src.data(), d, order); });
+    }
+    printf("OHWI -> OIHW fp32: per-element loop %.2f ms, layout::permute %.2f ms\n", oldMs,
+           newMs);
+    printf("OHWI -> OIHW fp16: convert then permute %.2f ms, fused %.2f ms\n", oldFp16Ms,
+           fusedMs);
+    layout::setMaxThreads(1);
+    double singleMs = 0;
+    for (const auto& d : layers)
+        singleMs += timeMs(5, [&] { layout::permute(dst.data(), src.data(), d, order); });
+    layout::setMaxThreads(0);
+    printf("OHWI -> OIHW fp32 on one thread: %.2f ms\n", singleMs);
+}
+
+int main() {
+    int failures = checkAll();
+    layout::setMaxThreads(3);
+    failures += checkAll();
+    layout::setMaxThreads(0);
+    benchmark();
+    return failures ? 1 : 0;
+}